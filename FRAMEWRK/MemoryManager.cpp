@@ -10,10 +10,13 @@
 //              MemoryManager handles assigning of threads to pools, and the
 //              creation of new pools when a thread asks for memory the first
 //              time.  Using a singleton class, the manager provides an interface
-//              to C code into the manager.  The number of unique pools starts
-//              as MEMORYPOOLS, defined in MemoryManager.h.  When a new thread
-//              needs a pool, and the current set of pools are all assigned,
-//              the number of pools increases by a factor of two.
+//              to C code into the manager.
+//
+//              The pool of a thread is stored in a fiber local storage slot,
+//              so finding it does not depend on the number of threads and
+//              does not need any lock: a pool is only ever seen by the thread
+//              which owns it.  The system calls ReleasePool when a thread
+//              exits, and its pool is deleted.
 // 
 // Platform:    Microsoft Windows
 //
@@ -24,7 +27,19 @@
 //
 // Singleton instance of the class
 //
-MemoryManager* vpmm;
+MemoryManager* volatile vpmm;
+
+//
+// Deletes the singleton when the DLL is unloaded
+//
+static struct MemoryManagerCleanup
+{
+	~MemoryManagerCleanup()
+	{
+		delete vpmm;
+		vpmm = 0;
+	}
+} vmmCleanup;
 
 //
 // Interface for C callers to ask for memory
@@ -47,15 +62,38 @@ void MFreeAllTempMemory()
 }
 
 //
-// Returns the singleton class, or creates one if it doesn't exit
+// Interface for C callers to know the largest amount of temporary
+// memory used at once by a thread, since the DLL was loaded
+//
+size_t MTempMemoryHighWater()
+{
+	return MemoryManager::GetManager()->CPP_TempMemoryHighWater();
+}
+
+//
+// Returns the singleton class, or creates one if it doesn't exit.
+// Several threads may race to create it, only the first one
+// installs its instance and the others delete theirs.
 //
 MemoryManager* MemoryManager::GetManager()
 {
-	if (!vpmm)
+	MemoryManager* pmm = vpmm;
+
+	if (!pmm)
 	{
-		vpmm = new MemoryManager();
+		MemoryManager* pmmNew = new MemoryManager();
+
+		pmm = (MemoryManager*) InterlockedCompareExchangePointer((PVOID volatile*) &vpmm, pmmNew, 0);
+		if (pmm)
+		{
+			delete pmmNew;
+		}
+		else
+		{
+			pmm = pmmNew;
+		}
 	}
-	return vpmm;
+	return pmm;
 }
 
 //
@@ -63,31 +101,24 @@ MemoryManager* MemoryManager::GetManager()
 //
 MemoryManager::MemoryManager(void)
 {
-	m_impCur = 0;
-	m_impMax = MEMORYPOOLS;
-	m_rgmp = new MemoryPool[MEMORYPOOLS];
+	m_dwFlsIndex = FlsAlloc(ReleasePool);
+	m_cbHighWater = 0;
 }
 
 //
-// Destructor.  Because of the way memory pools get copied,
-// this function needs to call an additional function to clear
-// up the MemoryPool memory - the deconstructor on MemoryPool
-// does not actually delete its memory
+// Destructor.  Freeing the slot releases the pools of all
+// threads which are still alive.
 //
 MemoryManager::~MemoryManager(void)
 {
-	MemoryPool* pmp = m_rgmp;
-	int i;
-
-	for (i = 0; i < m_impMax; i++)
+	if (m_dwFlsIndex != FLS_OUT_OF_INDEXES)
 	{
-		if (pmp->m_rgchMemBlock)
-		{
-			pmp->ClearPool();
-		}
-		pmp++;
+		// Not all implementations of FlsFree call the callback,
+		// the pool of the calling thread is released explicitly
+		ReleasePool(FlsGetValue(m_dwFlsIndex));
+		FlsSetValue(m_dwFlsIndex, 0);
+		FlsFree(m_dwFlsIndex);
 	}
-	delete [] m_rgmp;
 }
 
 //
@@ -97,18 +128,42 @@ MemoryManager::~MemoryManager(void)
 //
 LPSTR MemoryManager::CPP_GetTempMemory(size_t cByte)
 {
-	DWORD dwThreadID;
 	MemoryPool* pmp;
+	LPSTR lpMemory;
+	LONGLONG cbHighWater;
 
-	dwThreadID = GetCurrentThreadId(); //the id of the calling thread
-	pmp = GetMemoryPool(dwThreadID);
+	pmp = GetMemoryPool();
 
-	if (!pmp) //no more room for pools
+	if (!pmp) //no pool could be created
 	{
 		return 0;
 	}
 
-	return pmp->GetTempMemory(cByte);
+	lpMemory = pmp->GetTempMemory(cByte);
+
+	// Publish a new high-water mark, this seldom happens
+	cbHighWater = m_cbHighWater;
+	while ((LONGLONG) pmp->m_cbHighWater > cbHighWater)
+	{
+		LONGLONG cbPrevious = InterlockedCompareExchange64(&m_cbHighWater, pmp->m_cbHighWater, cbHighWater);
+
+		if (cbPrevious == cbHighWater)
+		{
+			break;
+		}
+		cbHighWater = cbPrevious;
+	}
+
+	return lpMemory;
+}
+
+//
+// Method that returns the largest amount of temporary memory
+// used at once by a thread
+//
+size_t MemoryManager::CPP_TempMemoryHighWater()
+{
+	return (size_t) m_cbHighWater;
 }
 
 //
@@ -117,13 +172,17 @@ LPSTR MemoryManager::CPP_GetTempMemory(size_t cByte)
 //
 void MemoryManager::CPP_FreeAllTempMemory()
 {
-	DWORD dwThreadID;
 	MemoryPool* pmp;
 
-	dwThreadID = GetCurrentThreadId(); //the id of the calling thread
-	pmp = GetMemoryPool(dwThreadID);
+	if (m_dwFlsIndex == FLS_OUT_OF_INDEXES)
+	{
+		return;
+	}
+
+	// Nothing to free if this thread never asked for memory
+	pmp = (MemoryPool*) FlsGetValue(m_dwFlsIndex);
 
-	if (!pmp) //no more room for pools
+	if (!pmp)
 	{
 		return;
 	}
@@ -132,75 +191,59 @@ void MemoryManager::CPP_FreeAllTempMemory()
 }
 
 //
-// Method iterates through the memory pools in an attempt to find
-// the pool that matches the given thread ID. If a pool is not found,
-// it creates a new one
+// Method returns the pool of the calling thread.  If the thread
+// does not have one yet, it creates a new one
 //
-MemoryPool* MemoryManager::GetMemoryPool(DWORD dwThreadID)
+MemoryPool* MemoryManager::GetMemoryPool()
 {
-	int imp; //loop var
-	MemoryPool* pmp; //current pool
-
-	pmp = m_rgmp;
+	MemoryPool* pmp;
 
-	for (imp = 0; imp < m_impCur; imp++)
+	if (m_dwFlsIndex == FLS_OUT_OF_INDEXES)
 	{
-		if (pmp->m_dwOwner == dwThreadID)
-		{
-			return pmp;
-		}
+		return 0;
+	}
+
+	pmp = (MemoryPool*) FlsGetValue(m_dwFlsIndex);
 
-		pmp++;
+	if (!pmp)
+	{
+		pmp = CreateNewPool(GetCurrentThreadId()); //first call of this thread
 	}
 
-	return CreateNewPool(dwThreadID); //didn't find the owner, make a new one
+	return pmp;
 }
 
 //
-// Will assign an unused pool to a thread; should all pools be assigned,
-// it will grow the number of pools available.
+// Will create a pool for the calling thread and store it in its
+// fiber local storage slot.
 //
 MemoryPool* MemoryManager::CreateNewPool(DWORD dwThreadID)
 {
-	if (m_impCur >= m_impMax)
+	MemoryPool* pmp = new MemoryPool();
+
+	pmp->m_dwOwner = dwThreadID;
+	if (!FlsSetValue(m_dwFlsIndex, pmp))
 	{
-		GrowPools();
+		ReleasePool(pmp);
+		return 0;
 	}
-	m_rgmp[m_impCur++].m_dwOwner = dwThreadID;
 
-	return m_rgmp+m_impCur-1;
+	return pmp;
 }
 
 //
-// Increases the number of available pools by a factor of two. All of
-// the old pools have their memory pointed to by the new pools. The
-// memory for the new pools that get replaced is first freed. The reason
-// ~MemoryPool() can't free its array is in this method - they would be
-// deleted when the old array of pools is freed at the end of the method,
-// despite the fact they are now being pointed to by the new pools.
+// Called by the system when a thread exits, or when the slot is
+// freed.  The deconstructor on MemoryPool does not actually delete
+// its memory, this function needs to call an additional function
+// to clear it up
 //
-void MemoryManager::GrowPools()
+VOID WINAPI MemoryManager::ReleasePool(PVOID pvPool)
 {
-	MemoryPool* rgmpTemp;
-	MemoryPool* pmpDst;
-	MemoryPool* pmpSrc;
+	MemoryPool* pmp = (MemoryPool*) pvPool;
 
-	int i, impMaxNew;
-
-	impMaxNew = 2*m_impMax;
-	pmpDst = rgmpTemp = new MemoryPool[2*m_impMax];
-	pmpSrc = m_rgmp;
-
-	for (i = 0; i < m_impCur; i++)
+	if (pmp)
 	{
-		delete [] pmpDst->m_rgchMemBlock;
-		pmpDst->m_rgchMemBlock = pmpSrc->m_rgchMemBlock;
-		pmpDst->m_dwOwner = pmpSrc->m_dwOwner;
-
-		pmpDst++;
-		pmpSrc++;
+		pmp->ClearPool();
+		delete pmp;
 	}
-	delete [] m_rgmp;
-	m_rgmp = rgmpTemp;
-	m_impMax = impMaxNew;
 }
@@ -13,12 +13,6 @@
 
 #include "MemoryPool.h"
 
-//
-// Total number of memory allocation pools to manage
-//
-
-#define MEMORYPOOLS 4
-
 class MemoryManager
 {
 public:
@@ -29,15 +23,15 @@ public:
 
 	LPSTR CPP_GetTempMemory(size_t cByte);
 	void CPP_FreeAllTempMemory();
+	size_t CPP_TempMemoryHighWater();
 
 private:
 	MemoryPool* CreateNewPool(DWORD dwThreadID);
-	MemoryPool* GetMemoryPool(DWORD dwThreadID);
-	void GrowPools();
+	MemoryPool* GetMemoryPool();
+	static VOID WINAPI ReleasePool(PVOID pvPool);
 
-	int m_impCur;		// Current number of pools
-	int m_impMax;		// Max number of mem pools
-	MemoryPool* m_rgmp;	// Storage for the memory pools
+	DWORD m_dwFlsIndex;	// Slot holding the pool of each thread
+	volatile LONGLONG m_cbHighWater;	// Largest high-water mark of all pools
 };
 
 #endif //__cplusplus
@@ -52,6 +46,7 @@ extern "C"
 #endif
 	LPSTR MGetTempMemory(size_t cByte);
 	void MFreeAllTempMemory();
+	size_t MTempMemoryHighWater();
 #ifdef __cplusplus
 }
 #endif 
@@ -1,30 +1,44 @@
 ///***************************************************************************
 // File:        MemoryPool.cpp
 //
-// Purpose:     A memory pool is an array of characters that is pre-allocated,
-//              and used as temporary memory by the caller. The allocation
-//              algorithm is very simple. When a thread asks for some memory,
-//              the index into the array moves forward by that many bytes, and
-//              a pointer is returned to the previous index before the pointer
-//              was advanced. When a call comes to free all of the memory, the
-//              pointer is set back to the beginning of the array.
-//
-//              Each pool has MEMORYSIZE bytes of storage space available to it
+// Purpose:     A memory pool is a list of arrays of characters that are
+//              pre-allocated, and used as temporary memory by the caller. The
+//              allocation algorithm is very simple. When a thread asks for some
+//              memory, the index into the current array moves forward by that
+//              many bytes, and a pointer is returned to the previous index
+//              before the pointer was advanced. When the current array is full,
+//              the next one is used, and a new one is added at the end of the
+//              list if needed. When a call comes to free all of the memory, the
+//              pointer is set back to the beginning of the first array; arrays
+//              are kept so that they are reused by next calls.
+//
+//              The first array has MEMORYSIZE bytes, each new array is twice
+//              as large as the last one, or larger if needed by a single call.
+//              All pointers are aligned on MEMORYALIGN bytes.
 // 
 // Platform:    Microsoft Windows
 //
 ///***************************************************************************
 
+#include <new>
 #include "MemoryPool.h"
 
 //
-// Constructor creates the memory to be used by the pool
-// and starts the index at the beginning.
+// Data of a block, right after its header
+//
+#define CHUNKDATA(pmc) ((char*) ((pmc) + 1))
+
+//
+// Constructor creates the first block of memory to be used by
+// the pool and starts the index at the beginning.
 //
 MemoryPool::MemoryPool(void)
 {
-	m_rgchMemBlock = new char[MEMORYSIZE];
+	m_cbReserved = 0;
+	m_pmcFirst = m_pmcCur = NewChunk(MEMORYSIZE);
 	m_ichOffsetMemBlock = 0;
+	m_cbInUse = 0;
+	m_cbHighWater = 0;
 	m_dwOwner = (DWORD)-1;
 }
 
@@ -36,44 +50,116 @@ MemoryPool::~MemoryPool(void)
 }
 
 //
-// Unable to delete the memory block when we delete the pool,
-// as it may be still be in use due to a GrowPools() call; this
-// method will actually delete the pool's memory
+// The memory blocks are not deleted with the pool, this method
+// will actually delete the pool's memory; see
+// MemoryManager::ReleasePool
 //
 
 void MemoryPool::ClearPool(void)
 {
-	delete [] m_rgchMemBlock;
+	MemoryChunk* pmc = m_pmcFirst;
+
+	while (pmc)
+	{
+		MemoryChunk* pmcNext = pmc->m_pmcNext;
+		delete [] (char*) pmc;
+		pmc = pmcNext;
+	}
+	m_pmcFirst = m_pmcCur = 0;
+	m_ichOffsetMemBlock = 0;
+	m_cbInUse = 0;
+	m_cbReserved = 0;
 }
 
 //
-// Advances the index forward by the given number of bytes.
-// Should there not be enough memory, or the number of bytes
-// is not allowed, this method will return 0. Can be called
-// and used exactly as malloc().
+// Allocates a block of memory with room for cbSize bytes of data.
+// The header size is a multiple of MEMORYALIGN, so data is aligned
+// like the block itself.  Returns 0 if memory is exhausted.
+//
+MemoryChunk* MemoryPool::NewChunk(size_t cbSize)
+{
+	MemoryChunk* pmc;
+
+	pmc = (MemoryChunk*) new (std::nothrow) char[sizeof(MemoryChunk) + cbSize];
+	if (pmc)
+	{
+		pmc->m_pmcNext = 0;
+		pmc->m_cbSize = cbSize;
+		m_cbReserved += cbSize;
+	}
+	return pmc;
+}
+
+//
+// Advances the index forward by the given number of bytes, rounded
+// up to a multiple of MEMORYALIGN.  Should the current block be full,
+// moves to the next block large enough, allocating it if needed.
+// Returns 0 if the number of bytes is not allowed or if memory is
+// exhausted. Can be called and used exactly as malloc().
 //
 LPSTR MemoryPool::GetTempMemory(size_t cBytes)
 {
 	LPSTR lpMemory;
+	MemoryChunk* pmc;
+	size_t cbAligned;
 
-	if (m_ichOffsetMemBlock + cBytes > MEMORYSIZE || cBytes <= 0)
+	if (cBytes <= 0 || cBytes > ((size_t)-1) / 2 || !m_pmcCur)
 	{
 		return 0;
 	}
-	else
+
+	cbAligned = (cBytes + MEMORYALIGN - 1) & ~((size_t) MEMORYALIGN - 1);
+
+	if (m_ichOffsetMemBlock + cbAligned > m_pmcCur->m_cbSize)
 	{
-		lpMemory = (LPSTR) m_rgchMemBlock + m_ichOffsetMemBlock;
-		m_ichOffsetMemBlock += cBytes;
+		// Skip blocks which are too small, they are reused after next reset
+		pmc = m_pmcCur->m_pmcNext;
+		while (pmc && pmc->m_cbSize < cbAligned)
+		{
+			m_pmcCur = pmc;
+			pmc = pmc->m_pmcNext;
+		}
+
+		if (!pmc)
+		{
+			size_t cbNew = 2 * m_pmcCur->m_cbSize;
 
-		return lpMemory;
+			if (cbNew < cbAligned)
+			{
+				cbNew = cbAligned;
+			}
+			pmc = NewChunk(cbNew);
+			if (!pmc)
+			{
+				return 0;
+			}
+			m_pmcCur->m_pmcNext = pmc;
+		}
+
+		m_pmcCur = pmc;
+		m_ichOffsetMemBlock = 0;
+	}
+
+	lpMemory = (LPSTR) CHUNKDATA(m_pmcCur) + m_ichOffsetMemBlock;
+	m_ichOffsetMemBlock += cbAligned;
+
+	m_cbInUse += cbAligned;
+	if (m_cbInUse > m_cbHighWater)
+	{
+		m_cbHighWater = m_cbInUse;
 	}
+
+	return lpMemory;
 }
 
 //
 // Frees all the temporary memory by setting the index for
-// available memory back to the beginning
+// available memory back to the beginning of the first block.
+// Blocks are kept for later use.
 //
 void MemoryPool::FreeAllTempMemory()
 {
+	m_pmcCur = m_pmcFirst;
 	m_ichOffsetMemBlock = 0;
+	m_cbInUse = 0;
 }
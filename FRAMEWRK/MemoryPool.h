@@ -2,7 +2,7 @@
 // File:		MemoryPool.h
 //
 // Purpose:		Class definition for the memory pool class used by the
-//				memory manager.  Each pool is a block of memory set
+//				memory manager.  Each pool is a list of memory blocks set
 //				aside for a specific thread for use in creating temporary
 //				XLOPER/XLOPER12's in the framework
 // 
@@ -13,11 +13,28 @@
 #include <windows.h>
 
 //
-// Total amount of memory to allocate for all temporary XLOPERs
+// Size of the first block of memory of each pool, further
+// blocks are at least as large as the previous one
 //
 
 #define MEMORYSIZE 10240
 
+//
+// Alignment of all temporary memory, enough for XLOPER12
+//
+
+#define MEMORYALIGN 8
+
+//
+// Header of a block of memory, followed by its data
+//
+
+struct MemoryChunk
+{
+	MemoryChunk* m_pmcNext;		// Next block, or 0
+	size_t m_cbSize;			// Bytes of data in this block
+};
+
 class MemoryPool
 {
 public:
@@ -28,6 +45,13 @@ public:
 	void FreeAllTempMemory();
 
 	DWORD m_dwOwner;			// ID of ownning thread
-	char* m_rgchMemBlock;		// Memory for temporary XLOPERs
-	size_t m_ichOffsetMemBlock;	// Offset of next memory block to allocate
+	MemoryChunk* m_pmcFirst;	// Memory for temporary XLOPERs
+	MemoryChunk* m_pmcCur;		// Block in which memory is allocated
+	size_t m_ichOffsetMemBlock;	// Offset of next memory block to allocate in m_pmcCur
+	size_t m_cbInUse;			// Bytes handed out since last FreeAllTempMemory
+	size_t m_cbHighWater;		// Largest value of m_cbInUse
+	size_t m_cbReserved;		// Total size of all blocks
+
+private:
+	MemoryChunk* NewChunk(size_t cbSize);
 };
@@ -0,0 +1,520 @@
+///***************************************************************************
+// File:        windows.h
+//
+// Purpose:     Minimal subset of the Win32 API needed to compile the
+//              FRAMEWRK library and the add-in sources on platforms other
+//              than Microsoft Windows, so that they can be loaded by the
+//              headless host (see otxll_host/xll_host.h).
+//
+//              Only what the add-in actually uses is provided.  Strings
+//              handed to Excel are UTF-16, so everything including this
+//              header must be compiled with -fshort-wchar.
+//
+// Platform:    POSIX (Linux)
+//
+///***************************************************************************
+
+#ifndef OTXLL_COMPAT_WINDOWS_H
+#define OTXLL_COMPAT_WINDOWS_H
+
+#ifdef _WIN32
+# error "compat/windows.h must not be used on Microsoft Windows"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Calling conventions and storage classes are meaningless on x86-64 POSIX
+//
+
+#define WINAPI
+#define PASCAL
+#define pascal
+#define CALLBACK
+#define cdecl
+#define _cdecl
+#define far
+#define FAR
+#define near
+#define __forceinline static inline __attribute__((always_inline))
+#define __declspec(x) __attribute__((visibility("default")))
+
+#ifndef TRUE
+# define TRUE 1
+#endif
+#ifndef FALSE
+# define FALSE 0
+#endif
+
+//
+// Basic types
+//
+
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef uint32_t DWORD;
+typedef int BOOL;
+typedef int INT32;
+typedef unsigned int UINT;
+typedef int32_t LONG;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef WCHAR* LPWSTR;
+typedef const WCHAR* LPCWSTR;
+typedef uintptr_t DWORD_PTR;
+typedef intptr_t LPARAM;
+typedef void VOID;
+typedef void* PVOID;
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef void* HWND;
+typedef void* FARPROC;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+
+typedef union _LARGE_INTEGER
+{
+	struct
+	{
+		DWORD LowPart;
+		LONG HighPart;
+	} u;
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+// XLOPER12 strings are UTF-16, and so are the L"" literals of the add-in
+typedef char otxll_check_short_wchar[sizeof(WCHAR) == 2 ? 1 : -1];
+
+#define MAXWORD 0xffff
+#define INFINITE 0xffffffff
+#define WAIT_OBJECT_0 0
+#define CP_ACP 0
+#define MB_ICONERROR 0x00000010L
+
+//
+// Module lookup always fails, the host installs its callback
+// through SetExcel12EntryPt instead
+//
+
+static inline HMODULE GetModuleHandle(LPCSTR lpModuleName)
+{
+	(void) lpModuleName;
+	return NULL;
+}
+
+static inline FARPROC GetProcAddress(HMODULE hModule, LPCSTR lpProcName)
+{
+	(void) hModule;
+	(void) lpProcName;
+	return NULL;
+}
+
+static inline DWORD GetCurrentThreadId(void)
+{
+	return (DWORD) syscall(SYS_gettid);
+}
+
+//
+// High-resolution timer, in nanoseconds
+//
+
+static inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* lpFrequency)
+{
+	lpFrequency->QuadPart = 1000000000LL;
+	return TRUE;
+}
+
+static inline BOOL QueryPerformanceCounter(LARGE_INTEGER* lpPerformanceCount)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	lpPerformanceCount->QuadPart = (LONGLONG) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	return TRUE;
+}
+
+//
+// Critical sections are recursive mutexes
+//
+
+typedef pthread_mutex_t CRITICAL_SECTION;
+typedef CRITICAL_SECTION* LPCRITICAL_SECTION;
+
+static inline void InitializeCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(lpCriticalSection, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static inline void DeleteCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+{
+	pthread_mutex_destroy(lpCriticalSection);
+}
+
+static inline void EnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+{
+	pthread_mutex_lock(lpCriticalSection);
+}
+
+static inline void LeaveCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+{
+	pthread_mutex_unlock(lpCriticalSection);
+}
+
+//
+// Condition variables, only with critical sections which are entered once
+//
+
+typedef pthread_cond_t CONDITION_VARIABLE;
+typedef CONDITION_VARIABLE* PCONDITION_VARIABLE;
+
+static inline void InitializeConditionVariable(PCONDITION_VARIABLE ConditionVariable)
+{
+	pthread_cond_init(ConditionVariable, NULL);
+}
+
+static inline BOOL SleepConditionVariableCS(PCONDITION_VARIABLE ConditionVariable,
+	LPCRITICAL_SECTION CriticalSection, DWORD dwMilliseconds)
+{
+	(void) dwMilliseconds;
+	return pthread_cond_wait(ConditionVariable, CriticalSection) == 0;
+}
+
+static inline void WakeConditionVariable(PCONDITION_VARIABLE ConditionVariable)
+{
+	pthread_cond_signal(ConditionVariable);
+}
+
+static inline void WakeAllConditionVariable(PCONDITION_VARIABLE ConditionVariable)
+{
+	pthread_cond_broadcast(ConditionVariable);
+}
+
+//
+// Threads.  HANDLE are only thread handles: WaitForSingleObject waits for
+// the end of the thread (timeouts are not supported), and CloseHandle must
+// only be called after it.
+//
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(void* lpThreadParameter);
+
+typedef struct _OTXLL_THREAD
+{
+	pthread_t thread;
+	LPTHREAD_START_ROUTINE start;
+	void* parameter;
+} OTXLL_THREAD;
+
+static inline void* otxll_thread_start(void* data)
+{
+	OTXLL_THREAD* t = (OTXLL_THREAD*) data;
+
+	t->start(t->parameter);
+	return NULL;
+}
+
+static inline HANDLE CreateThread(void* lpThreadAttributes, size_t dwStackSize,
+	LPTHREAD_START_ROUTINE lpStartAddress, void* lpParameter, DWORD dwCreationFlags, DWORD* lpThreadId)
+{
+	OTXLL_THREAD* t = (OTXLL_THREAD*) malloc(sizeof(OTXLL_THREAD));
+
+	(void) lpThreadAttributes;
+	(void) dwStackSize;
+	(void) dwCreationFlags;
+	if (!t)
+		return NULL;
+	t->start = lpStartAddress;
+	t->parameter = lpParameter;
+	if (pthread_create(&t->thread, NULL, otxll_thread_start, t) != 0)
+	{
+		free(t);
+		return NULL;
+	}
+	if (lpThreadId)
+		*lpThreadId = 0;
+	return t;
+}
+
+static inline DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds)
+{
+	(void) dwMilliseconds;
+	pthread_join(((OTXLL_THREAD*) hHandle)->thread, NULL);
+	return WAIT_OBJECT_0;
+}
+
+static inline BOOL CloseHandle(HANDLE hObject)
+{
+	free(hObject);
+	return TRUE;
+}
+
+typedef struct _SYSTEM_INFO
+{
+	DWORD dwNumberOfProcessors;
+} SYSTEM_INFO;
+
+static inline void GetSystemInfo(SYSTEM_INFO* lpSystemInfo)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	lpSystemInfo->dwNumberOfProcessors = n > 0 ? (DWORD) n : 1;
+}
+
+static inline DWORD GetEnvironmentVariableA(LPCSTR lpName, LPSTR lpBuffer, DWORD nSize)
+{
+	const char* value = getenv(lpName);
+	size_t len;
+
+	if (!value)
+		return 0;
+	len = strlen(value);
+	// Like Windows, the required size is returned if the buffer is too small
+	if (len + 1 > nSize)
+		return (DWORD) (len + 1);
+	memcpy(lpBuffer, value, len + 1);
+	return (DWORD) len;
+}
+
+//
+// Fiber local storage, which is thread local storage since the host does
+// not use fibers.  Like on Windows, the callback is called when a thread
+// exits with a non-NULL value; unlike on Windows, FlsFree does not call it.
+//
+
+#define FLS_OUT_OF_INDEXES ((DWORD) 0xffffffff)
+
+typedef void (WINAPI *PFLS_CALLBACK_FUNCTION)(void* lpFlsData);
+
+static inline DWORD FlsAlloc(PFLS_CALLBACK_FUNCTION lpCallback)
+{
+	pthread_key_t key;
+
+	if (pthread_key_create(&key, lpCallback) != 0)
+		return FLS_OUT_OF_INDEXES;
+	return (DWORD) key;
+}
+
+static inline BOOL FlsFree(DWORD dwFlsIndex)
+{
+	return pthread_key_delete((pthread_key_t) dwFlsIndex) == 0;
+}
+
+static inline void* FlsGetValue(DWORD dwFlsIndex)
+{
+	return pthread_getspecific((pthread_key_t) dwFlsIndex);
+}
+
+static inline BOOL FlsSetValue(DWORD dwFlsIndex, void* lpFlsData)
+{
+	return pthread_setspecific((pthread_key_t) dwFlsIndex, lpFlsData) == 0;
+}
+
+//
+// Interlocked operations
+//
+
+static inline LONG InterlockedIncrement(LONG volatile* Addend)
+{
+	return __sync_add_and_fetch(Addend, 1);
+}
+
+static inline LONG InterlockedExchange(LONG volatile* Target, LONG Value)
+{
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONGLONG InterlockedExchangeAdd64(LONGLONG volatile* Addend, LONGLONG Value)
+{
+	return __sync_fetch_and_add(Addend, Value);
+}
+
+static inline LONGLONG InterlockedCompareExchange64(LONGLONG volatile* Destination, LONGLONG Exchange, LONGLONG Comparand)
+{
+	return __sync_val_compare_and_swap(Destination, Comparand, Exchange);
+}
+
+static inline PVOID InterlockedCompareExchangePointer(PVOID volatile* Destination, PVOID Exchange, PVOID Comparand)
+{
+	return __sync_val_compare_and_swap(Destination, Comparand, Exchange);
+}
+
+//
+// Debugger output and dialogs go to stderr
+//
+
+static inline void OutputDebugStringA(LPCSTR lpOutputString)
+{
+	fputs(lpOutputString, stderr);
+}
+
+static inline int wvsprintfA(LPSTR lpOut, LPCSTR lpFmt, va_list arglist)
+{
+	return vsprintf(lpOut, lpFmt, arglist);
+}
+
+static inline int MessageBox(HWND hWnd, LPCSTR lpText, LPCSTR lpCaption, UINT uType)
+{
+	(void) hWnd;
+	(void) uType;
+	fprintf(stderr, "%s: %s\n", lpCaption ? lpCaption : "Error", lpText);
+	return 1;
+}
+
+//
+// Safe CRT and wide string functions.  The C library wide functions
+// assume a 4-byte wchar_t, so they are reimplemented here.
+//
+
+static inline int memcpy_s(void* dest, size_t destsz, const void* src, size_t count)
+{
+	if (count > destsz)
+		return -1;
+	if (count)
+		memcpy(dest, src, count);
+	return 0;
+}
+
+static inline int wmemcpy_s(WCHAR* dest, size_t destsz, const WCHAR* src, size_t count)
+{
+	if (count > destsz)
+		return -1;
+	if (count)
+		memcpy(dest, src, count * sizeof(WCHAR));
+	return 0;
+}
+
+static inline int lstrlenW(LPCWSTR lpString)
+{
+	int len = 0;
+
+	if (!lpString)
+		return 0;
+	while (lpString[len])
+		len++;
+	return len;
+}
+
+static inline int _wcsicmp(LPCWSTR lhs, LPCWSTR rhs)
+{
+	WCHAR a, b;
+
+	do
+	{
+		a = *lhs++;
+		b = *rhs++;
+		if (a >= L'A' && a <= L'Z')
+			a += L'a' - L'A';
+		if (b >= L'A' && b <= L'Z')
+			b += L'a' - L'A';
+	} while (a && a == b);
+	return (int) a - (int) b;
+}
+
+//
+// Only the conversions needed by FRAMEWRK.C; characters outside
+// Latin-1 are replaced by '?'
+//
+
+static inline int WideCharToMultiByte(UINT CodePage, DWORD dwFlags, LPCWSTR lpWideCharStr,
+	int cchWideChar, LPSTR lpMultiByteStr, int cbMultiByte, LPCSTR lpDefaultChar, BOOL* lpUsedDefaultChar)
+{
+	int i;
+
+	(void) CodePage;
+	(void) dwFlags;
+	(void) lpDefaultChar;
+	(void) lpUsedDefaultChar;
+	for (i = 0; i < cchWideChar && i < cbMultiByte; i++)
+		lpMultiByteStr[i] = lpWideCharStr[i] < 0x100 ? (CHAR) lpWideCharStr[i] : '?';
+	return i;
+}
+
+static inline int MultiByteToWideChar(UINT CodePage, DWORD dwFlags, LPCSTR lpMultiByteStr,
+	int cbMultiByte, LPWSTR lpWideCharStr, int cchWideChar)
+{
+	int i;
+
+	(void) CodePage;
+	(void) dwFlags;
+	for (i = 0; i < cbMultiByte && i < cchWideChar; i++)
+		lpWideCharStr[i] = (WCHAR) (BYTE) lpMultiByteStr[i];
+	return i;
+}
+
+//
+// wsprintfW supports the subset used by the add-in: %s (wide),
+// %hs (narrow), %d and %%.
+//
+
+static inline int wsprintfW(LPWSTR lpOut, LPCWSTR lpFmt, ...)
+{
+	va_list ap;
+	int n = 0;
+
+	va_start(ap, lpFmt);
+	while (*lpFmt)
+	{
+		if (*lpFmt != L'%')
+		{
+			lpOut[n++] = *lpFmt++;
+			continue;
+		}
+		lpFmt++;
+		if (lpFmt[0] == L'h' && lpFmt[1] == L's')
+		{
+			const char* s = va_arg(ap, const char*);
+			while (*s)
+				lpOut[n++] = (WCHAR) (BYTE) *s++;
+			lpFmt += 2;
+		}
+		else if (lpFmt[0] == L's')
+		{
+			const WCHAR* s = va_arg(ap, const WCHAR*);
+			while (*s)
+				lpOut[n++] = *s++;
+			lpFmt++;
+		}
+		else if (lpFmt[0] == L'd')
+		{
+			char buf[16];
+			char* s = buf;
+			snprintf(buf, sizeof(buf), "%d", va_arg(ap, int));
+			while (*s)
+				lpOut[n++] = (WCHAR) *s++;
+			lpFmt++;
+		}
+		else if (lpFmt[0] == L'%')
+		{
+			lpOut[n++] = L'%';
+			lpFmt++;
+		}
+	}
+	va_end(ap);
+	lpOut[n] = 0;
+	return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OTXLL_COMPAT_WINDOWS_H
@@ -0,0 +1,5 @@
+//
+// Lowercase alias used by the add-in sources, which rely on the
+// case-insensitive file system of Microsoft Windows.
+//
+#include "../../FRAMEWRK/XLCALL.CPP"
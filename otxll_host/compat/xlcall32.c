@@ -0,0 +1,31 @@
+///***************************************************************************
+// File:        xlcall32.c
+//
+// Purpose:     Replacement for xlcall32.lib on platforms other than
+//              Microsoft Windows.  The headless host only implements
+//              the Excel 12 callback (see SetExcel12EntryPt), calls
+//              through the Excel 4 API always fail.
+//
+// Platform:    POSIX (Linux)
+//
+///***************************************************************************
+
+#include <windows.h>
+#include <xlcall.h>
+
+int pascal Excel4v(int xlfn, LPXLOPER operRes, int count, LPXLOPER opers[])
+{
+	(void) xlfn;
+	(void) operRes;
+	(void) count;
+	(void) opers;
+	return xlretFailed;
+}
+
+int _cdecl Excel4(int xlfn, LPXLOPER operRes, int count, ...)
+{
+	(void) xlfn;
+	(void) operRes;
+	(void) count;
+	return xlretFailed;
+}
@@ -0,0 +1,384 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "xll_host.h"
+#include "xll_profile.h"
+
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+/*
+ * xllbench: time the OT_NORMAL_PDF* functions of the add-in over ranges of
+ * 1 to 1048576 rows, and split the time across the stages of xll_profile.h.
+ *
+ *   xllbench [-t seconds] [-m max rows] [-f function] ./libotxll_profile.so
+ *   xllbench -k [-t seconds] [-m max rows] ./libotxll_profile.so
+ *
+ * For a range of n rows, OT_NORMAL_PDF is entered in n cells and called n
+ * times, the other functions are array formulas called once.  Each size is
+ * repeated until it has run for the given time (0.2s by default).
+ *
+ * Functions registered with FP12 arrays ("K%" type) are then compared with
+ * their "U" counterparts.  Note that the host converts ranges to FP12 itself,
+ * like Excel does, and this time is reported as "other".
+ *
+ * Stage columns are percentages of the total time, "free" is the time spent
+ * in xlAutoFree12 and "other" what is left (host callbacks outside of the
+ * instrumented code, call overhead).  The stages are only reported when the
+ * add-in was built with OTXLL_PROFILE, see "make bench".
+ *
+ * With -k, the kernels of ot_normal_kernel.h are compared to OpenTURNS
+ * instead: the largest relative error of each kernel is reported in units
+ * of DBL_EPSILON, for |z| <= 2, 8 and 40 where z = (x - mu) / sigma, and
+ * their throughput is measured over max rows points (1048576 at most).
+ * The error grows like z^2 since a rounding error on z is amplified by
+ * exp(-z^2 / 2), so it is only checked for |z| <= 2 and |z| <= 8.
+ */
+
+namespace {
+
+typedef int (WINAPI *ProfileReadProc)(double *, int);
+typedef void (WINAPI *ProfileResetProc)(void);
+typedef int (WINAPI *KernelEvalProc)(int, int, double, double, const double *, double *, int);
+typedef const char * (WINAPI *KernelNameProc)(int);
+
+const char * const stageNames[XLL_STAGE_COUNT] = { "coerce", "copy", "sample", "compute", "result" };
+
+void usage()
+{
+    fprintf(stderr, "Usage: xllbench [-t seconds] [-m max rows] [-f function] add-in.so\n"
+                    "       xllbench -k [-t seconds] [-m max rows] add-in.so\n");
+}
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedSince(const Clock::time_point & start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Points in column A, mu in C1, sigma in D1, like xllhost
+void fillSheet(XllHost & host, int rows)
+{
+    host.clear();
+    for (int i = 0; i < rows; ++i)
+        host.setNumber(i, 0, -5.0 + 10.0 * i / (rows > 1 ? rows - 1 : 1));
+    host.setNumber(0, 2, 0.0);
+    host.setNumber(0, 3, 1.0);
+}
+
+/*
+ * Evaluate the function once over a range of the given size.  Returns the
+ * number of errors, and accumulates in freeTime the time spent in release().
+ */
+int evaluate(XllHost & host, const std::string & name, int rows, double & freeTime)
+{
+    const XLOPER12 mu = XllHost::makeRef(0, 0, 2, 2);
+    const XLOPER12 sigma = XllHost::makeRef(0, 0, 3, 3);
+    std::vector<XLOPER12> args;
+    int calls = 1;
+
+    if (name == "OT_NORMAL_PDF")
+    {
+        args.push_back(mu);
+        args.push_back(sigma);
+        args.push_back(XllHost::makeRef(0, 0, 0, 0));
+        calls = rows;
+    }
+    else if (name == "OT_NORMAL_PDF_ARRAY" || name == "OT_NORMAL_PDF_ARRAY_FP")
+    {
+        args.push_back(mu);
+        args.push_back(sigma);
+        args.push_back(XllHost::makeRef(0, rows - 1, 0, 0));
+        XllHost::setCaller(0, rows - 1, 5, 5);
+    }
+    else if (name == "OT_NORMAL_PDF_DRAW")
+    {
+        args.push_back(mu);
+        args.push_back(sigma);
+        XllHost::setCaller(0, rows - 1, 5, 6);
+    }
+    else
+    {
+        args.push_back(XllHost::makeNum(rows));
+        args.push_back(mu);
+        args.push_back(sigma);
+        XllHost::setCaller(0, rows - 1, 5, 6);
+    }
+
+    int errors = 0;
+    for (int i = 0; i < calls; ++i)
+    {
+        if (calls > 1)
+        {
+            args[2].val.sref.ref.rwFirst = args[2].val.sref.ref.rwLast = i;
+            XllHost::setCaller(i, i, 5, 5);
+        }
+        LPXLOPER12 result = host.call(name, args);
+        if (!result || (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) == xltypeErr)
+            ++errors;
+        const Clock::time_point start = Clock::now();
+        host.release(result);
+        freeTime += elapsedSince(start);
+    }
+    return errors;
+}
+
+// Largest relative error of values against reference, in units of DBL_EPSILON
+double maxError(const std::vector<double> & values, const std::vector<double> & reference, const std::vector<double> & z, double zMax)
+{
+    double error = 0.0;
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        if (fabs(z[i]) > zMax || !(fabs(reference[i]) >= DBL_MIN) || fabs(reference[i]) > DBL_MAX)
+            continue;
+        const double e = fabs(values[i] - reference[i]) / fabs(reference[i]) / DBL_EPSILON;
+        if (!(e <= error))
+            error = e;
+    }
+    return error;
+}
+
+/*
+ * Accuracy and throughput of the normal kernels, see -k.  Returns 1 if a
+ * kernel is off by more than 16 DBL_EPSILON for |z| <= 2, or by more than
+ * 256 DBL_EPSILON for |z| <= 8.
+ */
+int benchKernels(XllHost & host, double budget, int maxRows)
+{
+    KernelEvalProc eval = (KernelEvalProc) host.getProcAddress("XllNormalKernelEval");
+    KernelNameProc name = (KernelNameProc) host.getProcAddress("XllNormalKernelName");
+    if (!eval || !name)
+    {
+        fprintf(stderr, "xllbench: the add-in is not instrumented, see make bench\n");
+        return 1;
+    }
+
+    static const char * const functionNames[3] = { "pdf", "log-pdf", "cdf" };
+    static const double parameters[2][2] = { { 0.0, 1.0 }, { 0.75, 2.5 } };
+    const double zLimits[3] = { 2.0, 8.0, 40.0 };
+    const double tolerances[2] = { 16.0, 256.0 };
+
+    // Points over |z| <= 40, for accuracy
+    const int accuracyPoints = 400001;
+    // Points over |z| <= 8, for throughput
+    const int speedPoints = maxRows < 1048576 ? maxRows : 1048576;
+
+    printf("%-8s %-8s %14s %14s %14s %12s %8s\n", "function", "kernel", "error |z|<=2", "error |z|<=8", "error |z|<=40",
+           "Mevals/s", "speedup");
+    int status = 0;
+    for (int f = 0; f < 3; ++f)
+    {
+        double referenceSpeed = 0.0;
+        for (int level = -1; level < 8; ++level)
+        {
+            const char * kernel = level < 0 ? "OT" : name(level);
+            if (!kernel)
+                break;
+
+            double errors[3] = { 0.0, 0.0, 0.0 };
+            for (int p = 0; p < 2; ++p)
+            {
+                const double mu = parameters[p][0];
+                const double sigma = parameters[p][1];
+                std::vector<double> z(accuracyPoints), x(accuracyPoints), y(accuracyPoints), reference(accuracyPoints);
+                for (int i = 0; i < accuracyPoints; ++i)
+                {
+                    z[i] = -40.0 + 80.0 * i / (accuracyPoints - 1);
+                    x[i] = mu + sigma * z[i];
+                }
+                if (!eval(-1, f, mu, sigma, &x[0], &reference[0], accuracyPoints)
+                    || !eval(level, f, mu, sigma, &x[0], &y[0], accuracyPoints))
+                {
+                    fprintf(stderr, "xllbench: evaluation failed\n");
+                    return 1;
+                }
+                for (int l = 0; l < 3; ++l)
+                {
+                    const double e = maxError(y, reference, z, zLimits[l]);
+                    errors[l] = e > errors[l] ? e : errors[l];
+                }
+            }
+
+            std::vector<double> x(speedPoints), y(speedPoints);
+            for (int i = 0; i < speedPoints; ++i)
+                x[i] = -8.0 + 16.0 * i / (speedPoints > 1 ? speedPoints - 1 : 1);
+            int evals = 0;
+            const Clock::time_point start = Clock::now();
+            double total = 0.0;
+            do
+            {
+                eval(level, f, 0.0, 1.0, &x[0], &y[0], speedPoints);
+                ++evals;
+                total = elapsedSince(start);
+            } while (total < budget);
+            const double speed = 1e-6 * speedPoints * evals / total;
+            if (level < 0)
+                referenceSpeed = speed;
+
+            const bool failed = level >= 0 && (errors[0] > tolerances[0] || errors[1] > tolerances[1]);
+            printf("%-8s %-8s %14.1f %14.1f %14.1f %12.1f %7.2fx%s\n", functionNames[f], kernel, errors[0], errors[1],
+                   errors[2], speed, speed / referenceSpeed, failed ? " ERRORS" : "");
+            if (failed)
+                status = 1;
+        }
+    }
+    return status;
+}
+
+} // empty namespace
+
+int
+main(int argc, char ** argv)
+{
+    double budget = 0.2;
+    int maxRows = 1048576;
+    std::string only;
+    bool kernels = false;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; ++i)
+    {
+        if (!strcmp(argv[i], "-k"))
+        {
+            kernels = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 2;
+        }
+        if (!strcmp(argv[i], "-t"))
+            budget = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-m"))
+            maxRows = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-f"))
+            only = argv[++i];
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (i + 1 != argc || budget < 0.0 || maxRows <= 0)
+    {
+        usage();
+        return 2;
+    }
+
+    XllHost host;
+    if (!host.load(argv[i]))
+        return 1;
+    if (kernels)
+    {
+        const int status = benchKernels(host, budget, maxRows);
+        host.unload();
+        return status;
+    }
+    ProfileReadProc profileRead = (ProfileReadProc) host.getProcAddress("XllProfileRead");
+    ProfileResetProc profileReset = (ProfileResetProc) host.getProcAddress("XllProfileReset");
+    if (!profileRead || !profileReset)
+        fprintf(stderr, "xllbench: %s is not instrumented, only total times are reported\n", argv[i]);
+    fillSheet(host, maxRows);
+
+    printf("%-24s %8s %8s %14s", "function", "rows", "evals", "us/eval");
+    for (int s = 0; s < XLL_STAGE_COUNT; ++s)
+        printf(" %7s", stageNames[s]);
+    printf(" %7s %7s\n", "free", "other");
+
+    int status = 0;
+    static const char * const names[] = {
+        "OT_NORMAL_PDF", "OT_NORMAL_PDF_ARRAY", "OT_NORMAL_PDF_DRAW", "OT_NORMAL_PDF_DRAW_CMD",
+        "OT_NORMAL_PDF_ARRAY_FP", "OT_NORMAL_PDF_DRAW_FP"
+    };
+    // us/eval of each function and size, for the comparison of K% and U types
+    std::map<std::pair<std::string, int>, double> timings;
+    for (size_t f = 0; f < sizeof(names) / sizeof(names[0]); ++f)
+    {
+        const std::string name = names[f];
+        if ((!only.empty() && name != only) || !host.findFunction(name))
+            continue;
+
+        for (int rows = 1; rows <= maxRows; rows *= 4)
+        {
+            double stages[XLL_STAGE_COUNT] = { 0.0 };
+            double freeTime = 0.0;
+            int evals = 0;
+            int errors = 0;
+
+            if (profileReset)
+                profileReset();
+            const Clock::time_point start = Clock::now();
+            double total = 0.0;
+            do
+            {
+                errors += evaluate(host, name, rows, freeTime);
+                ++evals;
+                total = elapsedSince(start);
+            } while (total < budget);
+            if (profileRead)
+                profileRead(stages, XLL_STAGE_COUNT);
+
+            timings[std::make_pair(name, rows)] = 1e6 * total / evals;
+            double other = total - freeTime;
+            printf("%-24s %8d %8d %14.3f", name.c_str(), rows, evals, 1e6 * total / evals);
+            for (int s = 0; s < XLL_STAGE_COUNT; ++s)
+            {
+                printf(" %6.1f%%", 100.0 * stages[s] / total);
+                other -= stages[s];
+            }
+            printf(" %6.1f%% %6.1f%%%s\n", 100.0 * freeTime / total, 100.0 * other / total,
+                   errors ? " ERRORS" : "");
+            if (errors)
+                status = 1;
+        }
+    }
+
+    // Speedup of functions registered with FP12 arrays
+    static const char * const pairs[][2] = {
+        { "OT_NORMAL_PDF_ARRAY", "OT_NORMAL_PDF_ARRAY_FP" },
+        { "OT_NORMAL_PDF_DRAW_CMD", "OT_NORMAL_PDF_DRAW_FP" }
+    };
+    for (size_t p = 0; p < sizeof(pairs) / sizeof(pairs[0]); ++p)
+    {
+        bool header = true;
+        for (int rows = 1; rows <= maxRows; rows *= 4)
+        {
+            std::map<std::pair<std::string, int>, double>::const_iterator u = timings.find(std::make_pair(pairs[p][0], rows));
+            std::map<std::pair<std::string, int>, double>::const_iterator k = timings.find(std::make_pair(pairs[p][1], rows));
+            if (u == timings.end() || k == timings.end())
+                continue;
+            if (header)
+            {
+                printf("\n%-24s %8s %14s %14s %8s\n", pairs[p][1], "rows", "U us/eval", "K% us/eval", "speedup");
+                header = false;
+            }
+            printf("%-24s %8d %14.3f %14.3f %7.2fx\n", "", rows, u->second, k->second, u->second / k->second);
+        }
+    }
+
+    host.unload();
+    return status;
+}
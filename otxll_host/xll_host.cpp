@@ -0,0 +1,1046 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "xll_host.h"
+
+#include <dlfcn.h>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * XllHost::call() passes integer-class arguments (pointers, ints) and
+ * double arguments through a single function pointer type.  This is only
+ * valid with calling conventions which assign both kinds of arguments to
+ * registers independently of their order, like x86-64 System V and AArch64.
+ */
+#if !defined(__x86_64__) && !defined(__aarch64__)
+# error "The headless host requires the x86-64 System V or the AArch64 calling convention"
+#endif
+
+namespace {
+
+typedef int (PASCAL *EXCEL12PROC) (int xlfn, int coper, LPXLOPER12 *rgpxloper12, LPXLOPER12 xloper12Res);
+typedef void (PASCAL *SETEXCEL12ENTRYPTPROC) (EXCEL12PROC pexcel12New);
+typedef int (WINAPI *XLAUTOPROC) (void);
+typedef void (WINAPI *XLAUTOFREEPROC) (LPXLOPER12 p);
+
+const int maxIntArgs = 6;
+const int maxDoubleArgs = 8;
+typedef intptr_t (*INTPROC) (intptr_t, intptr_t, intptr_t, intptr_t, intptr_t, intptr_t,
+                             double, double, double, double, double, double, double, double);
+typedef double (*DOUBLEPROC) (intptr_t, intptr_t, intptr_t, intptr_t, intptr_t, intptr_t,
+                              double, double, double, double, double, double, double, double);
+
+// There is a single worksheet
+const IDSHEET hostSheetId = 1;
+
+// Host which receives the callbacks of the add-in
+XllHost * activeHost = 0;
+
+// Calling cell of the current thread, see xlfCaller
+thread_local XLREF12 callerRef = { -1, -1, -1, -1 };
+
+// Results of functions which do not return an XLOPER12
+thread_local XLOPER12 scalarResult;
+thread_local XLOPER12 fpResult;
+thread_local std::vector<XLOPER12> fpResultCells;
+
+// Seconds after which a call waiting for an asynchronous result gives up
+const int asyncTimeout = 60;
+
+// Result of the last asynchronous call of a thread, see XllHost::waitAsync
+struct AsyncResult
+{
+    AsyncResult()
+    {
+        value.xltype = xltypeNil;
+    }
+    ~AsyncResult()
+    {
+        XllHost::freeOper(&value);
+    }
+    XLOPER12 value;
+};
+
+thread_local AsyncResult asyncResult;
+
+XLOPER12 nilOper()
+{
+    XLOPER12 x;
+    x.xltype = xltypeNil;
+    return x;
+}
+
+const XLOPER12 nilCell = nilOper();
+
+DWORD baseType(const XLOPER12 & x)
+{
+    return x.xltype & ~(xlbitXLFree | xlbitDLLFree);
+}
+
+XCHAR * copyString(const XCHAR * str)
+{
+    XCHAR * result = new XCHAR[str[0] + 1];
+    memcpy(result, str, (str[0] + 1) * sizeof(XCHAR));
+    return result;
+}
+
+XCHAR * newString(const std::string & str)
+{
+    std::vector<XCHAR> chars(toPascalString(str));
+    XCHAR * result = new XCHAR[chars.size()];
+    memcpy(result, &chars[0], chars.size() * sizeof(XCHAR));
+    return result;
+}
+
+// Deep copy without memory flags
+void copyValue(const XLOPER12 & source, XLOPER12 & target)
+{
+    target = source;
+    target.xltype = baseType(source);
+    switch (target.xltype)
+    {
+    case xltypeStr:
+        target.val.str = copyString(source.val.str);
+        break;
+    case xltypeMulti:
+    {
+        const int size = source.val.array.rows * source.val.array.columns;
+        target.val.array.lparray = new XLOPER12[size];
+        for (int i = 0; i < size; ++i)
+            copyValue(source.val.array.lparray[i], target.val.array.lparray[i]);
+        break;
+    }
+    case xltypeRef:
+    {
+        const size_t bytes = sizeof(XLMREF12) + (source.val.mref.lpmref->count - 1) * sizeof(XLREF12);
+        target.val.mref.lpmref = (LPXLMREF12) malloc(bytes);
+        memcpy(target.val.mref.lpmref, source.val.mref.lpmref, bytes);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Deep copy, the copy is released by XllHost::freeOper
+void copyOper(const XLOPER12 & source, XLOPER12 & target)
+{
+    copyValue(source, target);
+    target.xltype |= xlbitXLFree;
+}
+
+bool toNumber(const XLOPER12 & value, double & result)
+{
+    switch (baseType(value))
+    {
+    case xltypeNum:
+        result = value.val.num;
+        return true;
+    case xltypeInt:
+        result = value.val.w;
+        return true;
+    case xltypeBool:
+        result = value.val.xbool ? 1.0 : 0.0;
+        return true;
+    case xltypeNil:
+    case xltypeMissing:
+        result = 0.0;
+        return true;
+    case xltypeStr:
+    {
+        const std::string str(toString(value.val.str + 1, value.val.str[0]));
+        char * end = 0;
+        result = strtod(str.c_str(), &end);
+        return !str.empty() && *end == '\0';
+    }
+    default:
+        return false;
+    }
+}
+
+// Conversion of a single value to one of the requested types
+int convertValue(const XLOPER12 & value, int types, LPXLOPER12 result)
+{
+    const DWORD type = baseType(value);
+    double num = 0.0;
+
+    if (types == 0 || (type & types))
+    {
+        copyOper(value, *result);
+        return xlretSuccess;
+    }
+    if (type == xltypeMulti)
+    {
+        // Like Excel, use the top-left element
+        if (value.val.array.rows * value.val.array.columns == 0)
+            return xlretFailed;
+        return convertValue(value.val.array.lparray[0], types, result);
+    }
+    if (type == xltypeErr)
+        return xlretFailed;
+    if (types & xltypeMulti)
+    {
+        result->xltype = xltypeMulti | xlbitXLFree;
+        result->val.array.rows = 1;
+        result->val.array.columns = 1;
+        result->val.array.lparray = new XLOPER12[1];
+        copyValue(value, result->val.array.lparray[0]);
+        return xlretSuccess;
+    }
+    if (!toNumber(value, num))
+        return xlretFailed;
+    if (types & xltypeNum)
+    {
+        result->xltype = xltypeNum | xlbitXLFree;
+        result->val.num = num;
+    }
+    else if (types & xltypeInt)
+    {
+        if (num < INT_MIN || num > INT_MAX)
+            return xlretFailed;
+        result->xltype = xltypeInt | xlbitXLFree;
+        result->val.w = (int) num;
+    }
+    else if (types & xltypeBool)
+    {
+        result->xltype = xltypeBool | xlbitXLFree;
+        result->val.xbool = num != 0.0;
+    }
+    else if (types & xltypeStr)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.15g", num);
+        result->xltype = xltypeStr | xlbitXLFree;
+        result->val.str = newString(buffer);
+    }
+    else
+    {
+        return xlretFailed;
+    }
+    return xlretSuccess;
+}
+
+// Registered type codes understood by XllHost::call:
+//   B (double), J (int), Q and U (XLOPER12), K% (FP12), X (asynchronous
+//   handle) and '>' for a void return.  Flags '#', '!', '$' and '&' are
+//   ignored.
+char nextTypeCode(const std::string & text, size_t & i)
+{
+    const char c = text[i++];
+    if (c == 'K')
+    {
+        if (i < text.size() && text[i] == '%')
+        {
+            ++i;
+            return 'K';
+        }
+        return 0;
+    }
+    if (c == 'B' || c == 'J' || c == 'Q' || c == 'U' || c == 'X')
+        return c;
+    return 0;
+}
+
+bool parseTypeText(const std::string & text, char & returnCode, std::vector<char> & argCodes)
+{
+    size_t i = 0;
+
+    if (text.empty())
+        return false;
+    if (text[0] == '>')
+    {
+        returnCode = '>';
+        ++i;
+    }
+    else if (!(returnCode = nextTypeCode(text, i)))
+    {
+        return false;
+    }
+    while (i < text.size())
+    {
+        if (strchr("#!$&", text[i]))
+        {
+            ++i;
+            continue;
+        }
+        const char code = nextTypeCode(text, i);
+        if (!code)
+            return false;
+        argCodes.push_back(code);
+    }
+    return true;
+}
+
+LPXLOPER12 errorResult(int err)
+{
+    scalarResult.xltype = xltypeErr;
+    scalarResult.val.err = err;
+    return &scalarResult;
+}
+
+} // empty namespace
+
+std::string
+toString(const XCHAR * str, size_t len)
+{
+    std::string result(len, ' ');
+    for (size_t i = 0; i < len; ++i)
+        result[i] = str[i] < 0x80 ? (char) str[i] : '?';
+    return result;
+}
+
+std::vector<XCHAR>
+toPascalString(const std::string & str)
+{
+    const size_t len = str.size() < 32767 ? str.size() : 32767;
+    std::vector<XCHAR> result(len + 1);
+    result[0] = (XCHAR) len;
+    for (size_t i = 0; i < len; ++i)
+        result[i + 1] = (XCHAR) (unsigned char) str[i];
+    return result;
+}
+
+XllHost::XllHost()
+    : handle_(0)
+    , nextAsyncId_(0)
+    , lateReturns_(0)
+{
+}
+
+XllHost::~XllHost()
+{
+    unload();
+}
+
+bool
+XllHost::load(const std::string & path)
+{
+    if (handle_ || activeHost)
+    {
+        fprintf(stderr, "xllhost: an add-in is already loaded\n");
+        return false;
+    }
+    char * resolved = realpath(path.c_str(), 0);
+    path_ = resolved ? resolved : path;
+    free(resolved);
+
+    handle_ = dlopen(path_.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle_)
+    {
+        fprintf(stderr, "xllhost: %s\n", dlerror());
+        return false;
+    }
+    SETEXCEL12ENTRYPTPROC setEntryPt = (SETEXCEL12ENTRYPTPROC) getProcAddress("SetExcel12EntryPt");
+    XLAUTOPROC autoOpen = (XLAUTOPROC) getProcAddress("xlAutoOpen");
+    if (!setEntryPt || !autoOpen)
+    {
+        fprintf(stderr, "xllhost: %s does not export SetExcel12EntryPt and xlAutoOpen\n", path_.c_str());
+        dlclose(handle_);
+        handle_ = 0;
+        return false;
+    }
+    activeHost = this;
+    setEntryPt(&XllHost::Callback);
+    if (autoOpen() != 1)
+    {
+        fprintf(stderr, "xllhost: xlAutoOpen failed\n");
+        unload();
+        return false;
+    }
+    return true;
+}
+
+void
+XllHost::unload()
+{
+    if (!handle_)
+        return;
+    XLAUTOPROC autoClose = (XLAUTOPROC) getProcAddress("xlAutoClose");
+    if (autoClose)
+        autoClose();
+    dlclose(handle_);
+    handle_ = 0;
+    activeHost = 0;
+    functions_.clear();
+    index_.clear();
+    events_.clear();
+    for (std::map<long, AsyncCall>::iterator it = asyncCalls_.begin(); it != asyncCalls_.end(); ++it)
+        freeOper(&it->second.result);
+    asyncCalls_.clear();
+}
+
+void *
+XllHost::getProcAddress(const std::string & symbol) const
+{
+    return handle_ ? dlsym(handle_, symbol.c_str()) : 0;
+}
+
+void
+XllHost::setCell(RW row, COL col, const XLOPER12 & value)
+{
+    std::vector<XLOPER12> & column = columns_[col];
+    if ((size_t) row >= column.size())
+        column.resize(row + 1, nilCell);
+    column[row] = value;
+    strings_.erase(std::make_pair(row, col));
+}
+
+const XLOPER12 &
+XllHost::getCell(RW row, COL col) const
+{
+    std::map<COL, std::vector<XLOPER12> >::const_iterator it = columns_.find(col);
+    if (it == columns_.end() || (size_t) row >= it->second.size())
+        return nilCell;
+    return it->second[row];
+}
+
+void
+XllHost::setNumber(RW row, COL col, double value)
+{
+    setCell(row, col, makeNum(value));
+}
+
+void
+XllHost::setString(RW row, COL col, const std::string & value)
+{
+    XLOPER12 cell;
+    cell.xltype = xltypeStr;
+    setCell(row, col, cell);
+    std::vector<XCHAR> & storage = strings_[std::make_pair(row, col)];
+    storage = toPascalString(value);
+    columns_[col][row].val.str = &storage[0];
+}
+
+void
+XllHost::setError(RW row, COL col, int err)
+{
+    XLOPER12 cell;
+    cell.xltype = xltypeErr;
+    cell.val.err = err;
+    setCell(row, col, cell);
+}
+
+void
+XllHost::clear()
+{
+    columns_.clear();
+    strings_.clear();
+}
+
+XLOPER12
+XllHost::makeRef(RW rwFirst, RW rwLast, COL colFirst, COL colLast)
+{
+    XLOPER12 ref;
+    ref.xltype = xltypeSRef;
+    ref.val.sref.count = 1;
+    ref.val.sref.ref.rwFirst = rwFirst;
+    ref.val.sref.ref.rwLast = rwLast;
+    ref.val.sref.ref.colFirst = colFirst;
+    ref.val.sref.ref.colLast = colLast;
+    return ref;
+}
+
+XLOPER12
+XllHost::makeAreas(LPXLMREF12 areas)
+{
+    XLOPER12 ref;
+    ref.xltype = xltypeRef;
+    ref.val.mref.lpmref = areas;
+    ref.val.mref.idSheet = hostSheetId;
+    return ref;
+}
+
+XLOPER12
+XllHost::makeNum(double value)
+{
+    XLOPER12 num;
+    num.xltype = xltypeNum;
+    num.val.num = value;
+    return num;
+}
+
+XLOPER12
+XllHost::makeMissing()
+{
+    XLOPER12 missing;
+    missing.xltype = xltypeMissing;
+    return missing;
+}
+
+void
+XllHost::setCaller(RW rwFirst, RW rwLast, COL colFirst, COL colLast)
+{
+    callerRef.rwFirst = rwFirst;
+    callerRef.rwLast = rwLast;
+    callerRef.colFirst = colFirst;
+    callerRef.colLast = colLast;
+}
+
+const XllFunction *
+XllHost::findFunction(const std::string & name) const
+{
+    std::map<std::string, size_t>::const_iterator it = index_.find(name);
+    return it == index_.end() ? 0 : &functions_[it->second];
+}
+
+const std::vector<XllFunction> &
+XllHost::getFunctions() const
+{
+    return functions_;
+}
+
+int
+XllHost::coerce(const XLOPER12 & source, int types, LPXLOPER12 result) const
+{
+    const DWORD type = baseType(source);
+    const XLREF12 * ref = 0;
+
+    if (type == xltypeSRef)
+    {
+        ref = &source.val.sref.ref;
+    }
+    else if (type == xltypeRef)
+    {
+        // Multiple areas cannot be coerced to values
+        if (!source.val.mref.lpmref || source.val.mref.lpmref->count != 1 || source.val.mref.idSheet != hostSheetId)
+            return xlretFailed;
+        ref = &source.val.mref.lpmref->reftbl[0];
+    }
+    if (!ref)
+        return convertValue(source, types, result);
+
+    const RW rows = ref->rwLast - ref->rwFirst + 1;
+    const COL columns = ref->colLast - ref->colFirst + 1;
+    if (rows <= 0 || columns <= 0)
+        return xlretFailed;
+    if (rows == 1 && columns == 1 && !(types & xltypeMulti))
+        return convertValue(getCell(ref->rwFirst, ref->colFirst), types, result);
+    if (types && !(types & xltypeMulti))
+        return xlretFailed;
+
+    LPXLOPER12 array = new XLOPER12[(size_t) rows * columns];
+    for (COL j = 0; j < columns; ++j)
+    {
+        std::map<COL, std::vector<XLOPER12> >::const_iterator it = columns_.find(ref->colFirst + j);
+        for (RW i = 0; i < rows; ++i)
+        {
+            const RW row = ref->rwFirst + i;
+            const XLOPER12 & cell = (it == columns_.end() || (size_t) row >= it->second.size()) ? nilCell : it->second[row];
+            copyValue(cell, array[(size_t) i * columns + j]);
+        }
+    }
+    result->xltype = xltypeMulti | xlbitXLFree;
+    result->val.array.rows = rows;
+    result->val.array.columns = columns;
+    result->val.array.lparray = array;
+    return xlretSuccess;
+}
+
+void
+XllHost::freeOper(LPXLOPER12 oper)
+{
+    switch (baseType(*oper))
+    {
+    case xltypeStr:
+        delete [] oper->val.str;
+        break;
+    case xltypeMulti:
+    {
+        const int size = oper->val.array.rows * oper->val.array.columns;
+        for (int i = 0; i < size; ++i)
+            freeOper(&oper->val.array.lparray[i]);
+        delete [] oper->val.array.lparray;
+        break;
+    }
+    case xltypeRef:
+        free(oper->val.mref.lpmref);
+        break;
+    default:
+        break;
+    }
+    oper->xltype = xltypeNil;
+}
+
+LPXLOPER12
+XllHost::call(const std::string & name, const std::vector<XLOPER12> & args)
+{
+    const XllFunction * function = findFunction(name);
+    if (!function || !function->address)
+        return 0;
+
+    long asyncId = 0;
+    LPXLOPER12 result = invoke(*function, args, asyncId);
+    return asyncId ? waitAsync(asyncId) : result;
+}
+
+long
+XllHost::callAsync(const std::string & name, const std::vector<XLOPER12> & args)
+{
+    const XllFunction * function = findFunction(name);
+    if (!function || !function->address)
+        return 0;
+
+    long asyncId = 0;
+    LPXLOPER12 result = invoke(*function, args, asyncId);
+    if (!asyncId)
+        release(result);
+    return asyncId;
+}
+
+LPXLOPER12
+XllHost::invoke(const XllFunction & function, const std::vector<XLOPER12> & args, long & asyncId)
+{
+    const std::string & name = function.functionText;
+    char returnCode = 0;
+    std::vector<char> argCodes;
+    if (!parseTypeText(function.typeText, returnCode, argCodes))
+    {
+        fprintf(stderr, "xllhost: unsupported type text %s for %s\n", function.typeText.c_str(), name.c_str());
+        return 0;
+    }
+
+    intptr_t ints[maxIntArgs] = { 0 };
+    double doubles[maxDoubleArgs] = { 0.0 };
+    int nInts = 0, nDoubles = 0;
+    // Argument storage, the add-in must not see the caller's XLOPER12s
+    std::vector<XLOPER12> opers(argCodes.size(), makeMissing());
+    std::vector<bool> owned(argCodes.size(), false);
+    std::vector<std::vector<double> > fps(argCodes.size());
+    LPXLOPER12 result = 0;
+    // Argument receiving the handle of an asynchronous call
+    size_t handleArg = argCodes.size();
+
+    for (size_t i = 0; i < argCodes.size() && !result; ++i)
+    {
+        const XLOPER12 arg = i < args.size() ? args[i] : makeMissing();
+        const DWORD type = baseType(arg);
+        XLOPER12 value;
+        double num = 0.0;
+
+        if ((argCodes[i] == 'B' ? nDoubles >= maxDoubleArgs : nInts >= maxIntArgs))
+        {
+            fprintf(stderr, "xllhost: too many arguments for %s\n", name.c_str());
+            result = errorResult(xlerrValue);
+            break;
+        }
+        switch (argCodes[i])
+        {
+        case 'U':
+            opers[i] = arg;
+            ints[nInts++] = (intptr_t) &opers[i];
+            break;
+        case 'Q':
+            if (type == xltypeRef || type == xltypeSRef)
+            {
+                if (coerce(arg, 0, &opers[i]) != xlretSuccess)
+                {
+                    result = errorResult(xlerrValue);
+                    break;
+                }
+                // Values are passed without memory flags
+                opers[i].xltype &= ~xlbitXLFree;
+                owned[i] = true;
+            }
+            else
+            {
+                opers[i] = arg;
+            }
+            ints[nInts++] = (intptr_t) &opers[i];
+            break;
+        case 'B':
+        case 'J':
+            if (coerce(arg, xltypeNum, &value) != xlretSuccess)
+            {
+                result = errorResult(xlerrValue);
+                break;
+            }
+            num = value.val.num;
+            freeOper(&value);
+            if (argCodes[i] == 'B')
+                doubles[nDoubles++] = num;
+            else
+                ints[nInts++] = (int) num;
+            break;
+        case 'K':
+        {
+            if (coerce(arg, xltypeMulti, &value) != xlretSuccess)
+            {
+                result = errorResult(xlerrValue);
+                break;
+            }
+            const int rows = value.val.array.rows;
+            const int columns = value.val.array.columns;
+            std::vector<double> & fp = fps[i];
+            // FP12 header is two INT32 followed by the values
+            fp.resize(1 + (size_t) rows * columns);
+            FP12 * p = (FP12 *) &fp[0];
+            p->rows = rows;
+            p->columns = columns;
+            for (int k = 0; k < rows * columns && !result; ++k)
+            {
+                if (baseType(value.val.array.lparray[k]) != xltypeNum)
+                    result = errorResult(xlerrValue);
+                else
+                    p->array[k] = value.val.array.lparray[k].val.num;
+            }
+            freeOper(&value);
+            ints[nInts++] = (intptr_t) p;
+            break;
+        }
+        case 'X':
+            // The handle is created once all arguments are converted
+            handleArg = i;
+            ints[nInts++] = (intptr_t) &opers[i];
+            break;
+        default:
+            result = errorResult(xlerrValue);
+            break;
+        }
+    }
+
+    if (!result && handleArg < argCodes.size())
+    {
+        std::lock_guard<std::mutex> lock(asyncMutex_);
+        asyncId = ++nextAsyncId_;
+        AsyncCall & pending = asyncCalls_[asyncId];
+        pending.done = false;
+        pending.abandoned = false;
+        pending.result = nilCell;
+        opers[handleArg].xltype = xltypeBigData;
+        opers[handleArg].val.bigdata.h.hdata = (HANDLE) (intptr_t) asyncId;
+        opers[handleArg].val.bigdata.cbData = 0;
+    }
+
+    if (!result)
+    {
+        switch (returnCode)
+        {
+        case '>':
+            ((INTPROC) function.address)(ints[0], ints[1], ints[2], ints[3], ints[4], ints[5],
+                    doubles[0], doubles[1], doubles[2], doubles[3], doubles[4], doubles[5], doubles[6], doubles[7]);
+            // The result of an asynchronous call is given by waitAsync
+            if (!asyncId)
+            {
+                scalarResult.xltype = xltypeNil;
+                result = &scalarResult;
+            }
+            break;
+        case 'U':
+        case 'Q':
+            result = (LPXLOPER12) ((INTPROC) function.address)(ints[0], ints[1], ints[2], ints[3], ints[4], ints[5],
+                    doubles[0], doubles[1], doubles[2], doubles[3], doubles[4], doubles[5], doubles[6], doubles[7]);
+            break;
+        case 'B':
+            scalarResult.xltype = xltypeNum;
+            scalarResult.val.num = ((DOUBLEPROC) function.address)(ints[0], ints[1], ints[2], ints[3], ints[4], ints[5],
+                    doubles[0], doubles[1], doubles[2], doubles[3], doubles[4], doubles[5], doubles[6], doubles[7]);
+            result = &scalarResult;
+            break;
+        case 'J':
+            scalarResult.xltype = xltypeNum;
+            scalarResult.val.num = (int) ((INTPROC) function.address)(ints[0], ints[1], ints[2], ints[3], ints[4], ints[5],
+                    doubles[0], doubles[1], doubles[2], doubles[3], doubles[4], doubles[5], doubles[6], doubles[7]);
+            result = &scalarResult;
+            break;
+        case 'K':
+        {
+            const FP12 * fp = (const FP12 *) ((INTPROC) function.address)(ints[0], ints[1], ints[2], ints[3], ints[4], ints[5],
+                    doubles[0], doubles[1], doubles[2], doubles[3], doubles[4], doubles[5], doubles[6], doubles[7]);
+            if (!fp)
+            {
+                result = errorResult(xlerrNum);
+                break;
+            }
+            fpResultCells.resize((size_t) fp->rows * fp->columns);
+            for (size_t k = 0; k < fpResultCells.size(); ++k)
+            {
+                fpResultCells[k].xltype = xltypeNum;
+                fpResultCells[k].val.num = fp->array[k];
+            }
+            fpResult.xltype = xltypeMulti;
+            fpResult.val.array.rows = fp->rows;
+            fpResult.val.array.columns = fp->columns;
+            fpResult.val.array.lparray = fpResultCells.empty() ? 0 : &fpResultCells[0];
+            result = &fpResult;
+            break;
+        }
+        default:
+            result = errorResult(xlerrValue);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < opers.size(); ++i)
+        if (owned[i])
+            freeOper(&opers[i]);
+    return result;
+}
+
+LPXLOPER12
+XllHost::waitAsync(long id)
+{
+    std::unique_lock<std::mutex> lock(asyncMutex_);
+    std::map<long, AsyncCall>::iterator it = asyncCalls_.find(id);
+    if (it == asyncCalls_.end())
+        return 0;
+    AsyncCall & pending = it->second;
+    if (!asyncDone_.wait_for(lock, std::chrono::seconds(asyncTimeout),
+                             [&pending]() { return pending.done || pending.abandoned; }))
+    {
+        fprintf(stderr, "xllhost: no result for asynchronous call %ld after %d s\n", id, asyncTimeout);
+    }
+    LPXLOPER12 result = 0;
+    if (pending.done)
+    {
+        freeOper(&asyncResult.value);
+        asyncResult.value = pending.result;
+        result = &asyncResult.value;
+    }
+    asyncCalls_.erase(it);
+    return result;
+}
+
+void
+XllHost::cancelCalculation()
+{
+    {
+        std::lock_guard<std::mutex> lock(asyncMutex_);
+        for (std::map<long, AsyncCall>::iterator it = asyncCalls_.begin(); it != asyncCalls_.end(); ++it)
+            if (!it->second.done)
+                it->second.abandoned = true;
+    }
+    asyncDone_.notify_all();
+    runEvent(xlEventCalculationCanceled);
+}
+
+void
+XllHost::endCalculation()
+{
+    runEvent(xlEventCalculationEnded);
+}
+
+void
+XllHost::runEvent(int event)
+{
+    std::map<int, std::string>::const_iterator it = events_.find(event);
+    if (it == events_.end())
+        return;
+    const XllFunction * command = findFunction(it->second);
+    if (command && command->address)
+        ((XLAUTOPROC) command->address)();
+}
+
+int
+XllHost::getLateReturns()
+{
+    std::lock_guard<std::mutex> lock(asyncMutex_);
+    return lateReturns_;
+}
+
+int
+XllHost::asyncReturn(const XLOPER12 & handle, const XLOPER12 & result)
+{
+    if (baseType(handle) != xltypeBigData)
+        return xlretInvXloper;
+    const long id = (long) (intptr_t) handle.val.bigdata.h.hdata;
+
+    std::lock_guard<std::mutex> lock(asyncMutex_);
+    std::map<long, AsyncCall>::iterator it = asyncCalls_.find(id);
+    if (it == asyncCalls_.end() || it->second.done || it->second.abandoned)
+    {
+        ++lateReturns_;
+        return xlretInvAsynchronousContext;
+    }
+    // Excel copies the result, the add-in releases its own
+    copyValue(result, it->second.result);
+    it->second.done = true;
+    asyncDone_.notify_all();
+    return xlretSuccess;
+}
+
+void
+XllHost::release(LPXLOPER12 result)
+{
+    if (!result || result == &scalarResult || result == &fpResult || result == &asyncResult.value)
+        return;
+    if (result->xltype & xlbitDLLFree)
+    {
+        XLAUTOFREEPROC autoFree = (XLAUTOFREEPROC) getProcAddress("xlAutoFree12");
+        if (autoFree)
+            autoFree(result);
+    }
+}
+
+int PASCAL
+XllHost::Callback(int xlfn, int coper, LPXLOPER12 *rgpxloper12, LPXLOPER12 xloper12Res)
+{
+    if (!activeHost)
+        return xlretFailed;
+    return activeHost->dispatch(xlfn, coper, rgpxloper12, xloper12Res);
+}
+
+int
+XllHost::dispatch(int xlfn, int coper, LPXLOPER12 *rgpxloper12, LPXLOPER12 xloper12Res)
+{
+    switch (xlfn)
+    {
+    case xlFree:
+        for (int i = 0; i < coper; ++i)
+            if (rgpxloper12[i] && (rgpxloper12[i]->xltype & xlbitXLFree))
+                freeOper(rgpxloper12[i]);
+        return xlretSuccess;
+
+    case xlCoerce:
+    {
+        if (coper < 1)
+            return xlretInvCount;
+        int types = 0;
+        if (coper > 1)
+        {
+            double num = 0.0;
+            if (!toNumber(*rgpxloper12[1], num))
+                return xlretInvXloper;
+            types = (int) num;
+        }
+        XLOPER12 unused;
+        const int ret = coerce(*rgpxloper12[0], types, xloper12Res ? xloper12Res : &unused);
+        if (!xloper12Res && ret == xlretSuccess)
+            freeOper(&unused);
+        return ret;
+    }
+
+    case xlfCaller:
+        if (!xloper12Res)
+            return xlretSuccess;
+        if (callerRef.rwFirst < 0)
+        {
+            xloper12Res->xltype = xltypeErr;
+            xloper12Res->val.err = xlerrRef;
+            return xlretSuccess;
+        }
+        xloper12Res->xltype = xltypeRef | xlbitXLFree;
+        xloper12Res->val.mref.idSheet = hostSheetId;
+        xloper12Res->val.mref.lpmref = (LPXLMREF12) malloc(sizeof(XLMREF12));
+        xloper12Res->val.mref.lpmref->count = 1;
+        xloper12Res->val.mref.lpmref->reftbl[0] = callerRef;
+        return xlretSuccess;
+
+    case xlGetName:
+        if (xloper12Res)
+        {
+            xloper12Res->xltype = xltypeStr | xlbitXLFree;
+            xloper12Res->val.str = newString(path_);
+        }
+        return xlretSuccess;
+
+    case xlfRegister:
+        return registerFunction(coper, rgpxloper12, xloper12Res);
+
+    case xlAsyncReturn:
+        if (coper < 2)
+            return xlretInvCount;
+        return asyncReturn(*rgpxloper12[0], *rgpxloper12[1]);
+
+    case xlEventRegister:
+    {
+        if (coper < 2)
+            return xlretInvCount;
+        double event = 0.0;
+        if (baseType(*rgpxloper12[0]) != xltypeStr || !toNumber(*rgpxloper12[1], event))
+            return xlretInvXloper;
+        events_[(int) event] = toString(rgpxloper12[0]->val.str + 1, rgpxloper12[0]->val.str[0]);
+        if (xloper12Res)
+        {
+            xloper12Res->xltype = xltypeBool;
+            xloper12Res->val.xbool = TRUE;
+        }
+        return xlretSuccess;
+    }
+
+    case xlcAlert:
+        if (coper > 0 && baseType(*rgpxloper12[0]) == xltypeStr)
+            fprintf(stderr, "xllhost: alert: %s\n", toString(rgpxloper12[0]->val.str + 1, rgpxloper12[0]->val.str[0]).c_str());
+        // fall through
+    case xlfSetName:
+    case xlfUnregister:
+        if (xloper12Res)
+        {
+            xloper12Res->xltype = xltypeBool;
+            xloper12Res->val.xbool = TRUE;
+        }
+        return xlretSuccess;
+
+    case xlAbort:
+        if (xloper12Res)
+        {
+            xloper12Res->xltype = xltypeBool;
+            xloper12Res->val.xbool = FALSE;
+        }
+        return xlretSuccess;
+
+    default:
+        return xlretInvXlfn;
+    }
+}
+
+int
+XllHost::registerFunction(int coper, LPXLOPER12 *rgpxloper12, LPXLOPER12 xloper12Res)
+{
+    if (coper < 4)
+        return xlretInvCount;
+    for (int i = 1; i < 4; ++i)
+        if (baseType(*rgpxloper12[i]) != xltypeStr)
+            return xlretInvXloper;
+
+    XllFunction function;
+    function.procedure = toString(rgpxloper12[1]->val.str + 1, rgpxloper12[1]->val.str[0]);
+    function.typeText = toString(rgpxloper12[2]->val.str + 1, rgpxloper12[2]->val.str[0]);
+    function.functionText = toString(rgpxloper12[3]->val.str + 1, rgpxloper12[3]->val.str[0]);
+    function.address = getProcAddress(function.procedure);
+
+    if (!function.address)
+    {
+        fprintf(stderr, "xllhost: %s is not exported by the add-in\n", function.procedure.c_str());
+        if (xloper12Res)
+        {
+            xloper12Res->xltype = xltypeErr;
+            xloper12Res->val.err = xlerrValue;
+        }
+        return xlretSuccess;
+    }
+
+    std::map<std::string, size_t>::const_iterator it = index_.find(function.functionText);
+    size_t id = functions_.size();
+    if (it != index_.end())
+        id = it->second;
+    else
+        functions_.push_back(function);
+    functions_[id] = function;
+    index_[function.functionText] = id;
+
+    if (xloper12Res)
+    {
+        xloper12Res->xltype = xltypeNum;
+        xloper12Res->val.num = (double) (id + 1);
+    }
+    return xlretSuccess;
+}
@@ -0,0 +1,167 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef __XLL_HOST_H
+#define __XLL_HOST_H
+
+#include <windows.h>
+#include <xlcall.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Headless replacement for Excel, used to load the add-in on Linux and
+ * call its worksheet functions without a spreadsheet (profiling, sanitizers).
+ *
+ * The host installs its own MdCallBack12 through SetExcel12EntryPt, and
+ * implements the callbacks used by the add-in against an in-memory grid of
+ * cells: xlCoerce, xlFree, xlfCaller, xlGetName, xlfRegister, xlfSetName,
+ * xlfUnregister, xlAbort, xlcAlert, xlAsyncReturn and xlEventRegister.
+ * There is a single worksheet, rows and columns are 0-based like in XLREF12.
+ */
+
+/* Function registered by the add-in through xlfRegister */
+struct XllFunction
+{
+    std::string procedure;    // exported symbol
+    std::string typeText;     // e.g. "UUUU"
+    std::string functionText; // name in the Function Wizard
+    void * address;
+};
+
+class XllHost
+{
+public:
+    XllHost();
+    ~XllHost();
+
+    /* Load the add-in, install the callback and call xlAutoOpen */
+    bool load(const std::string & path);
+    /* Call xlAutoClose and unload the add-in */
+    void unload();
+    /* Address of a symbol exported by the add-in, or 0 */
+    void * getProcAddress(const std::string & symbol) const;
+
+    /* Cell grid.  The grid must not be modified while functions run. */
+    void setNumber(RW row, COL col, double value);
+    void setString(RW row, COL col, const std::string & value);
+    void setError(RW row, COL col, int err);
+    void clear();
+
+    /* Build a single-area reference to a block of cells */
+    static XLOPER12 makeRef(RW rwFirst, RW rwLast, COL colFirst, COL colLast);
+    /* Build a reference to several areas, which must outlive it */
+    static XLOPER12 makeAreas(LPXLMREF12 areas);
+    static XLOPER12 makeNum(double value);
+    static XLOPER12 makeMissing();
+
+    /* Cells in which the next calls of this thread are entered (xlfCaller) */
+    static void setCaller(RW rwFirst, RW rwLast, COL colFirst, COL colLast);
+
+    const XllFunction * findFunction(const std::string & name) const;
+    const std::vector<XllFunction> & getFunctions() const;
+
+    /*
+     * Call a registered function like a worksheet formula would: arguments
+     * are converted according to the registered type text, missing trailing
+     * arguments are passed as xltypeMissing.  Returns 0 if the function is
+     * unknown, the result must be given back with release().
+     */
+    LPXLOPER12 call(const std::string & name, const std::vector<XLOPER12> & args);
+    /* Give a result back to the add-in (xlAutoFree12) when it asked for it */
+    void release(LPXLOPER12 result);
+
+    /*
+     * Asynchronous functions, registered with a '>' return type and an 'X'
+     * argument, which the host fills with a new xltypeBigData handle.
+     * call() waits for their result.  callAsync() only starts the call and
+     * returns its handle, or 0 if the function is not asynchronous; the
+     * result is then given by waitAsync(), which returns 0 if the call was
+     * abandoned.  Results of both are released with release().
+     */
+    long callAsync(const std::string & name, const std::vector<XLOPER12> & args);
+    LPXLOPER12 waitAsync(long id);
+    /*
+     * Interrupt the recalculation, like a user pressing Esc: pending
+     * asynchronous calls are abandoned, then the command registered for
+     * xlEventCalculationCanceled is run.
+     */
+    void cancelCalculation();
+    /*
+     * End the recalculation: the command registered for
+     * xlEventCalculationEnded is run, on the calling thread.
+     */
+    void endCalculation();
+    /* Number of xlAsyncReturn callbacks on abandoned or unknown handles */
+    int getLateReturns();
+
+    /* Convert a cell value or a reference to the given xltype like xlCoerce */
+    int coerce(const XLOPER12 & source, int types, LPXLOPER12 result) const;
+    /* Free an XLOPER12 allocated by the host (xlFree) */
+    static void freeOper(LPXLOPER12 oper);
+
+    /* Entry point installed through SetExcel12EntryPt */
+    static int PASCAL Callback(int xlfn, int coper, LPXLOPER12 *rgpxloper12, LPXLOPER12 xloper12Res);
+
+private:
+    XllHost(const XllHost &);
+    XllHost & operator=(const XllHost &);
+
+    int dispatch(int xlfn, int coper, LPXLOPER12 *rgpxloper12, LPXLOPER12 xloper12Res);
+    int registerFunction(int coper, LPXLOPER12 *rgpxloper12, LPXLOPER12 xloper12Res);
+    int asyncReturn(const XLOPER12 & handle, const XLOPER12 & result);
+    // Call a function, asyncId is set to the handle of asynchronous calls
+    LPXLOPER12 invoke(const XllFunction & function, const std::vector<XLOPER12> & args, long & asyncId);
+    // Run the command registered for an event, if any
+    void runEvent(int event);
+    const XLOPER12 & getCell(RW row, COL col) const;
+    void setCell(RW row, COL col, const XLOPER12 & value);
+
+    void * handle_;
+    std::string path_;
+    std::vector<XllFunction> functions_;
+    std::map<std::string, size_t> index_;
+    // Column-major grid, missing cells are xltypeNil
+    std::map<COL, std::vector<XLOPER12> > columns_;
+    // Storage of string cells, which point into it
+    std::map<std::pair<RW, COL>, std::vector<XCHAR> > strings_;
+
+    // Pending asynchronous calls, by handle
+    struct AsyncCall
+    {
+        bool done;
+        bool abandoned;
+        XLOPER12 result;
+    };
+    std::mutex asyncMutex_;
+    std::condition_variable asyncDone_;
+    std::map<long, AsyncCall> asyncCalls_;
+    long nextAsyncId_;
+    int lateReturns_;
+    // Commands registered by xlEventRegister, by event
+    std::map<int, std::string> events_;
+};
+
+/* Conversions between UTF-16 strings of the add-in and std::string */
+std::string toString(const XCHAR * str, size_t len);
+std::vector<XCHAR> toPascalString(const std::string & str);
+
+#endif // __XLL_HOST_H
@@ -0,0 +1,1261 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "xll_host.h"
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <thread>
+
+/*
+ * xllhost: load the add-in and call its OT_NORMAL_PDF* functions in a
+ * loop, so that they can be run under perf, valgrind or sanitizers.
+ *
+ *   xllhost [-n iterations] [-r rows] [-f function] [-t threads] ./libotxll.so
+ *
+ * With -t, the functions are instead called concurrently by the given
+ * number of threads, like during a multithreaded recalculation, and their
+ * results are compared with those of a first call on the main thread.
+ * Run it under -fsanitize=thread to look for data races.
+ *
+ * Asynchronous functions are called like the others, the host waits for
+ * their result.  A last scenario then interrupts a recalculation while
+ * asynchronous calls are pending.
+ */
+
+namespace {
+
+void usage()
+{
+    fprintf(stderr, "Usage: xllhost [-n iterations] [-r rows] [-f function] [-t threads] add-in.so\n");
+}
+
+// Worksheet used by all scenarios: points in column A, probabilities in
+// column B, mu in C1, sigma in D1, a distribution name in E1 with its
+// parameters in H1:I1, and a kind of design in E2
+void fillSheet(XllHost & host, int rows)
+{
+    host.clear();
+    for (int i = 0; i < rows; ++i)
+    {
+        host.setNumber(i, 0, -5.0 + 10.0 * i / (rows > 1 ? rows - 1 : 1));
+        host.setNumber(i, 1, (i + 0.5) / rows);
+    }
+    host.setNumber(0, 2, 0.0);
+    host.setNumber(0, 3, 1.0);
+    host.setString(0, 4, "Normal");
+    host.setNumber(0, 7, 0.0);
+    host.setNumber(0, 8, 1.0);
+    host.setString(1, 4, "Sobol");
+}
+
+// Arguments of each function, and the cells it is entered in
+bool prepareCall(const std::string & name, int rows, std::vector<XLOPER12> & args)
+{
+    const XLOPER12 mu = XllHost::makeRef(0, 0, 2, 2);
+    const XLOPER12 sigma = XllHost::makeRef(0, 0, 3, 3);
+
+    args.clear();
+    if (name == "OT_NORMAL_PDF")
+    {
+        args.push_back(mu);
+        args.push_back(sigma);
+        args.push_back(XllHost::makeRef(0, 0, 0, 0));
+        XllHost::setCaller(0, 0, 5, 5);
+    }
+    else if (name == "OT_NORMAL_PDF_ARRAY" || name == "OT_NORMAL_PDF_ARRAY_ASYNC")
+    {
+        args.push_back(mu);
+        args.push_back(sigma);
+        args.push_back(XllHost::makeRef(0, rows - 1, 0, 0));
+        XllHost::setCaller(0, rows - 1, 5, 5);
+    }
+    else if (name == "OT_NORMAL_PDF_DRAW" || name == "OT_NORMAL_PDF_DRAW_ASYNC")
+    {
+        args.push_back(mu);
+        args.push_back(sigma);
+        XllHost::setCaller(0, rows - 1, 5, 6);
+    }
+    else if (name == "OT_NORMAL_PDF_ARRAY_FP")
+    {
+        args.push_back(mu);
+        args.push_back(sigma);
+        args.push_back(XllHost::makeRef(0, rows - 1, 0, 0));
+    }
+    else if (name == "OT_NORMAL_PDF_DRAW_CMD" || name == "OT_NORMAL_PDF_DRAW_FP")
+    {
+        args.push_back(XllHost::makeNum(rows));
+        args.push_back(mu);
+        args.push_back(sigma);
+        XllHost::setCaller(0, rows - 1, 5, 6);
+    }
+    else if (name == "OT_DIST_PDF" || name == "OT_DIST_LOGPDF" || name == "OT_DIST_CDF" || name == "OT_DIST_QUANTILE")
+    {
+        const COL points = name == "OT_DIST_QUANTILE" ? 1 : 0;
+        args.push_back(XllHost::makeRef(0, 0, 4, 4));
+        args.push_back(XllHost::makeRef(0, 0, 7, 8));
+        args.push_back(XllHost::makeRef(0, rows - 1, points, points));
+        XllHost::setCaller(0, rows - 1, 5, 5);
+    }
+    else if (name == "OT_DIST_SAMPLE")
+    {
+        args.push_back(XllHost::makeRef(0, 0, 4, 4));
+        args.push_back(XllHost::makeRef(0, 0, 7, 8));
+        args.push_back(XllHost::makeMissing());
+        args.push_back(XllHost::makeNum(42));
+        XllHost::setCaller(0, rows - 1, 5, 6);
+    }
+    else if (name == "OT_KERNEL_SMOOTHING_PDF")
+    {
+        args.push_back(XllHost::makeRef(0, rows - 1, 0, 0));
+        args.push_back(XllHost::makeRef(0, rows - 1, 1, 1));
+        args.push_back(XllHost::makeMissing());
+        XllHost::setCaller(0, rows - 1, 5, 5);
+    }
+    else if (name == "OT_DOE")
+    {
+        args.push_back(XllHost::makeRef(1, 1, 4, 4));
+        args.push_back(XllHost::makeNum(3));
+        args.push_back(XllHost::makeNum(rows));
+        args.push_back(XllHost::makeMissing());
+        XllHost::setCaller(0, rows - 1, 5, 7);
+    }
+    else if (name == "OT_FIT_BEST")
+    {
+        args.push_back(XllHost::makeRef(0, rows - 1, 0, 0));
+        args.push_back(XllHost::makeMissing());
+        args.push_back(XllHost::makeMissing());
+        XllHost::setCaller(0, 7, 5, 10);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// Values of a result, errors are stored as negative error codes, false if there are any, and
+// strings of arrays as their length and characters
+bool getValues(LPXLOPER12 result, std::vector<double> & values)
+{
+    values.clear();
+    if (!result)
+        return false;
+    const DWORD type = result->xltype & ~(xlbitXLFree | xlbitDLLFree);
+    if (type == xltypeNum)
+    {
+        values.push_back(result->val.num);
+        return true;
+    }
+    if (type == xltypeErr)
+    {
+        values.push_back(-result->val.err);
+        return false;
+    }
+    if (type != xltypeMulti)
+        return false;
+    const int size = result->val.array.rows * result->val.array.columns;
+    bool numbers = true;
+    for (int i = 0; i < size; ++i)
+    {
+        const XLOPER12 & cell = result->val.array.lparray[i];
+        if (cell.xltype == xltypeErr)
+            values.push_back(-cell.val.err);
+        else if (cell.xltype == xltypeNum)
+            values.push_back(cell.val.num);
+        else if (cell.xltype == xltypeStr)
+            values.insert(values.end(), cell.val.str, cell.val.str + cell.val.str[0] + 1);
+        else
+            return false;
+        numbers = numbers && cell.xltype != xltypeErr;
+    }
+    return numbers;
+}
+
+/*
+ * Call all functions from several threads at once, each thread starting
+ * with a different function.  Results must be identical to those of a
+ * call from the main thread.
+ */
+int stress(XllHost & host, const std::vector<std::string> & names, int rows, int iterations, int threads)
+{
+    std::vector<std::vector<double> > expected(names.size());
+    for (size_t f = 0; f < names.size(); ++f)
+    {
+        std::vector<XLOPER12> args;
+        prepareCall(names[f], rows, args);
+        LPXLOPER12 result = host.call(names[f], args);
+        if (!getValues(result, expected[f]))
+        {
+            fprintf(stderr, "xllhost: %s failed on main thread\n", names[f].c_str());
+            host.release(result);
+            return 1;
+        }
+        host.release(result);
+    }
+
+    std::atomic<int> errors(0);
+    std::atomic<int> mismatches(0);
+    std::vector<std::thread> pool;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t)
+    {
+        pool.push_back(std::thread([&, t]() {
+            std::vector<XLOPER12> args;
+            std::vector<double> values;
+            for (int n = 0; n < iterations; ++n)
+            {
+                for (size_t k = 0; k < names.size(); ++k)
+                {
+                    const size_t f = (k + t) % names.size();
+                    prepareCall(names[f], rows, args);
+                    LPXLOPER12 result = host.call(names[f], args);
+                    if (!getValues(result, values))
+                        ++errors;
+                    else if (values.size() != expected[f].size()
+                             || memcmp(&values[0], &expected[f][0], values.size() * sizeof(double)))
+                        ++mismatches;
+                    host.release(result);
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < pool.size(); ++t)
+        pool[t].join();
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%d threads, %d functions, %d calls each: %d errors, %d mismatches, %.3f s\n", threads,
+           (int) names.size(), iterations, errors.load(), mismatches.load(), elapsed);
+    return errors || mismatches ? 1 : 0;
+}
+
+/*
+ * Start asynchronous calls, interrupt the recalculation at once, then check
+ * that each call either returned the expected values or was abandoned, and
+ * that calls made afterwards still work.
+ */
+int cancellation(XllHost & host, const std::string & name, int rows, int calls)
+{
+    std::vector<XLOPER12> args;
+    std::vector<double> expected, values;
+    prepareCall(name, rows, args);
+    LPXLOPER12 result = host.call(name, args);
+    const bool ok = getValues(result, expected);
+    host.release(result);
+    if (!ok)
+    {
+        fprintf(stderr, "xllhost: %s failed\n", name.c_str());
+        return 1;
+    }
+
+    std::vector<long> ids;
+    for (int n = 0; n < calls; ++n)
+        ids.push_back(host.callAsync(name, args));
+    host.cancelCalculation();
+
+    int completed = 0, abandoned = 0, mismatches = 0;
+    for (size_t n = 0; n < ids.size(); ++n)
+    {
+        result = ids[n] ? host.waitAsync(ids[n]) : 0;
+        if (!result)
+            ++abandoned;
+        else if (!getValues(result, values) || values != expected)
+            ++mismatches;
+        else
+            ++completed;
+        host.release(result);
+    }
+
+    // The add-in must not be left in a canceled state
+    result = host.call(name, args);
+    if (!getValues(result, values) || values != expected)
+        ++mismatches;
+    host.release(result);
+
+    printf("cancellation: %d calls, %d completed, %d abandoned, %d mismatches\n", calls, completed, abandoned, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+// Call an OT_MAKE_* function from a cell of column K, store the handle in the cell
+std::string makeObject(XllHost & host, const std::string & name, const std::vector<XLOPER12> & args, RW row)
+{
+    std::string handle;
+    XllHost::setCaller(row, row, 10, 10);
+    LPXLOPER12 result = host.call(name, args);
+    if (result && (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) == xltypeStr)
+        for (int c = 1; c <= result->val.str[0]; ++c)
+            handle += (char) result->val.str[c];
+    host.release(result);
+    host.setString(row, 10, handle);
+    return handle;
+}
+
+/*
+ * Make a distribution, a sample, and a distribution from the first one in
+ * the cells of column K, then check that OT_DIST_PDF gives the same values
+ * through their handles and with a sample of two areas, that making them
+ * again from the same arguments returns the same handles, that changing
+ * a parameter of the first distribution drops the one made from it, and
+ * that objects are dropped once their cell is overwritten, or when too
+ * many are made outside of a cell.
+ */
+int objects(XllHost & host, int rows)
+{
+    std::vector<XLOPER12> distribution, sample, copy, args;
+    std::vector<double> expected, values;
+    distribution.push_back(XllHost::makeRef(0, 0, 4, 4));
+    distribution.push_back(XllHost::makeRef(0, 0, 7, 8));
+    sample.push_back(XllHost::makeRef(0, rows - 1, 0, 0));
+    copy.push_back(XllHost::makeRef(0, 0, 10, 10));
+    copy.push_back(XllHost::makeMissing());
+
+    int mismatches = 0;
+    const std::string first = makeObject(host, "OT_MAKE_DISTRIBUTION", distribution, 0);
+    const std::string points = makeObject(host, "OT_MAKE_SAMPLE", sample, 1);
+    const std::string derived = makeObject(host, "OT_MAKE_DISTRIBUTION", copy, 2);
+    if (first.empty() || points.empty() || derived.empty())
+    {
+        fprintf(stderr, "xllhost: OT_MAKE_* failed\n");
+        return 1;
+    }
+    // Unchanged arguments
+    if (makeObject(host, "OT_MAKE_DISTRIBUTION", distribution, 0) != first ||
+        makeObject(host, "OT_MAKE_SAMPLE", sample, 1) != points ||
+        makeObject(host, "OT_MAKE_DISTRIBUTION", copy, 2) != derived)
+        ++mismatches;
+
+    prepareCall("OT_DIST_PDF", rows, args);
+    LPXLOPER12 result = host.call("OT_DIST_PDF", args);
+    getValues(result, expected);
+    host.release(result);
+    args[0] = XllHost::makeRef(2, 2, 10, 10);
+    args[1] = XllHost::makeMissing();
+    args[2] = XllHost::makeRef(1, 1, 10, 10);
+    result = host.call("OT_DIST_PDF", args);
+    if (!getValues(result, values) || values != expected)
+        ++mismatches;
+    host.release(result);
+
+    // The same points, from two areas
+    std::vector<char> areas(sizeof(XLMREF12) + sizeof(XLREF12));
+    LPXLMREF12 mref = (LPXLMREF12) &areas[0];
+    mref->count = 2;
+    mref->reftbl[0] = XllHost::makeRef(0, rows / 2 - 1, 0, 0).val.sref.ref;
+    mref->reftbl[1] = XllHost::makeRef(rows / 2, rows - 1, 0, 0).val.sref.ref;
+    sample[0] = XllHost::makeAreas(mref);
+    const std::string stacked = makeObject(host, "OT_MAKE_SAMPLE", sample, 3);
+    args[2] = XllHost::makeRef(3, 3, 10, 10);
+    result = host.call("OT_DIST_PDF", args);
+    if (!getValues(result, values) || values != expected)
+        ++mismatches;
+    host.release(result);
+
+    // A new sigma replaces the first distribution, and drops the derived one
+    host.setNumber(0, 8, 2.0);
+    const std::string second = makeObject(host, "OT_MAKE_DISTRIBUTION", distribution, 0);
+    host.setNumber(0, 8, 1.0);
+    host.setString(0, 10, first);
+    result = host.call("OT_DIST_PDF", args);
+    if (second == first || getValues(result, values))
+        ++mismatches;
+    host.release(result);
+
+    // Once the recalculation is over, the sample of a cell overwritten by a
+    // number is dropped, while the cells which still hold their handle keep
+    // their objects
+    host.setString(0, 10, second);
+    host.setNumber(3, 10, 1.0);
+    host.endCalculation();
+    args[0] = XllHost::makeRef(0, 0, 10, 10);
+    args[2] = XllHost::makeRef(1, 1, 10, 10);
+    result = host.call("OT_DIST_PDF", args);
+    if (!getValues(result, values) || values.size() != expected.size())
+        ++mismatches;
+    host.release(result);
+    host.setString(5, 10, stacked);
+    args[2] = XllHost::makeRef(5, 5, 10, 10);
+    result = host.call("OT_DIST_PDF", args);
+    if (getValues(result, values))
+        ++mismatches;
+    host.release(result);
+
+    // Objects made outside of a cell are not all kept, the oldest go first
+    std::string oldest, newest;
+    XllHost::setCaller(-1, -1, -1, -1);
+    for (int n = 0; n < 1000; ++n)
+    {
+        result = host.call("OT_MAKE_SAMPLE", std::vector<XLOPER12>(1, XllHost::makeRef(0, 0, 0, 0)));
+        newest.clear();
+        if (result && (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) == xltypeStr)
+            for (int c = 1; c <= result->val.str[0]; ++c)
+                newest += (char) result->val.str[c];
+        host.release(result);
+        if (!n)
+            oldest = newest;
+    }
+    host.setString(5, 10, oldest);
+    result = host.call("OT_DIST_PDF", args);
+    if (getValues(result, values))
+        ++mismatches;
+    host.release(result);
+    host.setString(5, 10, newest);
+    result = host.call("OT_DIST_PDF", args);
+    if (!getValues(result, values) || values.size() != 1)
+        ++mismatches;
+    host.release(result);
+
+    printf("objects: %s, %s, %s, %s, then %s, %d mismatches\n", first.c_str(), points.c_str(), derived.c_str(),
+           stacked.c_str(), second.c_str(), mismatches);
+    return mismatches ? 1 : 0;
+}
+
+/*
+ * Copy the points of column A into column L, but for a string, a blank and
+ * an error, then check that OT_DIST_PDF fails on them by default, gives
+ * #N/A for them with "nan", and that OT_MAKE_SAMPLE leaves out their rows
+ * with "skip".
+ */
+int missing(XllHost & host, int rows)
+{
+    const RW bad[] = { 1, (RW) rows / 2, (RW) rows - 1 };
+    for (RW i = 0; i < rows; ++i)
+        if (i != bad[0] && i != bad[1] && i != bad[2])
+            host.setNumber(i, 11, -5.0 + 10.0 * i / (rows - 1));
+    host.setString(bad[0], 11, "x");
+    host.setError(bad[2], 11, xlerrDiv0);
+    host.setString(0, 12, "nan");
+    host.setString(1, 12, "skip");
+
+    std::vector<XLOPER12> args, sample;
+    std::vector<double> expected, values;
+    prepareCall("OT_DIST_PDF", rows, args);
+    LPXLOPER12 result = host.call("OT_DIST_PDF", args);
+    getValues(result, expected);
+    host.release(result);
+
+    int mismatches = 0;
+    args[2] = XllHost::makeRef(0, rows - 1, 11, 11);
+    result = host.call("OT_DIST_PDF", args);
+    if (getValues(result, values) || values.size() != 1)
+        ++mismatches;
+    host.release(result);
+
+    std::vector<double> kept;
+    for (RW i = 0; i < rows; ++i)
+    {
+        if (i == bad[0] || i == bad[1] || i == bad[2])
+            expected[i] = -xlerrNA;
+        else
+            kept.push_back(expected[i]);
+    }
+    args.push_back(XllHost::makeRef(0, 0, 12, 12));
+    result = host.call("OT_DIST_PDF", args);
+    if (getValues(result, values) || values != expected)
+        ++mismatches;
+    host.release(result);
+
+    sample.push_back(XllHost::makeRef(0, rows - 1, 11, 11));
+    sample.push_back(XllHost::makeRef(1, 1, 12, 12));
+    const std::string points = makeObject(host, "OT_MAKE_SAMPLE", sample, 4);
+    args[2] = XllHost::makeRef(4, 4, 10, 10);
+    args[3] = XllHost::makeMissing();
+    result = host.call("OT_DIST_PDF", args);
+    if (points.empty() || !getValues(result, values) || values != kept)
+        ++mismatches;
+    host.release(result);
+
+    printf("missing: %s of %d points, %d mismatches\n", points.c_str(), (int) kept.size(), mismatches);
+    return mismatches ? 1 : 0;
+}
+
+/*
+ * Estimate the density of a sample in column c at the points of column
+ * c + 1, and compare it to the sum of the kernels at every stride-th
+ * point; returns the number of mismatches, updates worst with the
+ * relative error and sets elapsed to the time of the call in seconds.
+ */
+int kernelMismatches(XllHost & host, const std::vector<double> & sample, const std::vector<double> & points,
+                     double bandwidth, COL c, double & worst, RW stride, double & elapsed)
+{
+    const RW size = (RW) sample.size();
+    const RW count = (RW) points.size();
+    std::vector<double> values;
+    for (RW i = 0; i < size; ++i)
+        host.setNumber(i, c, sample[i]);
+    for (RW i = 0; i < count; ++i)
+        host.setNumber(i, c + 1, points[i]);
+
+    std::vector<XLOPER12> args;
+    args.push_back(XllHost::makeRef(0, size - 1, c, c));
+    args.push_back(XllHost::makeRef(0, count - 1, c + 1, c + 1));
+    args.push_back(XllHost::makeNum(bandwidth));
+    XllHost::setCaller(0, count - 1, c + 2, c + 2);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    LPXLOPER12 result = host.call("OT_KERNEL_SMOOTHING_PDF", args);
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int mismatches = getValues(result, values) && values.size() == (size_t) count ? 0 : count;
+    host.release(result);
+
+    for (RW j = 0; j < count && !mismatches; j += stride)
+    {
+        double sum = 0.0;
+        for (RW i = 0; i < size; ++i)
+        {
+            const double z = (points[j] - sample[i]) / bandwidth;
+            sum += std::exp(-0.5 * z * z);
+        }
+        sum /= size * bandwidth * std::sqrt(2.0 * M_PI);
+        const double error = std::fabs(values[j] - sum) / (sum > 1e-3 ? sum : 1e-3);
+        worst = error > worst ? error : worst;
+        if (error > 1e-3)
+            ++mismatches;
+    }
+    return mismatches;
+}
+
+/*
+ * Estimate the density of a large sample in column N at a few points of
+ * column O, one of them far from the sample, which goes through the grid
+ * of ot_kernel_smoothing.h, and compare it to the sum of the kernels.
+ * Then at 20000 points over [-100, 100], most of them beyond the grid,
+ * which must not cost a sum over the sample each.  Then with a narrow
+ * bandwidth and a far outlier, for which the grid cannot cover the whole
+ * sample.
+ */
+int kernelSmoothing(XllHost & host)
+{
+    const RW size = 200000;
+    const double points[] = { -6.0, -5.0, -2.5, -0.01, 0.0, 1.234, 4.99, 5.3, 20.0 };
+    std::vector<double> sample(size);
+    for (RW i = 0; i < size; ++i)
+    {
+        // Uniform over [-5, 5], and normal around 1
+        const double u = std::fmod(i * 0.6180339887498949, 1.0);
+        sample[i] = i % 2 ? -5.0 + 10.0 * u : 1.0 + 0.5 * std::sqrt(-2.0 * std::log(1.0 - u)) * std::cos(i * 0.1);
+    }
+    double worst = 0.0, elapsed = 0.0, wide = 0.0;
+    int mismatches = kernelMismatches(host, sample, std::vector<double>(points, points + 9), 0.05, 13, worst, 1,
+                                      elapsed);
+
+    // Points far outside the sample
+    std::vector<double> spread(20000);
+    for (size_t j = 0; j < spread.size(); ++j)
+        spread[j] = -100.0 + 200.0 * j / (spread.size() - 1);
+    mismatches += kernelMismatches(host, sample, spread, 0.05, 291, worst, 397, wide);
+
+    // Uniform over [0, 1], but for an outlier at 1e5
+    const double bulk[] = { -0.02, 0.0, 0.1, 0.25, 0.5, 0.75, 0.99, 1.0, 1e5 };
+    for (RW i = 0; i < size; ++i)
+        sample[i] = i + 1 < size ? std::fmod(i * 0.6180339887498949, 1.0) : 1e5;
+    mismatches += kernelMismatches(host, sample, std::vector<double>(bulk, bulk + 9), 0.01, 272, worst, 1, elapsed);
+
+    printf("kernel smoothing: 9 points of %d, twice, and %d points in %.3f ms, relative error %.2g, %d mismatches\n",
+           (int) size, (int) spread.size(), 1e3 * wide, worst, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+// Name in the first column of row i of an OT_FIT_BEST result
+std::string fittedName(LPXLOPER12 result, RW i)
+{
+    std::string name;
+    if (!result || (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) != xltypeMulti || i >= result->val.array.rows)
+        return name;
+    const XLOPER12 & cell = result->val.array.lparray[(size_t) i * result->val.array.columns];
+    if (cell.xltype == xltypeStr)
+        for (int c = 1; c <= cell.val.str[0]; ++c)
+            name += (char) cell.val.str[c];
+    return name;
+}
+
+/*
+ * Fit all families to a normal sample of column P, by BIC and Kolmogorov,
+ * then Gamma and Normal only as listed in column Q: the normal
+ * distribution must come first, with the mean and standard deviation of
+ * the sample.
+ */
+int fitting(XllHost & host)
+{
+    const RW size = 20000;
+    double mean = 0.0, variance = 0.0;
+    for (RW i = 0; i < size; ++i)
+    {
+        const double u = std::fmod(i * 0.6180339887498949, 1.0), v = std::fmod(i * 0.7548776662466927, 1.0);
+        const double x = 2.0 + 0.5 * std::sqrt(-2.0 * std::log(1.0 - u)) * std::cos(2.0 * M_PI * v);
+        host.setNumber(i, 15, x);
+        mean += x;
+    }
+    mean /= size;
+    for (RW i = 0; i < size; ++i)
+    {
+        const double u = std::fmod(i * 0.6180339887498949, 1.0), v = std::fmod(i * 0.7548776662466927, 1.0);
+        const double x = 2.0 + 0.5 * std::sqrt(-2.0 * std::log(1.0 - u)) * std::cos(2.0 * M_PI * v);
+        variance += (x - mean) * (x - mean);
+    }
+    const double sigma = std::sqrt(variance / (size - 1));
+    host.setString(0, 16, "Gamma");
+    host.setString(1, 16, "normal");
+
+    std::vector<XLOPER12> args;
+    args.push_back(XllHost::makeRef(0, size - 1, 15, 15));
+    args.push_back(XllHost::makeMissing());
+    args.push_back(XllHost::makeMissing());
+    XllHost::setCaller(0, 3, 17, 22);
+    int mismatches = 0;
+    RW fitted[3] = { 0, 0, 0 };
+    for (int k = 0; k < 3; ++k)
+    {
+        if (k == 1)
+            host.setString(2, 16, "Kolmogorov");
+        if (k == 1)
+            args[2] = XllHost::makeRef(2, 2, 16, 16);
+        if (k == 2)
+            args[1] = XllHost::makeRef(0, 1, 16, 16);
+        LPXLOPER12 result = host.call("OT_FIT_BEST", args);
+        if (fittedName(result, 0) != "Normal" || result->val.array.columns != 6)
+            ++mismatches;
+        else
+        {
+            const XLOPER12 * row = result->val.array.lparray;
+            fitted[k] = result->val.array.rows;
+            if (row[2].xltype != xltypeNum || std::fabs(row[2].val.num - mean) > 1e-3 * sigma ||
+                row[3].xltype != xltypeNum || std::fabs(row[3].val.num / sigma - 1.0) > 1e-3)
+                ++mismatches;
+        }
+        host.release(result);
+    }
+    if (fitted[2] != 2)
+        ++mismatches;
+
+    printf("fitting: %d, %d and %d families, %d mismatches\n", (int) fitted[0], (int) fitted[1], (int) fitted[2],
+           mismatches);
+    return mismatches ? 1 : 0;
+}
+
+/*
+ * Broadcast a column of means in column S with repeated values, a row of
+ * standard deviations and a single point, then single parameters and a row
+ * of points, and compare each cell to OT_NORMAL_PDF; shapes which do not
+ * match must give an error.
+ */
+int broadcasting(XllHost & host)
+{
+    const RW rows = 40;
+    const COL columns = 3, points = 200;
+    for (RW i = 0; i < rows; ++i)
+        host.setNumber(i, 18, 0.25 * (i % 5) - 0.5);
+    for (COL j = 0; j < columns; ++j)
+        host.setNumber(0, 19 + j, 0.5 + j);
+    for (COL j = 0; j < points; ++j)
+        host.setNumber(1, 19 + j, -4.0 + 0.04 * j);
+
+    int mismatches = 0;
+    std::vector<XLOPER12> args, scalar(3);
+    for (int k = 0; k < 2; ++k)
+    {
+        args.clear();
+        args.push_back(k == 0 ? XllHost::makeRef(0, rows - 1, 18, 18) : XllHost::makeNum(0.5));
+        args.push_back(k == 0 ? XllHost::makeRef(0, 0, 19, 19 + columns - 1) : XllHost::makeNum(1.5));
+        args.push_back(k == 0 ? XllHost::makeNum(0.3) : XllHost::makeRef(1, 1, 19, 19 + points - 1));
+        const RW expectedRows = k == 0 ? rows : 1;
+        const COL expectedColumns = k == 0 ? columns : points;
+        XllHost::setCaller(0, expectedRows - 1, 30, 30 + expectedColumns - 1);
+        LPXLOPER12 result = host.call("OT_NORMAL_PDF_ARRAY", args);
+        if (!result || (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) != xltypeMulti ||
+            result->val.array.rows != expectedRows || result->val.array.columns != expectedColumns)
+        {
+            host.release(result);
+            ++mismatches;
+            continue;
+        }
+        for (RW i = 0; i < expectedRows; ++i)
+        {
+            for (COL j = 0; j < expectedColumns; ++j)
+            {
+                scalar[0] = k == 0 ? XllHost::makeRef(i, i, 18, 18) : args[0];
+                scalar[1] = k == 0 ? XllHost::makeRef(0, 0, 19 + j, 19 + j) : args[1];
+                scalar[2] = k == 0 ? args[2] : XllHost::makeRef(1, 1, 19 + j, 19 + j);
+                LPXLOPER12 value = host.call("OT_NORMAL_PDF", scalar);
+                const XLOPER12 & cell = result->val.array.lparray[(size_t) i * expectedColumns + j];
+                if (!value || cell.xltype != xltypeNum ||
+                    std::fabs(cell.val.num - value->val.num) > 1e-14 * std::fabs(value->val.num))
+                    ++mismatches;
+                host.release(value);
+            }
+        }
+        host.release(result);
+    }
+
+    // 40 means and 30 points cannot be broadcast together
+    args[0] = XllHost::makeRef(0, rows - 1, 18, 18);
+    args[1] = XllHost::makeNum(1.0);
+    args[2] = XllHost::makeRef(0, rows - 11, 18, 18);
+    LPXLOPER12 result = host.call("OT_NORMAL_PDF_ARRAY", args);
+    if (!result || (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) != xltypeErr)
+        ++mismatches;
+    host.release(result);
+
+    printf("broadcasting: %dx%d and 1x%d cells, %d mismatches\n", (int) rows, (int) columns, (int) points,
+           mismatches);
+    return mismatches ? 1 : 0;
+}
+
+// Number cell (i, j) of an xltypeMulti result, NaN if it is not a number
+double resultNumber(LPXLOPER12 result, RW i, COL j)
+{
+    if (!result || (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) != xltypeMulti ||
+        i >= result->val.array.rows || j >= result->val.array.columns)
+        return std::numeric_limits<double>::quiet_NaN();
+    const XLOPER12 & cell = result->val.array.lparray[(size_t) i * result->val.array.columns + j];
+    return cell.xltype == xltypeNum ? cell.val.num : std::numeric_limits<double>::quiet_NaN();
+}
+
+/*
+ * Build designs of experiments: the first points of the Sobol and Halton
+ * sequences, each dimension of 1023 Sobol points being stratified; a Latin
+ * hypercube with a normal and a uniform marginal in HW1:HZ2, which must be
+ * stratified, reproducible and change with the seed; and too many
+ * dimensions for a Sobol design.
+ */
+int designs(XllHost & host)
+{
+    int mismatches = 0;
+    std::vector<XLOPER12> args(4);
+    host.setString(0, 230, "normal");
+    host.setNumber(0, 231, 2.0);
+    host.setNumber(0, 232, 0.5);
+    host.setString(1, 230, "Uniform");
+    host.setNumber(1, 231, -1.0);
+    host.setNumber(1, 232, 1.0);
+    host.setString(2, 230, "Halton");
+    host.setString(3, 230, "lhs");
+
+    // Sobol, the origin being left out
+    args[0] = XllHost::makeRef(1, 1, 4, 4);
+    args[1] = XllHost::makeNum(2);
+    args[2] = XllHost::makeNum(1023);
+    args[3] = XllHost::makeMissing();
+    XllHost::setCaller(0, 1022, 240, 241);
+    LPXLOPER12 result = host.call("OT_DOE", args);
+    const double sobol[3][2] = { { 0.5, 0.5 }, { 0.75, 0.25 }, { 0.25, 0.75 } };
+    for (RW i = 0; i < 3; ++i)
+        for (COL j = 0; j < 2; ++j)
+            if (resultNumber(result, i, j) != sobol[i][j])
+                ++mismatches;
+    for (COL j = 0; j < 2; ++j)
+    {
+        std::vector<int> bins(1024, 0);
+        for (RW i = 0; i < 1023; ++i)
+        {
+            const double u = resultNumber(result, i, j);
+            if (u > 0.0 && u < 1.0)
+                ++bins[(int) (u * 1024)];
+        }
+        for (int b = 1; b < 1024; ++b)
+            if (bins[b] != 1)
+                ++mismatches;
+    }
+    host.release(result);
+
+    // Halton, bases 2 and 3
+    args[0] = XllHost::makeRef(2, 2, 230, 230);
+    args[2] = XllHost::makeNum(3);
+    result = host.call("OT_DOE", args);
+    const double halton[3][2] = { { 0.5, 1.0 / 3 }, { 0.25, 2.0 / 3 }, { 0.75, 1.0 / 9 } };
+    for (RW i = 0; i < 3; ++i)
+        for (COL j = 0; j < 2; ++j)
+            if (std::fabs(resultNumber(result, i, j) - halton[i][j]) > 1e-15)
+                ++mismatches;
+    host.release(result);
+
+    // Latin hypercube of 10000 points
+    const RW size = 10000;
+    args[0] = XllHost::makeRef(3, 3, 230, 230);
+    args[1] = XllHost::makeRef(0, 1, 230, 233);
+    args[2] = XllHost::makeNum(size);
+    args[3] = XllHost::makeNum(7);
+    XllHost::setCaller(0, size - 1, 240, 241);
+    std::vector<double> first, second, third;
+    result = host.call("OT_DOE", args);
+    getValues(result, first);
+    std::vector<int> bins(size, 0);
+    double mean = 0.0;
+    for (RW i = 0; i < size; ++i)
+    {
+        mean += resultNumber(result, i, 0) / size;
+        const double u = (resultNumber(result, i, 1) + 1.0) / 2.0;
+        if (u > 0.0 && u < 1.0)
+            ++bins[(int) (u * size)];
+    }
+    for (RW b = 0; b < size; ++b)
+        if (bins[b] != 1)
+            ++mismatches;
+    if (!(std::fabs(mean - 2.0) < 1e-2))
+        ++mismatches;
+    host.release(result);
+    result = host.call("OT_DOE", args);
+    getValues(result, second);
+    host.release(result);
+    args[3] = XllHost::makeNum(8);
+    result = host.call("OT_DOE", args);
+    getValues(result, third);
+    host.release(result);
+    if (first.size() != (size_t) size * 2 || first != second || first == third)
+        ++mismatches;
+
+    // At most 40 dimensions for Sobol
+    args[0] = XllHost::makeRef(1, 1, 4, 4);
+    args[1] = XllHost::makeNum(41);
+    args[2] = XllHost::makeNum(10);
+    result = host.call("OT_DOE", args);
+    if (!result || (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) != xltypeErr)
+        ++mismatches;
+    host.release(result);
+
+    printf("designs: Sobol, Halton and LHS of %d points, %d mismatches\n", (int) size, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+// String of a result, empty if it is not a string
+std::string resultString(LPXLOPER12 result)
+{
+    std::string text;
+    if (result && (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) == xltypeStr)
+        for (int c = 1; c <= result->val.str[0]; ++c)
+            text += (char) result->val.str[c];
+    return text;
+}
+
+// Model of the chaos scenario, a polynomial of degree 2 of three inputs
+double chaosModel(const double * x)
+{
+    return 1.0 + 2.0 * x[0] + x[1] * x[1] + 0.5 * x[0] * x[2];
+}
+
+/*
+ * Fit a polynomial chaos expansion of degree 2 on 2000 points of [-1, 1]^3
+ * in IQ:IS, with their values in IT and uniform marginals in IC1:IE3,
+ * which must reproduce the model at 100000 other points and give its
+ * Sobol indices; check that it is only fitted again when a value changes,
+ * and that it needs as many points as terms.  Then fit x1 + x2^2 for
+ * inputs normal around 1 in JP1:JR2, which must give its Sobol indices
+ * for that distribution, and a logistic input, which is not mapped to its
+ * polynomials by an affine function.
+ */
+int chaos(XllHost & host)
+{
+    int mismatches = 0;
+    const RW size = 2000;
+    const RW count = 100000;
+    std::vector<double> x(3 * count);
+    for (RW i = 0; i < size; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            const double u = std::fmod(0.1 * j + i * (0.6180339887498949 + 0.1 * j), 1.0);
+            x[3 * i + j] = 2.0 * u - 1.0;
+            host.setNumber(i, 250 + j, x[3 * i + j]);
+        }
+        host.setNumber(i, 253, chaosModel(&x[3 * i]));
+    }
+    for (RW j = 0; j < 3; ++j)
+    {
+        host.setString(j, 262, "Uniform");
+        host.setNumber(j, 263, -1.0);
+        host.setNumber(j, 264, 1.0);
+    }
+    std::vector<XLOPER12> args(4);
+    args[0] = XllHost::makeRef(0, size - 1, 250, 252);
+    args[1] = XllHost::makeRef(0, size - 1, 253, 253);
+    args[2] = XllHost::makeNum(2);
+    args[3] = XllHost::makeRef(0, 2, 262, 264);
+    XllHost::setCaller(0, 0, 254, 254);
+    std::string handle, again, changed;
+    LPXLOPER12 result = host.call("OT_PCE_BUILD", args);
+    handle = resultString(result);
+    host.release(result);
+
+    // Same handle for the same content, a new one when a value changes
+    result = host.call("OT_PCE_BUILD", args);
+    again = resultString(result);
+    host.release(result);
+    host.setNumber(5, 253, 100.0);
+    result = host.call("OT_PCE_BUILD", args);
+    changed = resultString(result);
+    host.release(result);
+    if (handle.empty() || again != handle || changed.empty() || changed == handle)
+        ++mismatches;
+    host.setNumber(5, 253, chaosModel(&x[15]));
+    result = host.call("OT_PCE_BUILD", args);
+    handle = resultString(result);
+    host.release(result);
+    host.setString(0, 254, handle);
+
+    // Evaluation at other points
+    for (RW i = 0; i < count; ++i)
+        for (int j = 0; j < 3; ++j)
+        {
+            x[3 * i + j] = std::sin(1.0 + i * (j + 1.5));
+            host.setNumber(i, 255 + j, x[3 * i + j]);
+        }
+    std::vector<XLOPER12> eval;
+    eval.push_back(XllHost::makeRef(0, 0, 254, 254));
+    eval.push_back(XllHost::makeRef(0, count - 1, 255, 257));
+    XllHost::setCaller(0, count - 1, 258, 258);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    result = host.call("OT_PCE_EVAL", eval);
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (RW i = 0; i < count; ++i)
+        if (!(std::fabs(resultNumber(result, i, 0) - chaosModel(&x[3 * i])) < 1e-10))
+            ++mismatches;
+    host.release(result);
+
+    // Sobol indices of the model for inputs uniform on [-1, 1]
+    const double variance = 4.0 / 3 + 4.0 / 45 + 1.0 / 36;
+    const double indices[3][2] = { { 4.0 / 3 / variance, (4.0 / 3 + 1.0 / 36) / variance },
+                                   { 4.0 / 45 / variance, 4.0 / 45 / variance },
+                                   { 0.0, 1.0 / 36 / variance } };
+    eval.resize(1);
+    XllHost::setCaller(0, 2, 259, 260);
+    result = host.call("OT_PCE_SOBOL", eval);
+    for (RW i = 0; i < 3; ++i)
+        for (COL j = 0; j < 2; ++j)
+            if (!(std::fabs(resultNumber(result, i, j) - indices[i][j]) < 1e-10))
+                ++mismatches;
+    host.release(result);
+
+    // 9 points are not enough for the 10 terms of degree 2
+    args[0] = XllHost::makeRef(0, 8, 250, 252);
+    args[1] = XllHost::makeRef(0, 8, 253, 253);
+    XllHost::setCaller(0, 0, 261, 261);
+    result = host.call("OT_PCE_BUILD", args);
+    if (!result || (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) != xltypeErr)
+        ++mismatches;
+    host.release(result);
+
+    // x1 + x2^2 for x1 and x2 normal with mean 1 and standard deviation 2, of variance 4 + 48
+    for (RW i = 0; i < 500; ++i)
+    {
+        double z[2];
+        for (int j = 0; j < 2; ++j)
+        {
+            const double u = std::fmod(0.5 + i * (0.6180339887498949 + 0.2 * j), 1.0);
+            const double v = std::fmod(0.25 + i * (0.7548776662466927 + 0.1 * j), 1.0);
+            z[j] = 1.0 + 2.0 * std::sqrt(-2.0 * std::log(1.0 - u)) * std::cos(6.283185307179586 * v);
+            host.setNumber(i, 275 + j, z[j]);
+        }
+        host.setNumber(i, 277, z[0] + z[1] * z[1]);
+    }
+    for (RW j = 0; j < 2; ++j)
+    {
+        host.setString(j, 278, "Normal");
+        host.setNumber(j, 279, 1.0);
+        host.setNumber(j, 280, 2.0);
+    }
+    args[0] = XllHost::makeRef(0, 499, 275, 276);
+    args[1] = XllHost::makeRef(0, 499, 277, 277);
+    args[3] = XllHost::makeRef(0, 1, 278, 280);
+    XllHost::setCaller(0, 0, 281, 281);
+    result = host.call("OT_PCE_BUILD", args);
+    host.setString(0, 281, resultString(result));
+    host.release(result);
+    eval[0] = XllHost::makeRef(0, 0, 281, 281);
+    XllHost::setCaller(0, 1, 282, 283);
+    result = host.call("OT_PCE_SOBOL", eval);
+    const double normal[2] = { 4.0 / 52, 48.0 / 52 };
+    for (RW i = 0; i < 2; ++i)
+        for (COL j = 0; j < 2; ++j)
+            if (!(std::fabs(resultNumber(result, i, j) - normal[i]) < 1e-10))
+                ++mismatches;
+    host.release(result);
+    for (RW i = 0; i < 100; ++i)
+        for (int j = 0; j < 2; ++j)
+            host.setNumber(i, 282 + j, 1.0 + 6.0 * std::sin(2.0 + i * (j + 0.5)));
+    eval.push_back(XllHost::makeRef(0, 99, 282, 283));
+    XllHost::setCaller(0, 99, 284, 284);
+    result = host.call("OT_PCE_EVAL", eval);
+    for (RW i = 0; i < 100; ++i)
+    {
+        const double x1 = 1.0 + 6.0 * std::sin(2.0 + i * 0.5), x2 = 1.0 + 6.0 * std::sin(2.0 + i * 1.5);
+        if (!(std::fabs(resultNumber(result, i, 0) - (x1 + x2 * x2)) < 1e-9))
+            ++mismatches;
+    }
+    host.release(result);
+
+    // A logistic input, whose values are only approximated by polynomials of degree 5
+    std::vector<double> logistic(500);
+    for (RW i = 0; i < 500; ++i)
+    {
+        const double u = (i + 0.5) / 500;
+        logistic[i] = std::log(u / (1.0 - u));
+        host.setNumber(i, 285, logistic[i]);
+    }
+    host.setString(0, 286, "Logistic");
+    host.setNumber(0, 287, 0.0);
+    host.setNumber(0, 288, 1.0);
+    args[0] = XllHost::makeRef(0, 499, 285, 285);
+    args[1] = XllHost::makeRef(0, 499, 285, 285);
+    args[2] = XllHost::makeNum(5);
+    args[3] = XllHost::makeRef(0, 0, 286, 288);
+    XllHost::setCaller(0, 0, 289, 289);
+    result = host.call("OT_PCE_BUILD", args);
+    if (resultString(result).empty())
+        ++mismatches;
+    host.setString(0, 289, resultString(result));
+    host.release(result);
+    eval[0] = XllHost::makeRef(0, 0, 289, 289);
+    eval[1] = XllHost::makeRef(0, 499, 285, 285);
+    XllHost::setCaller(0, 499, 290, 290);
+    result = host.call("OT_PCE_EVAL", eval);
+    for (RW i = 0; i < 500; ++i)
+        if (!(std::fabs(resultNumber(result, i, 0) - logistic[i]) < 1e-2))
+            ++mismatches;
+    host.release(result);
+
+    printf("chaos: %s evaluated at %d points in %.3f ms, %d mismatches\n", handle.c_str(), (int) count,
+           1e3 * elapsed, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+/*
+ * Estimate the Sobol indices of the model of the chaos scenario, for
+ * inputs uniform on [-1, 1] in IC1:IE3: from the expansion in IU1, on
+ * Sobol designs of 65536 points, which must be close to the exact ones and
+ * reproducible; then from the values of the model on random designs in
+ * IF:IJ, and with a value which is not a number.
+ */
+int sensitivity(XllHost & host)
+{
+    int mismatches = 0;
+    const double variance = 4.0 / 3 + 4.0 / 45 + 1.0 / 36;
+    const double indices[3][2] = { { 4.0 / 3 / variance, (4.0 / 3 + 1.0 / 36) / variance },
+                                   { 4.0 / 45 / variance, 4.0 / 45 / variance },
+                                   { 0.0, 1.0 / 36 / variance } };
+    for (RW j = 0; j < 3; ++j)
+    {
+        host.setString(j, 262, "Uniform");
+        host.setNumber(j, 263, -1.0);
+        host.setNumber(j, 264, 1.0);
+    }
+    std::vector<XLOPER12> args(4);
+    args[0] = XllHost::makeRef(0, 2, 262, 264);
+    args[1] = XllHost::makeRef(0, 0, 254, 254);
+    args[2] = XllHost::makeNum(65536);
+    args[3] = XllHost::makeNum(3);
+    XllHost::setCaller(0, 2, 270, 271);
+    std::vector<double> first, second;
+    LPXLOPER12 result = host.call("OT_SOBOL_INDICES", args);
+    getValues(result, first);
+    for (RW i = 0; i < 3; ++i)
+        for (COL j = 0; j < 2; ++j)
+            if (!(std::fabs(resultNumber(result, i, j) - indices[i][j]) < 5e-3))
+                ++mismatches;
+    host.release(result);
+    result = host.call("OT_SOBOL_INDICES", args);
+    getValues(result, second);
+    host.release(result);
+    if (first.size() != 6 || first != second)
+        ++mismatches;
+
+    // Values of the model on A, B and each C_i
+    const RW size = 50000;
+    std::mt19937_64 generator(11);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    for (RW r = 0; r < size; ++r)
+    {
+        double a[3], b[3], c[3];
+        for (int j = 0; j < 3; ++j)
+        {
+            a[j] = uniform(generator);
+            b[j] = uniform(generator);
+        }
+        host.setNumber(r, 265, chaosModel(a));
+        host.setNumber(r, 266, chaosModel(b));
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+                c[j] = j == i ? b[j] : a[j];
+            host.setNumber(r, 267 + i, chaosModel(c));
+        }
+    }
+    args[0] = XllHost::makeMissing();
+    args[1] = XllHost::makeRef(0, size - 1, 265, 269);
+    args[2] = XllHost::makeMissing();
+    args[3] = XllHost::makeMissing();
+    result = host.call("OT_SOBOL_INDICES", args);
+    for (RW i = 0; i < 3; ++i)
+        for (COL j = 0; j < 2; ++j)
+            if (!(std::fabs(resultNumber(result, i, j) - indices[i][j]) < 3e-2))
+                ++mismatches;
+    host.release(result);
+    host.setString(size / 2, 267, "x");
+    result = host.call("OT_SOBOL_INDICES", args);
+    if (!result || (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) != xltypeErr)
+        ++mismatches;
+    host.release(result);
+
+    printf("sensitivity: indices of 3 inputs from the PCE and %d rows of values, %d mismatches\n", (int) size,
+           mismatches);
+    return mismatches ? 1 : 0;
+}
+
+} // empty namespace
+
+int
+main(int argc, char ** argv)
+{
+    int iterations = 1000;
+    int rows = 1000;
+    int threads = 0;
+    std::string only;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; ++i)
+    {
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 2;
+        }
+        if (!strcmp(argv[i], "-n"))
+            iterations = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-r"))
+            rows = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-f"))
+            only = argv[++i];
+        else if (!strcmp(argv[i], "-t"))
+            threads = atoi(argv[++i]);
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (i + 1 != argc || iterations <= 0 || rows <= 0 || threads < 0)
+    {
+        usage();
+        return 2;
+    }
+
+    XllHost host;
+    if (!host.load(argv[i]))
+        return 1;
+    fillSheet(host, rows);
+
+    int status = 0;
+    std::vector<std::string> names;
+    const std::vector<XllFunction> & functions = host.getFunctions();
+    for (size_t f = 0; f < functions.size(); ++f)
+    {
+        const std::string & name = functions[f].functionText;
+        std::vector<XLOPER12> args;
+        if ((!only.empty() && name != only) || !prepareCall(name, rows, args))
+            continue;
+        names.push_back(name);
+        if (threads > 0)
+            continue;
+
+        int errors = 0;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; ++n)
+        {
+            LPXLOPER12 result = host.call(name, args);
+            if (!result || (result->xltype & ~(xlbitXLFree | xlbitDLLFree)) == xltypeErr)
+                ++errors;
+            host.release(result);
+        }
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%-26s %8d calls %10.3f us/call %s\n", name.c_str(), iterations, 1e6 * elapsed / iterations,
+               errors ? "ERRORS" : "ok");
+        if (errors)
+            status = 1;
+    }
+
+    if (threads > 0)
+        status = stress(host, names, rows, iterations, threads);
+
+    const std::string asyncName("OT_NORMAL_PDF_ARRAY_ASYNC");
+    if (host.findFunction(asyncName) && (only.empty() || only == asyncName) && cancellation(host, asyncName, rows, 64))
+        status = 1;
+
+    if (host.findFunction("OT_MAKE_DISTRIBUTION") && only.empty() && objects(host, rows))
+        status = 1;
+
+    if (host.findFunction("OT_MAKE_SAMPLE") && only.empty() && rows >= 4 && missing(host, rows))
+        status = 1;
+
+    if (host.findFunction("OT_NORMAL_PDF_ARRAY") && host.findFunction("OT_NORMAL_PDF") && only.empty() &&
+        broadcasting(host))
+        status = 1;
+
+    if (host.findFunction("OT_KERNEL_SMOOTHING_PDF") && only.empty() && kernelSmoothing(host))
+        status = 1;
+
+    if (host.findFunction("OT_DOE") && only.empty() && designs(host))
+        status = 1;
+
+    if (host.findFunction("OT_PCE_BUILD") && only.empty() && chaos(host))
+        status = 1;
+
+    // From the expansion of the chaos scenario
+    if (host.findFunction("OT_SOBOL_INDICES") && host.findFunction("OT_PCE_BUILD") && only.empty() &&
+        sensitivity(host))
+        status = 1;
+
+    if (host.findFunction("OT_FIT_BEST") && only.empty() && fitting(host))
+        status = 1;
+
+    // Temporary memory of the FRAMEWRK library (TempNum12, TempStr12...)
+    typedef size_t (*HIGHWATERPROC) (void);
+    HIGHWATERPROC highWater = (HIGHWATERPROC) host.getProcAddress("MTempMemoryHighWater");
+    if (highWater)
+        printf("temporary memory high-water mark: %lu bytes\n", (unsigned long) highWater());
+
+    // Usage of the distribution cache, a table of labels and values
+    if (host.findFunction("OT_CACHE_STATS"))
+    {
+        LPXLOPER12 stats = host.call("OT_CACHE_STATS", std::vector<XLOPER12>());
+        if (stats && (stats->xltype & ~(xlbitXLFree | xlbitDLLFree)) == xltypeMulti)
+        {
+            printf("distribution cache:");
+            for (int r = 0; r < stats->val.array.rows; ++r)
+            {
+                const XLOPER12 * row = stats->val.array.lparray + r * stats->val.array.columns;
+                if (row[0].xltype != xltypeStr || row[1].xltype != xltypeNum)
+                    continue;
+                printf("%s ", r ? "," : "");
+                for (int c = 1; c <= row[0].val.str[0]; ++c)
+                    putchar(tolower((char) row[0].val.str[c]));
+                printf(" %.0f", row[1].val.num);
+            }
+            printf("\n");
+        }
+        host.release(stats);
+    }
+
+    host.unload();
+    // Results of calls abandoned by the cancellation, which Excel refuses
+    printf("late asynchronous results: %d\n", host.getLateReturns());
+    return status;
+}
@@ -0,0 +1,631 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <framewrk.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <OT.hxx>
+#include "xll_helper_functions.h"
+#include "ot_marshal.h"
+#include "ot_functions.h"
+#include "xll_profile.h"
+#include "ot_chaos.h"
+#include "ot_object_store.h"
+#include "xll_thread_pool.h"
+#include "xll_result_pool.h"
+
+namespace {
+
+// Points of the fit the packed expansion is checked on against the metamodel of OpenTURNS
+#define CHAOS_CHECK_POINTS 16
+
+// Add a term from its multi-index, keeping the variables of non-zero degree
+void addTerm(StoredChaos & chaos, const OT::Indices & index)
+{
+    for (size_t j = 0; j < index.getSize(); ++j)
+    {
+        if (index[j] > 0)
+        {
+            chaos.variables.push_back((unsigned short) j);
+            chaos.degrees.push_back((unsigned char) index[j]);
+        }
+    }
+    chaos.offsets.push_back((unsigned int) chaos.variables.size());
+}
+
+/*
+ * Polynomials of degree 0 to the degree of the expansion, of each
+ * variable, at rows points x: the value of degree k of variable j at point
+ * b is table[(j * (degree + 1) + k) * CHAOS_BLOCK + b].  May throw for the
+ * marginals which are not mapped to their measure by an affine function.
+ */
+void tabulatePolynomials(const StoredChaos & chaos, const double * x, size_t rows, double * table)
+{
+    const int d = chaos.dimension;
+    const int p = chaos.degree;
+    double z[CHAOS_BLOCK];
+    for (int j = 0; j < d; ++j)
+    {
+        if (chaos.affine[j])
+        {
+            for (size_t b = 0; b < rows; ++b)
+            {
+                z[b] = (x[b * d + j] - chaos.shift[j]) * chaos.scale[j];
+            }
+        }
+        else
+        {
+            for (size_t b = 0; b < rows; ++b)
+            {
+                z[b] = chaos.measures[j].computeQuantile(chaos.marginals[j].computeCDF(x[b * d + j]))[0];
+            }
+        }
+        double * values = table + (size_t) j * (p + 1) * CHAOS_BLOCK;
+        std::fill(values, values + rows, 1.0);
+        for (int k = 0; k < p; ++k)
+        {
+            const double * r = &chaos.recurrence[3 * ((size_t) j * p + k)];
+            double * next = values + (k + 1) * CHAOS_BLOCK;
+            const double * current = values + k * CHAOS_BLOCK;
+            for (size_t b = 0; b < rows; ++b)
+            {
+                next[b] = (r[0] * z[b] + r[1]) * current[b];
+            }
+            if (k > 0)
+            {
+                const double * previous = current - CHAOS_BLOCK;
+                for (size_t b = 0; b < rows; ++b)
+                {
+                    next[b] += r[2] * previous[b];
+                }
+            }
+        }
+    }
+}
+
+// Values of term t of the expansion, without its coefficient, at rows points of a table
+inline void termValues(const StoredChaos & chaos, size_t t, const double * table, size_t rows, double * values)
+{
+    const size_t stride = (size_t) (chaos.degree + 1) * CHAOS_BLOCK;
+    const unsigned int begin = chaos.offsets[t];
+    const unsigned int end = chaos.offsets[t + 1];
+    if (begin == end)
+    {
+        std::fill(values, values + rows, 1.0);
+        return;
+    }
+    const double * factor = table + chaos.variables[begin] * stride + chaos.degrees[begin] * CHAOS_BLOCK;
+    std::copy(factor, factor + rows, values);
+    for (unsigned int f = begin + 1; f < end; ++f)
+    {
+        factor = table + chaos.variables[f] * stride + chaos.degrees[f] * CHAOS_BLOCK;
+        for (size_t b = 0; b < rows; ++b)
+        {
+            values[b] *= factor[b];
+        }
+    }
+}
+
+// State shared by the threads of OT_PCE_EVAL
+struct ChaosEvaluation
+{
+    const StoredChaos * chaos;
+    const double * x;
+    LPXLOPER12 cells;
+    // 1 if a marginal could not be mapped to its measure
+    volatile LONG failed;
+};
+
+// Values of points [begin, end), for parallel_for
+void evaluateChunk(void * context, size_t begin, size_t end)
+{
+    ChaosEvaluation & evaluation = *static_cast<ChaosEvaluation *>(context);
+    std::vector<double> y(end - begin);
+    try
+    {
+        chaos_evaluate(*evaluation.chaos, evaluation.x + begin * evaluation.chaos->dimension, &y[0], end - begin);
+    }
+    catch(...)
+    {
+        // parallel_for procs must not throw, the values are dropped
+        InterlockedExchange(&evaluation.failed, 1);
+        return;
+    }
+    LPXLOPER12 px = evaluation.cells + begin;
+    for (size_t i = 0; i < y.size(); ++i, ++px)
+    {
+        px->xltype = xltypeNum;
+        px->val.num = y[i];
+    }
+}
+
+/*
+ * Read the points of OT_PCE_BUILD and OT_PCE_EVAL: either the handle of
+ * an OT_MAKE_SAMPLE cell, or a range with one point per row, which is
+ * hashed into inputs if it is given.  Returns NULL on success, the error
+ * to return otherwise.
+ */
+LPXLOPER12 coerceChaosSample(const std::string & prefix, const char * argument, LPXLOPER12 xl_oper,
+                             OT::NumericalSample & sample, ObjectInputs * inputs)
+{
+    std::string handle;
+    RW rows = 0;
+    COL columns = 0;
+    int error = -1;
+
+    if (getObjectHandle(xl_oper, handle))
+    {
+        if (!findSample(handle, sample))
+        {
+            return dialogError(prefix + "Unknown sample '" + handle + "'", xlerrValue);
+        }
+        if (inputs)
+        {
+            addObjectHandle(*inputs, handle);
+        }
+        return NULL;
+    }
+    if((error = get_range_shape(xl_oper, &rows, &columns)) != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeMulti for argument '" + argument + "'", error);
+    }
+    // Read by blocks straight into the sample, see read_range
+    error = range_to_sample(xl_oper, CELLS_ERROR, rows, columns, sample, inputs ? &inputs->hash : NULL);
+    if (error != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeNum for argument '" + argument + "'", error);
+    }
+    return NULL;
+}
+
+// Expansion of a handle, NULL on success, the error to return otherwise
+LPXLOPER12 coerceChaos(const std::string & prefix, LPXLOPER12 xl_handle, StoredChaos & chaos)
+{
+    std::string handle;
+    if (!getObjectHandle(xl_handle, handle))
+    {
+        return dialogError(prefix + "Invalid argument 'handle', expected the handle of an OT_PCE_BUILD cell", xlerrValue);
+    }
+    if (!findChaos(handle, chaos))
+    {
+        return dialogError(prefix + "Unknown PCE '" + handle + "'", xlerrValue);
+    }
+    return NULL;
+}
+
+} // empty namespace
+
+/*********************************************************************
+**  chaos_terms()
+**
+**  Purpose :
+**      count the terms of an expansion, binomial(dimension + degree,
+**      degree), which is exact at each step of the product below.
+**
+**  Returns :
+**        the number of terms, 0 if there are more than CHAOS_MAX_TERMS
+**********************************************************************/
+size_t
+chaos_terms(int dimension, int degree)
+{
+    size_t terms = 1;
+    for (int k = 1; k <= degree; ++k)
+    {
+        terms = terms * (dimension + k) / k;
+        if (terms > CHAOS_MAX_TERMS)
+        {
+            return 0;
+        }
+    }
+    return terms;
+}
+
+/*********************************************************************
+**  chaos_build()
+**
+**  Purpose :
+**      fit an expansion with OT::FunctionalChaosAlgorithm, see
+**      ot_chaos.h, and pack its result for chaos_evaluate, which is
+**      checked against the metamodel of OpenTURNS.
+**
+**  Parameters:
+**
+**        x         : points, at least as many as terms
+**        y         : their values, of dimension 1
+**        marginals : a DesignMarginal per input, see coerceMarginals
+**        degree    : total degree of the expansion
+**        chaos     : StoredChaos, set by this function
+**********************************************************************/
+void
+chaos_build(const OT::NumericalSample & x, const OT::NumericalSample & y,
+            const std::vector<DesignMarginal> & marginals, int degree, StoredChaos & chaos)
+{
+    const int dimension = (int) x.getDimension();
+    const size_t size = x.getSize();
+    const size_t terms = chaos_terms(dimension, degree);
+    if (terms == 0 || degree > CHAOS_MAX_DEGREE)
+    {
+        throw std::invalid_argument("The expansion would have too many terms, lower the degree");
+    }
+    if (size < terms)
+    {
+        char message[128];
+        sprintf(message, "There must be at least %lu points for this degree", (unsigned long) terms);
+        throw std::invalid_argument(message);
+    }
+
+    // Fit on the basis of the marginals
+    //==================================
+    OT::ComposedDistribution::DistributionCollection collection(dimension);
+    OT::OrthogonalProductPolynomialFactory::PolynomialFamilyCollection polynomials(dimension);
+    for (int j = 0; j < dimension; ++j)
+    {
+        collection[j] = marginals[j].distribution;
+        polynomials[j] = OT::StandardDistributionPolynomialFactory(collection[j]);
+    }
+    const OT::LinearEnumerateFunction enumerate(dimension);
+    const OT::OrthogonalProductPolynomialFactory basis(polynomials, enumerate);
+    OT::FunctionalChaosAlgorithm algorithm(x, y, OT::ComposedDistribution(collection),
+                                           OT::FixedStrategy(basis, terms), OT::LeastSquaresStrategy());
+    algorithm.run();
+    const OT::FunctionalChaosResult result(algorithm.getResult());
+
+    // Pack the result
+    //================
+    chaos.dimension = dimension;
+    chaos.degree = degree;
+    for (int j = 0; j < dimension; ++j)
+    {
+        // Uniform and normal marginals have a measure of their family, mapped by matching their moments
+        const OT::Distribution measure(polynomials[j].getMeasure());
+        const bool affine = marginals[j].uniform || marginals[j].family == DISTRIBUTION_NORMAL;
+        const double scale = measure.getStandardDeviation()[0] / collection[j].getStandardDeviation()[0];
+        chaos.affine.push_back(affine);
+        chaos.scale.push_back(scale);
+        chaos.shift.push_back(collection[j].getMean()[0] - measure.getMean()[0] / scale);
+        chaos.marginals.push_back(collection[j]);
+        chaos.measures.push_back(measure);
+        for (int k = 0; k < degree; ++k)
+        {
+            const OT::NumericalPoint recurrence(polynomials[j].getRecurrenceCoefficients(k));
+            chaos.recurrence.insert(chaos.recurrence.end(), recurrence.begin(), recurrence.begin() + 3);
+        }
+    }
+    const OT::NumericalSample coefficients(result.getCoefficients());
+    const OT::Indices indices(result.getIndices());
+    chaos.offsets.assign(1, 0);
+    for (size_t t = 0; t < indices.getSize(); ++t)
+    {
+        chaos.coefficients.push_back(coefficients(t, 0));
+        addTerm(chaos, enumerate(indices[t]));
+    }
+    const OT::FunctionalChaosRandomVector vector(result);
+    for (int j = 0; j < dimension; ++j)
+    {
+        chaos.first.push_back(vector.getSobolIndex(j));
+        chaos.total.push_back(vector.getSobolTotalIndex(j));
+    }
+
+    // Check the packing on points spread over the fit
+    //================================================
+    const size_t count = std::min((size_t) CHAOS_CHECK_POINTS, size);
+    OT::NumericalSample points(count, dimension);
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (int j = 0; j < dimension; ++j)
+        {
+            points(i, j) = x(i * size / count, j);
+        }
+    }
+    const OT::NumericalSample expected(result.getMetaModel()(points));
+    std::vector<double> values(count);
+    chaos_evaluate(chaos, &points(0, 0), &values[0], count);
+    double magnitude = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        magnitude = std::max(magnitude, std::fabs(expected(i, 0)));
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!(std::fabs(values[i] - expected(i, 0)) <= 1e-8 * magnitude + DBL_MIN))
+        {
+            throw std::runtime_error("The expansion cannot be evaluated for these marginals");
+        }
+    }
+}
+
+/*********************************************************************
+**  chaos_evaluate()
+**
+**  Purpose :
+**      evaluate an expansion at n points, CHAOS_BLOCK points at a time:
+**      the polynomials of the block are tabulated, then each term adds
+**      its coefficient times the product of its factors.
+**
+**  Parameters:
+**
+**        chaos : StoredChaos
+**        x     : n points of its dimension, row by row
+**        y     : n values, set by this function
+**        n     : number of points
+**********************************************************************/
+void
+chaos_evaluate(const StoredChaos & chaos, const double * x, double * y, size_t n)
+{
+    const size_t terms = chaos.coefficients.size();
+    std::vector<double> table((size_t) chaos.dimension * (chaos.degree + 1) * CHAOS_BLOCK);
+    double values[CHAOS_BLOCK];
+    for (size_t i = 0; i < n; i += CHAOS_BLOCK)
+    {
+        const size_t rows = std::min((size_t) CHAOS_BLOCK, n - i);
+        tabulatePolynomials(chaos, x + i * chaos.dimension, rows, &table[0]);
+        double * block = y + i;
+        std::fill(block, block + rows, 0.0);
+        for (size_t t = 0; t < terms; ++t)
+        {
+            const double c = chaos.coefficients[t];
+            termValues(chaos, t, &table[0], rows, values);
+            for (size_t b = 0; b < rows; ++b)
+            {
+                block[b] += c * values[b];
+            }
+        }
+    }
+}
+
+/***********************************************************************************
+ OT_PCE_BUILD()
+
+ Purpose:
+
+      This function takes 4 arguments and fits a polynomial chaos
+      expansion of the given degree on points and their values, for
+      independent inputs of the given marginals, see ot_chaos.h.  The
+      expansion is stored, and other cells evaluate it or get its Sobol
+      indices through its handle.  It is only fitted again when the
+      content of its arguments changes.
+
+ Parameters:
+
+      LPXLOPER12      4 arguments : xl_x, xl_y, xl_degree, xl_marginals
+                      xl_x is a range with one point per row, and one
+                      column per input, or the handle of an OT_MAKE_SAMPLE
+                      cell;
+                      xl_y is a single column with the value at each
+                      point, or the handle of an OT_MAKE_SAMPLE cell of
+                      dimension 1;
+                      xl_degree is the total degree of the expansion;
+                      xl_marginals is the distribution of the inputs, as
+                      for OT_DOE, with one row per input
+
+ Returns:
+
+      LPXLOPER12      the handle of the expansion, like "PCE#14", the same
+                      as on the previous call if the arguments did not
+                      change, or #VALUE! if there are non-numerics in the
+                      supplied arguments.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_PCE_BUILD(LPXLOPER12 xl_x, LPXLOPER12 xl_y, LPXLOPER12 xl_degree, LPXLOPER12 xl_marginals)
+{
+    const std::string prefix = "(OT_PCE_BUILD): ";
+    OT::NumericalSample x, y;
+    std::vector<DesignMarginal> marginals;
+    ObjectInputs inputs;
+    std::string handle;
+    int degree = 0;
+    int error = -1;
+    XLL_PROFILE_START();
+
+    // Coerce the points, their values, the degree and the marginals
+    //===============================================================
+    LPXLOPER12 xError = coerceChaosSample(prefix, "x", xl_x, x, &inputs);
+    if (xError)
+    {
+        return xError;
+    }
+    if ((xError = coerceChaosSample(prefix, "y", xl_y, y, &inputs)))
+    {
+        return xError;
+    }
+    if (y.getDimension() != 1)
+    {
+        return dialogError(prefix + "Invalid argument 'y', there must be a single column", xlerrValue);
+    }
+    if (x.getSize() == 0)
+    {
+        return dialogError(prefix + "Invalid argument 'x', it is empty", xlerrValue);
+    }
+    if (x.getSize() != y.getSize())
+    {
+        return dialogError(prefix + "Invalid arguments, 'x' and 'y' must have the same number of rows", xlerrValue);
+    }
+    if((error = xloper_to_int(xl_degree, &degree)) != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeInt for argument 'degree'", error);
+    }
+    if (degree < 0 || degree > CHAOS_MAX_DEGREE)
+    {
+        return dialogError(prefix + "The degree must be an integer between 0 and 30", xlerrNum);
+    }
+    XLOPER12 xl_int;
+    xl_int.xltype = xltypeInt;
+    xl_int.val.w = degree;
+    inputs.hash = hash_xloper(xl_int, inputs.hash);
+    if ((xError = coerceMarginals(prefix, xl_marginals, marginals, &inputs)))
+    {
+        return xError;
+    }
+    if (marginals.size() != x.getDimension())
+    {
+        return dialogError(prefix + "Invalid argument 'marginals', there must be one per column of 'x'", xlerrValue);
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_SAMPLE);
+
+    // The expansion is not fitted again if the arguments did not change
+    if (findUnchangedObject(OBJECT_CHAOS, inputs, handle))
+    {
+        return handle_to_result(handle);
+    }
+
+    //Fit the expansion
+    //=================
+    StoredChaos chaos;
+    try
+    {
+        chaos_build(x, y, marginals, degree, chaos);
+        XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
+    }
+    catch(std::exception & e)
+    {
+        return dialogError(prefix + e.what(), xlerrValue);
+    }
+    return handle_to_result(storeChaos(chaos, inputs));
+}
+
+/***********************************************************************************
+ OT_PCE_EVAL()
+
+ Purpose:
+
+      This function takes 2 arguments and evaluates a polynomial chaos
+      expansion at given points, in a batched loop over its packed
+      coefficients, see chaos_evaluate; large ranges are split over the
+      threads of the add-in.
+
+ Parameters:
+
+      LPXLOPER12      2 arguments : xl_handle, xl_points
+                      xl_handle is the handle of an OT_PCE_BUILD cell;
+                      xl_points is a range with one point per row, and one
+                      column per input, or the handle of an OT_MAKE_SAMPLE
+                      cell
+
+ Returns:
+
+      LPXLOPER12      the value of the expansion at each point, as a
+                      column, or #VALUE! if there are non-numerics in the
+                      supplied arguments.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_PCE_EVAL(LPXLOPER12 xl_handle, LPXLOPER12 xl_points)
+{
+    const std::string prefix = "(OT_PCE_EVAL): ";
+    OT::NumericalSample points;
+    StoredChaos chaos;
+    XLL_PROFILE_START();
+
+    // Coerce the expansion and the points
+    //====================================
+    LPXLOPER12 xError = coerceChaos(prefix, xl_handle, chaos);
+    if (xError)
+    {
+        return xError;
+    }
+    if ((xError = coerceChaosSample(prefix, "points", xl_points, points, NULL)))
+    {
+        return xError;
+    }
+    const size_t size = points.getSize();
+    if (size > 0 && (int) points.getDimension() != chaos.dimension)
+    {
+        return dialogError(prefix + "Invalid argument 'points', there must be one column per input of the PCE", xlerrValue);
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_SAMPLE);
+
+    // Evaluate straight into the cells of the result
+    //===============================================
+    LPXLOPER12 xResult = new_multi((RW) size, 1);
+    if (!xResult || size == 0)
+    {
+        return xResult;
+    }
+    ChaosEvaluation evaluation;
+    evaluation.chaos = &chaos;
+    evaluation.x = &points(0, 0);
+    evaluation.cells = xResult->val.array.lparray;
+    evaluation.failed = 0;
+    parallel_for(size, &evaluateChunk, &evaluation);
+    if (evaluation.failed)
+    {
+        free_result(xResult);
+        return dialogError(prefix + "The points cannot be mapped to the polynomials of the marginals", xlerrValue);
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
+    return xResult;
+}
+
+/***********************************************************************************
+ OT_PCE_SOBOL()
+
+ Purpose:
+
+      This function takes 1 argument and returns the Sobol indices of
+      the inputs of a polynomial chaos expansion, which OpenTURNS computed
+      from its coefficients when it was built.
+
+ Parameters:
+
+      LPXLOPER12      1 argument : xl_handle
+                      xl_handle is the handle of an OT_PCE_BUILD cell
+
+ Returns:
+
+      LPXLOPER12      one row per input, with its first order index and
+                      its total index, or #VALUE! if the handle is unknown.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_PCE_SOBOL(LPXLOPER12 xl_handle)
+{
+    const std::string prefix = "(OT_PCE_SOBOL): ";
+    StoredChaos chaos;
+
+    LPXLOPER12 xError = coerceChaos(prefix, xl_handle, chaos);
+    if (xError)
+    {
+        return xError;
+    }
+    LPXLOPER12 xResult = new_multi((RW) chaos.dimension, 2);
+    if (!xResult)
+    {
+        return NULL;
+    }
+    LPXLOPER12 px = xResult->val.array.lparray;
+    for (int j = 0; j < chaos.dimension; ++j, px += 2)
+    {
+        px[0].xltype = xltypeNum;
+        px[0].val.num = chaos.first[j];
+        px[1].xltype = xltypeNum;
+        px[1].val.num = chaos.total[j];
+    }
+    return xResult;
+}
@@ -0,0 +1,71 @@
+#ifndef __OT_CHAOS_H
+#define __OT_CHAOS_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <OT.hxx>
+#include "ot_doe.h"
+
+/*
+ * Polynomial chaos expansion of OT_PCE_BUILD, fitted by least squares by
+ * OT::FunctionalChaosAlgorithm for independent inputs of given marginals,
+ * with all the multi-indices of total degree up to the degree of the
+ * expansion.  The polynomials of each input are orthonormal for the
+ * measure chosen by OT::StandardDistributionPolynomialFactory, so that
+ *
+ *     y(x) = sum_t c_t prod_j P_j,(a_tj)(T_j(x_j))
+ *
+ * where T_j maps marginal j to that measure and a_t is the multi-index of
+ * term t.  The Sobol indices of the inputs are computed by OpenTURNS when
+ * the expansion is built.
+ *
+ * The result of OpenTURNS is only packed for chaos_evaluate: T_j is affine
+ * for uniform and normal marginals, and the quantile of the measure at the
+ * CDF of the marginal otherwise; the polynomials follow from their
+ * recurrence coefficients.  A term only stores the variables of non-zero
+ * degree, at most the degree of the expansion, packed with those of the
+ * other terms: the evaluation tabulates the polynomials of CHAOS_BLOCK
+ * points at once, then adds the terms one after the other, with inner
+ * loops over the points of the block.  The packing is checked against the
+ * metamodel of OpenTURNS on a few points of the fit.
+ */
+
+#define CHAOS_MAX_TERMS 1000
+#define CHAOS_MAX_DEGREE 30
+#define CHAOS_BLOCK 64
+
+struct StoredChaos
+{
+    StoredChaos() : dimension(0), degree(0) {}
+
+    int dimension;
+    int degree;
+    /* T_j(x) = (x - shift[j]) * scale[j] if affine[j], the quantile of measures[j] at the CDF of marginals[j] otherwise */
+    std::vector<char> affine;
+    std::vector<double> shift;
+    std::vector<double> scale;
+    std::vector<OT::Distribution> marginals;
+    std::vector<OT::Distribution> measures;
+    /* P_(k+1) = (a_k z + b_k) P_k + c_k P_(k-1): a_k, b_k, c_k of input j at recurrence[3 * (j * degree + k)] */
+    std::vector<double> recurrence;
+    /* Coefficient of each term */
+    std::vector<double> coefficients;
+    /* Factors of term t are [offsets[t], offsets[t + 1]), with its variables and their degrees */
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned short> variables;
+    std::vector<unsigned char> degrees;
+    /* First order and total Sobol indices of each input */
+    std::vector<double> first;
+    std::vector<double> total;
+};
+
+/* Number of terms of total degree up to degree in dimension variables, 0 above CHAOS_MAX_TERMS */
+size_t chaos_terms(int dimension, int degree);
+/* Fit an expansion on the points x and their values y, for inputs of the given marginals; throws */
+void chaos_build(const OT::NumericalSample & x, const OT::NumericalSample & y,
+                 const std::vector<DesignMarginal> & marginals, int degree, StoredChaos & chaos);
+/* y[i] = value of the expansion at point i of x, row by row; may throw for other marginals than uniform and normal ones */
+void chaos_evaluate(const StoredChaos & chaos, const double * x, double * y, size_t n);
+
+#endif // __OT_CHAOS_H
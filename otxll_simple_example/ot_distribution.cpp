@@ -0,0 +1,555 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <framewrk.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <OT.hxx>
+#include "xll_helper_functions.h"
+#include "ot_marshal.h"
+#include "ot_functions.h"
+#include "xll_profile.h"
+#include "ot_distribution_cache.h"
+#include "ot_object_store.h"
+#include "ot_normal_kernel.h"
+#include "xll_thread_pool.h"
+#include "xll_random.h"
+#include "xll_result_pool.h"
+
+namespace {
+
+// What the OT_DIST_* functions compute for each point
+enum DistributionFunction
+{
+    FUNCTION_PDF = 0,
+    FUNCTION_LOGPDF,
+    FUNCTION_CDF,
+    FUNCTION_QUANTILE
+};
+
+// Kernels of the normal distribution, indexed by DistributionFunction
+const NormalKernelProc normalKernels[4] = { &normal_pdf, &normal_log_pdf, &normal_cdf, NULL };
+
+/*
+ * Get the distribution of the OT_DIST_* functions: either a handle made by
+ * OT_MAKE_DISTRIBUTION, parameters being then ignored, or a name and its
+ * parameters, the distribution coming from the cache.  The handle, or the
+ * family and parameters, are added to inputs if it is not NULL.  Returns
+ * NULL on success, the error to return to Excel otherwise.
+ */
+LPXLOPER12 coerceDistribution(const std::string & prefix, LPXLOPER12 xl_name, LPXLOPER12 xl_parameters,
+                              StoredDistribution & distribution, ObjectInputs * inputs = NULL)
+{
+    std::string name;
+    OT::NumericalSample parameters;
+    RW rows = 0;
+    COL columns = 0;
+    int error = -1;
+
+    // Look up a handle
+    //=================
+    if (getObjectHandle(xl_name, name))
+    {
+        if (!findDistribution(name, distribution))
+        {
+            return dialogError(prefix + "Unknown distribution '" + name + "'", xlerrValue);
+        }
+        if (inputs)
+        {
+            addObjectHandle(*inputs, name);
+        }
+        return NULL;
+    }
+
+    // Coerce the name of the distribution
+    //====================================
+    if((error = xloper_to_string(xl_name, &name)) != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeStr for argument 'name'", error);
+    }
+    if(!findDistributionFamily(name, distribution.family))
+    {
+        return dialogError(prefix + "Unknown distribution '" + name + "'", xlerrValue);
+    }
+
+    // Coerce the parameters, a range of any shape
+    //============================================
+    if((error = get_range_shape(xl_parameters, &rows, &columns)) != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeMulti for argument 'parameters'", error);
+    }
+    if ((size_t) rows * columns > DISTRIBUTION_MAX_PARAMETERS)
+    {
+        return dialogError(prefix + "Too many parameters for a " + getDistributionName(distribution.family) + " distribution", xlerrValue);
+    }
+    if((error = range_to_values(xl_parameters, parameters, &rows, &columns, inputs ? &inputs->hash : NULL)) != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeNum for argument 'parameters'", error);
+    }
+    distribution.count = (int) parameters.getSize();
+    for (int i = 0; i < DISTRIBUTION_MAX_PARAMETERS; ++i)
+    {
+        distribution.parameters[i] = i < distribution.count ? parameters(i, 0) : 0.0;
+    }
+    if (inputs)
+    {
+        // The family rather than the name, whose case does not matter
+        XLOPER12 family;
+        family.xltype = xltypeInt;
+        family.val.w = distribution.family;
+        inputs->hash = hash_xloper(family, inputs->hash);
+    }
+
+    // Parameters are checked by OpenTURNS
+    //====================================
+    try
+    {
+        distribution.distribution = getDistribution(distribution.family, distribution.parameters, distribution.count);
+    }
+    catch(OT::Exception & e)
+    {
+        return dialogError(e.what(), xlerrValue);
+    }
+    catch(std::exception & e)
+    {
+        return dialogError(e.what(), xlerrValue);
+    }
+    return NULL;
+}
+
+/*
+ * Body of the OT_DIST_* functions: coerce the name, parameters and points,
+ * get the distribution from the cache, then evaluate it on each cell of
+ * points, in place.  The normal distribution goes through the kernels of
+ * ot_normal_kernel.h, other ones through the NumericalSample methods of
+ * OpenTURNS.  The result has the same shape as points.  Cells of points
+ * which are not numbers make the function fail, or give #N/A if the policy
+ * is "nan" or "skip", their values being left out of the computation.
+ */
+LPXLOPER12 evaluateDistribution(const char * functionName, DistributionFunction function,
+                                LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_points,
+                                LPXLOPER12 xl_missing)
+{
+    const std::string prefix = std::string("(") + functionName + "): ";
+    StoredDistribution stored;
+    std::string handle;
+    OT::NumericalSample values;
+    std::vector<DWORD> valid;
+    XllCellPolicy policy;
+    RW rows = 0;
+    COL columns = 1;
+    int error = -1;
+    XLL_PROFILE_START();
+
+    LPXLOPER12 xError = coerceDistribution(prefix, xl_name, xl_parameters, stored);
+    if (xError)
+    {
+        return xError;
+    }
+    if((error = xloper_to_policy(xl_missing, &policy)) != -1)
+    {
+        return dialogError(prefix + "Invalid argument 'missing', expected error, nan or skip", error);
+    }
+
+    // Coerce the points, values are then computed in place
+    //=====================================================
+    if (getObjectHandle(xl_points, handle))
+    {
+        // Sample made by OT_MAKE_SAMPLE, returned as a column
+        if (!findSample(handle, values) || values.getDimension() != 1)
+        {
+            return dialogError(prefix + "Unknown sample of dimension 1 '" + handle + "'", xlerrValue);
+        }
+        rows = (RW) values.getSize();
+        XLL_PROFILE_LAP(XLL_STAGE_COERCE);
+    }
+    else
+    {
+        // Read by blocks into the sample, rather than copied at once into an xltypeMulti
+        error = policy == CELLS_ERROR ? range_to_values(xl_points, values, &rows, &columns)
+                                      : range_to_values(xl_points, values, &rows, &columns, valid);
+        XLL_PROFILE_LAP(XLL_STAGE_COERCE);
+        if (error != -1)
+        {
+            return dialogError(prefix + "Invalid conversion to xltypeNum for argument 'points'", error);
+        }
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_SAMPLE);
+
+    //Compute the function on points
+    //==============================
+    try
+    {
+        const OT::Distribution & distribution = stored.distribution;
+        const size_t size = values.getSize();
+        if (size > 0 && stored.family == DISTRIBUTION_NORMAL && normalKernels[function])
+        {
+            normal_parallel(normalKernels[function], stored.parameters[0], stored.parameters[1],
+                            &values(0, 0), &values(0, 0), size);
+        }
+        else if (size > 0)
+        {
+            switch (function)
+            {
+            case FUNCTION_PDF:
+                values = distribution.computePDF(values);
+                break;
+            case FUNCTION_LOGPDF:
+                values = distribution.computeLogPDF(values);
+                break;
+            case FUNCTION_CDF:
+                values = distribution.computeCDF(values);
+                break;
+            case FUNCTION_QUANTILE:
+                for (size_t i = 0; i < size; ++i)
+                {
+                    const OT::NumericalScalar probability = values(i, 0);
+                    if (!(probability >= 0.0 && probability <= 1.0))
+                    {
+                        throw std::invalid_argument("Probabilities must be in [0, 1]");
+                    }
+                    values(i, 0) = distribution.computeQuantile(probability)[0];
+                }
+                break;
+            }
+        }
+        XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
+    }
+    catch(OT::Exception & e)
+    {
+        return dialogError(e.what(), xlerrValue);
+    }
+    catch(std::exception & e)
+    {
+        return dialogError(e.what(), xlerrValue);
+    }
+
+    // Fill results
+    //=============
+    LPXLOPER12 xResult = valid.empty() ? sample_to_multi(values, rows, columns)
+                                       : sample_to_multi(values, rows, columns, valid);
+    XLL_PROFILE_LAP(XLL_STAGE_RESULT);
+    return xResult;
+}
+
+// Blocks of a sample must not be split between the chunks of parallel_for
+#if PARALLEL_CHUNK % RANDOM_BLOCK != 0
+# error "PARALLEL_CHUNK must be a multiple of RANDOM_BLOCK"
+#endif
+
+// State shared by the threads which draw a sample, see drawSample
+struct SampleContext
+{
+    const OT::Distribution * distribution;
+    bool normal;
+    OT::NumericalScalar mu;
+    OT::NumericalScalar sigma;
+    uint64_t seed;
+    LPXLOPER12 cells;
+    volatile LONG failed;
+};
+
+/*
+ * Draw cells [begin, end) of a sample, begin being the start of a chunk of
+ * parallel_for and thus of a block.  Values of the normal distribution are
+ * drawn by pairs with the Box-Muller transform, values of other ones by
+ * inversion of their CDF.
+ */
+void drawSample(void * context, size_t begin, size_t end)
+{
+    SampleContext & sample = *static_cast<SampleContext *>(context);
+    for (size_t block = begin; block < end; block += RANDOM_BLOCK)
+    {
+        XllRandomStream stream(sample.seed, block / RANDOM_BLOCK);
+        const size_t blockEnd = std::min(end, block + RANDOM_BLOCK);
+        if (sample.normal)
+        {
+            for (size_t i = block; i < blockEnd; i += 2)
+            {
+                const double radius = sample.sigma * std::sqrt(-2.0 * std::log(stream.uniform()));
+                const double angle = 6.283185307179586 * stream.uniform();
+                sample.cells[i].xltype = xltypeNum;
+                sample.cells[i].val.num = sample.mu + radius * std::cos(angle);
+                if (i + 1 < blockEnd)
+                {
+                    sample.cells[i + 1].xltype = xltypeNum;
+                    sample.cells[i + 1].val.num = sample.mu + radius * std::sin(angle);
+                }
+            }
+            continue;
+        }
+        try
+        {
+            for (size_t i = block; i < blockEnd; ++i)
+            {
+                sample.cells[i].xltype = xltypeNum;
+                sample.cells[i].val.num = sample.distribution->computeQuantile(stream.uniform())[0];
+            }
+        }
+        catch(...)
+        {
+            // parallel_for procs must not throw, the whole sample is dropped
+            InterlockedExchange(&sample.failed, 1);
+            return;
+        }
+    }
+}
+
+} // empty namespace
+
+/***********************************************************************************
+ OT_DIST_PDF()
+
+ Purpose:
+
+      This function takes 4 arguments and computes the probability density
+      function of any distribution of ot_distribution_cache.h at given points.
+
+ Parameters:
+
+      LPXLOPER12      4 arguments : xl_name, xl_parameters, xl_points,
+                      xl_missing
+                      xl_name is the name of the distribution, like "Normal",
+                      xl_parameters a range of its parameters, xl_points a
+                      range of any shape.  xl_name may also be the handle of
+                      an OT_MAKE_DISTRIBUTION cell, xl_parameters is then
+                      ignored, and xl_points the handle of an OT_MAKE_SAMPLE
+                      cell.  xl_missing tells what to do with the cells of
+                      xl_points which are not numbers: "error" by default,
+                      "nan" or "skip" for #N/A in their place
+
+ Returns:
+
+      LPXLOPER12      the PDF at given points, with the same shape or as
+                      a column for a sample
+                      or #VALUE! if the name is unknown or if there are
+                      non-numerics in the supplied arguments.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_DIST_PDF(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_points, LPXLOPER12 xl_missing)
+{
+    return evaluateDistribution("OT_DIST_PDF", FUNCTION_PDF, xl_name, xl_parameters, xl_points, xl_missing);
+}
+
+/***********************************************************************************
+ OT_DIST_LOGPDF()
+
+ Purpose:
+
+      Same as OT_DIST_PDF, for the logarithm of the probability density function.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_DIST_LOGPDF(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_points, LPXLOPER12 xl_missing)
+{
+    return evaluateDistribution("OT_DIST_LOGPDF", FUNCTION_LOGPDF, xl_name, xl_parameters, xl_points, xl_missing);
+}
+
+/***********************************************************************************
+ OT_DIST_CDF()
+
+ Purpose:
+
+      Same as OT_DIST_PDF, for the cumulative distribution function.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_DIST_CDF(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_points, LPXLOPER12 xl_missing)
+{
+    return evaluateDistribution("OT_DIST_CDF", FUNCTION_CDF, xl_name, xl_parameters, xl_points, xl_missing);
+}
+
+/***********************************************************************************
+ OT_DIST_QUANTILE()
+
+ Purpose:
+
+      Same as OT_DIST_PDF, for the quantiles of given probabilities, which
+      must be in [0, 1].
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_DIST_QUANTILE(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_probabilities, LPXLOPER12 xl_missing)
+{
+    return evaluateDistribution("OT_DIST_QUANTILE", FUNCTION_QUANTILE, xl_name, xl_parameters, xl_probabilities, xl_missing);
+}
+
+/***********************************************************************************
+ OT_DIST_SAMPLE()
+
+ Purpose:
+
+      This function takes 4 arguments and draws a sample of any distribution
+      of ot_distribution_cache.h.  The sample is reproducible: it only depends
+      on the seed, not on the number of threads, see xll_random.h.  Large
+      samples are drawn in parallel.
+
+ Parameters:
+
+      LPXLOPER12      4 arguments : xl_name, xl_parameters, xl_size, xl_seed
+                      xl_name and xl_parameters as for OT_DIST_PDF,
+                      xl_size the number of values, returned as a column,
+                      or missing to fill the selected range,
+                      xl_seed a non-negative integer, 0 if missing
+
+ Returns:
+
+      LPXLOPER12      the sample
+                      or #VALUE! if the name is unknown or if there are
+                      non-numerics in the supplied arguments.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_DIST_SAMPLE(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_size, LPXLOPER12 xl_seed)
+{
+    const std::string prefix = "(OT_DIST_SAMPLE): ";
+    StoredDistribution stored;
+    int rows = 0;
+    int columns = 1;
+    double seed = 0.0;
+    int error = -1;
+    XLL_PROFILE_START();
+
+    LPXLOPER12 xError = coerceDistribution(prefix, xl_name, xl_parameters, stored);
+    if (xError)
+    {
+        return xError;
+    }
+
+    // Coerce the size, or get it from the current selection
+    //=======================================================
+    if (xl_size->xltype == xltypeMissing || xl_size->xltype == xltypeNil)
+    {
+        rows = getNumberOfRows();
+        columns = getNumberOfColumns();
+        if (rows <= 0 || columns <= 0)
+        {
+            return dialogError(prefix + "detection of cell selection failed", xlerrValue);
+        }
+    }
+    else if((error = xloper_to_int(xl_size, &rows)) != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeInt for argument 'size'", error);
+    }
+    else if (rows <= 0)
+    {
+        return dialogError(prefix + "The size must be positive", xlerrValue);
+    }
+
+    // Coerce the seed
+    //================
+    if (xl_seed->xltype != xltypeMissing && xl_seed->xltype != xltypeNil)
+    {
+        if((error = xloper_to_num(xl_seed, &seed)) != -1)
+        {
+            return dialogError(prefix + "Invalid conversion to xltypeNum for argument 'seed'", error);
+        }
+        if (!(seed >= 0.0 && seed < 9007199254740992.0) || seed != std::floor(seed))
+        {
+            return dialogError(prefix + "The seed must be a non-negative integer", xlerrValue);
+        }
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_COERCE);
+
+    //Draw the sample in the cells of the result
+    //==========================================
+    LPXLOPER12 xResult = new_multi(rows, columns);
+    if (!xResult)
+    {
+        return NULL;
+    }
+    try
+    {
+        SampleContext context;
+        context.distribution = &stored.distribution;
+        context.normal = stored.family == DISTRIBUTION_NORMAL;
+        context.mu = stored.parameters[0];
+        context.sigma = stored.parameters[1];
+        context.seed = (uint64_t) seed;
+        context.cells = xResult->val.array.lparray;
+        context.failed = 0;
+        parallel_for((size_t) rows * columns, &drawSample, &context);
+        if (context.failed)
+        {
+            throw std::runtime_error("Quantiles of the distribution cannot be computed");
+        }
+        XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
+    }
+    catch(OT::Exception & e)
+    {
+        free_result(xResult);
+        return dialogError(e.what(), xlerrValue);
+    }
+    catch(std::exception & e)
+    {
+        free_result(xResult);
+        return dialogError(e.what(), xlerrValue);
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_RESULT);
+    return xResult;
+}
+
+/***********************************************************************************
+ OT_MAKE_DISTRIBUTION()
+
+ Purpose:
+
+      This function takes 2 arguments and stores a distribution, which the
+      OT_DIST_* functions then use through its handle, see ot_object_store.h.
+
+ Parameters:
+
+      LPXLOPER12      2 arguments : xl_name, xl_parameters
+                      as for OT_DIST_PDF
+
+ Returns:
+
+      LPXLOPER12      the handle of the distribution, like "Normal#12", the
+                      same as on the previous call if the arguments did not
+                      change, or #VALUE! if the name is unknown or if there are
+                      non-numerics in the supplied arguments.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_MAKE_DISTRIBUTION(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters)
+{
+    StoredDistribution stored;
+    ObjectInputs inputs;
+    std::string handle;
+
+    LPXLOPER12 xError = coerceDistribution("(OT_MAKE_DISTRIBUTION): ", xl_name, xl_parameters, stored, &inputs);
+    if (xError)
+    {
+        return xError;
+    }
+    if (findUnchangedObject(OBJECT_DISTRIBUTION, inputs, handle))
+    {
+        return handle_to_result(handle);
+    }
+    return handle_to_result(storeDistribution(stored, inputs));
+}
@@ -0,0 +1,623 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <framewrk.h>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+#include <OT.hxx>
+#include "ot_distribution_cache.h"
+#include "ot_normal_kernel.h"
+#include "ot_functions.h"
+#include "xll_lru_cache.h"
+#include "xll_result_pool.h"
+
+namespace {
+
+struct DistributionKey
+{
+    int family;
+    int count;
+    OT::NumericalScalar parameters[DISTRIBUTION_MAX_PARAMETERS];
+
+    // Parameters are compared bit by bit, so that NaN is a valid key
+    bool operator<(const DistributionKey & other) const
+    {
+        if (family != other.family)
+            return family < other.family;
+        if (count != other.count)
+            return count < other.count;
+        return memcmp(parameters, other.parameters, count * sizeof(OT::NumericalScalar)) < 0;
+    }
+};
+
+struct GridKey
+{
+    OT::NumericalScalar parameters[2];
+    int nrValues;
+
+    bool operator<(const GridKey & other) const
+    {
+        if (nrValues != other.nrValues)
+            return nrValues < other.nrValues;
+        return memcmp(parameters, other.parameters, sizeof(parameters)) < 0;
+    }
+};
+
+typedef XllLruCache<DistributionKey, OT::Distribution> DistributionCache;
+// Samples share their data when copied, cached grids are never modified
+typedef XllLruCache<GridKey, OT::NumericalSample> GridCache;
+
+DistributionCache distributionCache(DISTRIBUTION_CACHE_SIZE);
+GridCache gridCache(GRID_CACHE_SIZE);
+
+// Bounds of drawPDF for the standard normal distribution, see initDistributionCache
+bool gridBoundsKnown = false;
+OT::NumericalScalar gridLower = 0.0;
+OT::NumericalScalar gridUpper = 0.0;
+
+// Factories, which get between minParameters and maxParameters values
+typedef OT::Distribution (*DistributionBuilder)(const OT::NumericalScalar * p, int count);
+
+OT::Distribution buildNormal(const OT::NumericalScalar * p, int)
+{
+    return OT::Normal(p[0], p[1]);
+}
+
+OT::Distribution buildUniform(const OT::NumericalScalar * p, int)
+{
+    return OT::Uniform(p[0], p[1]);
+}
+
+OT::Distribution buildTriangular(const OT::NumericalScalar * p, int)
+{
+    return OT::Triangular(p[0], p[1], p[2]);
+}
+
+OT::Distribution buildTrapezoidal(const OT::NumericalScalar * p, int)
+{
+    return OT::Trapezoidal(p[0], p[1], p[2], p[3]);
+}
+
+OT::Distribution buildExponential(const OT::NumericalScalar * p, int count)
+{
+    return OT::Exponential(p[0], count > 1 ? p[1] : 0.0);
+}
+
+OT::Distribution buildGamma(const OT::NumericalScalar * p, int count)
+{
+    return OT::Gamma(p[0], p[1], count > 2 ? p[2] : 0.0);
+}
+
+OT::Distribution buildBeta(const OT::NumericalScalar * p, int)
+{
+    return OT::Beta(p[0], p[1], p[2], p[3]);
+}
+
+OT::Distribution buildLogNormal(const OT::NumericalScalar * p, int count)
+{
+    return OT::LogNormal(p[0], p[1], count > 2 ? p[2] : 0.0);
+}
+
+OT::Distribution buildWeibull(const OT::NumericalScalar * p, int count)
+{
+    return OT::Weibull(p[0], p[1], count > 2 ? p[2] : 0.0);
+}
+
+OT::Distribution buildGumbel(const OT::NumericalScalar * p, int)
+{
+    return OT::Gumbel(p[0], p[1]);
+}
+
+OT::Distribution buildLogistic(const OT::NumericalScalar * p, int)
+{
+    return OT::Logistic(p[0], p[1]);
+}
+
+OT::Distribution buildLaplace(const OT::NumericalScalar * p, int count)
+{
+    return OT::Laplace(p[0], count > 1 ? p[1] : 0.0);
+}
+
+OT::Distribution buildRayleigh(const OT::NumericalScalar * p, int count)
+{
+    return OT::Rayleigh(p[0], count > 1 ? p[1] : 0.0);
+}
+
+OT::Distribution buildStudent(const OT::NumericalScalar * p, int count)
+{
+    return OT::Student(p[0], count > 1 ? p[1] : 0.0, count > 2 ? p[2] : 1.0);
+}
+
+OT::Distribution buildChiSquare(const OT::NumericalScalar * p, int)
+{
+    return OT::ChiSquare(p[0]);
+}
+
+OT::Distribution buildPoisson(const OT::NumericalScalar * p, int)
+{
+    return OT::Poisson(p[0]);
+}
+
+OT::Distribution buildGeometric(const OT::NumericalScalar * p, int)
+{
+    return OT::Geometric(p[0]);
+}
+
+OT::Distribution buildBinomial(const OT::NumericalScalar * p, int)
+{
+    // The number of trials is an unsigned integer, which a double would silently truncate
+    if (!(p[0] >= 0.0 && p[0] < 4294967296.0) || p[0] != (double) (OT::UnsignedInteger) p[0])
+    {
+        throw std::invalid_argument("The number of trials of a Binomial distribution must be a non-negative integer");
+    }
+    return OT::Binomial((OT::UnsignedInteger) p[0], p[1]);
+}
+
+// OpenTURNS factories, which estimate the parameters of a family from a sample
+typedef OT::DistributionFactory (*DistributionFitter)();
+
+OT::DistributionFactory factoryNormal()
+{
+    return OT::NormalFactory();
+}
+
+OT::DistributionFactory factoryUniform()
+{
+    return OT::UniformFactory();
+}
+
+OT::DistributionFactory factoryTriangular()
+{
+    return OT::TriangularFactory();
+}
+
+OT::DistributionFactory factoryTrapezoidal()
+{
+    return OT::TrapezoidalFactory();
+}
+
+OT::DistributionFactory factoryExponential()
+{
+    return OT::ExponentialFactory();
+}
+
+OT::DistributionFactory factoryGamma()
+{
+    return OT::GammaFactory();
+}
+
+OT::DistributionFactory factoryBeta()
+{
+    return OT::BetaFactory();
+}
+
+OT::DistributionFactory factoryLogNormal()
+{
+    return OT::LogNormalFactory();
+}
+
+OT::DistributionFactory factoryWeibull()
+{
+    return OT::WeibullFactory();
+}
+
+OT::DistributionFactory factoryGumbel()
+{
+    return OT::GumbelFactory();
+}
+
+OT::DistributionFactory factoryLogistic()
+{
+    return OT::LogisticFactory();
+}
+
+OT::DistributionFactory factoryLaplace()
+{
+    return OT::LaplaceFactory();
+}
+
+OT::DistributionFactory factoryRayleigh()
+{
+    return OT::RayleighFactory();
+}
+
+OT::DistributionFactory factoryStudent()
+{
+    return OT::StudentFactory();
+}
+
+OT::DistributionFactory factoryChiSquare()
+{
+    return OT::ChiSquareFactory();
+}
+
+OT::DistributionFactory factoryPoisson()
+{
+    return OT::PoissonFactory();
+}
+
+OT::DistributionFactory factoryGeometric()
+{
+    return OT::GeometricFactory();
+}
+
+OT::DistributionFactory factoryBinomial()
+{
+    return OT::BinomialFactory();
+}
+
+struct DistributionFactory
+{
+    const char * name;
+    int minParameters;
+    int maxParameters;
+    DistributionBuilder build;
+    DistributionFitter factory;
+};
+
+// Indexed by DistributionFamily
+const DistributionFactory distributionFactories[DISTRIBUTION_FAMILIES] =
+{
+    { "Normal",      2, 2, &buildNormal,      &factoryNormal },
+    { "Uniform",     2, 2, &buildUniform,     &factoryUniform },
+    { "Triangular",  3, 3, &buildTriangular,  &factoryTriangular },
+    { "Trapezoidal", 4, 4, &buildTrapezoidal, &factoryTrapezoidal },
+    { "Exponential", 1, 2, &buildExponential, &factoryExponential },
+    { "Gamma",       2, 3, &buildGamma,       &factoryGamma },
+    { "Beta",        4, 4, &buildBeta,        &factoryBeta },
+    { "LogNormal",   2, 3, &buildLogNormal,   &factoryLogNormal },
+    { "Weibull",     2, 3, &buildWeibull,     &factoryWeibull },
+    { "Gumbel",      2, 2, &buildGumbel,      &factoryGumbel },
+    { "Logistic",    2, 2, &buildLogistic,    &factoryLogistic },
+    { "Laplace",     1, 2, &buildLaplace,     &factoryLaplace },
+    { "Rayleigh",    1, 2, &buildRayleigh,    &factoryRayleigh },
+    { "Student",     1, 3, &buildStudent,     &factoryStudent },
+    { "ChiSquare",   1, 1, &buildChiSquare,   &factoryChiSquare },
+    { "Poisson",     1, 1, &buildPoisson,     &factoryPoisson },
+    { "Geometric",   1, 1, &buildGeometric,   &factoryGeometric },
+    { "Binomial",    2, 2, &buildBinomial,    &factoryBinomial }
+};
+
+OT::Distribution buildDistribution(const DistributionKey & key)
+{
+    if (key.family < 0 || key.family >= DISTRIBUTION_FAMILIES)
+    {
+        throw std::invalid_argument("Unknown distribution family");
+    }
+    const DistributionFactory & factory = distributionFactories[key.family];
+    if (key.count < factory.minParameters || key.count > factory.maxParameters)
+    {
+        throw std::invalid_argument(std::string("Wrong number of parameters for a ") + factory.name + " distribution");
+    }
+    return factory.build(key.parameters, key.count);
+}
+
+// Regular grid of nrValues points and their PDF, in two columns like drawPDF
+OT::NumericalSample computeNormalGrid(const OT::Distribution & distribution,
+                                      OT::NumericalScalar mu, OT::NumericalScalar sigma, int nrValues)
+{
+    if (!gridBoundsKnown)
+    {
+        return distribution.drawPDF(nrValues).getDrawable(0).getData();
+    }
+
+    const OT::NumericalScalar lower = mu + gridLower * sigma;
+    const OT::NumericalScalar upper = mu + gridUpper * sigma;
+    const OT::NumericalScalar step = nrValues > 1 ? (upper - lower) / (nrValues - 1.0) : 0.0;
+    OT::NumericalSample points(nrValues, 1);
+    for (int i = 0; i < nrValues; ++i)
+    {
+        points(i, 0) = lower + i * step;
+    }
+    OT::NumericalSample pdf(nrValues, 1);
+    normal_pdf(mu, sigma, &points(0, 0), &pdf(0, 0), nrValues);
+
+    OT::NumericalSample grid(nrValues, 2);
+    for (int i = 0; i < nrValues; ++i)
+    {
+        grid(i, 0) = points(i, 0);
+        grid(i, 1) = pdf(i, 0);
+    }
+    return grid;
+}
+
+// Counted string for a cell of a result, released by xlAutoFree12
+void setString(XLOPER12 & cell, const XCHAR * text)
+{
+    const int length = lstrlenW(text);
+    cell.xltype = xltypeStr;
+    cell.val.str = new XCHAR[length + 1];
+    cell.val.str[0] = (XCHAR) length;
+    wmemcpy_s(cell.val.str + 1, length, text, length);
+}
+
+} // empty namespace
+
+/*********************************************************************
+**  findDistributionFamily()
+**
+**  Purpose :
+**      look up the family of a distribution name in the table of
+**      factories, ignoring case.
+**
+**  Parameters:
+**
+**        name   : std::string, e.g. "Normal" or "lognormal"
+**        family : DistributionFamily, set if the name is found
+**
+**  Returns :
+**        true if the name is known
+**********************************************************************/
+bool
+findDistributionFamily(const std::string & name, DistributionFamily & family)
+{
+    for (int i = 0; i < DISTRIBUTION_FAMILIES; ++i)
+    {
+        const char * factoryName = distributionFactories[i].name;
+        size_t j = 0;
+        while (j < name.size() && factoryName[j] && tolower((unsigned char) name[j]) == tolower((unsigned char) factoryName[j]))
+        {
+            ++j;
+        }
+        if (j == name.size() && !factoryName[j])
+        {
+            family = (DistributionFamily) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *
+getDistributionName(DistributionFamily family)
+{
+    return family >= 0 && family < DISTRIBUTION_FAMILIES ? distributionFactories[family].name : "";
+}
+
+/*********************************************************************
+**  getDistribution()
+**
+**  Purpose :
+**      get the distribution of the given family and parameters from
+**      the cache, building it on a miss.
+**
+**  Parameters:
+**
+**        family     : DistributionFamily
+**        parameters : array of count values
+**        count      : number of parameters, between the minimum and
+**                     maximum numbers of the family
+**
+**  Returns :
+**        OT::Distribution, which may be shared with other threads
+**        and must thus not be modified
+**********************************************************************/
+OT::Distribution
+getDistribution(DistributionFamily family, const OT::NumericalScalar * parameters, int count)
+{
+    if (count < 0 || count > DISTRIBUTION_MAX_PARAMETERS)
+    {
+        throw std::invalid_argument("Too many distribution parameters");
+    }
+
+    DistributionKey key;
+    memset(&key, 0, sizeof(key));
+    key.family = family;
+    key.count = count;
+    memcpy(key.parameters, parameters, count * sizeof(OT::NumericalScalar));
+
+    OT::Distribution distribution;
+    if (!distributionCache.get(key, distribution))
+    {
+        // Two threads may build the same distribution, the last one is kept
+        distribution = buildDistribution(key);
+        distributionCache.put(key, distribution);
+    }
+    return distribution;
+}
+
+/*********************************************************************
+**  fitDistribution()
+**
+**  Purpose :
+**      estimate the parameters of a family from a sample with the
+**      OpenTURNS factory of the family.  The distribution is not
+**      cached, each sample giving other parameters.
+**
+**  Parameters:
+**
+**        family     : DistributionFamily
+**        sample     : OT::NumericalSample of dimension 1
+**        parameters : array of DISTRIBUTION_MAX_PARAMETERS values,
+**                     receives the estimated parameters, in the order
+**                     of the table, see getDistribution
+**        count      : receives their number
+**
+**  Returns :
+**        OT::Distribution; throws like the OpenTURNS factories
+**********************************************************************/
+OT::Distribution
+fitDistribution(DistributionFamily family, const OT::NumericalSample & sample,
+                OT::NumericalScalar * parameters, int & count)
+{
+    if (family < 0 || family >= DISTRIBUTION_FAMILIES)
+    {
+        throw std::invalid_argument("Unknown distribution family");
+    }
+    const DistributionFactory & factory = distributionFactories[family];
+    const OT::Distribution distribution = factory.factory().build(sample);
+
+    // Parameters of the constructor, which the table follows
+    const OT::NumericalPoint values = distribution.getParametersCollection()[0];
+    count = (int) values.getSize() < factory.maxParameters ? (int) values.getSize() : factory.maxParameters;
+    for (int i = 0; i < count; ++i)
+    {
+        parameters[i] = values[i];
+    }
+    return distribution;
+}
+
+OT::Distribution
+getNormal(OT::NumericalScalar mu, OT::NumericalScalar sigma)
+{
+    const OT::NumericalScalar parameters[2] = { mu, sigma };
+    return getDistribution(DISTRIBUTION_NORMAL, parameters, 2);
+}
+
+/*********************************************************************
+**  getNormalGrid()
+**
+**  Purpose :
+**      get the points and PDF values drawn by drawPDF for a normal
+**      distribution from the cache, computing them on a miss.
+**
+**  Parameters:
+**
+**        mu, sigma : parameters of the normal distribution
+**        nrValues  : number of points, positive
+**
+**  Returns :
+**        OT::NumericalSample of nrValues points and dimension 2,
+**        which may be shared with other threads and must thus not
+**        be modified
+**********************************************************************/
+OT::NumericalSample
+getNormalGrid(OT::NumericalScalar mu, OT::NumericalScalar sigma, int nrValues)
+{
+    GridKey key;
+    memset(&key, 0, sizeof(key));
+    key.parameters[0] = mu;
+    key.parameters[1] = sigma;
+    key.nrValues = nrValues;
+
+    OT::NumericalSample grid;
+    if (nrValues <= GRID_CACHE_MAX_POINTS && gridCache.get(key, grid))
+    {
+        return grid;
+    }
+    grid = computeNormalGrid(getNormal(mu, sigma), mu, sigma, nrValues);
+    if (nrValues <= GRID_CACHE_MAX_POINTS)
+    {
+        gridCache.put(key, grid);
+    }
+    return grid;
+}
+
+/*********************************************************************
+**  initDistributionCache()
+**
+**  Purpose :
+**      read the bounds of the graph drawn by drawPDF for the standard
+**      normal distribution.  Until this is done, grids are computed
+**      by drawPDF.
+**********************************************************************/
+void
+initDistributionCache()
+{
+    try
+    {
+        const OT::NumericalSample data(OT::Normal(0.0, 1.0).drawPDF(2).getDrawable(0).getData());
+        gridLower = data(0, 0);
+        gridUpper = data(1, 0);
+        gridBoundsKnown = gridLower < gridUpper;
+    }
+    catch(std::exception &)
+    {
+        gridBoundsKnown = false;
+    }
+}
+
+/***********************************************************************************
+ OT_CACHE_CLEAR()
+
+ Purpose:
+
+      This function empties the caches of distributions and grids, and resets
+      their counters.
+
+ Returns:
+
+      LPXLOPER12      number of distributions and grids which were removed
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_CACHE_CLEAR()
+{
+    const size_t removed = distributionCache.clear() + gridCache.clear();
+
+    LPXLOPER12 xResult = new_result();
+    if (xResult)
+    {
+        xResult->xltype = xltypeNum | xlbitDLLFree;
+        xResult->val.num = (double) removed;
+    }
+    return xResult;
+}
+
+/***********************************************************************************
+ OT_CACHE_STATS()
+
+ Purpose:
+
+      This function reports the usage of the caches of distributions and grids.
+
+ Returns:
+
+      LPXLOPER12      xltypeMulti of 8 rows and 2 columns, a label and a value
+                      for the number of hits, misses, cached entries and the
+                      capacity of each cache
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_CACHE_STATS()
+{
+    static const XCHAR * const labels[8] = {
+        L"Hits", L"Misses", L"Entries", L"Capacity",
+        L"Grid hits", L"Grid misses", L"Grid entries", L"Grid capacity"
+    };
+    LONGLONG hits, misses, gridHits, gridMisses;
+    size_t size, gridSize;
+    distributionCache.getStats(hits, misses, size);
+    gridCache.getStats(gridHits, gridMisses, gridSize);
+    const double values[8] = {
+        (double) hits, (double) misses, (double) size, (double) distributionCache.getCapacity(),
+        (double) gridHits, (double) gridMisses, (double) gridSize, (double) gridCache.getCapacity()
+    };
+
+    // Labels are strings, which xlAutoFree12 must release
+    LPXLOPER12 xResult = new_result_multi(8, 2, false);
+    if (!xResult)
+    {
+        return NULL;
+    }
+    LPXLOPER12 px = xResult->val.array.lparray;
+    for (int i = 0; i < 8; ++i, px += 2)
+    {
+        setString(px[0], labels[i]);
+        px[1].xltype = xltypeNum;
+        px[1].val.num = values[i];
+    }
+    return xResult;
+}
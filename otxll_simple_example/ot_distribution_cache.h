@@ -0,0 +1,80 @@
+#ifndef __OT_DISTRIBUTION_CACHE_H
+#define __OT_DISTRIBUTION_CACHE_H
+
+#include <OT.hxx>
+#include <string>
+
+/*
+ * Cache of the distributions built by worksheet functions.  Cells of a
+ * sheet often share the same parameters and only differ by the point
+ * where the distribution is evaluated; the distribution is then built and
+ * its parameters checked once, and later calls get a copy of the cached
+ * OT::Distribution, which shares its implementation.
+ *
+ * Distributions are built from their family and parameters by a table of
+ * factories, which also gives the name of each family in worksheets and
+ * its number of parameters; trailing optional parameters get the default
+ * values of the OpenTURNS constructor.  The table also gives the OpenTURNS
+ * factory of each family, which estimates its parameters from a sample.
+ *
+ * Distributions are keyed by family and parameters, compared bit by bit.
+ * At most DISTRIBUTION_CACHE_SIZE distributions are kept, the least
+ * recently used one is evicted first.  Parameters which are rejected by
+ * OpenTURNS are not cached, the exception is thrown on each call.
+ *
+ * The grids of the OT_NORMAL_PDF_DRAW functions are cached too, keyed by
+ * mu, sigma and number of points.  They are computed without building an
+ * OT::Graph: drawPDF spans [mu + a * sigma, mu + b * sigma] for a normal
+ * distribution, where a and b only depend on the ResourceMap and are read
+ * once from the graph of the standard normal distribution, see
+ * initDistributionCache.  Only grids of at most GRID_CACHE_MAX_POINTS
+ * points are cached.
+ */
+
+#define DISTRIBUTION_CACHE_SIZE 256
+#define GRID_CACHE_SIZE 64
+#define GRID_CACHE_MAX_POINTS 65536
+#define DISTRIBUTION_MAX_PARAMETERS 4
+
+enum DistributionFamily
+{
+    DISTRIBUTION_NORMAL = 0,    // mu, sigma
+    DISTRIBUTION_UNIFORM,       // a, b
+    DISTRIBUTION_TRIANGULAR,    // a, m, b
+    DISTRIBUTION_TRAPEZOIDAL,   // a, b, c, d
+    DISTRIBUTION_EXPONENTIAL,   // lambda [, gamma]
+    DISTRIBUTION_GAMMA,         // k, lambda [, gamma]
+    DISTRIBUTION_BETA,          // r, t, a, b
+    DISTRIBUTION_LOGNORMAL,     // muLog, sigmaLog [, gamma]
+    DISTRIBUTION_WEIBULL,       // alpha, beta [, gamma]
+    DISTRIBUTION_GUMBEL,        // alpha, beta
+    DISTRIBUTION_LOGISTIC,      // alpha, beta
+    DISTRIBUTION_LAPLACE,       // lambda [, mu]
+    DISTRIBUTION_RAYLEIGH,      // sigma [, gamma]
+    DISTRIBUTION_STUDENT,       // nu [, mu [, sigma]]
+    DISTRIBUTION_CHISQUARE,     // nu
+    DISTRIBUTION_POISSON,       // lambda
+    DISTRIBUTION_GEOMETRIC,     // p
+    DISTRIBUTION_BINOMIAL,      // n, p
+    DISTRIBUTION_FAMILIES
+};
+
+/* Family of a distribution name like "Normal", case insensitive; returns false if it is unknown */
+bool findDistributionFamily(const std::string & name, DistributionFamily & family);
+/* Name of a family, as in OpenTURNS */
+const char * getDistributionName(DistributionFamily family);
+
+/* Get a distribution from the cache, or build and cache it; throws like OpenTURNS constructors */
+OT::Distribution getDistribution(DistributionFamily family, const OT::NumericalScalar * parameters, int count);
+/* Estimate the parameters of a family from a sample, which are copied to parameters; throws like OpenTURNS factories */
+OT::Distribution fitDistribution(DistributionFamily family, const OT::NumericalSample & sample,
+                                 OT::NumericalScalar * parameters, int & count);
+/* Same as getDistribution(DISTRIBUTION_NORMAL, {mu, sigma}, 2) */
+OT::Distribution getNormal(OT::NumericalScalar mu, OT::NumericalScalar sigma);
+/* Points and PDF of a normal distribution, same as drawPDF(nrValues).getDrawable(0).getData() */
+OT::NumericalSample getNormalGrid(OT::NumericalScalar mu, OT::NumericalScalar sigma, int nrValues);
+
+/* Read the bounds of drawPDF, must be called before any other thread uses the cache, see xlAutoOpen */
+void initDistributionCache();
+
+#endif // __OT_DISTRIBUTION_CACHE_H
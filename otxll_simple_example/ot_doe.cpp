@@ -0,0 +1,698 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <framewrk.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <OT.hxx>
+#include "xll_helper_functions.h"
+#include "ot_marshal.h"
+#include "ot_functions.h"
+#include "xll_profile.h"
+#include "ot_distribution_cache.h"
+#include "ot_doe.h"
+#include "ot_object_store.h"
+#include "xll_thread_pool.h"
+#include "xll_random.h"
+#include "xll_result_pool.h"
+
+namespace {
+
+// Designs of OT_DOE
+enum DesignKind
+{
+    DESIGN_LHS = 0,             // Latin hypercube, a random point in each cell
+    DESIGN_SOBOL,               // Sobol sequence
+    DESIGN_HALTON,              // Halton sequence
+    DESIGN_KINDS
+};
+
+const char * const designNames[DESIGN_KINDS] = { "lhs", "sobol", "halton" };
+
+// Columns of a worksheet
+#define DESIGN_MAX_DIMENSIONS 16384
+// Substreams of the permutations of a Latin hypercube, after those of the points
+#define LHS_PERMUTATION_BLOCK (1ULL << 40)
+
+/*
+ * Primitive polynomials and initial direction numbers of the Sobol
+ * sequence, dimensions 2 to SOBOL_DIMENSIONS of new-joe-kuo-6.21201 by
+ * S. Joe and F. Y. Kuo: degree s, coefficients a of the polynomial
+ * x^s + a_1 x^(s-1) + ... + a_(s-1) x + 1, and m_1 to m_s.  Dimension 1
+ * is the van der Corput sequence.
+ */
+struct SobolPolynomial
+{
+    int degree;
+    int a;
+    unsigned int m[8];
+};
+
+const SobolPolynomial sobolPolynomials[SOBOL_DIMENSIONS - 1] =
+{
+    { 1,  0, { 1 } },
+    { 2,  1, { 1, 3 } },
+    { 3,  1, { 1, 3, 1 } },
+    { 3,  2, { 1, 1, 1 } },
+    { 4,  1, { 1, 1, 3, 3 } },
+    { 4,  4, { 1, 3, 5, 13 } },
+    { 5,  2, { 1, 1, 5, 5, 17 } },
+    { 5,  4, { 1, 1, 5, 5, 5 } },
+    { 5,  7, { 1, 1, 7, 11, 19 } },
+    { 5, 11, { 1, 1, 5, 1, 1 } },
+    { 5, 13, { 1, 1, 1, 3, 11 } },
+    { 5, 14, { 1, 3, 5, 5, 31 } },
+    { 6,  1, { 1, 3, 3, 9, 7, 49 } },
+    { 6, 13, { 1, 1, 1, 15, 21, 21 } },
+    { 6, 16, { 1, 3, 1, 13, 27, 49 } },
+    { 6, 19, { 1, 1, 1, 15, 7, 5 } },
+    { 6, 22, { 1, 3, 1, 15, 13, 25 } },
+    { 6, 25, { 1, 1, 5, 5, 19, 61 } },
+    { 7,  1, { 1, 3, 7, 11, 23, 15, 103 } },
+    { 7,  4, { 1, 3, 7, 13, 13, 15, 69 } },
+    { 7,  7, { 1, 1, 3, 13, 7, 35, 63 } },
+    { 7,  8, { 1, 3, 5, 9, 1, 25, 53 } },
+    { 7, 14, { 1, 3, 1, 13, 9, 35, 107 } },
+    { 7, 19, { 1, 3, 1, 5, 27, 61, 31 } },
+    { 7, 21, { 1, 1, 5, 11, 19, 41, 61 } },
+    { 7, 28, { 1, 3, 5, 3, 3, 13, 69 } },
+    { 7, 31, { 1, 1, 7, 13, 1, 19, 1 } },
+    { 7, 32, { 1, 3, 7, 5, 13, 19, 59 } },
+    { 7, 37, { 1, 1, 3, 9, 25, 29, 41 } },
+    { 7, 41, { 1, 3, 5, 13, 23, 1, 55 } },
+    { 7, 42, { 1, 3, 7, 3, 13, 59, 17 } },
+    { 7, 50, { 1, 3, 1, 3, 5, 53, 69 } },
+    { 7, 55, { 1, 1, 5, 5, 23, 33, 13 } },
+    { 7, 56, { 1, 1, 7, 7, 1, 61, 123 } },
+    { 7, 59, { 1, 1, 7, 9, 13, 61, 49 } },
+    { 7, 62, { 1, 3, 3, 5, 3, 55, 33 } },
+    { 8, 14, { 1, 3, 1, 15, 31, 13, 49, 245 } },
+    { 8, 21, { 1, 3, 5, 15, 31, 59, 63, 97 } },
+    { 8, 22, { 1, 3, 1, 11, 11, 11, 77, 249 } }
+};
+
+// State shared by the threads filling a design, see fillDesign
+struct DesignContext
+{
+    DesignKind kind;
+    size_t size;
+    size_t dimension;
+    uint64_t seed;
+    const std::vector<DesignMarginal> * marginals;
+    // Sobol: SOBOL_BITS direction numbers per dimension, and a digital shift per dimension
+    std::vector<uint64_t> directions;
+    std::vector<uint64_t> shifts;
+    // Halton: a prime per dimension, and a shift modulo 1 per dimension
+    std::vector<unsigned int> primes;
+    std::vector<double> offsets;
+    // Latin hypercube: a permutation of [0, size) per dimension
+    std::vector<unsigned int> permutations;
+    LPXLOPER12 cells;
+    volatile LONG failed;
+};
+
+// Value in (0, 1) of an integer of SOBOL_BITS bits, 0 being moved inside
+// so that quantiles are finite
+inline double sobolValue(uint64_t x)
+{
+    return (x ? (double) x : 0.5) * (1.0 / 4503599627370496.0);
+}
+
+// Radical inverse of index in base, in (0, 1) for index > 0
+inline double radicalInverse(uint64_t index, unsigned int base)
+{
+    double value = 0.0;
+    double factor = 1.0 / base;
+    while (index)
+    {
+        value += (index % base) * factor;
+        index /= base;
+        factor /= base;
+    }
+    return value;
+}
+
+// Permutations [begin, end) of a Latin hypercube, by Fisher-Yates, for parallel_tasks
+void shuffleDimensions(void * context, size_t begin, size_t end)
+{
+    DesignContext & design = *static_cast<DesignContext *>(context);
+    for (size_t j = begin; j < end; ++j)
+    {
+        XllRandomStream stream(design.seed, LHS_PERMUTATION_BLOCK + j);
+        unsigned int * permutation = &design.permutations[j * design.size];
+        for (size_t i = 0; i < design.size; ++i)
+        {
+            permutation[i] = (unsigned int) i;
+        }
+        for (size_t i = design.size - 1; i > 0; --i)
+        {
+            const size_t k = std::min(i, (size_t) (stream.uniform() * (i + 1)));
+            std::swap(permutation[i], permutation[k]);
+        }
+    }
+}
+
+/*
+ * Fill points [begin, end) of a design, row by row, begin being the start
+ * of a chunk of parallel_for and thus of a block.  Values in (0, 1) are
+ * written to the cells, then mapped to the marginals.  Point i of a
+ * sequence is its point of index i + 1, the origin being left out; the
+ * Sobol points of a chunk follow from its first one by the Gray code.
+ */
+void fillDesign(void * context, size_t begin, size_t end)
+{
+    DesignContext & design = *static_cast<DesignContext *>(context);
+    const size_t d = design.dimension;
+    LPXLOPER12 px = design.cells + begin * d;
+    if (design.kind == DESIGN_SOBOL)
+    {
+        std::vector<double> u((end - begin) * d);
+        sobol_points(&design.directions[0], &design.shifts[0], d, begin, end, &u[0]);
+        for (size_t k = 0; k < u.size(); ++k, ++px)
+        {
+            px->xltype = xltypeNum;
+            px->val.num = u[k];
+        }
+    }
+    else if (design.kind == DESIGN_HALTON)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (size_t j = 0; j < d; ++j, ++px)
+            {
+                double u = radicalInverse(i + 1, design.primes[j]) + design.offsets[j];
+                u = u >= 1.0 ? u - 1.0 : u;
+                px->xltype = xltypeNum;
+                px->val.num = u > 0.0 ? u : 0.5 / 4503599627370496.0;
+            }
+        }
+    }
+    else
+    {
+        const double scale = 1.0 / design.size;
+        for (size_t block = begin; block < end; block += RANDOM_BLOCK)
+        {
+            XllRandomStream stream(design.seed, block / RANDOM_BLOCK);
+            const size_t blockEnd = std::min(end, block + RANDOM_BLOCK);
+            for (size_t i = block; i < blockEnd; ++i)
+            {
+                for (size_t j = 0; j < d; ++j, ++px)
+                {
+                    px->xltype = xltypeNum;
+                    px->val.num = (design.permutations[j * design.size + i] + stream.uniform()) * scale;
+                }
+            }
+        }
+    }
+
+    // Map the values to the marginals
+    try
+    {
+        for (size_t j = 0; j < d; ++j)
+        {
+            const DesignMarginal & marginal = (*design.marginals)[j];
+            px = design.cells + begin * d + j;
+            for (size_t i = begin; i < end; ++i, px += d)
+            {
+                px->val.num = design_quantile(marginal, px->val.num);
+            }
+        }
+    }
+    catch(...)
+    {
+        // parallel_for procs must not throw, the whole design is dropped
+        InterlockedExchange(&design.failed, 1);
+    }
+}
+
+} // empty namespace
+
+/*********************************************************************
+**  sobol_directions()
+**
+**  Purpose :
+**      direction numbers of the first dimensions of the Sobol sequence,
+**      from the table above, the first one being the van der Corput
+**      sequence.
+**
+**  Parameters:
+**
+**        dimension  : number of dimensions, at most SOBOL_DIMENSIONS
+**        directions : SOBOL_BITS numbers per dimension, set by this function
+**********************************************************************/
+void
+sobol_directions(size_t dimension, std::vector<uint64_t> & directions)
+{
+    directions.resize(dimension * SOBOL_BITS);
+    for (size_t j = 0; j < dimension; ++j)
+    {
+        uint64_t * v = &directions[j * SOBOL_BITS];
+        uint64_t m[SOBOL_BITS];
+        int s = 0;
+        if (j == 0)
+        {
+            for (int k = 0; k < SOBOL_BITS; ++k)
+            {
+                m[k] = 1;
+            }
+        }
+        else
+        {
+            // m_k = 2 a_1 m_(k-1) ^ 4 a_2 m_(k-2) ^ ... ^ 2^s m_(k-s) ^ m_(k-s)
+            const SobolPolynomial & polynomial = sobolPolynomials[j - 1];
+            s = polynomial.degree;
+            for (int k = 0; k < s; ++k)
+            {
+                m[k] = polynomial.m[k];
+            }
+            for (int k = s; k < SOBOL_BITS; ++k)
+            {
+                m[k] = m[k - s] ^ (m[k - s] << s);
+                for (int l = 1; l < s; ++l)
+                {
+                    if ((polynomial.a >> (s - 1 - l)) & 1)
+                    {
+                        m[k] ^= m[k - l] << l;
+                    }
+                }
+            }
+        }
+        for (int k = 0; k < SOBOL_BITS; ++k)
+        {
+            v[k] = m[k] << (SOBOL_BITS - 1 - k);
+        }
+    }
+}
+
+/*********************************************************************
+**  sobol_shifts()
+**
+**  Purpose :
+**      random digital shift of each dimension, which is xored to the
+**      points of the sequence, drawn from the first block of a seed.
+**
+**  Parameters:
+**
+**        seed      : non-negative integer, no shift if it is 0
+**        dimension : number of dimensions
+**        shifts    : a shift per dimension, set by this function
+**********************************************************************/
+void
+sobol_shifts(uint64_t seed, size_t dimension, std::vector<uint64_t> & shifts)
+{
+    shifts.assign(dimension, 0);
+    if (seed)
+    {
+        XllRandomStream stream(seed, 0);
+        for (size_t j = 0; j < dimension; ++j)
+        {
+            shifts[j] = stream.next() >> (64 - SOBOL_BITS);
+        }
+    }
+}
+
+/*********************************************************************
+**  sobol_points()
+**
+**  Purpose :
+**      compute points [begin, end) of the Sobol sequence, point i being
+**      the one of index i + 1 so that the origin is left out.  The
+**      first point follows from the Gray code of its index, the other
+**      ones from the previous point by a single direction number.
+**
+**  Parameters:
+**
+**        directions : see sobol_directions
+**        shifts     : see sobol_shifts
+**        dimension  : number of dimensions
+**        begin, end : range of points
+**        u          : (end - begin) * dimension values in (0, 1), set
+**                     by this function, row by row
+**********************************************************************/
+void
+sobol_points(const uint64_t * directions, const uint64_t * shifts, size_t dimension,
+             size_t begin, size_t end, double * u)
+{
+    const size_t d = dimension;
+    std::vector<uint64_t> x(d, 0);
+    const uint64_t gray = (begin + 1) ^ ((begin + 1) >> 1);
+    for (size_t j = 0; j < d; ++j)
+    {
+        const uint64_t * v = directions + j * SOBOL_BITS;
+        for (int k = 0; k < SOBOL_BITS && (gray >> k); ++k)
+        {
+            if ((gray >> k) & 1)
+            {
+                x[j] ^= v[k];
+            }
+        }
+    }
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (i > begin)
+        {
+            // Gray codes of i and i + 1 differ by the lowest bit set in i + 1
+            int c = 0;
+            while (!(((i + 1) >> c) & 1))
+            {
+                ++c;
+            }
+            for (size_t j = 0; j < d; ++j)
+            {
+                x[j] ^= directions[j * SOBOL_BITS + c];
+            }
+        }
+        for (size_t j = 0; j < d; ++j)
+        {
+            *u++ = sobolValue(x[j] ^ shifts[j]);
+        }
+    }
+}
+
+/*********************************************************************
+**  coerceMarginals()
+**
+**  Purpose :
+**      read the marginals of a design: a number of dimensions, which
+**      are uniform on [0, 1], or one row per marginal, with either the
+**      handle of an OT_MAKE_DISTRIBUTION cell, or a name and its
+**      parameters followed by blank cells.
+**
+**  Parameters:
+**
+**        prefix       : name of the function, for error messages
+**        xl_marginals : the argument
+**        marginals    : a DesignMarginal per dimension, set if success
+**        inputs       : ObjectInputs the cells and handles are added to,
+**                       or NULL
+**
+**  Returns :
+**        NULL if success, the error to return to Excel otherwise
+**********************************************************************/
+LPXLOPER12
+coerceMarginals(const std::string & prefix, LPXLOPER12 xl_marginals, std::vector<DesignMarginal> & marginals,
+                ObjectInputs * inputs)
+{
+    DesignMarginal marginal;
+    marginal.family = DISTRIBUTION_UNIFORM;
+    marginal.uniform = true;
+    marginal.a = 0.0;
+    marginal.b = 1.0;
+    if (xl_marginals->xltype == xltypeNum || xl_marginals->xltype == xltypeInt)
+    {
+        int dimension = 0;
+        int error = xloper_to_int(xl_marginals, &dimension);
+        if (error != -1 || dimension <= 0 || dimension > DESIGN_MAX_DIMENSIONS)
+        {
+            return dialogError(prefix + "The number of dimensions must be an integer between 1 and 16384", error != -1 ? error : xlerrValue);
+        }
+        const OT::NumericalScalar bounds[2] = { 0.0, 1.0 };
+        marginal.distribution = getDistribution(DISTRIBUTION_UNIFORM, bounds, 2);
+        marginals.assign(dimension, marginal);
+        if (inputs)
+        {
+            XLOPER12 xl_int;
+            xl_int.xltype = xltypeInt;
+            xl_int.val.w = dimension;
+            inputs->hash = hash_xloper(xl_int, inputs->hash);
+        }
+        return NULL;
+    }
+
+    XLOPER12 cells;
+    int error = xloper_to_multi(xl_marginals, &cells);
+    if (error != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeMulti for argument 'marginals'", error);
+    }
+    if (inputs)
+    {
+        inputs->hash = hash_xloper(cells, inputs->hash);
+    }
+    const RW rows = cells.val.array.rows;
+    const COL columns = cells.val.array.columns;
+    std::string message;
+    for (RW i = 0; i < rows && message.empty(); ++i)
+    {
+        LPXLOPER12 row = cells.val.array.lparray + (size_t) i * columns;
+        std::string name;
+        StoredDistribution stored;
+        if (getObjectHandle(row, name))
+        {
+            if (!findDistribution(name, stored))
+            {
+                message = "Unknown distribution '" + name + "'";
+                break;
+            }
+            if (inputs)
+            {
+                addObjectHandle(*inputs, name);
+            }
+        }
+        else if (xloper_to_string(row, &name) == -1 && findDistributionFamily(name, stored.family))
+        {
+            COL j = 1;
+            while (j < columns && row[j].xltype == xltypeNum && stored.count < DISTRIBUTION_MAX_PARAMETERS)
+            {
+                stored.parameters[stored.count++] = row[j++].val.num;
+            }
+            for (; j < columns; ++j)
+            {
+                if (row[j].xltype != xltypeNil && !(row[j].xltype == xltypeStr && row[j].val.str[0] == 0))
+                {
+                    message = "Invalid parameters of the " + name + " distribution";
+                }
+            }
+            try
+            {
+                if (message.empty())
+                {
+                    stored.distribution = getDistribution(stored.family, stored.parameters, stored.count);
+                }
+            }
+            catch(OT::Exception & e)
+            {
+                message = e.what();
+            }
+            catch(std::exception & e)
+            {
+                message = e.what();
+            }
+        }
+        else
+        {
+            message = name.empty() ? "Invalid marginal" : "Unknown distribution '" + name + "'";
+        }
+        marginal.family = stored.family;
+        marginal.uniform = stored.family == DISTRIBUTION_UNIFORM && stored.count == 2;
+        marginal.a = marginal.uniform ? stored.parameters[0] : 0.0;
+        marginal.b = marginal.uniform ? stored.parameters[1] : 1.0;
+        marginal.distribution = stored.distribution;
+        marginals.push_back(marginal);
+    }
+    Excel12f(xlFree, 0, 1, (LPXLOPER12) &cells);
+    if (!message.empty())
+    {
+        return dialogError(prefix + message + " in argument 'marginals'", xlerrValue);
+    }
+    return NULL;
+}
+
+/***********************************************************************************
+ OT_DOE()
+
+ Purpose:
+
+      This function takes 4 arguments and builds a design of experiments:
+      a Latin hypercube, or the first points of the Sobol or Halton
+      sequence, mapped to the given marginals by their quantiles.  Designs
+      are reproducible, they only depend on their arguments, not on the
+      number of threads; large ones are filled in parallel, straight into
+      the cells of the result.
+
+ Parameters:
+
+      LPXLOPER12      4 arguments : xl_kind, xl_marginals, xl_size, xl_seed
+                      xl_kind is "LHS", "Sobol" or "Halton";
+                      xl_marginals is a number of dimensions, uniform on
+                      [0, 1], or one row per dimension with the handle of
+                      an OT_MAKE_DISTRIBUTION cell, or a name and its
+                      parameters as for OT_DIST_PDF;
+                      xl_size is the number of points, or missing to fill
+                      the selected range;
+                      xl_seed is a non-negative integer, 0 if missing,
+                      which draws the Latin hypercube, and randomly
+                      shifts the sequences unless it is 0
+
+ Returns:
+
+      LPXLOPER12      one row per point and one column per dimension
+                      or #VALUE! if there are non-numerics in the
+                      supplied arguments.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_DOE(LPXLOPER12 xl_kind, LPXLOPER12 xl_marginals, LPXLOPER12 xl_size, LPXLOPER12 xl_seed)
+{
+    const std::string prefix = "(OT_DOE): ";
+    std::vector<DesignMarginal> marginals;
+    DesignContext design;
+    std::string name;
+    int rows = 0;
+    double seed = 0.0;
+    int error = -1;
+    XLL_PROFILE_START();
+
+    // Coerce the kind of design and its marginals
+    //============================================
+    if((error = xloper_to_string(xl_kind, &name)) != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeStr for argument 'kind'", error);
+    }
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    design.kind = DESIGN_KINDS;
+    for (int k = 0; k < DESIGN_KINDS; ++k)
+    {
+        if (name == designNames[k])
+        {
+            design.kind = (DesignKind) k;
+        }
+    }
+    if (design.kind == DESIGN_KINDS)
+    {
+        return dialogError(prefix + "Invalid argument 'kind', expected LHS, Sobol or Halton", xlerrValue);
+    }
+    LPXLOPER12 xError = coerceMarginals(prefix, xl_marginals, marginals);
+    if (xError)
+    {
+        return xError;
+    }
+    if (marginals.size() > DESIGN_MAX_DIMENSIONS)
+    {
+        return dialogError(prefix + "Designs have at most 16384 dimensions", xlerrValue);
+    }
+    if (design.kind == DESIGN_SOBOL && marginals.size() > SOBOL_DIMENSIONS)
+    {
+        return dialogError(prefix + "Sobol designs have at most 40 dimensions", xlerrValue);
+    }
+
+    // Coerce the size, or get it from the current selection
+    //=======================================================
+    if (xl_size->xltype == xltypeMissing || xl_size->xltype == xltypeNil)
+    {
+        rows = getNumberOfRows();
+        if (rows <= 0)
+        {
+            return dialogError(prefix + "detection of cell selection failed", xlerrValue);
+        }
+    }
+    else if((error = xloper_to_int(xl_size, &rows)) != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeInt for argument 'size'", error);
+    }
+    else if (rows <= 0)
+    {
+        return dialogError(prefix + "The size must be positive", xlerrValue);
+    }
+
+    // Coerce the seed
+    //================
+    if (xl_seed->xltype != xltypeMissing && xl_seed->xltype != xltypeNil)
+    {
+        if((error = xloper_to_num(xl_seed, &seed)) != -1)
+        {
+            return dialogError(prefix + "Invalid conversion to xltypeNum for argument 'seed'", error);
+        }
+        if (!(seed >= 0.0 && seed < 9007199254740992.0) || seed != std::floor(seed))
+        {
+            return dialogError(prefix + "The seed must be a non-negative integer", xlerrValue);
+        }
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_COERCE);
+
+    // Set up the design, the result first as it is the largest allocation
+    //=====================================================================
+    LPXLOPER12 xResult = new_multi(rows, (COL) marginals.size());
+    if (!xResult)
+    {
+        return NULL;
+    }
+    try
+    {
+        design.size = rows;
+        design.dimension = marginals.size();
+        design.seed = (uint64_t) seed;
+        design.marginals = &marginals;
+        design.failed = 0;
+        if (design.kind == DESIGN_SOBOL)
+        {
+            sobol_directions(design.dimension, design.directions);
+            sobol_shifts(design.seed, design.dimension, design.shifts);
+        }
+        else if (design.kind == DESIGN_HALTON)
+        {
+            design.offsets.assign(design.dimension, 0.0);
+            XllRandomStream stream(design.seed, 0);
+            for (unsigned int p = 2; design.primes.size() < design.dimension; ++p)
+            {
+                bool prime = true;
+                for (size_t k = 0; k < design.primes.size() && design.primes[k] * design.primes[k] <= p; ++k)
+                {
+                    prime = prime && p % design.primes[k] != 0;
+                }
+                if (prime)
+                {
+                    design.offsets[design.primes.size()] = design.seed ? stream.uniform() : 0.0;
+                    design.primes.push_back(p);
+                }
+            }
+        }
+        else
+        {
+            design.permutations.resize(design.size * design.dimension);
+            parallel_tasks(design.dimension, &shuffleDimensions, &design);
+        }
+    }
+    catch(std::exception & e)
+    {
+        free_result(xResult);
+        return dialogError(e.what(), xlerrValue);
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_SAMPLE);
+
+    //Fill the cells of the result
+    //============================
+    design.cells = xResult->val.array.lparray;
+    parallel_for(design.size, &fillDesign, &design);
+    if (design.failed)
+    {
+        free_result(xResult);
+        return dialogError(prefix + "Quantiles of the marginals cannot be computed", xlerrValue);
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
+    return xResult;
+}
@@ -0,0 +1,62 @@
+#ifndef __OT_DOE_H
+#define __OT_DOE_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <OT.hxx>
+#include "ot_distribution_cache.h"
+
+struct ObjectInputs;
+
+/*
+ * Designs of experiments of OT_DOE, also drawn by OT_SOBOL_INDICES.
+ *
+ * Points of the Sobol sequence only depend on their index: a range of
+ * points follows from its first one by the Gray code, so that a design is
+ * generated chunk by chunk, in any order, with the same values.  Values
+ * are integers of SOBOL_BITS bits divided by 2^SOBOL_BITS, with the
+ * direction numbers of Joe and Kuo up to SOBOL_DIMENSIONS dimensions.
+ */
+
+#define SOBOL_BITS 52
+#define SOBOL_DIMENSIONS 40
+
+/* Marginal of a design: uniform ones are scaled directly, other ones are
+   computed by their quantile */
+struct DesignMarginal
+{
+    DistributionFamily family;
+    bool uniform;
+    double a;
+    double b;
+    OT::Distribution distribution;
+};
+
+/* Value of a marginal at u in (0, 1), may throw for other marginals than uniform ones */
+inline double design_quantile(const DesignMarginal & marginal, double u)
+{
+    return marginal.uniform ? marginal.a + (marginal.b - marginal.a) * u : marginal.distribution.computeQuantile(u)[0];
+}
+
+/* Direction numbers of the first dimension dimensions, SOBOL_BITS per dimension */
+void sobol_directions(size_t dimension, std::vector<uint64_t> & directions);
+/* Digital shift of each dimension drawn from a seed, none if it is 0 */
+void sobol_shifts(uint64_t seed, size_t dimension, std::vector<uint64_t> & shifts);
+/* Points [begin, end) of a shifted sequence, the origin being left out, into u row by row */
+void sobol_points(const uint64_t * directions, const uint64_t * shifts, size_t dimension,
+                  size_t begin, size_t end, double * u);
+
+/* Marginals from a number of dimensions, or rows of handles or names and parameters, hashed into inputs if it
+   is given; NULL, or the error to return */
+LPXLOPER12 coerceMarginals(const std::string & prefix, LPXLOPER12 xl_marginals, std::vector<DesignMarginal> & marginals,
+                           ObjectInputs * inputs = NULL);
+
+#endif // __OT_DOE_H
@@ -0,0 +1,309 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <framewrk.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <OT.hxx>
+#include "xll_helper_functions.h"
+#include "ot_functions.h"
+#include "xll_profile.h"
+#include "ot_distribution_cache.h"
+#include "ot_object_store.h"
+#include "xll_thread_pool.h"
+#include "xll_result_pool.h"
+
+namespace {
+
+// How OT_FIT_BEST ranks the families, the lowest value first
+enum FitCriterion
+{
+    CRITERION_BIC = 0,          // -2 log-likelihood + parameters * log(size)
+    CRITERION_KOLMOGOROV        // largest distance between the empirical and fitted CDF
+};
+
+// Fit of a family, computed by a task of its own
+struct FamilyFit
+{
+    DistributionFamily family;
+    bool fitted;
+    OT::NumericalScalar parameters[DISTRIBUTION_MAX_PARAMETERS];
+    int count;
+    double value;
+};
+
+// State shared by the tasks of OT_FIT_BEST, see fitFamilies
+struct FitJob
+{
+    const OT::NumericalSample * sample;
+    FitCriterion criterion;
+    std::vector<FamilyFit> * fits;
+};
+
+// Lower value first, families which could not be fitted last, ties in the order of the table
+bool betterFit(const FamilyFit & a, const FamilyFit & b)
+{
+    if (a.fitted != b.fitted)
+    {
+        return a.fitted;
+    }
+    if (a.value != b.value)
+    {
+        return a.value < b.value;
+    }
+    return a.family < b.family;
+}
+
+/*
+ * Fit the families [begin, end) of a job and compute their criterion.  The
+ * sample is sorted when the criterion is the Kolmogorov statistic.  Each
+ * family only depends on the sample, results do not depend on the thread
+ * which computes them.
+ */
+void fitFamilies(void * context, size_t begin, size_t end)
+{
+    const FitJob & job = *static_cast<const FitJob *>(context);
+    const OT::NumericalSample & sample = *job.sample;
+    const size_t size = sample.getSize();
+    for (size_t i = begin; i < end; ++i)
+    {
+        FamilyFit & fit = (*job.fits)[i];
+        fit.fitted = false;
+        try
+        {
+            const OT::Distribution distribution = fitDistribution(fit.family, sample, fit.parameters, fit.count);
+            double value = 0.0;
+            if (job.criterion == CRITERION_BIC)
+            {
+                const OT::NumericalSample logPDF = distribution.computeLogPDF(sample);
+                for (size_t j = 0; j < size; ++j)
+                {
+                    value -= 2.0 * logPDF(j, 0);
+                }
+                value += fit.count * std::log((double) size);
+            }
+            else
+            {
+                const OT::NumericalSample cdf = distribution.computeCDF(sample);
+                for (size_t j = 0; j < size; ++j)
+                {
+                    const double below = cdf(j, 0) - (double) j / size;
+                    const double above = (double) (j + 1) / size - cdf(j, 0);
+                    value = std::max(value, std::max(below, above));
+                }
+            }
+            // A point outside of the support gives an infinite BIC, the family is then not a fit
+            fit.value = value;
+            fit.fitted = value < HUGE_VAL;
+        }
+        catch(...)
+        {
+            // Families which OpenTURNS cannot fit to this sample are left out
+        }
+    }
+}
+
+// Counted string for a cell of a result, released by xlAutoFree12
+void setName(XLOPER12 & cell, const char * text)
+{
+    const int length = (int) strlen(text);
+    cell.xltype = xltypeStr;
+    cell.val.str = new XCHAR[length + 1];
+    cell.val.str[0] = (XCHAR) length;
+    for (int i = 0; i < length; ++i)
+    {
+        cell.val.str[i + 1] = (XCHAR) text[i];
+    }
+}
+
+} // empty namespace
+
+/***********************************************************************************
+ OT_FIT_BEST()
+
+ Purpose:
+
+      This function takes 3 arguments, fits distribution families to a sample
+      with the factories of OpenTURNS and ranks them.  Families are fitted in
+      parallel, each one by a task of the thread pool, see parallel_tasks.
+
+ Parameters:
+
+      LPXLOPER12      3 arguments : xl_sample, xl_families, xl_criterion
+                      xl_sample is a single column, or the handle of an
+                      OT_MAKE_SAMPLE cell of dimension 1; xl_families are
+                      names of ot_distribution_cache.h, all of them if it
+                      is missing; xl_criterion is "BIC" (default) or
+                      "Kolmogorov"
+
+ Returns:
+
+      LPXLOPER12      one row per family which could be fitted, the best
+                      one first: its name, the value of the criterion and
+                      its parameters, in the order of OT_DIST_PDF;
+                      or #VALUE! if there are non-numerics in the supplied
+                      sample, or if no family could be fitted.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_FIT_BEST(LPXLOPER12 xl_sample, LPXLOPER12 xl_families, LPXLOPER12 xl_criterion)
+{
+    const std::string prefix = "(OT_FIT_BEST): ";
+    OT::NumericalSample sample;
+    std::vector<FamilyFit> fits;
+    FitCriterion criterion = CRITERION_BIC;
+    int error = -1;
+    XLL_PROFILE_START();
+
+    // Coerce the sample, the families and the criterion
+    //===================================================
+    LPXLOPER12 xError = coerceSampleColumn(prefix, "sample", xl_sample, sample);
+    if (xError)
+    {
+        return xError;
+    }
+    if (sample.getSize() < 2)
+    {
+        return dialogError(prefix + "Invalid argument 'sample', it must have at least 2 values", xlerrValue);
+    }
+    std::vector<bool> wanted(DISTRIBUTION_FAMILIES, xl_families->xltype == xltypeMissing || xl_families->xltype == xltypeNil);
+    if (!wanted[0])
+    {
+        XLOPER12 cells;
+        if((error = xloper_to_multi(xl_families, &cells)) != -1)
+        {
+            return dialogError(prefix + "Invalid conversion to xltypeMulti for argument 'families'", error);
+        }
+        const size_t size = (size_t) cells.val.array.rows * cells.val.array.columns;
+        std::string name;
+        for (size_t i = 0; i < size && error == -1; ++i)
+        {
+            DistributionFamily family;
+            if (cells.val.array.lparray[i].xltype == xltypeNil)
+            {
+                continue;
+            }
+            error = xloper_to_string(&cells.val.array.lparray[i], &name);
+            if (error == -1 && !findDistributionFamily(name, family))
+            {
+                error = xlerrValue;
+            }
+            if (error == -1)
+            {
+                wanted[family] = true;
+            }
+        }
+        Excel12f(xlFree, 0, 1, (LPXLOPER12) &cells);
+        if (error != -1)
+        {
+            return dialogError(prefix + "Unknown distribution '" + name + "' in argument 'families'", error);
+        }
+    }
+    if (xl_criterion->xltype != xltypeMissing && xl_criterion->xltype != xltypeNil)
+    {
+        std::string name;
+        if((error = xloper_to_string(xl_criterion, &name)) != -1)
+        {
+            return dialogError(prefix + "Invalid conversion to xltypeStr for argument 'criterion'", error);
+        }
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (name == "kolmogorov" || name == "ks")
+        {
+            criterion = CRITERION_KOLMOGOROV;
+        }
+        else if (name != "bic")
+        {
+            return dialogError(prefix + "Invalid argument 'criterion', expected BIC or Kolmogorov", xlerrValue);
+        }
+    }
+    for (int i = 0; i < DISTRIBUTION_FAMILIES; ++i)
+    {
+        if (wanted[i])
+        {
+            FamilyFit fit;
+            fit.family = (DistributionFamily) i;
+            fit.count = 0;
+            fits.push_back(fit);
+        }
+    }
+    if (criterion == CRITERION_KOLMOGOROV)
+    {
+        // The empirical CDF is read on the sorted sample
+        std::sort(&sample(0, 0), &sample(0, 0) + sample.getSize());
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_SAMPLE);
+
+    // Fit the families, each one on a thread
+    //=======================================
+    FitJob job;
+    job.sample = &sample;
+    job.criterion = criterion;
+    job.fits = &fits;
+    parallel_tasks(fits.size(), &fitFamilies, &job);
+    std::sort(fits.begin(), fits.end(), &betterFit);
+    size_t rows = 0;
+    while (rows < fits.size() && fits[rows].fitted)
+    {
+        ++rows;
+    }
+    if (rows == 0)
+    {
+        return dialogError(prefix + "No distribution could be fitted to the sample", xlerrValue);
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
+
+    // Fill results, names are strings which xlAutoFree12 must release
+    //================================================================
+    const COL columns = 2 + DISTRIBUTION_MAX_PARAMETERS;
+    LPXLOPER12 xResult = new_result_multi((RW) rows, columns, false);
+    if (!xResult)
+    {
+        return NULL;
+    }
+    LPXLOPER12 px = xResult->val.array.lparray;
+    for (size_t i = 0; i < rows; ++i, px += columns)
+    {
+        setName(px[0], getDistributionName(fits[i].family));
+        px[1].xltype = xltypeNum;
+        px[1].val.num = fits[i].value;
+        for (int j = 0; j < DISTRIBUTION_MAX_PARAMETERS; ++j)
+        {
+            if (j < fits[i].count)
+            {
+                px[2 + j].xltype = xltypeNum;
+                px[2 + j].val.num = fits[i].parameters[j];
+            }
+            else
+            {
+                // Excel would show 0 for an xltypeNil cell
+                setName(px[2 + j], "");
+            }
+        }
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_RESULT);
+    return xResult;
+}
@@ -0,0 +1,51 @@
+#ifndef __OT_FUNCTIONS_H
+#define __OT_FUNCTIONS_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+
+/*
+ * Worksheet functions exported by the add-in, see rgWorksheetFuncs in
+ * xll_functions.cpp for their registration.  They have C linkage so that
+ * their names are not decorated, which is needed when the add-in is not
+ * loaded by Excel but by the headless host (see otxll_host).
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+LPXLOPER12 WINAPI OT_NORMAL_PDF(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_point);
+LPXLOPER12 WINAPI OT_NORMAL_PDF_ARRAY(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_points);
+LPXLOPER12 WINAPI OT_NORMAL_PDF_DRAW(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma);
+LPXLOPER12 WINAPI OT_NORMAL_PDF_DRAW_CMD(int nrValues, LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma);
+FP12 * WINAPI OT_NORMAL_PDF_ARRAY_FP(double mu, double sigma, FP12 * points);
+FP12 * WINAPI OT_NORMAL_PDF_DRAW_FP(int nrValues, double mu, double sigma);
+LPXLOPER12 WINAPI OT_CACHE_CLEAR();
+LPXLOPER12 WINAPI OT_CACHE_STATS();
+void WINAPI OT_NORMAL_PDF_ARRAY_ASYNC(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_points, LPXLOPER12 xl_handle);
+void WINAPI OT_NORMAL_PDF_DRAW_ASYNC(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_handle);
+int WINAPI OT_ASYNC_CANCEL();
+int WINAPI OT_OBJECT_SWEEP();
+LPXLOPER12 WINAPI OT_DIST_PDF(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_points, LPXLOPER12 xl_missing);
+LPXLOPER12 WINAPI OT_DIST_LOGPDF(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_points, LPXLOPER12 xl_missing);
+LPXLOPER12 WINAPI OT_DIST_CDF(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_points, LPXLOPER12 xl_missing);
+LPXLOPER12 WINAPI OT_DIST_QUANTILE(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_probabilities, LPXLOPER12 xl_missing);
+LPXLOPER12 WINAPI OT_DIST_SAMPLE(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters, LPXLOPER12 xl_size, LPXLOPER12 xl_seed);
+LPXLOPER12 WINAPI OT_MAKE_DISTRIBUTION(LPXLOPER12 xl_name, LPXLOPER12 xl_parameters);
+LPXLOPER12 WINAPI OT_MAKE_SAMPLE(LPXLOPER12 xl_values, LPXLOPER12 xl_missing);
+LPXLOPER12 WINAPI OT_KERNEL_SMOOTHING_PDF(LPXLOPER12 xl_sample, LPXLOPER12 xl_points, LPXLOPER12 xl_bandwidth);
+LPXLOPER12 WINAPI OT_FIT_BEST(LPXLOPER12 xl_sample, LPXLOPER12 xl_families, LPXLOPER12 xl_criterion);
+LPXLOPER12 WINAPI OT_DOE(LPXLOPER12 xl_kind, LPXLOPER12 xl_marginals, LPXLOPER12 xl_size, LPXLOPER12 xl_seed);
+LPXLOPER12 WINAPI OT_PCE_BUILD(LPXLOPER12 xl_x, LPXLOPER12 xl_y, LPXLOPER12 xl_degree, LPXLOPER12 xl_marginals);
+LPXLOPER12 WINAPI OT_PCE_EVAL(LPXLOPER12 xl_handle, LPXLOPER12 xl_points);
+LPXLOPER12 WINAPI OT_PCE_SOBOL(LPXLOPER12 xl_handle);
+LPXLOPER12 WINAPI OT_SOBOL_INDICES(LPXLOPER12 xl_marginals, LPXLOPER12 xl_model, LPXLOPER12 xl_size, LPXLOPER12 xl_seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OT_FUNCTIONS_H
@@ -0,0 +1,328 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <framewrk.h>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <string>
+#include <vector>
+
+#include <OT.hxx>
+#include "xll_helper_functions.h"
+#include "ot_marshal.h"
+#include "ot_functions.h"
+#include "xll_profile.h"
+#include "ot_object_store.h"
+#include "ot_kernel_smoothing.h"
+
+namespace {
+
+typedef std::complex<double> Complex;
+
+const double invSqrt2Pi = 0.39894228040143267794;
+
+// In place radix-2 FFT of a power of two values, inverse if sign is 1, not scaled
+void fft(std::vector<Complex> & data, int sign)
+{
+    const size_t size = data.size();
+    for (size_t i = 1, j = 0; i < size; ++i)
+    {
+        size_t bit = size >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap(data[i], data[j]);
+        }
+    }
+    for (size_t length = 2; length <= size; length <<= 1)
+    {
+        const double angle = sign * 2.0 * 3.14159265358979323846 / length;
+        const Complex step(std::cos(angle), std::sin(angle));
+        for (size_t i = 0; i < size; i += length)
+        {
+            Complex w(1.0);
+            for (size_t k = 0; k < length / 2; ++k)
+            {
+                const Complex u = data[i + k];
+                const Complex v = data[i + k + length / 2] * w;
+                data[i + k] = u + v;
+                data[i + k + length / 2] = u - v;
+                w *= step;
+            }
+        }
+    }
+}
+
+// Sum of the kernels at a point of the sorted values [begin, end) which
+// are within KERNEL_TAIL bandwidths of it, for a sample of size n
+double nearSum(const double * begin, const double * end, size_t n, double h, double point)
+{
+    double sum = 0.0;
+    for (const double * v = std::lower_bound(begin, end, point - KERNEL_TAIL * h);
+         v != end && *v <= point + KERNEL_TAIL * h; ++v)
+    {
+        const double z = (point - *v) / h;
+        sum += std::exp(-0.5 * z * z);
+    }
+    return sum * invSqrt2Pi / (n * h);
+}
+
+} // empty namespace
+
+/****************************************************************
+** kernel_smoothing_binned()
+**
+** Purpose:
+**
+**      This function computes the kernel density estimate of a
+**      sample at given points on a grid, see ot_kernel_smoothing.h.
+**
+** Parameters:
+**
+**      6 argument : x, n, h, points, y, m
+**                   x is the sample of size n, h the bandwidth,
+**                   y receives the m values at points
+*****************************************************************/
+void
+kernel_smoothing_binned(const double * x, size_t n, double h, const double * points, double * y, size_t m)
+{
+    // Values on the grid, all of them unless the sample is too wide for
+    // KERNEL_MAX_BINS nodes: the grid then covers the window which holds
+    // the most values, and the sorted values around it are summed directly
+    std::vector<double> sorted;
+    const double * binned = x;
+    size_t count = n;
+    double lowest = *std::min_element(x, x + n);
+    double highest = *std::max_element(x, x + n);
+    const double width = (KERNEL_MAX_BINS - 2) * h / KERNEL_BINS_PER_BANDWIDTH - 2.0 * KERNEL_TAIL * h;
+    if (highest - lowest > width)
+    {
+        sorted.assign(x, x + n);
+        std::sort(sorted.begin(), sorted.end());
+        size_t first = 0;
+        count = 0;
+        for (size_t i = 0, j = 0; j < n; ++j)
+        {
+            while (sorted[j] - sorted[i] > width)
+            {
+                ++i;
+            }
+            if (j - i + 1 > count)
+            {
+                first = i;
+                count = j - i + 1;
+            }
+        }
+        binned = &sorted[first];
+        lowest = binned[0];
+        highest = binned[count - 1];
+    }
+    const double * farBegin = sorted.empty() ? NULL : &sorted[0];
+    const double * farEnd = farBegin ? farBegin + n : NULL;
+
+    // Grid of nodes over the binned values and the tails of the kernel
+    const double low = lowest - KERNEL_TAIL * h;
+    const double high = highest + KERNEL_TAIL * h;
+    const double wanted = std::ceil((high - low) / h * KERNEL_BINS_PER_BANDWIDTH) + 1.0;
+    const size_t bins = wanted < KERNEL_MAX_BINS ? (size_t) wanted : KERNEL_MAX_BINS;
+    const double delta = (high - low) / (bins - 1);
+
+    // Kernel truncated at KERNEL_TAIL bandwidths, the circular convolution
+    // by FFT does not wrap around if the buffer holds bins + reach values
+    const double tail = std::ceil(KERNEL_TAIL * h / delta);
+    const size_t reach = tail < bins - 1 ? (size_t) tail : bins - 1;
+    size_t size = 1;
+    while (size < bins + reach)
+    {
+        size <<= 1;
+    }
+
+    // Linear binning, each value is shared between the two nodes around it
+    std::vector<Complex> counts(size);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const double t = (binned[i] - low) / delta;
+        size_t j = (size_t) t;
+        if (j > bins - 2)
+        {
+            j = bins - 2;
+        }
+        const double weight = t - j;
+        counts[j] += 1.0 - weight;
+        counts[j + 1] += weight;
+    }
+
+    std::vector<Complex> kernel(size);
+    const double scale = invSqrt2Pi / (n * h * size);
+    for (size_t l = 0; l <= reach; ++l)
+    {
+        const double z = l * delta / h;
+        kernel[l] = std::exp(-0.5 * z * z) * scale;
+        if (l > 0)
+        {
+            kernel[size - l] = kernel[l];
+        }
+    }
+
+    fft(counts, -1);
+    fft(kernel, -1);
+    for (size_t k = 0; k < size; ++k)
+    {
+        counts[k] *= kernel[k];
+    }
+    fft(counts, 1);
+
+    // Linear interpolation between the nodes, rounding errors of the FFT may give tiny negative values
+    for (size_t i = 0; i < m; ++i)
+    {
+        const double t = (points[i] - low) / delta;
+        if (!(t >= 0.0 && t <= bins - 1))
+        {
+            // Beyond the tails of the binned values, only the sorted values left out of the grid may be near
+            y[i] = farBegin ? nearSum(farBegin, farEnd, n, h, points[i]) : 0.0;
+            continue;
+        }
+        size_t j = (size_t) t;
+        if (j > bins - 2)
+        {
+            j = bins - 2;
+        }
+        const double weight = t - j;
+        const double value = (1.0 - weight) * counts[j].real() + weight * counts[j + 1].real();
+        y[i] = value > 0.0 ? value : 0.0;
+        if (farBegin)
+        {
+            // Values left out of the grid, on either side of the binned ones
+            const double point = points[i];
+            y[i] += nearSum(farBegin, binned, n, h, point) + nearSum(binned + count, farEnd, n, h, point);
+        }
+    }
+}
+
+/***********************************************************************************
+ OT_KERNEL_SMOOTHING_PDF()
+
+ Purpose:
+
+      This function takes 3 arguments and computes the kernel density estimate
+      of a sample, with a normal kernel, at given points.  Small problems are
+      computed by OT::KernelSmoothing, large ones on a grid by FFT, see
+      ot_kernel_smoothing.h.
+
+ Parameters:
+
+      LPXLOPER12      3 arguments : xl_sample, xl_points, xl_bandwidth
+                      xl_sample and xl_points are a single column each, or
+                      the handle of an OT_MAKE_SAMPLE cell of dimension 1;
+                      xl_bandwidth is positive, or missing for the rule of
+                      Silverman
+
+ Returns:
+
+      LPXLOPER12      the estimated density at given points, as a column,
+                      or #VALUE! if there are non-numerics in the supplied
+                      arguments.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_KERNEL_SMOOTHING_PDF(LPXLOPER12 xl_sample, LPXLOPER12 xl_points, LPXLOPER12 xl_bandwidth)
+{
+    const std::string prefix = "(OT_KERNEL_SMOOTHING_PDF): ";
+    OT::NumericalSample sample, points;
+    double bandwidth = 0.0;
+    int error = -1;
+    XLL_PROFILE_START();
+
+    // Coerce the sample and the points
+    //=================================
+    LPXLOPER12 xError = coerceSampleColumn(prefix, "sample", xl_sample, sample);
+    if (xError)
+    {
+        return xError;
+    }
+    if (sample.getSize() == 0)
+    {
+        return dialogError(prefix + "Invalid argument 'sample', it is empty", xlerrValue);
+    }
+    if ((xError = coerceSampleColumn(prefix, "points", xl_points, points)))
+    {
+        return xError;
+    }
+    if (xl_bandwidth->xltype != xltypeMissing && xl_bandwidth->xltype != xltypeNil)
+    {
+        if((error = xloper_to_num(xl_bandwidth, &bandwidth)) != -1)
+        {
+            return dialogError(prefix + "Invalid conversion to xltypeNum for argument 'bandwidth'", error);
+        }
+        if (!(bandwidth > 0.0 && bandwidth < HUGE_VAL))
+        {
+            return dialogError(prefix + "Invalid argument 'bandwidth', it must be positive", xlerrNum);
+        }
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_SAMPLE);
+
+    //Compute the density on points
+    //=============================
+    try
+    {
+        OT::KernelSmoothing smoothing;
+        if (bandwidth == 0.0)
+        {
+            bandwidth = smoothing.computeSilvermanBandwidth(sample)[0];
+            if (!(bandwidth > 0.0 && bandwidth < HUGE_VAL))
+            {
+                return dialogError(prefix + "Invalid argument 'sample', its values must not all be equal", xlerrNum);
+            }
+        }
+        const size_t size = sample.getSize();
+        const size_t count = points.getSize();
+        if (count > 0 && (double) size * count <= KERNEL_DIRECT_LIMIT)
+        {
+            points = smoothing.build(sample, OT::NumericalPoint(1, bandwidth)).computePDF(points);
+        }
+        else if (count > 0)
+        {
+            kernel_smoothing_binned(&sample(0, 0), size, bandwidth, &points(0, 0), &points(0, 0), count);
+        }
+        XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
+    }
+    catch(OT::Exception & e)
+    {
+        return dialogError(e.what(), xlerrValue);
+    }
+    catch(std::exception & e)
+    {
+        return dialogError(e.what(), xlerrValue);
+    }
+
+    // Fill results
+    //=============
+    LPXLOPER12 xResult = sample_to_multi(points);
+    XLL_PROFILE_LAP(XLL_STAGE_RESULT);
+    return xResult;
+}
@@ -0,0 +1,42 @@
+#ifndef __OT_KERNEL_SMOOTHING_H
+#define __OT_KERNEL_SMOOTHING_H
+
+#include <stddef.h>
+
+/*
+ * Binned evaluation of the kernel density estimate of a sample with a
+ * normal kernel,
+ *
+ *     f(x) = 1 / (n h) sum_i phi((x - x_i) / h),
+ *
+ * for OT_KERNEL_SMOOTHING_PDF when the sample and the points are too large
+ * for the n * m terms of the sum (see KERNEL_DIRECT_LIMIT), which are left
+ * to OT::KernelSmoothing otherwise.
+ *
+ * The sample is spread over a regular grid by linear binning, each value
+ * being shared between the two nodes around it, then the grid is convolved
+ * with the kernel by FFT, and the estimate is interpolated linearly between
+ * the nodes at each point: the cost is O(n + M log M + m) for M nodes.  The
+ * grid covers the sample and KERNEL_TAIL bandwidths on each side, beyond
+ * which the kernel is truncated, with KERNEL_BINS_PER_BANDWIDTH nodes per
+ * bandwidth, so that the relative error is about 1e-4 where the density is
+ * not negligible.  The estimate is 0 at points outside the grid, which are
+more than KERNEL_TAIL bandwidths away from the binned values.
+ *
+ * The grid has at most KERNEL_MAX_BINS nodes.  When the sample is too wide
+ * for them, e.g. with a far outlier, the grid only covers the window which
+ * holds the most values, and the values left out of it are added by the
+ * sum, restricted to those within KERNEL_TAIL bandwidths of each point, at
+points outside the grid too.
+ */
+
+#define KERNEL_DIRECT_LIMIT 1048576
+#define KERNEL_BINS_PER_BANDWIDTH 32
+#define KERNEL_MAX_BINS 1048576
+#define KERNEL_TAIL 6.0
+
+/* y[i] = kernel density estimate of sample x[0..n) with bandwidth h at points[i],
+   n > 0 and h > 0; points and y may be the same array */
+void kernel_smoothing_binned(const double * x, size_t n, double h, const double * points, double * y, size_t m);
+
+#endif // __OT_KERNEL_SMOOTHING_H
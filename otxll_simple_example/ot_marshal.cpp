@@ -0,0 +1,408 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cstring>
+
+#include "ot_marshal.h"
+#include "xll_helper_functions.h"
+#include "xll_result_pool.h"
+
+namespace {
+
+// Destination of the blocks of read_range: numbers are copied at data,
+// which has room for size more of them
+struct RangeReader
+{
+    OT::NumericalScalar * data;
+    size_t size;
+};
+
+int readBlock(void * context, const double * values, RW rows, COL columns)
+{
+    RangeReader & reader = *static_cast<RangeReader *>(context);
+    const size_t count = (size_t) rows * columns;
+    if (count > reader.size)
+    {
+        return xlerrValue;
+    }
+    memcpy(reader.data, values, count * sizeof(double));
+    reader.data += count;
+    reader.size -= count;
+    return -1;
+}
+
+// Only count the rows of the blocks, see count_range_rows
+int countBlock(void * context, const double * /* values */, RW rows, COL /* columns */)
+{
+    *static_cast<size_t *>(context) += rows;
+    return -1;
+}
+
+// Read a range into the buffer of a sample, which it must fill exactly
+int readSample(LPXLOPER12 xl_range, XllCellPolicy policy, OT::NumericalSample & sample, ULONGLONG * hash = NULL)
+{
+    RangeReader reader;
+    reader.size = (size_t) sample.getSize() * sample.getDimension();
+    reader.data = reader.size > 0 ? &sample(0, 0) : NULL;
+    const int error = read_range(xl_range, &readBlock, &reader, policy, hash);
+    return error != -1 || reader.size == 0 ? error : xlerrValue;
+}
+
+} // empty namespace
+
+/*********************************************************************
+**  count_range_rows()
+**
+**  Purpose :
+**      tell how many rows read_range gives for a range.  With
+**      CELLS_SKIP, or to hash the range, the range is read once
+**      without keeping its values, so that a function can tell
+**      whether its inputs changed, then allocate its sample, before
+**      reading the values with range_to_sample.
+**
+**  Parameters:
+**
+**        xl_range : value or reference, see read_range
+**        policy   : XllCellPolicy for the cells which are not numbers
+**        rows     : set to the number of rows
+**        columns  : set to the number of columns
+**        hash     : if not NULL, updated with the range, see read_range
+**
+**  Returns :
+**        -1 if success, the error of read_range otherwise
+**********************************************************************/
+int
+count_range_rows(LPXLOPER12 xl_range, XllCellPolicy policy, RW * rows, COL * columns, ULONGLONG * hash)
+{
+    int error = get_range_shape(xl_range, rows, columns);
+    if (error != -1 || (policy != CELLS_SKIP && !hash))
+    {
+        return error;
+    }
+    size_t count = 0;
+    if ((error = read_range(xl_range, &countBlock, &count, policy, hash)) == -1)
+    {
+        *rows = (RW) count;
+    }
+    return error;
+}
+
+/*********************************************************************
+**  range_to_sample()
+**
+**  Purpose :
+**      read a range by blocks into a sample with one point per row,
+**      see read_range, so that the range is never held at once in an
+**      xltypeMulti.
+**
+**  Parameters:
+**
+**        xl_range : value or reference, see read_range
+**        policy   : XllCellPolicy for the cells which are not numbers
+**        rows     : number of rows given by count_range_rows
+**        columns  : number of columns
+**        sample   : OT::NumericalSample, resized by this function
+**        hash     : if not NULL, updated with the range, see read_range
+**
+**  Returns :
+**        -1 if success, the error of read_range otherwise
+**********************************************************************/
+int
+range_to_sample(LPXLOPER12 xl_range, XllCellPolicy policy, RW rows, COL columns, OT::NumericalSample & sample,
+                ULONGLONG * hash)
+{
+    sample = OT::NumericalSample(rows, columns);
+    return readSample(xl_range, policy, sample, hash);
+}
+
+/*********************************************************************
+**  range_to_values()
+**
+**  Purpose :
+**      copy a value or a reference of any shape into a sample of
+**      dimension 1, one point per cell, for functions which evaluate
+**      each cell on its own.  The range is read by blocks, see
+**      read_range, and the result is shaped back by sample_to_multi.
+**
+**  Parameters:
+**
+**        xl_range : value or reference
+**        sample   : OT::NumericalSample, resized by this function
+**        rows     : set to the number of rows of the range
+**        columns  : set to its number of columns
+**        hash     : if not NULL, updated with the range, see read_range
+**
+**  Returns :
+**        -1 if success, the error of the first cell which is not a
+**        number otherwise
+**********************************************************************/
+int
+range_to_values(LPXLOPER12 xl_range, OT::NumericalSample & sample, RW * rows, COL * columns, ULONGLONG * hash)
+{
+    const int error = get_range_shape(xl_range, rows, columns);
+    if (error != -1)
+    {
+        return error;
+    }
+    sample = OT::NumericalSample((size_t) *rows * *columns, 1);
+    return readSample(xl_range, CELLS_ERROR, sample, hash);
+}
+
+/*********************************************************************
+**  range_to_values()
+**
+**  Purpose :
+**      same as above, for functions which give #N/A for the cells which
+**      are not numbers instead of failing: only the numbers are kept
+**      in the sample, in order, and valid tells which cells they come
+**      from.  The result is shaped back by sample_to_multi with valid.
+**
+**  Parameters:
+**
+**        xl_range : value or reference
+**        sample   : OT::NumericalSample, resized by this function
+**        rows     : set to the number of rows of the range
+**        columns  : set to its number of columns
+**        valid    : bitmap of the cells, resized by this function
+**
+**  Returns :
+**        -1 if success, an error if the range cannot be coerced
+**********************************************************************/
+int
+range_to_values(LPXLOPER12 xl_range, OT::NumericalSample & sample, RW * rows, COL * columns,
+                std::vector<DWORD> & valid)
+{
+    int error = get_range_shape(xl_range, rows, columns);
+    if (error != -1)
+    {
+        return error;
+    }
+    const size_t size = (size_t) *rows * *columns;
+    sample = OT::NumericalSample(size, 1);
+    valid.assign(CELL_BITMAP_SIZE(size), 0);
+    if ((error = readSample(xl_range, CELLS_NAN, sample)) != -1 || size == 0)
+    {
+        return error;
+    }
+
+    // Cells hold no NaN, those come from the cells which are not numbers
+    OT::NumericalScalar * values = &sample(0, 0);
+    size_t count = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (values[i] == values[i])
+        {
+            valid[i / 32] |= (DWORD) 1 << (i % 32);
+            values[count++] = values[i];
+        }
+    }
+    if (count < size)
+    {
+        OT::NumericalSample numbers(count, 1);
+        if (count > 0)
+        {
+            memcpy(&numbers(0, 0), values, count * sizeof(double));
+        }
+        sample = numbers;
+    }
+    return -1;
+}
+
+/*********************************************************************
+**  new_multi()
+**
+**  Purpose :
+**      allocate an XLOPER12 of xltypeMulti type returned to Excel,
+**      whose cells will only hold numbers or errors; values are left
+**      uninitialized.
+**
+**  Parameters:
+**
+**        rows    : number of rows
+**        columns : number of columns
+**
+**  Returns :
+**        LPXLOPER12 with xlbitDLLFree set, so that Excel calls
+**        xlAutoFree12 when it is done with it; NULL if memory
+**        cannot be allocated
+**********************************************************************/
+LPXLOPER12
+new_multi(RW rows, COL columns)
+{
+    // xlbitDLLFree enables the DLL to release
+    // any dynamically allocated memory
+    // that was associated with the xloper
+    return new_result_multi(rows, columns, true);
+}
+
+/*********************************************************************
+**  sample_to_multi()
+**
+**  Purpose :
+**      copy a sample into a new xltypeMulti, one row per point and
+**      one column per component.  Values are read directly from the
+**      buffer of the sample.
+**
+**  Parameters:
+**
+**        sample : OT::NumericalSample
+**
+**  Returns :
+**        LPXLOPER12 allocated by new_multi
+**********************************************************************/
+LPXLOPER12
+sample_to_multi(const OT::NumericalSample & sample)
+{
+    return sample_to_multi(sample, sample.getSize(), sample.getDimension());
+}
+
+/*********************************************************************
+**  sample_to_multi()
+**
+**  Purpose :
+**      copy a sample into a new xltypeMulti of the given shape, which
+**      is filled row by row.
+**
+**  Parameters:
+**
+**        sample  : OT::NumericalSample of rows * columns values
+**        rows    : number of rows of the result
+**        columns : number of columns of the result
+**
+**  Returns :
+**        LPXLOPER12 allocated by new_multi, or NULL if the shape does
+**        not match the sample
+**********************************************************************/
+LPXLOPER12
+sample_to_multi(const OT::NumericalSample & sample, RW rows, COL columns)
+{
+    const size_t size = (size_t) rows * columns;
+    if ((size_t) sample.getSize() * sample.getDimension() != size)
+    {
+        return NULL;
+    }
+    LPXLOPER12 xResult = new_multi(rows, columns);
+    if (!xResult || size == 0)
+    {
+        return xResult;
+    }
+
+    const OT::NumericalScalar * pData = &sample(0, 0);
+    LPXLOPER12 px = xResult->val.array.lparray;
+    for (size_t i = 0; i < size; ++i, ++px, ++pData)
+    {
+        px->xltype = xltypeNum;
+        px->val.num = *pData;
+    }
+    return xResult;
+}
+
+/*********************************************************************
+**  sample_to_multi()
+**
+**  Purpose :
+**      same as above for the values read by range_to_values with a
+**      bitmap: they go in order to the cells whose bit is set, and
+**      other cells are #N/A.
+**
+**  Parameters:
+**
+**        sample  : OT::NumericalSample of dimension 1
+**        rows    : number of rows of the result
+**        columns : number of columns of the result
+**        valid   : bitmap of rows * columns cells
+**
+**  Returns :
+**        LPXLOPER12 allocated by new_multi, or NULL if the shape does
+**        not match the sample
+**********************************************************************/
+LPXLOPER12
+sample_to_multi(const OT::NumericalSample & sample, RW rows, COL columns,
+                const std::vector<DWORD> & valid)
+{
+    const size_t size = (size_t) rows * columns;
+    if (valid.size() != CELL_BITMAP_SIZE(size) || sample.getDimension() != 1)
+    {
+        return NULL;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        count += CELL_IS_VALID(valid, i);
+    }
+    if (count != (size_t) sample.getSize())
+    {
+        return NULL;
+    }
+    LPXLOPER12 xResult = new_multi(rows, columns);
+    if (!xResult || size == 0)
+    {
+        return xResult;
+    }
+
+    const OT::NumericalScalar * pData = count > 0 ? &sample(0, 0) : NULL;
+    LPXLOPER12 px = xResult->val.array.lparray;
+    for (size_t i = 0; i < size; ++i, ++px)
+    {
+        if (CELL_IS_VALID(valid, i))
+        {
+            px->xltype = xltypeNum;
+            px->val.num = *pData++;
+        }
+        else
+        {
+            px->xltype = xltypeErr;
+            px->val.err = xlerrNA;
+        }
+    }
+    return xResult;
+}
+
+/*********************************************************************
+**  sample_to_fp12()
+**
+**  Purpose :
+**      copy a sample into the buffer returned by new_fp12, with the
+**      given shape; values of the sample are read row by row.
+**
+**  Parameters:
+**
+**        sample  : OT::NumericalSample
+**        rows    : number of rows of the result
+**        columns : number of columns of the result
+**
+**  Returns :
+**        FP12 * valid until next call, or NULL if the shape does not
+**        match the sample or if memory cannot be allocated
+**********************************************************************/
+FP12 *
+sample_to_fp12(const OT::NumericalSample & sample, int rows, int columns)
+{
+    const size_t size = sample.getSize() * sample.getDimension();
+    if (size == 0 || size != (size_t) rows * columns)
+    {
+        return NULL;
+    }
+
+    FP12 * fpResult = new_fp12(rows, columns);
+    if (fpResult)
+    {
+        memcpy(fpResult->array, &sample(0, 0), size * sizeof(double));
+    }
+    return fpResult;
+}
@@ -0,0 +1,46 @@
+#ifndef __OT_MARSHAL_H
+#define __OT_MARSHAL_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <vector>
+
+#include <OT.hxx>
+#include "xll_helper_functions.h"
+
+/*
+ * Conversions between xltypeMulti or FP12 arrays and OT::NumericalSample.
+ * They all store values row by row, so numbers are copied in a single pass
+ * between Excel arrays and the buffer of the sample, without intermediate
+ * containers.  The range_to_* functions read ranges by blocks instead of
+ * coercing them to a single xltypeMulti, see read_range.
+ */
+
+/* Rows read_range gives for a range, reading it with CELLS_SKIP or to update hash if not NULL */
+int count_range_rows(LPXLOPER12 xl_range, XllCellPolicy policy, RW * rows, COL * columns, ULONGLONG * hash = NULL);
+/* Read the rows counted by count_range_rows into a sample with one point per row, by blocks */
+int range_to_sample(LPXLOPER12 xl_range, XllCellPolicy policy, RW rows, COL columns, OT::NumericalSample & sample,
+                    ULONGLONG * hash = NULL);
+/* Read a value or a reference of any shape into a sample of dimension 1, one point per cell, by blocks */
+int range_to_values(LPXLOPER12 xl_range, OT::NumericalSample & sample, RW * rows, COL * columns,
+                    ULONGLONG * hash = NULL);
+/* Same, for the cells which are numbers only, as marked in the bitmap valid */
+int range_to_values(LPXLOPER12 xl_range, OT::NumericalSample & sample, RW * rows, COL * columns,
+                    std::vector<DWORD> & valid);
+/* Allocate an xltypeMulti result, released by xlAutoFree12 */
+LPXLOPER12 new_multi(RW rows, COL columns);
+/* Copy a sample into a new xltypeMulti result */
+LPXLOPER12 sample_to_multi(const OT::NumericalSample & sample);
+/* Same, with the given shape, e.g. the values read by range_to_values */
+LPXLOPER12 sample_to_multi(const OT::NumericalSample & sample, RW rows, COL columns);
+/* Same, values going to the cells marked in valid, #N/A to the others */
+LPXLOPER12 sample_to_multi(const OT::NumericalSample & sample, RW rows, COL columns,
+                           const std::vector<DWORD> & valid);
+
+/* Copy a sample into the FP12 result buffer, see new_fp12 */
+FP12 * sample_to_fp12(const OT::NumericalSample & sample, int rows, int columns);
+
+#endif // __OT_MARSHAL_H
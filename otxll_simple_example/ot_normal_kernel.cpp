@@ -0,0 +1,311 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+#ifdef _MSC_VER
+# include <intrin.h>
+# include <immintrin.h>
+#else
+# include <cpuid.h>
+#endif
+
+#include "ot_normal_kernel.h"
+#include "ot_normal_kernel_impl.h"
+#include "xll_thread_pool.h"
+
+// Defined in ot_normal_kernel_avx.cpp, which is compiled for AVX
+extern const NormalKernel normalKernelAvx;
+
+namespace {
+
+// Plain C++, one value at a time
+struct ScalarOps
+{
+    typedef double Vec;
+    typedef bool Mask;
+    enum { WIDTH = 1 };
+
+    static Vec load(const double * p) { return *p; }
+    static void store(double * p, Vec a) { *p = a; }
+    static Vec set1(double a) { return a; }
+    static Vec add(Vec a, Vec b) { return a + b; }
+    static Vec sub(Vec a, Vec b) { return a - b; }
+    static Vec mul(Vec a, Vec b) { return a * b; }
+    static Vec div(Vec a, Vec b) { return a / b; }
+    // Like SSE2, the second operand is returned if one of them is NaN
+    static Vec min(Vec a, Vec b) { return a < b ? a : b; }
+    static Vec max(Vec a, Vec b) { return a > b ? a : b; }
+    static Mask less(Vec a, Vec b) { return a < b; }
+    static Mask isNaN(Vec a) { return a != a; }
+    static Vec select(Mask m, Vec a, Vec b) { return m ? a : b; }
+    // Conversions to integers truncate, |a| < 2^51
+    static Vec round(Vec a) { return (double) (long long) (a >= 0.0 ? a + 0.5 : a - 0.5); }
+    static Vec floor(Vec a)
+    {
+        const double t = (double) (long long) a;
+        return t > a ? t - 1.0 : t;
+    }
+    static Vec pow2(Vec k)
+    {
+        const unsigned long long bits = (unsigned long long) ((long long) k + 1023) << 52;
+        double result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+};
+
+// SSE2, 2 doubles at a time
+struct Sse2Ops
+{
+    typedef __m128d Vec;
+    typedef __m128d Mask;
+    enum { WIDTH = 2 };
+
+    static Vec load(const double * p) { return _mm_loadu_pd(p); }
+    static void store(double * p, Vec a) { _mm_storeu_pd(p, a); }
+    static Vec set1(double a) { return _mm_set1_pd(a); }
+    static Vec add(Vec a, Vec b) { return _mm_add_pd(a, b); }
+    static Vec sub(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+    static Vec mul(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+    static Vec div(Vec a, Vec b) { return _mm_div_pd(a, b); }
+    static Vec min(Vec a, Vec b) { return _mm_min_pd(a, b); }
+    static Vec max(Vec a, Vec b) { return _mm_max_pd(a, b); }
+    static Mask less(Vec a, Vec b) { return _mm_cmplt_pd(a, b); }
+    static Mask isNaN(Vec a) { return _mm_cmpunord_pd(a, a); }
+    static Vec select(Mask m, Vec a, Vec b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+    // Adding 1.5 * 2^52 leaves no fractional bits, and rounds to nearest
+    static Vec round(Vec a)
+    {
+        const Vec magic = _mm_set1_pd(6755399441055744.0);
+        return _mm_sub_pd(_mm_add_pd(a, magic), magic);
+    }
+    static Vec floor(Vec a)
+    {
+        const Vec r = round(a);
+        return _mm_sub_pd(r, _mm_and_pd(_mm_cmpgt_pd(r, a), _mm_set1_pd(1.0)));
+    }
+    // The low bits of k + 1023 + 1.5 * 2^52 are k + 1023, which is the biased exponent of 2^k
+    static Vec pow2(Vec k)
+    {
+        const Vec t = _mm_add_pd(k, _mm_set1_pd(6755399441055744.0 + 1023.0));
+        return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(t), 52));
+    }
+};
+
+const NormalKernel normalKernelScalar =
+{
+    "scalar",
+    &NormalKernelImpl<ScalarOps>::computePdf,
+    &NormalKernelImpl<ScalarOps>::computeLogPdf,
+    &NormalKernelImpl<ScalarOps>::computeCdf
+};
+
+const NormalKernel normalKernelSse2 =
+{
+    "sse2",
+    &NormalKernelImpl<Sse2Ops>::computePdf,
+    &NormalKernelImpl<Sse2Ops>::computeLogPdf,
+    &NormalKernelImpl<Sse2Ops>::computeCdf
+};
+
+const NormalKernel * const kernels[NORMAL_KERNEL_LEVELS] =
+{
+    &normalKernelScalar,
+    &normalKernelSse2,
+    &normalKernelAvx
+};
+
+// Features of CPUID leaf 1, false if it does not exist
+bool getCpuFeatures(unsigned int & ecx, unsigned int & edx)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 1)
+        return false;
+    __cpuid(info, 1);
+    ecx = (unsigned int) info[2];
+    edx = (unsigned int) info[3];
+    return true;
+#else
+    unsigned int eax, ebx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) != 0;
+#endif
+}
+
+// Register states saved by the system, see XGETBV
+unsigned long long getEnabledStates()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return ((unsigned long long) edx << 32) | eax;
+#endif
+}
+
+NormalKernelLevel detectLevel()
+{
+    unsigned int ecx = 0, edx = 0;
+    if (!getCpuFeatures(ecx, edx))
+        return NORMAL_KERNEL_SCALAR;
+    if (!(edx & (1u << 26)))
+        return NORMAL_KERNEL_SCALAR;
+    // AVX needs the OSXSAVE and AVX bits, and the system must save the YMM registers
+    if ((ecx & (1u << 27)) && (ecx & (1u << 28)) && (getEnabledStates() & 6) == 6)
+        return NORMAL_KERNEL_AVX;
+    return NORMAL_KERNEL_SSE2;
+}
+
+// Selected when the DLL is loaded, never changed afterwards
+const NormalKernelLevel supportedLevel = detectLevel();
+const NormalKernel * const selectedKernel = kernels[supportedLevel];
+
+// Arguments of normal_parallel, for parallel_for
+struct NormalKernelTask
+{
+    NormalKernelProc proc;
+    double mu;
+    double sigma;
+    const double * x;
+    double * y;
+};
+
+void normalKernelChunk(void * context, size_t begin, size_t end)
+{
+    const NormalKernelTask * task = (const NormalKernelTask *) context;
+    task->proc(task->mu, task->sigma, task->x + begin, task->y + begin, end - begin);
+}
+
+} // empty namespace
+
+void
+normal_pdf(double mu, double sigma, const double * x, double * y, size_t n)
+{
+    selectedKernel->pdf(mu, sigma, x, y, n);
+}
+
+void
+normal_log_pdf(double mu, double sigma, const double * x, double * y, size_t n)
+{
+    selectedKernel->logPdf(mu, sigma, x, y, n);
+}
+
+void
+normal_cdf(double mu, double sigma, const double * x, double * y, size_t n)
+{
+    selectedKernel->cdf(mu, sigma, x, y, n);
+}
+
+void
+normal_parallel(NormalKernelProc proc, double mu, double sigma, const double * x, double * y, size_t n)
+{
+    NormalKernelTask task = { proc, mu, sigma, x, y };
+    parallel_for(n, &normalKernelChunk, &task);
+}
+
+NormalKernelLevel
+normal_kernel_supported()
+{
+    return supportedLevel;
+}
+
+const NormalKernel *
+normal_kernel(NormalKernelLevel level)
+{
+    if (level < 0 || level > supportedLevel)
+        return NULL;
+    return kernels[level];
+}
+
+#ifdef OTXLL_PROFILE
+
+#include <OT.hxx>
+
+/*********************************************************************
+**  XllNormalKernelEval()
+**
+**  Purpose :
+**      evaluate a function of the normal distribution with the kernel
+**      of the given level, or with OpenTURNS, for the benchmark.
+**
+**  Parameters:
+**
+**        level    : NormalKernelLevel, or -1 for OpenTURNS
+**        function : 0 for the PDF, 1 for its log, 2 for the CDF
+**        mu, sigma: parameters of the distribution
+**        x, y, n  : points, values and their number
+**
+**  Returns :
+**        1 on success, 0 if the level is not supported or if
+**        OpenTURNS throws an exception
+**********************************************************************/
+int WINAPI
+XllNormalKernelEval(int level, int function, double mu, double sigma, const double * x, double * y, int n)
+{
+    if (level < 0)
+    {
+        try
+        {
+            const OT::Normal distribution(mu, sigma);
+            OT::NumericalSample points(n, 1);
+            for (int i = 0; i < n; ++i)
+                points(i, 0) = x[i];
+            const OT::NumericalSample values(function == 0 ? distribution.computePDF(points)
+                                             : function == 1 ? distribution.computeLogPDF(points)
+                                             : distribution.computeCDF(points));
+            for (int i = 0; i < n; ++i)
+                y[i] = values(i, 0);
+        }
+        catch(std::exception &)
+        {
+            return 0;
+        }
+        return 1;
+    }
+
+    const NormalKernel * kernel = normal_kernel((NormalKernelLevel) level);
+    if (!kernel)
+        return 0;
+    NormalKernelProc proc = function == 0 ? kernel->pdf : function == 1 ? kernel->logPdf : kernel->cdf;
+    proc(mu, sigma, x, y, n);
+    return 1;
+}
+
+/*********************************************************************
+**  XllNormalKernelName()
+**
+**  Purpose :
+**      name of the kernel of the given level, NULL if it is not
+**      supported by this processor.
+**********************************************************************/
+const char * WINAPI
+XllNormalKernelName(int level)
+{
+    const NormalKernel * kernel = normal_kernel((NormalKernelLevel) level);
+    return kernel ? kernel->name : NULL;
+}
+
+#endif // OTXLL_PROFILE
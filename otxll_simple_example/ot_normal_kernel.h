@@ -0,0 +1,69 @@
+#ifndef __OT_NORMAL_KERNEL_H
+#define __OT_NORMAL_KERNEL_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <stddef.h>
+
+/*
+ * Bulk evaluation of the normal distribution over contiguous arrays of
+ * doubles, without going through OT::NumericalSample.  x and y may be the
+ * same array.  sigma must be positive, which is checked by the callers when
+ * they get the distribution, see getNormal.
+ *
+ * The kernel is selected when the DLL is loaded, from what the processor
+ * supports: AVX (4 doubles at a time), SSE2 (2 doubles) or plain C++.  All
+ * of them use the same algorithms: exp is evaluated by a polynomial after
+ * range reduction, and the CDF by the rational approximations of W. J. Cody
+ * for erfc, so that results agree within a few ulps whatever the kernel.
+ * xllbench -k compares them to OpenTURNS and measures their throughput.
+ */
+
+enum NormalKernelLevel
+{
+    NORMAL_KERNEL_SCALAR = 0,
+    NORMAL_KERNEL_SSE2,
+    NORMAL_KERNEL_AVX,
+    NORMAL_KERNEL_LEVELS
+};
+
+typedef void (*NormalKernelProc)(double mu, double sigma, const double * x, double * y, size_t n);
+
+struct NormalKernel
+{
+    const char * name;
+    NormalKernelProc pdf;
+    NormalKernelProc logPdf;
+    NormalKernelProc cdf;
+};
+
+/* y[i] = PDF of N(mu, sigma) at x[i] */
+void normal_pdf(double mu, double sigma, const double * x, double * y, size_t n);
+/* y[i] = log of the PDF of N(mu, sigma) at x[i] */
+void normal_log_pdf(double mu, double sigma, const double * x, double * y, size_t n);
+/* y[i] = CDF of N(mu, sigma) at x[i] */
+void normal_cdf(double mu, double sigma, const double * x, double * y, size_t n);
+
+/* Call proc, one of the functions above, split between the threads of the
+   pool when n is large, see xll_thread_pool.h; results do not change */
+void normal_parallel(NormalKernelProc proc, double mu, double sigma, const double * x, double * y, size_t n);
+
+/* Best level supported by this processor, used by the functions above */
+NormalKernelLevel normal_kernel_supported();
+/* Kernel of the given level, NULL if it is not supported */
+const NormalKernel * normal_kernel(NormalKernelLevel level);
+
+#ifdef OTXLL_PROFILE
+/*
+ * Accessors for xllbench -k, they are not exported to Excel.  Level -1
+ * evaluates function (0: PDF, 1: log-PDF, 2: CDF) with OpenTURNS.
+ */
+extern "C" {
+int WINAPI XllNormalKernelEval(int level, int function, double mu, double sigma, const double * x, double * y, int n);
+const char * WINAPI XllNormalKernelName(int level);
+}
+#endif // OTXLL_PROFILE
+
+#endif // __OT_NORMAL_KERNEL_H
@@ -0,0 +1,73 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * AVX kernel of ot_normal_kernel.h.  This file is compiled with /arch:AVX
+ * (-mavx with gcc) and its code is only run when the processor supports
+ * AVX, see detectLevel in ot_normal_kernel.cpp.  AVX has no 256-bit
+ * integer instructions, AVX2 needs a more recent compiler than Visual
+ * Studio 2010.
+ */
+#include <immintrin.h>
+
+#include "ot_normal_kernel.h"
+#include "ot_normal_kernel_impl.h"
+
+namespace {
+
+// AVX, 4 doubles at a time
+struct AvxOps
+{
+    typedef __m256d Vec;
+    typedef __m256d Mask;
+    enum { WIDTH = 4 };
+
+    static Vec load(const double * p) { return _mm256_loadu_pd(p); }
+    static void store(double * p, Vec a) { _mm256_storeu_pd(p, a); }
+    static Vec set1(double a) { return _mm256_set1_pd(a); }
+    static Vec add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+    static Vec sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+    static Vec mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+    static Vec div(Vec a, Vec b) { return _mm256_div_pd(a, b); }
+    static Vec min(Vec a, Vec b) { return _mm256_min_pd(a, b); }
+    static Vec max(Vec a, Vec b) { return _mm256_max_pd(a, b); }
+    static Mask less(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static Mask isNaN(Vec a) { return _mm256_cmp_pd(a, a, _CMP_UNORD_Q); }
+    static Vec select(Mask m, Vec a, Vec b) { return _mm256_blendv_pd(b, a, m); }
+    static Vec round(Vec a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static Vec floor(Vec a) { return _mm256_floor_pd(a); }
+    // Same as Sse2Ops::pow2, the shift is done on each 128-bit half
+    static Vec pow2(Vec k)
+    {
+        const __m256i t = _mm256_castpd_si256(_mm256_add_pd(k, _mm256_set1_pd(6755399441055744.0 + 1023.0)));
+        const __m128i low = _mm_slli_epi64(_mm256_castsi256_si128(t), 52);
+        const __m128i high = _mm_slli_epi64(_mm256_extractf128_si256(t, 1), 52);
+        return _mm256_castsi256_pd(_mm256_insertf128_si256(_mm256_castsi128_si256(low), high, 1));
+    }
+};
+
+} // empty namespace
+
+extern const NormalKernel normalKernelAvx =
+{
+    "avx",
+    &NormalKernelImpl<AvxOps>::computePdf,
+    &NormalKernelImpl<AvxOps>::computeLogPdf,
+    &NormalKernelImpl<AvxOps>::computeCdf
+};
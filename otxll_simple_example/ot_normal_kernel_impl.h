@@ -0,0 +1,247 @@
+#ifndef __OT_NORMAL_KERNEL_IMPL_H
+#define __OT_NORMAL_KERNEL_IMPL_H
+
+#include <stddef.h>
+#include <cmath>
+
+/*
+ * Algorithms of ot_normal_kernel.h, written once for all kernels.  Ops
+ * provides the arithmetic on a vector of Ops::WIDTH doubles:
+ *
+ *   Vec, Mask                      vector and result of comparisons
+ *   load, store, set1              memory access, unaligned
+ *   add, sub, mul, div, min, max   arithmetic
+ *   less, isNaN                    comparisons
+ *   select(m, a, b)                m ? a : b, lane by lane
+ *   round, floor                   to integer values, |x| < 2^51
+ *   pow2(k)                        2^k for integers -1022 <= k <= 1023
+ *
+ * This header is included by each kernel source, which is compiled with
+ * the instruction set of its Ops; everything here must thus only be used
+ * through NormalKernelImpl<Ops>, and Ops must have internal linkage, so
+ * that the linker never mixes code of several instruction sets.
+ */
+
+namespace {
+
+// 1 / sqrt(2 pi), log(sqrt(2 pi)), 1 / sqrt(2) and 1 / sqrt(pi)
+const double NK_INV_SQRT_2PI = 0.39894228040143267794;
+const double NK_LOG_SQRT_2PI = 0.91893853320467274178;
+const double NK_INV_SQRT_2 = 0.70710678118654752440;
+const double NK_INV_SQRT_PI = 0.56418958354775628695;
+
+const double NK_LOG2E = 1.44269504088896340736;
+// ln(2) split so that k * NK_LN2_HI is exact
+const double NK_LN2_HI = 6.93147180369123816490e-01;
+const double NK_LN2_LO = 1.90821492927058770002e-10;
+// Below this, exp underflows to 0
+const double NK_EXP_MIN = -745.2;
+// Above this, erfc underflows to 0
+const double NK_ERFC_MAX = 27.0;
+
+// Rational approximations of erf and erfc, W. J. Cody, Math. Comp. 23 (1969)
+const double NK_ERF_A[5] = {
+    3.16112374387056560e00, 1.13864154151050156e02, 3.77485237685302021e02,
+    3.20937758913846947e03, 1.85777706184603153e-1
+};
+const double NK_ERF_B[4] = {
+    2.36012909523441209e01, 2.44024637934444173e02, 1.28261652607737228e03,
+    2.84423683343917062e03
+};
+const double NK_ERF_C[9] = {
+    5.64188496988670089e-1, 8.88314979438837594e00, 6.61191906371416295e01,
+    2.98635138197400131e02, 8.81952221241769090e02, 1.71204761263407058e03,
+    2.05107837782607147e03, 1.23033935479799725e03, 2.15311535474403846e-8
+};
+const double NK_ERF_D[8] = {
+    1.57449261107098347e01, 1.17693950891312499e02, 5.37181101862009858e02,
+    1.62138957456669019e03, 3.29079923573345963e03, 4.36261909014324716e03,
+    3.43936767414372164e03, 1.23033935480374942e03
+};
+const double NK_ERF_P[6] = {
+    3.05326634961232344e-1, 3.60344899949804439e-1, 1.25781726111229246e-1,
+    1.60837851487422766e-2, 6.58749161529837803e-4, 1.63153871373020978e-2
+};
+const double NK_ERF_Q[5] = {
+    2.56852019228982242e00, 1.87295284992346725e00, 5.27905102951428412e-1,
+    6.05183413124413191e-2, 2.33520497626869185e-3
+};
+
+template <class Ops>
+struct NormalKernelImpl
+{
+    typedef typename Ops::Vec Vec;
+    typedef typename Ops::Mask Mask;
+
+    // exp(x) for x <= 0, NaN is propagated
+    static Vec expNonPositive(Vec x)
+    {
+        const Vec xc = Ops::max(x, Ops::set1(NK_EXP_MIN));
+        const Vec k = Ops::round(Ops::mul(xc, Ops::set1(NK_LOG2E)));
+        const Vec r = Ops::sub(Ops::sub(xc, Ops::mul(k, Ops::set1(NK_LN2_HI))), Ops::mul(k, Ops::set1(NK_LN2_LO)));
+
+        // Taylor polynomial of degree 13, |r| <= ln(2) / 2
+        Vec p = Ops::set1(1.0 / 6227020800.0);
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 479001600.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 39916800.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 3628800.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 362880.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 40320.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 5040.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 720.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 120.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 24.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0 / 6.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(0.5));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0));
+        p = Ops::add(Ops::mul(p, r), Ops::set1(1.0));
+
+        // 2^k in two factors, so that subnormal results are right
+        const Vec k1 = Ops::round(Ops::mul(k, Ops::set1(0.5)));
+        const Vec k2 = Ops::sub(k, k1);
+        Vec y = Ops::mul(Ops::mul(p, Ops::pow2(k1)), Ops::pow2(k2));
+        y = Ops::select(Ops::less(x, Ops::set1(NK_EXP_MIN)), Ops::set1(0.0), y);
+        return Ops::select(Ops::isNaN(x), x, y);
+    }
+
+    // erfc(y) for y >= 0
+    static Vec erfcNonNegative(Vec y)
+    {
+        const Vec yc = Ops::min(y, Ops::set1(NK_ERFC_MAX));
+
+        // 0 <= y <= 0.46875, erfc = 1 - erf
+        const Vec ysq = Ops::mul(yc, yc);
+        Vec num = Ops::mul(Ops::set1(NK_ERF_A[4]), ysq);
+        Vec den = ysq;
+        for (int i = 0; i < 3; ++i)
+        {
+            num = Ops::mul(Ops::add(num, Ops::set1(NK_ERF_A[i])), ysq);
+            den = Ops::mul(Ops::add(den, Ops::set1(NK_ERF_B[i])), ysq);
+        }
+        const Vec small = Ops::sub(Ops::set1(1.0),
+            Ops::div(Ops::mul(yc, Ops::add(num, Ops::set1(NK_ERF_A[3]))), Ops::add(den, Ops::set1(NK_ERF_B[3]))));
+
+        // 0.46875 < y <= 4
+        num = Ops::mul(Ops::set1(NK_ERF_C[8]), yc);
+        den = yc;
+        for (int i = 0; i < 7; ++i)
+        {
+            num = Ops::mul(Ops::add(num, Ops::set1(NK_ERF_C[i])), yc);
+            den = Ops::mul(Ops::add(den, Ops::set1(NK_ERF_D[i])), yc);
+        }
+        const Vec middle = Ops::div(Ops::add(num, Ops::set1(NK_ERF_C[7])), Ops::add(den, Ops::set1(NK_ERF_D[7])));
+
+        // y > 4
+        const Vec inv = Ops::div(Ops::set1(1.0), ysq);
+        num = Ops::mul(Ops::set1(NK_ERF_P[5]), inv);
+        den = inv;
+        for (int i = 0; i < 4; ++i)
+        {
+            num = Ops::mul(Ops::add(num, Ops::set1(NK_ERF_P[i])), inv);
+            den = Ops::mul(Ops::add(den, Ops::set1(NK_ERF_Q[i])), inv);
+        }
+        Vec large = Ops::div(Ops::mul(inv, Ops::add(num, Ops::set1(NK_ERF_P[4]))), Ops::add(den, Ops::set1(NK_ERF_Q[4])));
+        large = Ops::div(Ops::sub(Ops::set1(NK_INV_SQRT_PI), large), yc);
+
+        // exp(-y^2) of the last two ranges, computed as exp(-t^2) * exp(-(y - t) * (y + t))
+        // with t = y rounded down to 1/16, which keeps its accuracy for large y
+        const Vec t = Ops::mul(Ops::floor(Ops::mul(yc, Ops::set1(16.0))), Ops::set1(1.0 / 16.0));
+        const Vec del = Ops::mul(Ops::sub(yc, t), Ops::add(yc, t));
+        const Vec e = Ops::mul(expNonPositive(Ops::sub(Ops::set1(0.0), Ops::mul(t, t))),
+                               expNonPositive(Ops::sub(Ops::set1(0.0), del)));
+
+        const Vec tail = Ops::mul(e, Ops::select(Ops::less(Ops::set1(4.0), yc), large, middle));
+        const Vec result = Ops::select(Ops::less(Ops::set1(0.46875), yc), tail, small);
+        return Ops::select(Ops::isNaN(y), y, result);
+    }
+
+    static Vec pdf(Vec x, Vec mu, Vec invSigma, Vec factor)
+    {
+        const Vec z = Ops::mul(Ops::sub(x, mu), invSigma);
+        return Ops::mul(factor, expNonPositive(Ops::mul(Ops::set1(-0.5), Ops::mul(z, z))));
+    }
+
+    static Vec logPdf(Vec x, Vec mu, Vec invSigma, Vec offset)
+    {
+        const Vec z = Ops::mul(Ops::sub(x, mu), invSigma);
+        return Ops::sub(Ops::mul(Ops::set1(-0.5), Ops::mul(z, z)), offset);
+    }
+
+    // Phi(z) = erfc(-z / sqrt(2)) / 2, and erfc(-u) = 2 - erfc(u)
+    static Vec cdf(Vec x, Vec mu, Vec invSigma)
+    {
+        const Vec u = Ops::mul(Ops::mul(Ops::sub(mu, x), invSigma), Ops::set1(NK_INV_SQRT_2));
+        const Vec negative = Ops::sub(Ops::set1(0.0), u);
+        const Vec e = erfcNonNegative(Ops::max(u, negative));
+        const Vec result = Ops::select(Ops::less(u, Ops::set1(0.0)), Ops::sub(Ops::set1(2.0), e), e);
+        return Ops::mul(Ops::set1(0.5), result);
+    }
+
+    // Apply F to full vectors, then to the last values through a padded buffer
+    template <class F>
+    static void apply(const F & f, double mu, const double * x, double * y, size_t n)
+    {
+        size_t i = 0;
+        for (; i + Ops::WIDTH <= n; i += Ops::WIDTH)
+        {
+            Ops::store(y + i, f(Ops::load(x + i)));
+        }
+        if (i < n)
+        {
+            double buffer[Ops::WIDTH];
+            for (size_t j = 0; j < (size_t) Ops::WIDTH; ++j)
+                buffer[j] = i + j < n ? x[i + j] : mu;
+            Ops::store(buffer, f(Ops::load(buffer)));
+            for (size_t j = 0; i + j < n; ++j)
+                y[i + j] = buffer[j];
+        }
+    }
+
+    struct Pdf
+    {
+        Vec mu, invSigma, factor;
+        Vec operator()(Vec x) const { return NormalKernelImpl::pdf(x, mu, invSigma, factor); }
+    };
+
+    struct LogPdf
+    {
+        Vec mu, invSigma, offset;
+        Vec operator()(Vec x) const { return NormalKernelImpl::logPdf(x, mu, invSigma, offset); }
+    };
+
+    struct Cdf
+    {
+        Vec mu, invSigma;
+        Vec operator()(Vec x) const { return NormalKernelImpl::cdf(x, mu, invSigma); }
+    };
+
+    static void computePdf(double mu, double sigma, const double * x, double * y, size_t n)
+    {
+        Pdf f;
+        f.mu = Ops::set1(mu);
+        f.invSigma = Ops::set1(1.0 / sigma);
+        f.factor = Ops::set1(NK_INV_SQRT_2PI / sigma);
+        apply(f, mu, x, y, n);
+    }
+
+    static void computeLogPdf(double mu, double sigma, const double * x, double * y, size_t n)
+    {
+        LogPdf f;
+        f.mu = Ops::set1(mu);
+        f.invSigma = Ops::set1(1.0 / sigma);
+        f.offset = Ops::set1(NK_LOG_SQRT_2PI + std::log(sigma));
+        apply(f, mu, x, y, n);
+    }
+
+    static void computeCdf(double mu, double sigma, const double * x, double * y, size_t n)
+    {
+        Cdf f;
+        f.mu = Ops::set1(mu);
+        f.invSigma = Ops::set1(1.0 / sigma);
+        apply(f, mu, x, y, n);
+    }
+};
+
+} // empty namespace
+
+#endif // __OT_NORMAL_KERNEL_IMPL_H
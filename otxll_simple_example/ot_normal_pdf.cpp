@@ -22,10 +22,283 @@
 #include <windows.h>
 #include <xlcall.h>
 #include <framewrk.h>
+#include <algorithm>
+#include <map>
+#include <vector>
 
 #include <OT.hxx>
-#include <vector>
 #include "xll_helper_functions.h"
+#include "ot_marshal.h"
+#include "ot_functions.h"
+#include "xll_profile.h"
+#include "xll_result_pool.h"
+#include "ot_distribution_cache.h"
+#include "ot_normal_kernel.h"
+#include "xll_async.h"
+#include "xll_thread_pool.h"
+
+namespace {
+
+enum BroadcastArgument
+{
+    BROADCAST_MU = 0,
+    BROADCAST_SIGMA,
+    BROADCAST_POINTS,
+    BROADCAST_ARGUMENTS
+};
+
+const char * const broadcastNames[BROADCAST_ARGUMENTS] = { "mu", "sigma", "points" };
+
+// Arguments of OT_NORMAL_PDF_ARRAY: each of them is a scalar, a row, a
+// column or an array, whose values are stored row by row, and the shape
+// of the result is the largest of their shapes
+struct NormalBroadcast
+{
+    OT::NumericalSample values[BROADCAST_ARGUMENTS];
+    RW rows[BROADCAST_ARGUMENTS];
+    COL columns[BROADCAST_ARGUMENTS];
+    RW resultRows;
+    COL resultColumns;
+};
+
+// Index in the values of argument k of cell (i, j) of the result, a
+// dimension of size 1 being repeated along the result
+inline size_t broadcastIndex(const NormalBroadcast & broadcast, int k, RW i, COL j)
+{
+    return (size_t) (broadcast.rows[k] == 1 ? 0 : i) * broadcast.columns[k] + (broadcast.columns[k] == 1 ? 0 : j);
+}
+
+/*
+ * Coerce mu, sigma and points, and check that each dimension of each of
+ * them is either 1 or that of the result.  Returns NULL on success, the
+ * error to return otherwise.
+ */
+LPXLOPER12 coerceBroadcast(const std::string & prefix, LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_points,
+                           NormalBroadcast & broadcast)
+{
+    LPXLOPER12 arguments[BROADCAST_ARGUMENTS] = { xl_mu, xl_sigma, xl_points };
+    broadcast.resultRows = 1;
+    broadcast.resultColumns = 1;
+    for (int k = 0; k < BROADCAST_ARGUMENTS; ++k)
+    {
+        // Values are read by blocks straight into the sample, see read_range
+        const int error = range_to_values(arguments[k], broadcast.values[k], &broadcast.rows[k], &broadcast.columns[k]);
+        if (error != -1)
+        {
+            return dialogError(prefix + "Invalid conversion to xltypeNum for argument '" + broadcastNames[k] + "'", error);
+        }
+        broadcast.resultRows = std::max(broadcast.resultRows, broadcast.rows[k]);
+        broadcast.resultColumns = std::max(broadcast.resultColumns, broadcast.columns[k]);
+    }
+    for (int k = 0; k < BROADCAST_ARGUMENTS; ++k)
+    {
+        if ((broadcast.rows[k] != 1 && broadcast.rows[k] != broadcast.resultRows) ||
+            (broadcast.columns[k] != 1 && broadcast.columns[k] != broadcast.resultColumns))
+        {
+            return dialogError(prefix + "Invalid shapes, mu, sigma and points must be scalars, or rows and columns of the same size", xlerrValue);
+        }
+    }
+    return NULL;
+}
+
+// Points grouped by distinct parameters, for parallel_for: the points of
+// group g are x[offsets[g]] to x[offsets[g + 1] - 1].  With a single
+// group, x is the sample of the points, computed in place; otherwise the
+// points are copied into sorted, and value k goes to cell cells[k]
+struct NormalGroups
+{
+    std::vector<double> mu;
+    std::vector<double> sigma;
+    std::vector<size_t> offsets;
+    std::vector<double> sorted;
+    std::vector<size_t> cells;
+    double * x;
+};
+
+void normalGroupsChunk(void * context, size_t begin, size_t end)
+{
+    const NormalGroups * groups = (const NormalGroups *) context;
+    size_t g = std::upper_bound(groups->offsets.begin(), groups->offsets.end(), begin) - groups->offsets.begin() - 1;
+    for (; begin < end; ++g)
+    {
+        const size_t last = std::min(end, groups->offsets[g + 1]);
+        normal_pdf(groups->mu[g], groups->sigma[g], groups->x + begin, groups->x + begin, last - begin);
+        begin = last;
+    }
+}
+
+/*
+ * PDF of N(mu, sigma) at points, broadcast to the shape of the result.
+ * Cells with the same mu and sigma are grouped, so that each distinct
+ * distribution is checked once by getNormal and its points are computed
+ * by a single call of the kernel, unless a group is split between threads.
+ * A single group, the common case, is computed in place in the points,
+ * once per point even if they are repeated along the result; several ones
+ * on a copy of the points of each cell, sorted by group.  See
+ * broadcastResult for the cells of the result.  OT::Exception is thrown if
+ * a distribution is invalid.
+ */
+void computeBroadcast(NormalBroadcast & broadcast, NormalGroups & groups)
+{
+    const RW rows = broadcast.resultRows;
+    const COL columns = broadcast.resultColumns;
+    const size_t size = (size_t) rows * columns;
+    const OT::NumericalSample & mu = broadcast.values[BROADCAST_MU];
+    const OT::NumericalSample & sigma = broadcast.values[BROADCAST_SIGMA];
+    OT::NumericalSample & points = broadcast.values[BROADCAST_POINTS];
+
+    // Group of each cell of mu and sigma broadcast together
+    const RW parameterRows = std::max(broadcast.rows[BROADCAST_MU], broadcast.rows[BROADCAST_SIGMA]);
+    const COL parameterColumns = std::max(broadcast.columns[BROADCAST_MU], broadcast.columns[BROADCAST_SIGMA]);
+    std::vector<size_t> parameterGroups((size_t) parameterRows * parameterColumns);
+    std::map<std::pair<double, double>, size_t> distinct;
+    for (RW i = 0; i < parameterRows; ++i)
+    {
+        for (COL j = 0; j < parameterColumns; ++j)
+        {
+            const std::pair<double, double> key(mu(broadcastIndex(broadcast, BROADCAST_MU, i, j), 0),
+                                                sigma(broadcastIndex(broadcast, BROADCAST_SIGMA, i, j), 0));
+            std::map<std::pair<double, double>, size_t>::iterator it = distinct.find(key);
+            if (it == distinct.end())
+            {
+                // Parameters are checked by OpenTURNS
+                getNormal(key.first, key.second);
+                it = distinct.insert(std::make_pair(key, groups.mu.size())).first;
+                groups.mu.push_back(key.first);
+                groups.sigma.push_back(key.second);
+            }
+            parameterGroups[(size_t) i * parameterColumns + j] = it->second;
+        }
+    }
+
+    // A single group is computed in place by the kernel
+    if (groups.mu.size() == 1)
+    {
+        groups.x = &points(0, 0);
+        normal_parallel(&normal_pdf, groups.mu[0], groups.sigma[0], groups.x, groups.x, points.getSize());
+        return;
+    }
+
+    // Otherwise the points of the cells are sorted by group
+    groups.offsets.assign(groups.mu.size() + 1, 0);
+    for (RW i = 0; i < rows; ++i)
+    {
+        for (COL j = 0; j < columns; ++j)
+        {
+            const size_t p = (size_t) (parameterRows == 1 ? 0 : i) * parameterColumns + (parameterColumns == 1 ? 0 : j);
+            ++groups.offsets[parameterGroups[p] + 1];
+        }
+    }
+    for (size_t g = 1; g < groups.offsets.size(); ++g)
+    {
+        groups.offsets[g] += groups.offsets[g - 1];
+    }
+    std::vector<size_t> next(groups.offsets.begin(), groups.offsets.end() - 1);
+    groups.cells.resize(size);
+    groups.sorted.resize(size);
+    for (RW i = 0; i < rows; ++i)
+    {
+        for (COL j = 0; j < columns; ++j)
+        {
+            const size_t p = (size_t) (parameterRows == 1 ? 0 : i) * parameterColumns + (parameterColumns == 1 ? 0 : j);
+            const size_t k = next[parameterGroups[p]]++;
+            groups.cells[k] = (size_t) i * columns + j;
+            groups.sorted[k] = points(broadcastIndex(broadcast, BROADCAST_POINTS, i, j), 0);
+        }
+    }
+    groups.x = &groups.sorted[0];
+    parallel_for(size, &normalGroupsChunk, &groups);
+}
+
+// Cells of the result of computeBroadcast, NULL if it cannot be allocated
+LPXLOPER12 broadcastResult(const NormalBroadcast & broadcast, const NormalGroups & groups)
+{
+    const RW rows = broadcast.resultRows;
+    const COL columns = broadcast.resultColumns;
+    LPXLOPER12 xResult = new_multi(rows, columns);
+    if (!xResult)
+    {
+        return NULL;
+    }
+    LPXLOPER12 px = xResult->val.array.lparray;
+    if (groups.cells.empty())
+    {
+        for (RW i = 0; i < rows; ++i)
+        {
+            for (COL j = 0; j < columns; ++j, ++px)
+            {
+                px->xltype = xltypeNum;
+                px->val.num = groups.x[broadcastIndex(broadcast, BROADCAST_POINTS, i, j)];
+            }
+        }
+        return xResult;
+    }
+    for (size_t k = 0; k < groups.cells.size(); ++k)
+    {
+        LPXLOPER12 pCell = px + groups.cells[k];
+        pCell->xltype = xltypeNum;
+        pCell->val.num = groups.x[k];
+    }
+    return xResult;
+}
+
+// Computation of OT_NORMAL_PDF_ARRAY_ASYNC, arguments are coerced by the caller
+class NormalPdfArrayTask : public XllAsyncTask
+{
+public:
+    NormalBroadcast broadcast;
+
+    LPXLOPER12 run()
+    {
+        NormalGroups groups;
+        try
+        {
+            computeBroadcast(broadcast, groups);
+        }
+        catch(OT::Exception & e)
+        {
+            return dialogError(e.what(), xlerrValue);
+        }
+        catch(std::exception & e)
+        {
+            return dialogError(e.what(), xlerrValue);
+        }
+        return broadcastResult(broadcast, groups);
+    }
+};
+
+// Computation of OT_NORMAL_PDF_DRAW_ASYNC
+class NormalPdfDrawTask : public XllAsyncTask
+{
+public:
+    double mu;
+    double sigma;
+    int nrValues;
+
+    LPXLOPER12 run()
+    {
+        OT::NumericalSample samplePDF;
+        try
+        {
+            samplePDF = getNormalGrid(mu, sigma, nrValues);
+        }
+        catch(OT::Exception & e)
+        {
+            return dialogError(e.what(), xlerrValue);
+        }
+        catch(std::exception & e)
+        {
+            return dialogError(e.what(), xlerrValue);
+        }
+        if (nrValues != (int) samplePDF.getSize() || samplePDF.getDimension() != 2)
+        {
+            return dialogError("(OT_NORMAL_PDF_DRAW_ASYNC): Internal error", xlerrValue);
+        }
+        return sample_to_multi(samplePDF);
+    }
+};
+
+} // empty namespace
 
 /***********************************************************************************
  OT_NORMAL_PDF()
@@ -52,6 +325,7 @@ OT_NORMAL_PDF(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_point)
 {
     double mu, sigma, point;
     int error = -1;
+    XLL_PROFILE_START();
 
     // Coerce the mean parameter
     //======================
@@ -74,13 +348,16 @@ OT_NORMAL_PDF(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_point)
         return dialogError("(OT_NORMAL_PDF): Invalid conversion to xltypeNum for argument 'point'", error);
     }
 
+    XLL_PROFILE_LAP(XLL_STAGE_COERCE);
+
     double value;
     //Compute the PDF on point
     //========================
     try
     {
-        OT::Normal distribution(mu, sigma);
-        value = distribution.computePDF(point);
+        // Parameters are checked by OpenTURNS, values computed by the kernel
+        getNormal(mu, sigma);
+        normal_pdf(mu, sigma, &point, &value, 1);
     }
     catch(OT::Exception & e)
     {
@@ -90,13 +367,18 @@ OT_NORMAL_PDF(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_point)
     {
         return dialogError(e.what(), xlerrValue);
     }
+    XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
 
     // xlbitDLLFree enables the DLL to release
     // any dynamically allocated memory
     // that was associated with the xloper
-    LPXLOPER12 xResult = new XLOPER12();
-    xResult->xltype = xltypeNum | xlbitDLLFree;
-    xResult->val.num = value;
+    LPXLOPER12 xResult = new_result();
+    if (xResult)
+    {
+        xResult->xltype = xltypeNum | xlbitDLLFree;
+        xResult->val.num = value;
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_RESULT);
 
     return xResult;
 }
@@ -107,77 +389,45 @@ OT_NORMAL_PDF(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_point)
  Purpose:
 
       This function takes 3 arguments and computes the normal distribution at given points.
+      Each argument is a scalar, a row, a column or an array, and the result has the
+      largest of their shapes: a dimension of size 1 is repeated along the result, e.g.
+      a column of means and a row of points give the PDF of each mean at each point.
 
  Parameters:
 
       LPXLOPER12      3 arguments : xl_mu, xl_sigma, xl_points
-                      (first two can be reference or value, last one is a reference)
+                      (can be reference or value)
 
  Returns:
 
       LPXLOPER12      the normal distribution at given points
                       or #VALUE! if there are
                       non-numerics in the supplied
-                      argument.
+                      argument, or if their shapes
+                      do not match.
 *************************************************************************************/
 
 LPXLOPER12 WINAPI
 OT_NORMAL_PDF_ARRAY(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_points)
 {
-    double mu, sigma;
-    int error = -1;
-    std::vector<double> points, pdf;
-
-    // Coerce the mean parameter
-    //==========================
-    if((error = xloper_to_num(xl_mu, &mu)) != -1)
-    {
-        return dialogError("(OT_NORMAL_PDF_ARRAY): Invalid conversion to xltypeNum for argument 'mu'", error);
-    }
-
-    // Coerce the standard deviation parameter
-    //========================================
-    if((error = xloper_to_num(xl_sigma, &sigma)) != -1)
-    {
-        return dialogError("(OT_NORMAL_PDF_ARRAY): Invalid conversion to xltypeNum for argument 'sigma'", error);
-    }
+    NormalBroadcast broadcast;
+    XLL_PROFILE_START();
 
-    // Coerce the points parameter : to compute the PDF
-    //=================================================
-    XLOPER12 cells;
-    if((error = xloper_to_multi(xl_points, &cells)) != -1)
-    {
-        return dialogError("(OT_NORMAL_PDF_ARRAY): Invalid conversion to xltypeMulti for argument 'points'", error);
-    }
-    if (cells.val.array.columns != 1)
-    {
-        Excel12f(xlFree, 0, 1, (LPXLOPER12) &cells);
-        return dialogError("(OT_NORMAL_PDF_ARRAY): Invalid active selection, there must be a single column", xlerrValue);
-    }
-    points.reserve(cells.val.array.rows);
-    for(int i = 0; i < cells.val.array.rows; ++i)
+    // Coerce mu, sigma and the points
+    //================================
+    LPXLOPER12 xResult = coerceBroadcast("(OT_NORMAL_PDF_ARRAY): ", xl_mu, xl_sigma, xl_points, broadcast);
+    if (xResult)
     {
-        points.push_back(cells.val.array.lparray[i].val.num);
+        return xResult;
     }
-    // Delete cells to avoid leaks, this structure is no more needed
-    Excel12f(xlFree, 0, 1, (LPXLOPER12) &cells);
+    XLL_PROFILE_LAP(XLL_STAGE_COERCE);
 
-    //Compute the PDF on points and store values in a vector
-    //======================================================
+    //Compute the PDF on points
+    //=========================
+    NormalGroups groups;
     try
     {
-        OT::Normal distribution(mu, sigma);
-        OT::NumericalSample sampleInput(points.size(), 1);
-        for(OT::UnsignedInteger i = 0; i < points.size(); ++i)
-        {
-            sampleInput[i][0] = points[i];
-        }
-        OT::NumericalSample samplePDF(distribution.computePDF(sampleInput));
-        pdf.reserve(samplePDF.getSize());
-        for(OT::UnsignedInteger i = 0; i < samplePDF.getSize(); ++i)
-        {
-            pdf.push_back(samplePDF[i][0]);
-        }
+        computeBroadcast(broadcast, groups);
     }
     catch(OT::Exception & e)
     {
@@ -187,29 +437,12 @@ OT_NORMAL_PDF_ARRAY(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_points)
     {
         return dialogError(e.what(), xlerrValue);
     }
-    if (points.size() != pdf.size())
-    {
-        return dialogError("(OT_NORMAL_PDF_ARRAY): Internal error", xlerrValue);
-    }
+    XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
 
     // Fill results
     //=============
-    LPXLOPER12 xResult = new XLOPER12();
-
-    // xlbitDLLFree enables the DLL to release
-    // any dynamically allocated memory
-    // that was associated with the xloper
-    xResult->xltype = xltypeMulti | xlbitDLLFree;
-    xResult->val.array.columns = 1;
-    xResult->val.array.rows = pdf.size();
-    xResult->val.array.lparray = new XLOPER12[xResult->val.array.rows*xResult->val.array.columns];
-
-    LPXLOPER12 px = xResult->val.array.lparray;
-    for(int i = 0; i < xResult->val.array.rows; ++i, ++px)
-    {
-        px->xltype = xltypeNum;
-        px->val.num = pdf[i];
-    }
+    xResult = broadcastResult(broadcast, groups);
+    XLL_PROFILE_LAP(XLL_STAGE_RESULT);
     return xResult;
 }
 
@@ -239,7 +472,8 @@ OT_NORMAL_PDF_DRAW(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma)
 {
     double mu, sigma;
     int error = -1;
-    std::vector<double> pdf;
+    OT::NumericalSample samplePDF;
+    XLL_PROFILE_START();
 
     // Get the number of rows in current selection
     //============================================
@@ -274,16 +508,11 @@ OT_NORMAL_PDF_DRAW(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma)
 
     //Compute the normal distribution and its PDF
     //===========================================
+    XLL_PROFILE_LAP(XLL_STAGE_COERCE);
     try
     {
-        OT::Normal distribution(mu, sigma);
-        OT::NumericalSample samplePDF(distribution.drawPDF(nrValues).getDrawable(0).getData());
-        pdf.reserve(2*samplePDF.getSize());
-        for(OT::UnsignedInteger i = 0; i < samplePDF.getSize(); ++i)
-        {
-            pdf.push_back(samplePDF[i][0]);
-            pdf.push_back(samplePDF[i][1]);
-        }
+        samplePDF = getNormalGrid(mu, sigma, nrValues);
+        XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
     }
     catch(OT::Exception & e)
     {
@@ -293,29 +522,15 @@ OT_NORMAL_PDF_DRAW(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma)
     {
         return dialogError(e.what(), xlerrValue);
     }
-    if (2*nrValues != pdf.size())
+    if (nrValues != (int) samplePDF.getSize() || samplePDF.getDimension() != 2)
     {
         return dialogError("(OT_NORMAL_PDF_DRAW): Internal error", xlerrValue);
     }
 
     // Fill results
     //=============
-    LPXLOPER12 xResult = new XLOPER12();
-
-    // xlbitDLLFree enables the DLL to release
-    // any dynamically allocated memory
-    // that was associated with the xloper
-    xResult->xltype = xltypeMulti | xlbitDLLFree;
-    xResult->val.array.columns = 2;
-    xResult->val.array.rows = nrValues;
-    xResult->val.array.lparray = new XLOPER12[xResult->val.array.rows*xResult->val.array.columns];
-
-    LPXLOPER12 px = xResult->val.array.lparray;
-    for(int i = 0; i < xResult->val.array.rows*xResult->val.array.columns; ++i, ++px)
-    {
-        px->xltype = xltypeNum;
-        px->val.num = pdf[i];
-    }
+    LPXLOPER12 xResult = sample_to_multi(samplePDF);
+    XLL_PROFILE_LAP(XLL_STAGE_RESULT);
     return xResult;
 }
 
@@ -345,7 +560,8 @@ OT_NORMAL_PDF_DRAW_CMD(int nrValues, LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma)
 {
     double mu, sigma;
     int error = -1;
-    std::vector<double> pdf;
+    OT::NumericalSample samplePDF;
+    XLL_PROFILE_START();
 
     if(nrValues <= 0)
     {
@@ -368,16 +584,11 @@ OT_NORMAL_PDF_DRAW_CMD(int nrValues, LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma)
 
     //Compute the PDF on point
     //========================
+    XLL_PROFILE_LAP(XLL_STAGE_COERCE);
     try
     {
-        OT::Normal distribution(mu, sigma);
-        OT::NumericalSample samplePDF(distribution.drawPDF(nrValues).getDrawable(0).getData());
-        pdf.reserve(2*samplePDF.getSize());
-        for(OT::UnsignedInteger i = 0; i < samplePDF.getSize(); ++i)
-        {
-            pdf.push_back(samplePDF[i][0]);
-            pdf.push_back(samplePDF[i][1]);
-        }
+        samplePDF = getNormalGrid(mu, sigma, nrValues);
+        XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
     }
     catch(OT::Exception & e)
     {
@@ -387,30 +598,235 @@ OT_NORMAL_PDF_DRAW_CMD(int nrValues, LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma)
     {
         return dialogError(e.what(), xlerrValue);
     }
-    if (2*nrValues != pdf.size())
+    if (nrValues != (int) samplePDF.getSize() || samplePDF.getDimension() != 2)
     {
         return dialogError("(OT_NORMAL_PDF_DRAW_CMD): Internal error", xlerrValue);
     }   
 
     // Fill results
     //=============
-    LPXLOPER12 xResult = new XLOPER12();
+    LPXLOPER12 xResult = sample_to_multi(samplePDF);
+    XLL_PROFILE_LAP(XLL_STAGE_RESULT);
 
-    // xlbitDLLFree enables the DLL to release
-    // any dynamically allocated memory
-    // that was associated with the xloper
-    xResult->xltype = xltypeMulti | xlbitDLLFree;
-    xResult->val.array.columns = 2;
-    xResult->val.array.rows = nrValues;
-    xResult->val.array.lparray = new XLOPER12[xResult->val.array.rows*xResult->val.array.columns];
+    return xResult;
+}
 
-    LPXLOPER12 px = xResult->val.array.lparray;
-    for(int i = 0; i < xResult->val.array.rows * xResult->val.array.columns; ++i, ++px)
+/***********************************************************************************
+ OT_NORMAL_PDF_ARRAY_FP()
+
+ Purpose:
+
+      Same as OT_NORMAL_PDF_ARRAY, but arguments and result are passed as
+      numbers and FP12 arrays (type "K%").  Excel converts ranges itself and
+      calls this function only if all cells are numeric, there is thus no
+      xlCoerce callback and no per-cell type tag.
+
+ Parameters:
+
+      double          mu, sigma
+      FP12 *          points, of any shape
+
+ Returns:
+
+      FP12 *          the normal distribution at given points, with the same
+                      shape as points, or NULL on error.  It is valid until
+                      next call, see new_fp12.
+*************************************************************************************/
+
+FP12 * WINAPI
+OT_NORMAL_PDF_ARRAY_FP(double mu, double sigma, FP12 * points)
+{
+    FP12 * fpResult = NULL;
+    XLL_PROFILE_START();
+
+    //Compute the PDF on points
+    //=========================
+    try
+    {
+        // Parameters are checked by OpenTURNS, values are written by the
+        // kernel straight into the result
+        getNormal(mu, sigma);
+        fpResult = new_fp12(points->rows, points->columns);
+        XLL_PROFILE_LAP(XLL_STAGE_RESULT);
+        if (!fpResult)
+        {
+            displayError("(OT_NORMAL_PDF_ARRAY_FP): Cannot allocate the result");
+            return NULL;
+        }
+        normal_parallel(&normal_pdf, mu, sigma, points->array, fpResult->array, (size_t) points->rows * points->columns);
+        XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
+    }
+    catch(OT::Exception & e)
+    {
+        displayError(e.what());
+        return NULL;
+    }
+    catch(std::exception & e)
+    {
+        displayError(e.what());
+        return NULL;
+    }
+    return fpResult;
+}
+
+/***********************************************************************************
+ OT_NORMAL_PDF_DRAW_FP()
+
+ Purpose:
+
+      Same as OT_NORMAL_PDF_DRAW_CMD, but arguments and result are passed as
+      numbers and FP12 arrays (type "K%").
+
+ Parameters:
+
+      int             nrValues
+      double          mu, sigma
+
+ Returns:
+
+      FP12 *          nrValues rows and two columns, or NULL on error.
+                      It is valid until next call, see new_fp12.
+*************************************************************************************/
+
+FP12 * WINAPI
+OT_NORMAL_PDF_DRAW_FP(int nrValues, double mu, double sigma)
+{
+    FP12 * fpResult = NULL;
+    XLL_PROFILE_START();
+
+    if(nrValues <= 0)
     {
-        px->xltype = xltypeNum;
-        px->val.num = pdf[i];
+        displayError("(OT_NORMAL_PDF_DRAW_FP): first argument must be positive");
+        return NULL;
     }
 
-    return xResult;
+    //Compute the normal distribution and its PDF
+    //===========================================
+    try
+    {
+        const OT::NumericalSample samplePDF(getNormalGrid(mu, sigma, nrValues));
+        XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
+        fpResult = sample_to_fp12(samplePDF, nrValues, 2);
+        XLL_PROFILE_LAP(XLL_STAGE_RESULT);
+    }
+    catch(OT::Exception & e)
+    {
+        displayError(e.what());
+        return NULL;
+    }
+    catch(std::exception & e)
+    {
+        displayError(e.what());
+        return NULL;
+    }
+    return fpResult;
+}
+
+/***********************************************************************************
+ OT_NORMAL_PDF_ARRAY_ASYNC()
+
+ Purpose:
+
+      Asynchronous version of OT_NORMAL_PDF_ARRAY, see xll_async.h.  Arguments
+      are coerced on the calculation thread, the PDF is computed on a thread
+      of the queue.
+
+ Parameters:
+
+      LPXLOPER12      3 arguments : xl_mu, xl_sigma, xl_points
+                      (can be reference or value)
+      LPXLOPER12      xl_handle, the xltypeBigData handle of the call
+
+ Returns:
+
+      The normal distribution at given points, or #VALUE! if there are
+      non-numerics in the supplied argument, is passed to xlAsyncReturn.
+*************************************************************************************/
+
+void WINAPI
+OT_NORMAL_PDF_ARRAY_ASYNC(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_points, LPXLOPER12 xl_handle)
+{
+    NormalPdfArrayTask * task = new NormalPdfArrayTask();
+
+    // Coerce mu, sigma and the points
+    //================================
+    LPXLOPER12 xError = coerceBroadcast("(OT_NORMAL_PDF_ARRAY_ASYNC): ", xl_mu, xl_sigma, xl_points, task->broadcast);
+    if (xError)
+    {
+        delete task;
+        async_return(xl_handle, xError);
+        return;
+    }
+
+    async_submit(xl_handle, task);
 }
 
+/***********************************************************************************
+ OT_NORMAL_PDF_DRAW_ASYNC()
+
+ Purpose:
+
+      Asynchronous version of OT_NORMAL_PDF_DRAW, see xll_async.h.  The number
+      of points is read from the active cell selection on the calculation
+      thread, the grid is computed on a thread of the queue.
+
+ Parameters:
+
+      LPXLOPER12      2 arguments : xl_mu, xl_sigma
+                      (can be reference or value)
+      LPXLOPER12      xl_handle, the xltypeBigData handle of the call
+
+ Returns:
+
+      The normal distribution at given points, or #VALUE! if there are
+      non-numerics in the supplied argument, is passed to xlAsyncReturn.
+*************************************************************************************/
+
+void WINAPI
+OT_NORMAL_PDF_DRAW_ASYNC(LPXLOPER12 xl_mu, LPXLOPER12 xl_sigma, LPXLOPER12 xl_handle)
+{
+    int error = -1;
+    double mu, sigma;
+
+    // Get the number of rows in current selection
+    //============================================
+    int nrValues = getNumberOfRows();
+    if(nrValues <= 0)
+    {
+        async_return(xl_handle, dialogError("(OT_NORMAL_PDF_DRAW_ASYNC): detection of cell selection failed", xlerrValue));
+        return;
+    }
+    int nrColumns = getNumberOfColumns();
+    if(nrColumns == 0)
+    {
+        async_return(xl_handle, dialogError("(OT_NORMAL_PDF_DRAW_ASYNC): detection of cell selection failed", xlerrValue));
+        return;
+    }
+    if(nrColumns != 2)
+    {
+        async_return(xl_handle, dialogError("(OT_NORMAL_PDF_DRAW_ASYNC): wrong number of columns, two columns must be selected", xlerrValue));
+        return;
+    }
+
+    // Coerce the mean parameter
+    //======================
+    if((error = xloper_to_num(xl_mu, &mu)) != -1)
+    {
+        async_return(xl_handle, dialogError("(OT_NORMAL_PDF_DRAW_ASYNC): Invalid conversion to xltypeNum for argument 'mu'", error));
+        return;
+    }
+
+    // Coerce the standard deviation parameter
+    //========================================
+    if((error = xloper_to_num(xl_sigma, &sigma)) != -1)
+    {
+        async_return(xl_handle, dialogError("(OT_NORMAL_PDF_DRAW_ASYNC): Invalid conversion to xltypeNum for argument 'sigma'", error));
+        return;
+    }
+
+    NormalPdfDrawTask * task = new NormalPdfDrawTask();
+    task->mu = mu;
+    task->sigma = sigma;
+    task->nrValues = nrValues;
+    async_submit(xl_handle, task);
+}
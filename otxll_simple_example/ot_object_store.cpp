@@ -0,0 +1,833 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <framewrk.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+
+#include "ot_object_store.h"
+#include "ot_functions.h"
+#include "ot_marshal.h"
+#include "xll_helper_functions.h"
+#include "xll_result_pool.h"
+
+namespace {
+
+// Cell which owns an object of the given kind
+struct ObjectOwner
+{
+    IDSHEET sheet;
+    RW row;
+    COL column;
+    ObjectKind kind;
+
+    bool operator<(const ObjectOwner & other) const
+    {
+        if (sheet != other.sheet)
+            return sheet < other.sheet;
+        if (row != other.row)
+            return row < other.row;
+        if (column != other.column)
+            return column < other.column;
+        return kind < other.kind;
+    }
+};
+
+// Object of the store, only the member of its kind is set
+struct ObjectEntry
+{
+    ObjectEntry()
+        : kind(OBJECT_KINDS)
+        , owned(false)
+    {
+        owner.sheet = 0;
+        owner.row = 0;
+        owner.column = 0;
+        owner.kind = OBJECT_KINDS;
+    }
+
+    ObjectKind kind;
+    // Start of the handle, before the number
+    std::string label;
+    bool owned;
+    ObjectOwner owner;
+    ObjectInputs inputs;
+    StoredDistribution distribution;
+    OT::NumericalSample sample;
+    StoredChaos chaos;
+};
+
+// Object of a cell, see sweepObjectStore
+struct OwnedObject
+{
+    ObjectOwner owner;
+    unsigned long id;
+    std::string handle;
+};
+
+// Handle of an object
+std::string makeHandle(const std::string & label, unsigned long id)
+{
+    char number[16];
+    sprintf(number, "#%lu", id);
+    return label + number;
+}
+
+/*
+ * Objects by number, the number of the object of each owner, and the
+ * objects made from each object.  All methods may be called concurrently
+ * by the recalculation threads.
+ */
+class ObjectStore
+{
+public:
+    ObjectStore()
+        : lastId_(0)
+    {
+        InitializeCriticalSection(&lock_);
+    }
+
+    ~ObjectStore()
+    {
+        DeleteCriticalSection(&lock_);
+    }
+
+    // Insert an entry, replacing the object of its owner; returns its number
+    unsigned long insert(const ObjectEntry & entry)
+    {
+        // Released once the lock is left, the last copies may be large
+        std::vector<ObjectEntry> dropped;
+        EnterCriticalSection(&lock_);
+        const unsigned long id = ++lastId_;
+        if (entry.owned)
+        {
+            Owners::iterator previous = owners_.find(entry.owner);
+            if (previous != owners_.end())
+            {
+                drop(previous->second, dropped);
+            }
+            owners_[entry.owner] = id;
+        }
+        else
+        {
+            // Nothing replaces these objects, the oldest ones make room
+            unowned_.push_back(id);
+            while (unowned_.size() > OBJECT_MAX_UNOWNED)
+            {
+                drop(unowned_.front(), dropped);
+                unowned_.pop_front();
+            }
+        }
+        objects_.insert(std::make_pair(id, entry));
+        for (size_t i = 0; i < entry.inputs.upstream.size(); ++i)
+        {
+            // An upstream object replaced meanwhile has already dropped its
+            // dependents, this one is replaced when its cell is recalculated
+            if (objects_.count(entry.inputs.upstream[i]))
+            {
+                dependents_.insert(std::make_pair(entry.inputs.upstream[i], id));
+            }
+        }
+        LeaveCriticalSection(&lock_);
+        return id;
+    }
+
+    // Copy the object of the given number and kind, false if there is none
+    bool find(unsigned long id, ObjectKind kind, ObjectEntry & entry)
+    {
+        EnterCriticalSection(&lock_);
+        Objects::const_iterator it = objects_.find(id);
+        const bool found = it != objects_.end() && it->second.kind == kind;
+        if (found)
+        {
+            entry = it->second;
+        }
+        LeaveCriticalSection(&lock_);
+        return found;
+    }
+
+    // Handle of the object of an owner if it was made from the given inputs
+    bool findUnchanged(const ObjectOwner & owner, const ObjectInputs & inputs, std::string & handle)
+    {
+        bool found = false;
+        EnterCriticalSection(&lock_);
+        Owners::const_iterator it = owners_.find(owner);
+        if (it != owners_.end())
+        {
+            Objects::const_iterator object = objects_.find(it->second);
+            if (object != objects_.end() && object->second.inputs.hash == inputs.hash &&
+                object->second.inputs.upstream == inputs.upstream)
+            {
+                handle = makeHandle(object->second.label, object->first);
+                found = true;
+            }
+        }
+        LeaveCriticalSection(&lock_);
+        return found;
+    }
+
+    // Owned objects, with their owners and handles
+    void owned(std::vector<OwnedObject> & objects)
+    {
+        EnterCriticalSection(&lock_);
+        objects.reserve(owners_.size());
+        for (Owners::const_iterator it = owners_.begin(); it != owners_.end(); ++it)
+        {
+            Objects::const_iterator object = objects_.find(it->second);
+            if (object != objects_.end())
+            {
+                OwnedObject owned;
+                owned.owner = it->first;
+                owned.id = it->second;
+                owned.handle = makeHandle(object->second.label, object->first);
+                objects.push_back(owned);
+            }
+        }
+        LeaveCriticalSection(&lock_);
+    }
+
+    // Drop the object of an owner and the objects made from it, unless the
+    // owner has replaced it meanwhile; returns how many were dropped
+    size_t release(const ObjectOwner & owner, unsigned long id)
+    {
+        std::vector<ObjectEntry> dropped;
+        EnterCriticalSection(&lock_);
+        Owners::const_iterator it = owners_.find(owner);
+        if (it != owners_.end() && it->second == id)
+        {
+            drop(id, dropped);
+        }
+        LeaveCriticalSection(&lock_);
+        return dropped.size();
+    }
+
+    // Drop all objects and return how many there were
+    size_t clear()
+    {
+        Objects dropped;
+        EnterCriticalSection(&lock_);
+        dropped.swap(objects_);
+        owners_.clear();
+        dependents_.clear();
+        unowned_.clear();
+        LeaveCriticalSection(&lock_);
+        return dropped.size();
+    }
+
+private:
+    typedef std::map<unsigned long, ObjectEntry> Objects;
+    typedef std::map<ObjectOwner, unsigned long> Owners;
+    typedef std::multimap<unsigned long, unsigned long> Dependents;
+
+    // Not copyable
+    ObjectStore(const ObjectStore &);
+    ObjectStore & operator=(const ObjectStore &);
+
+    // Remove an object and the objects made from it, recursively, into dropped
+    void drop(unsigned long id, std::vector<ObjectEntry> & dropped)
+    {
+        std::vector<unsigned long> pending(1, id);
+        while (!pending.empty())
+        {
+            id = pending.back();
+            pending.pop_back();
+            Objects::iterator it = objects_.find(id);
+            if (it == objects_.end())
+            {
+                continue;
+            }
+
+            // Objects made from this one
+            std::pair<Dependents::iterator, Dependents::iterator> range = dependents_.equal_range(id);
+            for (Dependents::iterator d = range.first; d != range.second; ++d)
+            {
+                pending.push_back(d->second);
+            }
+            dependents_.erase(range.first, range.second);
+
+            // Links from the objects this one was made from
+            const std::vector<unsigned long> & upstream = it->second.inputs.upstream;
+            for (size_t i = 0; i < upstream.size(); ++i)
+            {
+                range = dependents_.equal_range(upstream[i]);
+                for (Dependents::iterator d = range.first; d != range.second; ++d)
+                {
+                    if (d->second == id)
+                    {
+                        dependents_.erase(d);
+                        break;
+                    }
+                }
+            }
+
+            if (it->second.owned)
+            {
+                Owners::iterator owner = owners_.find(it->second.owner);
+                if (owner != owners_.end() && owner->second == id)
+                {
+                    owners_.erase(owner);
+                }
+            }
+            dropped.push_back(it->second);
+            objects_.erase(it);
+        }
+    }
+
+    CRITICAL_SECTION lock_;
+    unsigned long lastId_;
+    Objects objects_;
+    Owners owners_;
+    // Objects made from each object, by number
+    Dependents dependents_;
+    // Numbers of the objects made outside of a cell, oldest first, some may be dropped already
+    std::deque<unsigned long> unowned_;
+};
+
+ObjectStore objectStore;
+
+// Calling cell, as the owner of an object of the given kind
+bool getOwner(ObjectKind kind, ObjectOwner & owner)
+{
+    owner.kind = kind;
+    return getCallerCell(&owner.sheet, &owner.row, &owner.column);
+}
+
+// Whether the cell of an owner still holds the given handle, false if the cell cannot be read
+bool holdsHandle(const ObjectOwner & owner, const std::string & handle)
+{
+    XLMREF12 area;
+    area.count = 1;
+    area.reftbl[0].rwFirst = area.reftbl[0].rwLast = owner.row;
+    area.reftbl[0].colFirst = area.reftbl[0].colLast = owner.column;
+    XLOPER12 cell;
+    cell.xltype = xltypeRef;
+    cell.val.mref.idSheet = owner.sheet;
+    cell.val.mref.lpmref = &area;
+
+    std::string text;
+    return getObjectHandle(&cell, text) && text == handle;
+}
+
+// Store an entry on behalf of the calling cell, returns its handle
+std::string storeEntry(ObjectEntry & entry)
+{
+    entry.owned = getOwner(entry.kind, entry.owner);
+    return makeHandle(entry.label, objectStore.insert(entry));
+}
+
+// Number of a handle "label#number", 0 if the string is not a handle
+unsigned long parseHandle(const std::string & handle)
+{
+    const size_t sharp = handle.rfind('#');
+    if (sharp == std::string::npos || sharp == 0 || sharp + 1 == handle.size() || sharp + 11 < handle.size())
+    {
+        return 0;
+    }
+    for (size_t i = sharp + 1; i < handle.size(); ++i)
+    {
+        if (handle[i] < '0' || handle[i] > '9')
+        {
+            return 0;
+        }
+    }
+    return strtoul(handle.c_str() + sharp + 1, NULL, 10);
+}
+
+} // empty namespace
+
+/*********************************************************************
+**  addObjectHandle()
+**
+**  Purpose :
+**      add a handle to the inputs of an object, which is then dropped
+**      with the object of this handle.
+**
+**  Parameters:
+**
+**        inputs : ObjectInputs
+**        handle : std::string, see getObjectHandle
+**********************************************************************/
+void
+addObjectHandle(ObjectInputs & inputs, const std::string & handle)
+{
+    XLOPER12 number;
+    number.xltype = xltypeNum;
+    number.val.num = (double) parseHandle(handle);
+    inputs.hash = hash_xloper(number, inputs.hash);
+    inputs.upstream.push_back(parseHandle(handle));
+}
+
+/*********************************************************************
+**  findUnchangedObject()
+**
+**  Purpose :
+**      look for the object of the given kind which the calling cell
+**      made from the same inputs, so that it is not built again.
+**
+**  Parameters:
+**
+**        kind   : ObjectKind
+**        inputs : ObjectInputs, with all the arguments of the call
+**        handle : std::string, set to the handle of the object
+**
+**  Returns :
+**        true if the object is found and still stored
+**********************************************************************/
+bool
+findUnchangedObject(ObjectKind kind, const ObjectInputs & inputs, std::string & handle)
+{
+    ObjectOwner owner;
+    return getOwner(kind, owner) && objectStore.findUnchanged(owner, inputs, handle);
+}
+
+/*********************************************************************
+**  storeDistribution()
+**
+**  Purpose :
+**      insert a distribution into the store, replacing the previous
+**      distribution of the calling cell.
+**
+**  Parameters:
+**
+**        distribution : StoredDistribution
+**        inputs       : ObjectInputs it was made from
+**
+**  Returns :
+**        the handle of the distribution, e.g. "Normal#12"
+**********************************************************************/
+std::string
+storeDistribution(const StoredDistribution & distribution, const ObjectInputs & inputs)
+{
+    ObjectEntry entry;
+    entry.kind = OBJECT_DISTRIBUTION;
+    const char * name = getDistributionName(distribution.family);
+    entry.label = *name ? name : "Distribution";
+    entry.inputs = inputs;
+    entry.distribution = distribution;
+    return storeEntry(entry);
+}
+
+/*********************************************************************
+**  storeSample()
+**
+**  Purpose :
+**      insert a sample into the store, replacing the previous sample
+**      of the calling cell.
+**
+**  Parameters:
+**
+**        sample : OT::NumericalSample
+**        inputs : ObjectInputs it was made from
+**
+**  Returns :
+**        the handle of the sample, e.g. "Sample#13"
+**********************************************************************/
+std::string
+storeSample(const OT::NumericalSample & sample, const ObjectInputs & inputs)
+{
+    ObjectEntry entry;
+    entry.kind = OBJECT_SAMPLE;
+    entry.label = "Sample";
+    entry.inputs = inputs;
+    entry.sample = sample;
+    return storeEntry(entry);
+}
+
+/*********************************************************************
+**  storeChaos()
+**
+**  Purpose :
+**      insert a polynomial chaos expansion into the store, replacing
+**      the previous expansion of the calling cell.
+**
+**  Parameters:
+**
+**        chaos  : StoredChaos
+**        inputs : ObjectInputs it was made from
+**
+**  Returns :
+**        the handle of the expansion, e.g. "PCE#14"
+**********************************************************************/
+std::string
+storeChaos(const StoredChaos & chaos, const ObjectInputs & inputs)
+{
+    ObjectEntry entry;
+    entry.kind = OBJECT_CHAOS;
+    entry.label = "PCE";
+    entry.inputs = inputs;
+    entry.chaos = chaos;
+    return storeEntry(entry);
+}
+
+/*********************************************************************
+**  getObjectHandle()
+**
+**  Purpose :
+**      read an argument which may be a handle: a string, or a single
+**      cell holding a string, of the form "label#number".  Ranges of
+**      several cells are not even coerced.
+**
+**  Parameters:
+**
+**        xl_oper : LPXLOPER12 argument of a worksheet function
+**        handle  : std::string, set if the argument is a handle
+**
+**  Returns :
+**        true if the argument looks like a handle, which may still
+**        be unknown to the store
+**********************************************************************/
+bool
+getObjectHandle(LPXLOPER12 xl_oper, std::string & handle)
+{
+    switch (xl_oper->xltype & ~(xlbitXLFree | xlbitDLLFree))
+    {
+    case xltypeStr:
+        break;
+    case xltypeSRef:
+        if (xl_oper->val.sref.ref.rwFirst != xl_oper->val.sref.ref.rwLast ||
+            xl_oper->val.sref.ref.colFirst != xl_oper->val.sref.ref.colLast)
+            return false;
+        break;
+    case xltypeRef:
+        if (!xl_oper->val.mref.lpmref || xl_oper->val.mref.lpmref->count != 1 ||
+            xl_oper->val.mref.lpmref->reftbl[0].rwFirst != xl_oper->val.mref.lpmref->reftbl[0].rwLast ||
+            xl_oper->val.mref.lpmref->reftbl[0].colFirst != xl_oper->val.mref.lpmref->reftbl[0].colLast)
+            return false;
+        break;
+    default:
+        return false;
+    }
+
+    std::string text;
+    if (xloper_to_string(xl_oper, &text) != -1 || parseHandle(text) == 0)
+    {
+        return false;
+    }
+    handle = text;
+    return true;
+}
+
+/*********************************************************************
+**  findDistribution()
+**
+**  Purpose :
+**      copy the distribution of a handle out of the store.
+**
+**  Parameters:
+**
+**        handle       : std::string, see getObjectHandle
+**        distribution : StoredDistribution, set if it is found
+**
+**  Returns :
+**        false if the handle is unknown or not a distribution
+**********************************************************************/
+bool
+findDistribution(const std::string & handle, StoredDistribution & distribution)
+{
+    ObjectEntry entry;
+    if (!objectStore.find(parseHandle(handle), OBJECT_DISTRIBUTION, entry))
+    {
+        return false;
+    }
+    distribution = entry.distribution;
+    return true;
+}
+
+/*********************************************************************
+**  findSample()
+**
+**  Purpose :
+**      copy the sample of a handle out of the store.
+**
+**  Parameters:
+**
+**        handle : std::string, see getObjectHandle
+**        sample : OT::NumericalSample, set if it is found
+**
+**  Returns :
+**        false if the handle is unknown or not a sample
+**********************************************************************/
+bool
+findSample(const std::string & handle, OT::NumericalSample & sample)
+{
+    ObjectEntry entry;
+    if (!objectStore.find(parseHandle(handle), OBJECT_SAMPLE, entry))
+    {
+        return false;
+    }
+    sample = entry.sample;
+    return true;
+}
+
+/*********************************************************************
+**  findChaos()
+**
+**  Purpose :
+**      copy the polynomial chaos expansion of a handle out of the store.
+**
+**  Parameters:
+**
+**        handle : std::string, see getObjectHandle
+**        chaos  : StoredChaos, set if it is found
+**
+**  Returns :
+**        false if the handle is unknown or not an expansion
+**********************************************************************/
+bool
+findChaos(const std::string & handle, StoredChaos & chaos)
+{
+    ObjectEntry entry;
+    if (!objectStore.find(parseHandle(handle), OBJECT_CHAOS, entry))
+    {
+        return false;
+    }
+    chaos = entry.chaos;
+    return true;
+}
+
+/*********************************************************************
+**  coerceSampleColumn()
+**
+**  Purpose :
+**      get a sample of dimension 1 for a function argument: either
+**      the handle of an OT_MAKE_SAMPLE cell, or a single column of
+**      numbers.
+**
+**  Parameters:
+**
+**        prefix   : name of the function, for error messages
+**        argument : name of the argument, for error messages
+**        xl_oper  : the argument
+**        sample   : OT::NumericalSample, set if success
+**
+**  Returns :
+**        NULL if success, the error to return to Excel otherwise
+**********************************************************************/
+LPXLOPER12
+coerceSampleColumn(const std::string & prefix, const char * argument, LPXLOPER12 xl_oper,
+                   OT::NumericalSample & sample)
+{
+    std::string handle;
+    RW rows = 0;
+    COL columns = 0;
+    int error = -1;
+
+    if (getObjectHandle(xl_oper, handle))
+    {
+        if (!findSample(handle, sample) || sample.getDimension() != 1)
+        {
+            return dialogError(prefix + "Unknown sample of dimension 1 '" + handle + "'", xlerrValue);
+        }
+        return NULL;
+    }
+    if((error = get_range_shape(xl_oper, &rows, &columns)) != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeMulti for argument '" + argument + "'", error);
+    }
+    if (columns != 1)
+    {
+        return dialogError(prefix + "Invalid argument '" + argument + "', there must be a single column", xlerrValue);
+    }
+    // Read by blocks rather than coerced at once, see read_range
+    if((error = range_to_sample(xl_oper, CELLS_ERROR, rows, columns, sample)) != -1)
+    {
+        return dialogError(prefix + "Invalid conversion to xltypeNum for argument '" + argument + "'", error);
+    }
+    return NULL;
+}
+
+/*********************************************************************
+**  sweepObjectStore()
+**
+**  Purpose :
+**      drop the objects whose cell no longer holds their handle, with
+**      the objects made from them: the cell was cleared, deleted or
+**      overwritten, or its formula does not make an object anymore.
+**      Cells are read with xlCoerce, so that this must be called from
+**      a command once the recalculation is over, see OT_OBJECT_SWEEP.
+**
+**  Returns :
+**        the number of objects which were dropped
+**********************************************************************/
+size_t
+sweepObjectStore()
+{
+    std::vector<OwnedObject> owned;
+    objectStore.owned(owned);
+    size_t count = 0;
+    for (size_t i = 0; i < owned.size(); ++i)
+    {
+        if (!holdsHandle(owned[i].owner, owned[i].handle))
+        {
+            count += objectStore.release(owned[i].owner, owned[i].id);
+        }
+    }
+    return count;
+}
+
+/*********************************************************************
+**  clearObjectStore()
+**
+**  Purpose :
+**      drop all objects of the store.
+**
+**  Returns :
+**        the number of objects which were dropped
+**********************************************************************/
+size_t
+clearObjectStore()
+{
+    return objectStore.clear();
+}
+
+/*********************************************************************
+**  handle_to_result()
+**
+**  Purpose :
+**      return a handle to Excel, as a string released by xlAutoFree12.
+**
+**  Parameters:
+**
+**        handle : std::string, ASCII
+**
+**  Returns :
+**        LPXLOPER12 allocated by new_result, or NULL
+**********************************************************************/
+LPXLOPER12
+handle_to_result(const std::string & handle)
+{
+    LPXLOPER12 xResult = new_result();
+    if (!xResult)
+    {
+        return NULL;
+    }
+    const size_t length = handle.size() < 255 ? handle.size() : 255;
+    xResult->xltype = xltypeStr | xlbitDLLFree;
+    xResult->val.str = new XCHAR[length + 1];
+    xResult->val.str[0] = (XCHAR) length;
+    for (size_t i = 0; i < length; ++i)
+    {
+        xResult->val.str[i + 1] = (XCHAR) handle[i];
+    }
+    return xResult;
+}
+
+/***********************************************************************************
+ OT_OBJECT_SWEEP()
+
+ Purpose:
+
+      Command registered for xlEventCalculationEnded by xlAutoOpen.  Excel
+      calls it on its main thread once a recalculation is over, the objects
+      of cells which no longer hold their handle are then dropped, see
+      sweepObjectStore.
+
+ Returns:
+
+      int             1
+*************************************************************************************/
+
+int WINAPI
+OT_OBJECT_SWEEP()
+{
+    sweepObjectStore();
+    return 1;
+}
+
+/***********************************************************************************
+ OT_MAKE_SAMPLE()
+
+ Purpose:
+
+      This function takes 2 arguments and stores a sample, which other
+      functions then use through its handle without reading the range again.
+      The range is read by blocks, see read_range, so that only the sample
+      is held in memory, not a copy of the whole range.  It is read twice:
+      first to hash it and count its rows, so that an unchanged range gives
+      its handle back without allocating anything, then into the sample.
+
+ Parameters:
+
+      LPXLOPER12      2 arguments : xl_values, xl_missing
+                      xl_values is a range with one point per row, and one
+                      column per component, or several areas of the same
+                      width which are stacked; xl_missing tells what to do
+                      with its cells which are not numbers: "error" by
+                      default, "nan" to keep them as NaN, or "skip" to leave
+                      out their rows
+
+ Returns:
+
+      LPXLOPER12      the handle of the sample, like "Sample#13", the same
+                      as on the previous call if the values did not change,
+                      or #VALUE! if there are non-numerics in the
+                      supplied argument.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_MAKE_SAMPLE(LPXLOPER12 xl_values, LPXLOPER12 xl_missing)
+{
+    ObjectInputs inputs;
+    std::string handle;
+    XllCellPolicy policy;
+    RW rows = 0;
+    COL columns = 0;
+    int error = -1;
+
+    if((error = xloper_to_policy(xl_missing, &policy)) != -1)
+    {
+        return dialogError("(OT_MAKE_SAMPLE): Invalid argument 'missing', expected error, nan or skip", error);
+    }
+    XLOPER12 xl_policy;
+    xl_policy.xltype = xltypeInt;
+    xl_policy.val.w = policy;
+    inputs.hash = hash_xloper(xl_policy, inputs.hash);
+
+    // Hash the values and count the rows which are kept
+    //=================================================
+    if((error = get_range_shape(xl_values, &rows, &columns)) != -1)
+    {
+        return dialogError("(OT_MAKE_SAMPLE): Invalid range for argument 'values', areas must have the same width", error);
+    }
+    if((error = count_range_rows(xl_values, policy, &rows, &columns, &inputs.hash)) != -1)
+    {
+        return dialogError("(OT_MAKE_SAMPLE): Invalid conversion to xltypeNum for argument 'values'", error);
+    }
+    // Nothing is allocated if the values did not change
+    if (findUnchangedObject(OBJECT_SAMPLE, inputs, handle))
+    {
+        return handle_to_result(handle);
+    }
+
+    // Read the values block by block into the sample
+    //================================================
+    OT::NumericalSample sample;
+    if((error = range_to_sample(xl_values, policy, rows, columns, sample)) != -1)
+    {
+        return dialogError("(OT_MAKE_SAMPLE): Invalid conversion to xltypeNum for argument 'values'", error);
+    }
+    return handle_to_result(storeSample(sample, inputs));
+}
@@ -0,0 +1,122 @@
+#ifndef __OT_OBJECT_STORE_H
+#define __OT_OBJECT_STORE_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <string>
+#include <vector>
+
+#include <OT.hxx>
+#include "ot_chaos.h"
+#include "ot_distribution_cache.h"
+#include "xll_helper_functions.h"
+
+/*
+ * Store of the OpenTURNS objects made by the OT_MAKE_* functions, and of
+ * the expansions of OT_PCE_BUILD, so that they are built once and then
+ * used by any number of cells.
+ *
+ * Each object is identified by a short string handle, like "Normal#12",
+ * "Sample#13" or "PCE#14", which the function making it returns and other
+ * functions accept instead of a distribution name and its parameters, or
+ * instead of a range of points.  The number of a handle is never reused,
+ * so cells depending on it are recalculated when the object is rebuilt.
+ *
+ * An object is owned by the cell which made it, as identified by
+ * xlfCaller: when the cell is recalculated, its new object replaces the
+ * previous one, which is dropped from the store.  A cell owns one object
+ * of each kind.  Once a recalculation is over, the objects of cells which
+ * no longer hold their handle, because they were cleared, deleted or
+ * overwritten, are dropped as well, see sweepObjectStore.  Objects made
+ * outside of a cell, e.g. from VB, have no cell to replace them: only the
+ * last OBJECT_MAX_UNOWNED ones are kept.  All objects are dropped by
+ * clearObjectStore, see xlAutoClose.
+ *
+ * Objects also record the inputs they were made of: a hash of the content
+ * of their coerced arguments, see hash_xloper, and the objects of the
+ * handles among them.  When a cell is recalculated with unchanged inputs,
+ * it gets its handle back instead of building a new object, so that cells
+ * depending on the handle do not rebuild their own objects either.  When
+ * an object is replaced or dropped, the objects made from its handle are
+ * dropped too, recursively, and only them: a change upstream invalidates
+ * exactly the objects which depend on it, until their cells are
+ * recalculated.
+ *
+ * Objects are copied out of the store under its lock.  OpenTURNS objects
+ * are reference-counted handles to a shared implementation, so an object
+ * remains valid for the threads using it even if its cell replaces it
+ * meanwhile.  They are shared and must not be modified.  Expansions are
+ * copied as a whole: their tables of coefficients and terms are small, see
+ * CHAOS_MAX_TERMS, and their marginals and measures are OT::Distribution
+ * handles, shared by reference count like the other objects.
+ */
+
+/* Number of objects made outside of a cell which are kept */
+#define OBJECT_MAX_UNOWNED 256
+
+enum ObjectKind
+{
+    OBJECT_DISTRIBUTION = 0,
+    OBJECT_SAMPLE,
+    OBJECT_CHAOS,
+    OBJECT_KINDS
+};
+
+/* Distribution of the store, with the family and parameters it was made of,
+   which are DISTRIBUTION_FAMILIES and none if it does not come from the table */
+struct StoredDistribution
+{
+    StoredDistribution() : family(DISTRIBUTION_FAMILIES), count(0) {}
+
+    DistributionFamily family;
+    OT::NumericalScalar parameters[DISTRIBUTION_MAX_PARAMETERS];
+    int count;
+    OT::Distribution distribution;
+};
+
+/* Inputs an object is made of */
+struct ObjectInputs
+{
+    ObjectInputs() : hash(XLOPER_HASH_SEED) {}
+
+    /* Hash of the coerced arguments, see xloper_to_multi and hash_xloper */
+    ULONGLONG hash;
+    /* Numbers of the objects of the handles among the arguments */
+    std::vector<unsigned long> upstream;
+};
+
+/* Add a handle to the inputs of an object, which then depends on it */
+void addObjectHandle(ObjectInputs & inputs, const std::string & handle);
+/* Handle of the object the calling cell made from the same inputs, if it is still stored */
+bool findUnchangedObject(ObjectKind kind, const ObjectInputs & inputs, std::string & handle);
+
+/* Store a distribution on behalf of the calling cell, returns its handle */
+std::string storeDistribution(const StoredDistribution & distribution, const ObjectInputs & inputs);
+/* Store a sample on behalf of the calling cell, returns its handle */
+std::string storeSample(const OT::NumericalSample & sample, const ObjectInputs & inputs);
+/* Store a polynomial chaos expansion on behalf of the calling cell, returns its handle */
+std::string storeChaos(const StoredChaos & chaos, const ObjectInputs & inputs);
+
+/* Whether an argument is a string which looks like a handle, which is copied */
+bool getObjectHandle(LPXLOPER12 xl_oper, std::string & handle);
+/* Copy the object of a handle, false if it is unknown or of another kind */
+bool findDistribution(const std::string & handle, StoredDistribution & distribution);
+bool findSample(const std::string & handle, OT::NumericalSample & sample);
+bool findChaos(const std::string & handle, StoredChaos & chaos);
+
+/* Get a sample of dimension 1 from a handle or a single column; NULL, or the error to return to Excel */
+LPXLOPER12 coerceSampleColumn(const std::string & prefix, const char * argument, LPXLOPER12 xl_oper,
+                              OT::NumericalSample & sample);
+
+/* Return a handle to Excel, released by xlAutoFree12 */
+LPXLOPER12 handle_to_result(const std::string & handle);
+
+/* Drop the objects of cells which no longer hold their handle and return their number, see OT_OBJECT_SWEEP */
+size_t sweepObjectStore();
+/* Drop all objects and return their number, see xlAutoClose */
+size_t clearObjectStore();
+
+#endif // __OT_OBJECT_STORE_H
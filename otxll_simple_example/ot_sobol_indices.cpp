@@ -0,0 +1,454 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <framewrk.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <OT.hxx>
+#include "xll_helper_functions.h"
+#include "ot_marshal.h"
+#include "ot_functions.h"
+#include "xll_profile.h"
+#include "ot_chaos.h"
+#include "ot_doe.h"
+#include "ot_object_store.h"
+#include "xll_thread_pool.h"
+#include "xll_random.h"
+#include "xll_result_pool.h"
+
+namespace {
+
+// Sums of a block of points, see accumulateBlock: the size, mean and sum of
+// squared deviations of f(A) and f(B) together, then for each input i the
+// sums of f(B) (f(C_i) - f(A)), of f(C_i) - f(A) and of (f(C_i) - f(A))^2
+#define SALTELLI_SUMS(d) (3 + 3 * (d))
+
+/*
+ * State shared by the threads of OT_SOBOL_INDICES for an expansion,
+ * evaluated on designs A and B drawn here.
+ */
+struct SaltelliContext
+{
+    size_t size;
+    size_t dimension;
+    const StoredChaos * chaos;
+    const std::vector<DesignMarginal> * marginals;
+    // A and B are the two halves of a Sobol design of 2 d dimensions, or random points
+    bool sequence;
+    uint64_t seed;
+    std::vector<uint64_t> directions;
+    std::vector<uint64_t> shifts;
+    // SALTELLI_SUMS per block of PARALLEL_CHUNK points
+    std::vector<double> sums;
+    // 1 if a quantile or the expansion failed
+    volatile LONG failed;
+};
+
+/*
+ * Values of the worksheet, one row per point with f(A), f(B), then f(C_i)
+ * for each input i, C_i being A with its column i taken from B.  They are
+ * given by read_range, and gathered into blocks of PARALLEL_CHUNK points
+ * whose sums are added to sums, so that only one block is held at once.
+ */
+struct SaltelliReader
+{
+    size_t size;
+    size_t dimension;
+    // Rows of the current block, d + 2 values each
+    std::vector<double> rows;
+    std::vector<double> fa;
+    std::vector<double> fb;
+    std::vector<double> fc;
+    // SALTELLI_SUMS per block of PARALLEL_CHUNK points
+    std::vector<double> sums;
+};
+
+// Start the sums of a block from f(A) and f(B) at its rows points
+void initBlockSums(double * sums, size_t d, const double * fa, const double * fb, size_t rows)
+{
+    double mean = 0.0;
+    for (size_t r = 0; r < rows; ++r)
+    {
+        mean += fa[r] + fb[r];
+    }
+    mean /= 2.0 * rows;
+    double squares = 0.0;
+    for (size_t r = 0; r < rows; ++r)
+    {
+        squares += (fa[r] - mean) * (fa[r] - mean) + (fb[r] - mean) * (fb[r] - mean);
+    }
+    sums[0] = 2.0 * rows;
+    sums[1] = mean;
+    sums[2] = squares;
+    std::fill(sums + 3, sums + SALTELLI_SUMS(d), 0.0);
+}
+
+// Sums of input i over rows points of a block
+void accumulateBlock(double * sums, size_t d, size_t i, const double * fa, const double * fb,
+                     const double * fc, size_t rows)
+{
+    double first = 0.0, difference = 0.0, total = 0.0;
+    for (size_t r = 0; r < rows; ++r)
+    {
+        const double delta = fc[r] - fa[r];
+        first += fb[r] * delta;
+        difference += delta;
+        total += delta * delta;
+    }
+    sums[3 + i] = first;
+    sums[3 + d + i] = difference;
+    sums[3 + 2 * d + i] = total;
+}
+
+/*
+ * Sums of points [begin, end), for parallel_for, one block of
+ * PARALLEL_CHUNK points at a time: the designs of a block are drawn,
+ * evaluated and reduced to its sums before the next one, so that memory
+ * does not depend on the number of points.
+ */
+void saltelliChunk(void * context, size_t begin, size_t end)
+{
+    SaltelliContext & saltelli = *static_cast<SaltelliContext *>(context);
+    const size_t d = saltelli.dimension;
+    const size_t rows = std::min((size_t) PARALLEL_CHUNK, end - begin);
+    std::vector<double> fa(rows), fb(rows), fc(rows);
+    std::vector<double> u(rows * 2 * d), a(rows * d), b(rows * d);
+
+    for (size_t block = begin; block < end; block += PARALLEL_CHUNK)
+    {
+        const size_t count = std::min((size_t) PARALLEL_CHUNK, end - block);
+        double * sums = &saltelli.sums[block / PARALLEL_CHUNK * SALTELLI_SUMS(d)];
+        // Draw the points of A and B, then evaluate A, B, and each C_i by swapping its column into a
+        if (saltelli.sequence)
+        {
+            sobol_points(&saltelli.directions[0], &saltelli.shifts[0], 2 * d, block, block + count, &u[0]);
+        }
+        else
+        {
+            XllRandomStream stream(saltelli.seed, block / RANDOM_BLOCK);
+            for (size_t k = 0; k < count * 2 * d; ++k)
+            {
+                u[k] = stream.uniform();
+            }
+        }
+        try
+        {
+            for (size_t r = 0; r < count; ++r)
+            {
+                for (size_t j = 0; j < d; ++j)
+                {
+                    a[r * d + j] = design_quantile((*saltelli.marginals)[j], u[r * 2 * d + j]);
+                    b[r * d + j] = design_quantile((*saltelli.marginals)[j], u[r * 2 * d + d + j]);
+                }
+            }
+            chaos_evaluate(*saltelli.chaos, &a[0], &fa[0], count);
+            chaos_evaluate(*saltelli.chaos, &b[0], &fb[0], count);
+            initBlockSums(sums, d, &fa[0], &fb[0], count);
+            for (size_t i = 0; i < d; ++i)
+            {
+                for (size_t r = 0; r < count; ++r)
+                {
+                    std::swap(a[r * d + i], b[r * d + i]);
+                }
+                chaos_evaluate(*saltelli.chaos, &a[0], &fc[0], count);
+                for (size_t r = 0; r < count; ++r)
+                {
+                    std::swap(a[r * d + i], b[r * d + i]);
+                }
+                accumulateBlock(sums, d, i, &fa[0], &fb[0], &fc[0], count);
+            }
+        }
+        catch(...)
+        {
+            // parallel_for procs must not throw, the indices are dropped
+            InterlockedExchange(&saltelli.failed, 1);
+            return;
+        }
+    }
+}
+
+// Sums of the rows of the current block, which is then emptied
+void reduceBlock(SaltelliReader & reader)
+{
+    const size_t d = reader.dimension;
+    const size_t columns = d + 2;
+    const size_t count = reader.rows.size() / columns;
+    const double * row = &reader.rows[0];
+    for (size_t r = 0; r < count; ++r, row += columns)
+    {
+        reader.fa[r] = row[0];
+        reader.fb[r] = row[1];
+    }
+    reader.sums.resize(reader.sums.size() + SALTELLI_SUMS(d));
+    double * sums = &reader.sums[reader.sums.size() - SALTELLI_SUMS(d)];
+    initBlockSums(sums, d, &reader.fa[0], &reader.fb[0], count);
+    for (size_t i = 0; i < d; ++i)
+    {
+        row = &reader.rows[0];
+        for (size_t r = 0; r < count; ++r, row += columns)
+        {
+            reader.fc[r] = row[2 + i];
+        }
+        accumulateBlock(sums, d, i, &reader.fa[0], &reader.fb[0], &reader.fc[0], count);
+    }
+    reader.size += count;
+    reader.rows.clear();
+}
+
+// Gather the rows of a block of the range, for read_range
+int saltelliRows(void * context, const double * values, RW rows, COL columns)
+{
+    SaltelliReader & reader = *static_cast<SaltelliReader *>(context);
+    const size_t block = (size_t) PARALLEL_CHUNK * columns;
+    const double * end = values + (size_t) rows * columns;
+    while (values < end)
+    {
+        const size_t count = std::min(block - reader.rows.size(), (size_t) (end - values));
+        reader.rows.insert(reader.rows.end(), values, values + count);
+        values += count;
+        if (reader.rows.size() == block)
+        {
+            reduceBlock(reader);
+        }
+    }
+    return -1;
+}
+
+} // empty namespace
+
+/***********************************************************************************
+ OT_SOBOL_INDICES()
+
+ Purpose:
+
+      This function takes 4 arguments and estimates the first order and
+      total Sobol indices of the inputs of a model by the scheme of
+      Saltelli: the model is evaluated on two independent designs A and
+      B, and on the designs C_i, which are A with column i taken from B,
+      that is on N (d + 2) points for N points and d inputs.  The first
+      order indices are given by the estimator of Saltelli (2010), the
+      total ones by the estimator of Jansen.
+
+      The model is either a polynomial chaos expansion, evaluated on
+      designs drawn here, or a range of its values computed by the
+      worksheet.  Points are processed by blocks of PARALLEL_CHUNK points,
+      reduced to a few sums before the next one, so that memory does not
+      grow with the number of points: for an expansion, the designs of
+      the blocks are drawn and evaluated in parallel; a range is read by
+      blocks of rows, see read_range, whose points are summed as they
+      come.  The sums of the blocks are added in order, so that indices
+      do not depend on the number of threads.
+
+ Parameters:
+
+      LPXLOPER12      4 arguments : xl_marginals, xl_model, xl_size, xl_seed
+                      xl_marginals is one row per input with the handle of
+                      an OT_MAKE_DISTRIBUTION cell, or a name and its
+                      parameters as for OT_DOE, or a number of inputs
+                      uniform on [0, 1]; it may be missing for a range;
+                      xl_model is the handle of an OT_PCE_BUILD cell, or a
+                      range with one row per point and d + 2 columns: the
+                      values on A, on B, then on C_1 to C_d;
+                      xl_size is the number of points of the designs drawn
+                      for an expansion;
+                      xl_seed is a non-negative integer, 0 if missing: A
+                      and B are the two halves of a Sobol design of 2 d
+                      dimensions, randomly shifted unless the seed is 0, or
+                      random points drawn from the seed above 20 inputs
+
+ Returns:
+
+      LPXLOPER12      one row per input, with its first order index and
+                      its total index, or #VALUE! if there are
+                      non-numerics in the supplied arguments.
+*************************************************************************************/
+
+LPXLOPER12 WINAPI
+OT_SOBOL_INDICES(LPXLOPER12 xl_marginals, LPXLOPER12 xl_model, LPXLOPER12 xl_size, LPXLOPER12 xl_seed)
+{
+    const std::string prefix = "(OT_SOBOL_INDICES): ";
+    std::vector<DesignMarginal> marginals;
+    SaltelliContext saltelli;
+    SaltelliReader reader;
+    StoredChaos chaos;
+    std::string handle;
+    RW rows = 0;
+    COL columns = 0;
+    int size = 0;
+    double seed = 0.0;
+    int error = -1;
+    XLL_PROFILE_START();
+
+    saltelli.chaos = NULL;
+    saltelli.marginals = &marginals;
+    saltelli.sequence = false;
+    saltelli.seed = 0;
+    saltelli.failed = 0;
+
+    // Coerce the model, and the marginals
+    //====================================
+    const bool missing = xl_marginals->xltype == xltypeMissing || xl_marginals->xltype == xltypeNil;
+    LPXLOPER12 xError = missing ? NULL : coerceMarginals(prefix, xl_marginals, marginals);
+    if (xError)
+    {
+        return xError;
+    }
+    if (getObjectHandle(xl_model, handle))
+    {
+        if (!findChaos(handle, chaos))
+        {
+            return dialogError(prefix + "Unknown PCE '" + handle + "'", xlerrValue);
+        }
+        if (marginals.size() != (size_t) chaos.dimension)
+        {
+            return dialogError(prefix + "Invalid argument 'marginals', there must be one row per input of the PCE", xlerrValue);
+        }
+        saltelli.chaos = &chaos;
+        saltelli.dimension = chaos.dimension;
+    }
+    else
+    {
+        if((error = get_range_shape(xl_model, &rows, &columns)) != -1)
+        {
+            return dialogError(prefix + "Invalid conversion to xltypeMulti for argument 'model'", error);
+        }
+        saltelli.dimension = columns > 2 ? columns - 2 : 0;
+        if (saltelli.dimension == 0 || rows < 2)
+        {
+            return dialogError(prefix + "Invalid argument 'model', expected the handle of an OT_PCE_BUILD cell, "
+                               "or at least 2 rows of the values on A, B and each C_i", xlerrValue);
+        }
+        if (!missing && marginals.size() != saltelli.dimension)
+        {
+            return dialogError(prefix + "Invalid argument 'marginals', there must be one row per input of the model", xlerrValue);
+        }
+
+        // Sums of each block, as the range is read, see read_range
+        reader.size = 0;
+        reader.dimension = saltelli.dimension;
+        reader.rows.reserve((size_t) PARALLEL_CHUNK * columns);
+        reader.fa.resize(PARALLEL_CHUNK);
+        reader.fb.resize(PARALLEL_CHUNK);
+        reader.fc.resize(PARALLEL_CHUNK);
+        if ((error = read_range(xl_model, &saltelliRows, &reader)) != -1)
+        {
+            return dialogError(prefix + "Invalid conversion to xltypeNum for argument 'model'", error);
+        }
+        if (!reader.rows.empty())
+        {
+            reduceBlock(reader);
+        }
+        saltelli.size = reader.size;
+        saltelli.sums.swap(reader.sums);
+    }
+
+    // Coerce the size and the seed of the designs of an expansion
+    //============================================================
+    if (saltelli.chaos)
+    {
+        if((error = xloper_to_int(xl_size, &size)) != -1)
+        {
+            return dialogError(prefix + "Invalid conversion to xltypeInt for argument 'size'", error);
+        }
+        if (size < 2)
+        {
+            return dialogError(prefix + "The size must be at least 2", xlerrValue);
+        }
+        if (xl_seed->xltype != xltypeMissing && xl_seed->xltype != xltypeNil)
+        {
+            if((error = xloper_to_num(xl_seed, &seed)) != -1)
+            {
+                return dialogError(prefix + "Invalid conversion to xltypeNum for argument 'seed'", error);
+            }
+            if (!(seed >= 0.0 && seed < 9007199254740992.0) || seed != std::floor(seed))
+            {
+                return dialogError(prefix + "The seed must be a non-negative integer", xlerrValue);
+            }
+        }
+        saltelli.size = size;
+        saltelli.seed = (uint64_t) seed;
+        saltelli.sequence = 2 * saltelli.dimension <= SOBOL_DIMENSIONS;
+        if (saltelli.sequence)
+        {
+            sobol_directions(2 * saltelli.dimension, saltelli.directions);
+            sobol_shifts(saltelli.seed, 2 * saltelli.dimension, saltelli.shifts);
+        }
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_COERCE);
+
+    // Sums of each block of an expansion, then indices
+    //=================================================
+    const size_t d = saltelli.dimension;
+    const size_t blocks = (saltelli.size + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+    if (saltelli.chaos)
+    {
+        saltelli.sums.assign(blocks * SALTELLI_SUMS(d), 0.0);
+        parallel_for(saltelli.size, &saltelliChunk, &saltelli);
+        if (saltelli.failed)
+        {
+            return dialogError(prefix + "Quantiles of the marginals or values of the expansion cannot be computed", xlerrValue);
+        }
+    }
+
+    // Blocks are merged in order, means and squared deviations by the formula of Chan et al.
+    std::vector<double> total(SALTELLI_SUMS(d), 0.0);
+    for (size_t k = 0; k < blocks; ++k)
+    {
+        const double * sums = &saltelli.sums[k * SALTELLI_SUMS(d)];
+        const double n = total[0] + sums[0];
+        const double delta = sums[1] - total[1];
+        total[2] += sums[2] + delta * delta * total[0] * sums[0] / n;
+        total[1] += delta * sums[0] / n;
+        total[0] = n;
+        for (size_t j = 3; j < SALTELLI_SUMS(d); ++j)
+        {
+            total[j] += sums[j];
+        }
+    }
+    const double points = (double) saltelli.size;
+    const double mean = total[1];
+    const double variance = total[2] / total[0];
+    XLL_PROFILE_LAP(XLL_STAGE_COMPUTE);
+
+    LPXLOPER12 xResult = new_multi((RW) d, 2);
+    if (!xResult)
+    {
+        return NULL;
+    }
+    LPXLOPER12 px = xResult->val.array.lparray;
+    for (size_t i = 0; i < d; ++i, px += 2)
+    {
+        const double first = (total[3 + i] - mean * total[3 + d + i]) / points;
+        const double effect = total[3 + 2 * d + i] / (2.0 * points);
+        px[0].xltype = xltypeNum;
+        px[0].val.num = variance > 0.0 ? first / variance : 0.0;
+        px[1].xltype = xltypeNum;
+        px[1].val.num = variance > 0.0 ? effect / variance : 0.0;
+    }
+    XLL_PROFILE_LAP(XLL_STAGE_RESULT);
+    return xResult;
+}
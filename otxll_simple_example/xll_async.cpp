@@ -0,0 +1,317 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+#include <framewrk.h>
+#include <deque>
+#include <vector>
+
+#include "xll_async.h"
+#include "xll_result_pool.h"
+#include "ot_functions.h"
+
+namespace {
+
+// A queued call
+struct AsyncCall
+{
+    // Copy of the xltypeBigData handle given by Excel
+    XLOPER12 handle;
+    XllAsyncTask * task;
+    // Value of AsyncQueue::generation_ when the call was queued
+    LONG generation;
+};
+
+// Run a task and delete it
+LPXLOPER12 runTask(XllAsyncTask * task)
+{
+    LPXLOPER12 result = NULL;
+    try
+    {
+        result = task->run();
+    }
+    catch(...)
+    {
+        result = NULL;
+    }
+    delete task;
+    return result;
+}
+
+class AsyncQueue
+{
+public:
+    AsyncQueue()
+        : stopping_(false)
+        , generation_(0)
+    {
+        InitializeCriticalSection(&lock_);
+        InitializeConditionVariable(&work_);
+    }
+
+    ~AsyncQueue()
+    {
+        stop();
+        DeleteCriticalSection(&lock_);
+    }
+
+    void start(int threads)
+    {
+        for (int i = 0; i < threads; ++i)
+        {
+            HANDLE thread = CreateThread(NULL, 0, &AsyncQueue::threadMain, this, 0, NULL);
+            if (!thread)
+                break;
+            threads_.push_back(thread);
+        }
+    }
+
+    void stop()
+    {
+        EnterCriticalSection(&lock_);
+        stopping_ = true;
+        drop();
+        WakeAllConditionVariable(&work_);
+        LeaveCriticalSection(&lock_);
+        for (size_t i = 0; i < threads_.size(); ++i)
+        {
+            WaitForSingleObject(threads_[i], INFINITE);
+            CloseHandle(threads_[i]);
+        }
+        threads_.clear();
+        stopping_ = false;
+    }
+
+    void submit(LPXLOPER12 handle, XllAsyncTask * task)
+    {
+        AsyncCall call;
+        call.handle = *handle;
+        call.task = task;
+
+        EnterCriticalSection(&lock_);
+        const bool queued = !threads_.empty() && calls_.size() < ASYNC_QUEUE_SIZE;
+        if (queued)
+        {
+            call.generation = generation_;
+            calls_.push_back(call);
+            WakeConditionVariable(&work_);
+        }
+        LeaveCriticalSection(&lock_);
+
+        // Excel goes on once the queue has room again
+        if (!queued)
+        {
+            async_return(handle, runTask(task));
+        }
+    }
+
+    int cancel()
+    {
+        EnterCriticalSection(&lock_);
+        const int dropped = drop();
+        LeaveCriticalSection(&lock_);
+        return dropped;
+    }
+
+private:
+    // Called with the lock held; results of running tasks are discarded
+    int drop()
+    {
+        const int dropped = (int) calls_.size();
+        for (size_t i = 0; i < calls_.size(); ++i)
+        {
+            delete calls_[i].task;
+        }
+        calls_.clear();
+        ++generation_;
+        return dropped;
+    }
+
+    static DWORD WINAPI threadMain(void * data)
+    {
+        AsyncQueue * queue = (AsyncQueue *) data;
+
+        EnterCriticalSection(&queue->lock_);
+        for (;;)
+        {
+            while (!queue->stopping_ && queue->calls_.empty())
+            {
+                SleepConditionVariableCS(&queue->work_, &queue->lock_, INFINITE);
+            }
+            if (queue->stopping_)
+                break;
+            const AsyncCall call = queue->calls_.front();
+            queue->calls_.pop_front();
+            LeaveCriticalSection(&queue->lock_);
+
+            LPXLOPER12 result = runTask(call.task);
+
+            EnterCriticalSection(&queue->lock_);
+            const bool canceled = call.generation != queue->generation_;
+            LeaveCriticalSection(&queue->lock_);
+            if (canceled)
+            {
+                // Excel abandoned the call, xlAsyncReturn would fail
+                if (result)
+                    free_result(result);
+            }
+            else
+            {
+                async_return((LPXLOPER12) &call.handle, result);
+            }
+            EnterCriticalSection(&queue->lock_);
+        }
+        LeaveCriticalSection(&queue->lock_);
+        return 0;
+    }
+
+    // Not copyable
+    AsyncQueue(const AsyncQueue &);
+    AsyncQueue & operator=(const AsyncQueue &);
+
+    CRITICAL_SECTION lock_;
+    // Signaled when a call is queued, or when threads must stop
+    CONDITION_VARIABLE work_;
+    std::deque<AsyncCall> calls_;
+    std::vector<HANDLE> threads_;
+    bool stopping_;
+    // Incremented when queued calls are dropped
+    LONG generation_;
+};
+
+AsyncQueue asyncQueue;
+
+} // empty namespace
+
+/*********************************************************************
+**  async_submit()
+**
+**  Purpose :
+**      queue the task of an asynchronous call, or run it at once if
+**      the queue is full.
+**
+**  Parameters:
+**
+**        handle : xltypeBigData handle passed by Excel, it is copied
+**        task   : XllAsyncTask allocated with new, deleted once it has
+**                 run or when it is dropped
+**********************************************************************/
+void
+async_submit(LPXLOPER12 handle, XllAsyncTask * task)
+{
+    asyncQueue.submit(handle, task);
+}
+
+/*********************************************************************
+**  async_return()
+**
+**  Purpose :
+**      give the result of an asynchronous call to Excel, which copies
+**      it, then release it.  Excel may already have abandoned the call,
+**      in which case xlAsyncReturn fails and the result is ignored.
+**
+**  Parameters:
+**
+**        handle : xltypeBigData handle of the call
+**        result : LPXLOPER12 allocated by new_result or new_result_multi,
+**                 or NULL which is returned as #NUM!
+**********************************************************************/
+void
+async_return(LPXLOPER12 handle, LPXLOPER12 result)
+{
+    if (!result)
+    {
+        XLOPER12 error;
+        error.xltype = xltypeErr;
+        error.val.err = xlerrNum;
+        Excel12f(xlAsyncReturn, 0, 2, handle, &error);
+        return;
+    }
+    // xlbitDLLFree only applies to values returned by functions
+    result->xltype &= ~xlbitDLLFree;
+    Excel12f(xlAsyncReturn, 0, 2, handle, result);
+    result->xltype |= xlbitDLLFree;
+    free_result(result);
+}
+
+/*********************************************************************
+**  async_cancel()
+**
+**  Purpose :
+**      drop the queued tasks, and discard the results of the running
+**      ones, see OT_ASYNC_CANCEL.
+**
+**  Returns :
+**        the number of dropped tasks
+**********************************************************************/
+int
+async_cancel()
+{
+    return asyncQueue.cancel();
+}
+
+/*********************************************************************
+**  initAsyncQueue()
+**
+**  Purpose :
+**      start the threads of the queue.
+**********************************************************************/
+void
+initAsyncQueue()
+{
+    asyncQueue.stop();
+    asyncQueue.start(ASYNC_THREADS);
+}
+
+/*********************************************************************
+**  releaseAsyncQueue()
+**
+**  Purpose :
+**      drop the queued tasks, and wait for the running ones.  Tasks
+**      submitted later are run at once by async_submit.
+**********************************************************************/
+void
+releaseAsyncQueue()
+{
+    asyncQueue.stop();
+}
+
+/***********************************************************************************
+ OT_ASYNC_CANCEL()
+
+ Purpose:
+
+      Command registered for xlEventCalculationCanceled by xlAutoOpen.  Excel
+      calls it on its main thread when the user interrupts a recalculation,
+      it has then abandoned all pending asynchronous calls.
+
+ Returns:
+
+      int             1
+*************************************************************************************/
+
+int WINAPI
+OT_ASYNC_CANCEL()
+{
+    async_cancel();
+    return 1;
+}
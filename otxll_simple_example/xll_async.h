@@ -0,0 +1,54 @@
+#ifndef __XLL_ASYNC_H
+#define __XLL_ASYNC_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+
+/*
+ * Asynchronous worksheet functions, available since Excel 2010.
+ *
+ * Such a function is registered with a void return type ('>') and a
+ * trailing 'X' argument, an xltypeBigData handle which identifies the
+ * call.  It coerces its arguments on the calculation thread, as callbacks
+ * other than xlAsyncReturn are not allowed elsewhere, then gives the
+ * computation to async_submit and returns at once.  Excel goes on with the
+ * recalculation, and cells display #GETTING_DATA until the result is passed
+ * to xlAsyncReturn by one of the ASYNC_THREADS threads of the queue.
+ *
+ * The queue holds at most ASYNC_QUEUE_SIZE tasks; when it is full, or when
+ * its threads are not started, tasks are run at once on the calculation
+ * thread.  When the user interrupts a recalculation, Excel abandons all
+ * pending calls and fires xlEventCalculationCanceled, which is handled by
+ * OT_ASYNC_CANCEL: queued tasks are dropped, and results of tasks which
+ * are already running are discarded.
+ */
+
+#define ASYNC_THREADS 2
+#define ASYNC_QUEUE_SIZE 256
+
+/* Computation of an asynchronous call, deleted once it has run */
+class XllAsyncTask
+{
+public:
+    virtual ~XllAsyncTask() {}
+    /* Compute the result on a thread of the queue, as new_result would;
+       the result must be an error rather than an exception */
+    virtual LPXLOPER12 run() = 0;
+};
+
+/* Queue a task, which is owned by the queue from now on */
+void async_submit(LPXLOPER12 handle, XllAsyncTask * task);
+/* Give the result of a call to Excel and release it, NULL is #NUM! */
+void async_return(LPXLOPER12 handle, LPXLOPER12 result);
+/* Drop the queued tasks, returns their number */
+int async_cancel();
+
+/* Start the threads, see xlAutoOpen */
+void initAsyncQueue();
+/* Drop the queued tasks and stop the threads, see xlAutoClose */
+void releaseAsyncQueue();
+
+#endif // __XLL_ASYNC_H
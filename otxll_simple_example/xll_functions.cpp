@@ -24,7 +24,15 @@
 #include <framewrk.h>
 
 #include <OT.hxx>
-
+#include "xll_helper_functions.h"
+#include "xll_result_pool.h"
+#include "ot_distribution_cache.h"
+#include "xll_thread_pool.h"
+#include "xll_async.h"
+#include "ot_object_store.h"
+
+// C linkage, see ot_functions.h
+extern "C" {
 int WINAPI xlAutoOpen(void);
 int WINAPI xlAutoClose(void);
 int WINAPI xlAutoAdd(void);
@@ -32,20 +40,28 @@ int WINAPI xlAutoRemove(void);
 void WINAPI xlAutoFree12(LPXLOPER12 p);
 LPXLOPER12 WINAPI xlAutoRegister12(LPXLOPER12 pxName);
 LPXLOPER12 WINAPI xlAddInManagerInfo12(LPXLOPER12 xAction);
+}
 
-#define rgWorksheetFuncsRows 4
-#define rgWorksheetFuncsCols 12
+#define rgWorksheetFuncsRows 26
+#define rgWorksheetFuncsCols 13
 
 // Used To register XLL functions
+//   All functions but OT_MAKE_SAMPLE are thread-safe, which is expressed by
+//   the dollar sign at the end of their signature: Excel may call them
+//   concurrently from all its recalculation threads.  Such functions can
+//   neither take U arguments nor be macro sheet equivalents (#), they take
+//   Q arguments instead, which are values: Excel resolves references before
+//   the call.
 LPWSTR rgWorksheetFuncs[rgWorksheetFuncsRows][rgWorksheetFuncsCols] =
 {
     // LPXLOPER12 OT_NORMAL_PDF(LPXLOPER12 mu, LPXLOPER12 sigma, LPXLOPER12 point)
     // Arguments: mu, sigma and point are either numerical values or single cells
     // Returns an xltypeNum cell containing value OT::Normal(mu, sigma).computePDF(point)
     { L"OT_NORMAL_PDF",      // Name of the function in DLL
-      L"UUUU",               // Data type of the return value and arguments
-        // Most common values are B (double, passed by value) and
-        // U (XLOPER12 values, arrays, and range references
+      L"QQQQ$",              // Data type of the return value and arguments
+        // Most common values are B (double, passed by value),
+        // U (XLOPER12 values, arrays, and range references) and
+        // Q (XLOPER12 values and arrays)
       L"OT_NORMAL_PDF",      // The function name as it will appear in the Function Wizard
       L"Mu, Sigma, Point",   // Description of arguments
       L"1",                  // Macro type, use "1" by default or "2" for hidden commands
@@ -58,12 +74,12 @@ LPWSTR rgWorksheetFuncs[rgWorksheetFuncsRows][rgWorksheetFuncsCols] =
       L"Point where PDF is evaluated"                     // Description of third argument
     },
     // LPXLOPER12 OT_NORMAL_PDF_ARRAY(LPXLOPER12 mu, LPXLOPER12 sigma, LPXLOPER12 points)
-    // Arguments: mu and sigma are either numerical values or single cells
-    //            points is a range selection of one column
-    // Returns an xltypeMulti cell containing one column and the same number of rows as points
-    // Values are OT::Normal(mu, sigma).computePDF(p) for each p in points
+    // Arguments: mu, sigma and points are each a numerical value, a row, a column or a range
+    // Returns an xltypeMulti cell of the largest of their shapes, a dimension of size 1
+    //   being repeated, e.g. one row per mu and one column per point
+    // Values are OT::Normal(mu, sigma).computePDF(p) for each cell
     { L"OT_NORMAL_PDF_ARRAY",
-      L"UUUU",
+      L"QQQQ$",
       L"OT_NORMAL_PDF_ARRAY",
       L"Mu, Sigma, Array",
       L"1",
@@ -71,19 +87,20 @@ LPWSTR rgWorksheetFuncs[rgWorksheetFuncsRows][rgWorksheetFuncsCols] =
       L"",
       L"",
       L"Compute the probability density function on a cell selection",
-      L"Mean of the Gaussian distribution",
-      L"Standard deviation of the Gaussian distribution",
+      L"Means of the Gaussian distributions",
+      L"Standard deviations of the Gaussian distributions",
       L"Cells containing points where PDF is evaluated"
     },
     // LPXLOPER12 OT_NORMAL_PDF_DRAW(LPXLOPER12 mu, LPXLOPER12 sigma)
     // Arguments: mu and sigma are either numerical values or single cells
     // Returns an xltypeMulti cell containing two columns.  The number of rows
-    //   is computed from active selection, this is why this function needs extra
-    //   permissions, which are expressed by the hash sign in its signature.
-    //   We ask OpenTURNS to return the given number of rows by
+    //   is computed from active selection, which is read from the reference
+    //   returned by xlfCaller; this does not need macro sheet permissions.
+    //   Values are those of
     //     OT::Normal(mu, sigma).drawPDF(nrOfRows).getDrawable(0).getData()
+    //   but they are computed without the graph, and cached, see getNormalGrid
     { L"OT_NORMAL_PDF_DRAW",
-      L"UUU#",
+      L"QQQ$",
       L"OT_NORMAL_PDF_DRAW",
       L"Mu, Sigma",
       L"1",
@@ -101,15 +118,16 @@ LPWSTR rgWorksheetFuncs[rgWorksheetFuncsRows][rgWorksheetFuncsCols] =
     //   if the current selection has nrOfRows rows.  This function is thus only meant
     //   to be called from VB, this is why its macro type is set to "2", it is hidden
     //   from Function Wizard.
-    //   We ask OpenTURNS to return the given number of rows by
+    //   Values are those of
     //     OT::Normal(mu, sigma).drawPDF(nrOfRows).getDrawable(0).getData()
+    //   but they are computed without the graph, and cached, see getNormalGrid
     //   Example of VB macro:
     //     Sub drawNormal()
     //         Range("K100:L199").Select
     //         Selection.FormulaArray = "=OT_NORMAL_PDF_DRAW_CMD(100,0,1)"
     //     End Sub
     { L"OT_NORMAL_PDF_DRAW_CMD",
-      L"UJUU",
+      L"QJQQ$",
       L"OT_NORMAL_PDF_DRAW_CMD",
       L"NrPoints, Mu, Sigma",
       L"2",
@@ -120,6 +138,374 @@ LPWSTR rgWorksheetFuncs[rgWorksheetFuncsRows][rgWorksheetFuncsCols] =
       L"Number of cells",
       L"Mean of the Gaussian distribution",
       L"Standard deviation of the Gaussian distribution"
+    },
+    // FP12 * OT_NORMAL_PDF_ARRAY_FP(double mu, double sigma, FP12 * points)
+    // Same as OT_NORMAL_PDF_ARRAY, but with native types: K% is an FP12 array,
+    //   Excel passes ranges as contiguous doubles and expects one back.
+    //   The result has the same shape as points.  Ranges containing non-numeric
+    //   cells are rejected by Excel with #VALUE! before the call.
+    { L"OT_NORMAL_PDF_ARRAY_FP",
+      L"K%BBK%$",
+      L"OT_NORMAL_PDF_ARRAY_FP",
+      L"Mu, Sigma, Array",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Compute the probability density function on a range of numbers",
+      L"Mean of the Gaussian distribution",
+      L"Standard deviation of the Gaussian distribution",
+      L"Cells containing points where PDF is evaluated"
+    },
+    // FP12 * OT_NORMAL_PDF_DRAW_FP(int nrOfRows, double mu, double sigma)
+    // Same as OT_NORMAL_PDF_DRAW_CMD, with native types
+    { L"OT_NORMAL_PDF_DRAW_FP",
+      L"K%JBB$",
+      L"OT_NORMAL_PDF_DRAW_FP",
+      L"NrPoints, Mu, Sigma",
+      L"2",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Compute the probability density function",
+      L"Number of cells",
+      L"Mean of the Gaussian distribution",
+      L"Standard deviation of the Gaussian distribution"
+    },
+    // LPXLOPER12 OT_CACHE_CLEAR()
+    // Empties the caches of distributions and grids, see ot_distribution_cache.h
+    // Returns an xltypeNum cell containing the number of removed entries
+    { L"OT_CACHE_CLEAR",
+      L"Q$",
+      L"OT_CACHE_CLEAR",
+      L"",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Empty the cache of distributions"
+    },
+    // LPXLOPER12 OT_CACHE_STATS()
+    // Returns an xltypeMulti cell of 8 rows and 2 columns, labels and values of
+    //   the hits, misses, number of entries and capacity of the distribution cache.
+    //   The last 4 rows are for the cache of grids of OT_NORMAL_PDF_DRAW functions.
+    //   It is volatile (!) so that values are refreshed on each recalculation.
+    { L"OT_CACHE_STATS",
+      L"Q!$",
+      L"OT_CACHE_STATS",
+      L"",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Report the usage of the cache of distributions"
+    },
+    // void OT_NORMAL_PDF_ARRAY_ASYNC(LPXLOPER12 mu, LPXLOPER12 sigma, LPXLOPER12 points, LPXLOPER12 handle)
+    // Same as OT_NORMAL_PDF_ARRAY, but asynchronous: the return type is void (>)
+    //   and the last argument (X) is a handle which is not seen by users, the
+    //   result is given later to xlAsyncReturn, see xll_async.h
+    { L"OT_NORMAL_PDF_ARRAY_ASYNC",
+      L">QQQX$",
+      L"OT_NORMAL_PDF_ARRAY_ASYNC",
+      L"Mu, Sigma, Array",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Compute the probability density function on a cell selection, in the background",
+      L"Means of the Gaussian distributions",
+      L"Standard deviations of the Gaussian distributions",
+      L"Cells containing points where PDF is evaluated"
+    },
+    // void OT_NORMAL_PDF_DRAW_ASYNC(LPXLOPER12 mu, LPXLOPER12 sigma, LPXLOPER12 handle)
+    // Same as OT_NORMAL_PDF_DRAW, but asynchronous
+    { L"OT_NORMAL_PDF_DRAW_ASYNC",
+      L">QQX$",
+      L"OT_NORMAL_PDF_DRAW_ASYNC",
+      L"Mu, Sigma",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Fill-in current cell selection with the probability density function, in the background",
+      L"Mean of the Gaussian distribution",
+      L"Standard deviation of the Gaussian distribution"
+    },
+    // int OT_ASYNC_CANCEL()
+    // Command called by Excel when a recalculation is interrupted, it is
+    //   registered for xlEventCalculationCanceled by xlAutoOpen
+    { L"OT_ASYNC_CANCEL",
+      L"J",
+      L"OT_ASYNC_CANCEL",
+      L"",
+      L"2",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Cancel the asynchronous computations"
+    },
+    // int OT_OBJECT_SWEEP()
+    // Command called by Excel when a recalculation is over, it is
+    //   registered for xlEventCalculationEnded by xlAutoOpen
+    { L"OT_OBJECT_SWEEP",
+      L"J",
+      L"OT_OBJECT_SWEEP",
+      L"",
+      L"2",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Drop the objects of cells which no longer hold their handle"
+    },
+    // LPXLOPER12 OT_DIST_PDF(LPXLOPER12 name, LPXLOPER12 parameters, LPXLOPER12 points, LPXLOPER12 missing)
+    // Arguments: name of a distribution of ot_distribution_cache.h, like "Normal"
+    //            parameters is a range of numbers, e.g. mu and sigma
+    //            points is a range of any shape
+    //            missing is "error", "nan" or "skip", see XllCellPolicy
+    // Returns an xltypeMulti cell of the same shape as points, values are
+    //   computePDF of the distribution, taken from the cache of distributions,
+    //   and #N/A for cells which are not numbers unless missing is "error".
+    //   OT_DIST_LOGPDF, OT_DIST_CDF and OT_DIST_QUANTILE are alike.
+    { L"OT_DIST_PDF",
+      L"QQQQQ$",
+      L"OT_DIST_PDF",
+      L"Name, Parameters, Points, Missing",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Compute the probability density function of a distribution",
+      L"Name of the distribution, e.g. Normal, Uniform, Gamma",
+      L"Cells containing the parameters of the distribution",
+      L"Cells containing points where PDF is evaluated",
+      L"What to do with cells which are not numbers: error (default), or nan or skip for #N/A"
+    },
+    { L"OT_DIST_LOGPDF",
+      L"QQQQQ$",
+      L"OT_DIST_LOGPDF",
+      L"Name, Parameters, Points, Missing",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Compute the logarithm of the probability density function of a distribution",
+      L"Name of the distribution, e.g. Normal, Uniform, Gamma",
+      L"Cells containing the parameters of the distribution",
+      L"Cells containing points where the log-PDF is evaluated",
+      L"What to do with cells which are not numbers: error (default), or nan or skip for #N/A"
+    },
+    { L"OT_DIST_CDF",
+      L"QQQQQ$",
+      L"OT_DIST_CDF",
+      L"Name, Parameters, Points, Missing",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Compute the cumulative distribution function of a distribution",
+      L"Name of the distribution, e.g. Normal, Uniform, Gamma",
+      L"Cells containing the parameters of the distribution",
+      L"Cells containing points where CDF is evaluated",
+      L"What to do with cells which are not numbers: error (default), or nan or skip for #N/A"
+    },
+    { L"OT_DIST_QUANTILE",
+      L"QQQQQ$",
+      L"OT_DIST_QUANTILE",
+      L"Name, Parameters, Probabilities, Missing",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Compute quantiles of a distribution",
+      L"Name of the distribution, e.g. Normal, Uniform, Gamma",
+      L"Cells containing the parameters of the distribution",
+      L"Cells containing probabilities, between 0 and 1",
+      L"What to do with cells which are not numbers: error (default), or nan or skip for #N/A"
+    },
+    // LPXLOPER12 OT_DIST_SAMPLE(LPXLOPER12 name, LPXLOPER12 parameters, LPXLOPER12 size, LPXLOPER12 seed)
+    // Arguments: name and parameters as above, the size of the sample or nothing
+    //   to fill the selection, and a seed which makes the sample reproducible
+    // Returns an xltypeMulti, not volatile: a sample changes with its seed only
+    { L"OT_DIST_SAMPLE",
+      L"QQQQQ$",
+      L"OT_DIST_SAMPLE",
+      L"Name, Parameters, Size, Seed",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Draw a sample of a distribution",
+      L"Name of the distribution, e.g. Normal, Uniform, Gamma",
+      L"Cells containing the parameters of the distribution",
+      L"Number of values, or nothing to fill the selected cells",
+      L"Non-negative integer which identifies the sample, 0 by default"
+    },
+    // LPXLOPER12 OT_MAKE_DISTRIBUTION(LPXLOPER12 name, LPXLOPER12 parameters)
+    // LPXLOPER12 OT_MAKE_SAMPLE(LPXLOPER12 values, LPXLOPER12 missing)
+    // Arguments: name and parameters as above, values a range with one point per row,
+    //   missing as above, "skip" leaving out the rows of cells which are not numbers
+    // Returns an xltypeStr handle, like "Normal#12" or "Sample#13", which the
+    //   OT_DIST_* functions accept instead of a name or points, see ot_object_store.h
+    //   OT_MAKE_SAMPLE takes a U argument, a reference which is read by blocks
+    //   (see read_range) rather than coerced at once by Excel, and is thus not
+    //   thread-safe; it is only called when its range changes.
+    { L"OT_MAKE_DISTRIBUTION",
+      L"QQQ$",
+      L"OT_MAKE_DISTRIBUTION",
+      L"Name, Parameters",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Build a distribution once and return its handle",
+      L"Name of the distribution, e.g. Normal, Uniform, Gamma",
+      L"Cells containing the parameters of the distribution"
+    },
+    { L"OT_MAKE_SAMPLE",
+      L"QUQ",
+      L"OT_MAKE_SAMPLE",
+      L"Values, Missing",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Store a sample once and return its handle",
+      L"Cells containing the sample, one point per row",
+      L"What to do with cells which are not numbers: error (default), nan, or skip their rows"
+    },
+    // LPXLOPER12 OT_KERNEL_SMOOTHING_PDF(LPXLOPER12 sample, LPXLOPER12 points, LPXLOPER12 bandwidth)
+    // Arguments: sample and points are a single column each, or a handle of OT_MAKE_SAMPLE
+    //            bandwidth of the normal kernel, the rule of Silverman if it is missing
+    // Returns an xltypeMulti column, the kernel density estimate at points,
+    //   computed on a grid by FFT for large samples, see ot_kernel_smoothing.h
+    { L"OT_KERNEL_SMOOTHING_PDF",
+      L"QQQQ$",
+      L"OT_KERNEL_SMOOTHING_PDF",
+      L"Sample, Points, Bandwidth",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Estimate the probability density function of a sample by kernel smoothing",
+      L"Cells containing the sample, or its handle",
+      L"Cells containing points where the density is estimated",
+      L"Bandwidth of the normal kernel, the rule of Silverman by default"
+    },
+    // LPXLOPER12 OT_FIT_BEST(LPXLOPER12 sample, LPXLOPER12 families, LPXLOPER12 criterion)
+    // Arguments: sample as above, families a range of names as for OT_DIST_PDF, all of
+    //            them if it is missing, criterion "BIC" (default) or "Kolmogorov"
+    // Returns an xltypeMulti of one row per fitted family, the best one first: its
+    //   name, the value of the criterion and its parameters; families are fitted
+    //   in parallel by the thread pool, see parallel_tasks
+    { L"OT_FIT_BEST",
+      L"QQQQ$",
+      L"OT_FIT_BEST",
+      L"Sample, Families, Criterion",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Fit distributions to a sample and rank them",
+      L"Cells containing the sample, or its handle",
+      L"Names of the distributions to fit, all of them by default",
+      L"BIC (default) or Kolmogorov"
+    },
+    // LPXLOPER12 OT_DOE(LPXLOPER12 kind, LPXLOPER12 marginals, LPXLOPER12 size, LPXLOPER12 seed)
+    // Arguments: kind "LHS", "Sobol" or "Halton", marginals a number of dimensions uniform
+    //            on [0, 1], or one row per dimension with a handle or a name and its
+    //            parameters as above, size and seed as for OT_DIST_SAMPLE
+    // Returns an xltypeMulti of one row per point and one column per dimension, filled
+    //   in parallel; the sequences are shifted at random unless the seed is 0
+    { L"OT_DOE",
+      L"QQQQQ$",
+      L"OT_DOE",
+      L"Kind, Marginals, Size, Seed",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Build a design of experiments",
+      L"LHS, Sobol or Halton",
+      L"Number of dimensions, or one row per dimension with a distribution and its parameters",
+      L"Number of points, or nothing to fill the selected cells",
+      L"Non-negative integer which identifies the design, 0 by default"
+    },
+    // LPXLOPER12 OT_PCE_BUILD(LPXLOPER12 x, LPXLOPER12 y, LPXLOPER12 degree, LPXLOPER12 marginals)
+    // Arguments: x one row per point and one column per input, y one value per point,
+    //            either of them may be the handle of an OT_MAKE_SAMPLE cell, marginals
+    //            of the inputs as for OT_DOE
+    // Returns the handle of a polynomial chaos expansion of the given total degree,
+    //   fitted by OT::FunctionalChaosAlgorithm, and only fitted again when the content
+    //   of x, y, degree or marginals changes
+    { L"OT_PCE_BUILD",
+      L"QQQQQ$",
+      L"OT_PCE_BUILD",
+      L"X, Y, Degree, Marginals",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Fit a polynomial chaos expansion",
+      L"Cells containing the points, one per row, or their handle",
+      L"Cells containing the value at each point, or their handle",
+      L"Total degree of the polynomials",
+      L"One row per input with a distribution and its parameters"
+    },
+    // LPXLOPER12 OT_PCE_EVAL(LPXLOPER12 handle, LPXLOPER12 points)
+    // Arguments: handle of an OT_PCE_BUILD cell, points as x above
+    // Returns an xltypeMulti column with the value of the expansion at each point,
+    //   evaluated in parallel over its packed coefficients
+    { L"OT_PCE_EVAL",
+      L"QQQ$",
+      L"OT_PCE_EVAL",
+      L"Handle, Points",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Evaluate a polynomial chaos expansion",
+      L"Handle of an OT_PCE_BUILD cell",
+      L"Cells containing the points, one per row, or their handle",
+      L"",
+      L""
+    },
+    // LPXLOPER12 OT_PCE_SOBOL(LPXLOPER12 handle)
+    // Arguments: handle of an OT_PCE_BUILD cell
+    // Returns an xltypeMulti of one row per input, with its first order and total
+    //   Sobol indices, computed by OpenTURNS when the expansion was built
+    { L"OT_PCE_SOBOL",
+      L"QQ$",
+      L"OT_PCE_SOBOL",
+      L"Handle",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Sobol indices of the inputs of a polynomial chaos expansion",
+      L"Handle of an OT_PCE_BUILD cell",
+      L"",
+      L"",
+      L""
+    },
+    // LPXLOPER12 OT_SOBOL_INDICES(LPXLOPER12 marginals, LPXLOPER12 model, LPXLOPER12 size, LPXLOPER12 seed)
+    // Arguments: marginals as for OT_DOE, model the handle of an OT_PCE_BUILD cell, or the
+    //            values of the model on the designs A, B and C_i of the Saltelli scheme,
+    //            size and seed of the designs drawn for an expansion
+    // Returns an xltypeMulti of one row per input, with its first order and total Sobol
+    //   indices; designs are drawn, evaluated and summed by blocks, in parallel
+    { L"OT_SOBOL_INDICES",
+      L"QQQQQ$",
+      L"OT_SOBOL_INDICES",
+      L"Marginals, Model, Size, Seed",
+      L"1",
+      L"Openturns Add-In",
+      L"",
+      L"",
+      L"Estimate the Sobol indices of the inputs of a model",
+      L"One row per input with a distribution and its parameters",
+      L"Handle of an OT_PCE_BUILD cell, or the values of the model on A, B and each C_i",
+      L"Number of points of the designs of an expansion",
+      L"Non-negative integer which identifies the designs, 0 by default"
     }
 };
 
@@ -181,6 +567,30 @@ int WINAPI xlAutoOpen(void)
 
     Excel12f(xlGetName, &xDLL, 0);
 
+    /* Record the main thread, and allocate thread local storage */
+    initHelpers();
+
+    /*
+    ** OpenTURNS creates some singletons (ResourceMap, Log, ...) when they
+    ** are first used.  Use a distribution now, on the main thread, so that
+    ** they are not created concurrently by the recalculation threads.
+    */
+    try
+    {
+        OT::Normal distribution(0.0, 1.0);
+        distribution.computePDF(0.0);
+        distribution.drawPDF(2);
+    }
+    catch(std::exception &)
+    {
+    }
+    /* Bounds of the grids of OT_NORMAL_PDF_DRAW functions */
+    initDistributionCache();
+    /* Threads evaluating large ranges */
+    initThreadPool();
+    /* Threads of asynchronous functions */
+    initAsyncQueue();
+
     for (i=0;i<rgWorksheetFuncsRows;i++)
     {
         Excel12f(xlfRegister, 0,  1 + rgWorksheetFuncsCols,
@@ -196,10 +606,16 @@ int WINAPI xlAutoOpen(void)
             (LPXLOPER12)TempStr12(rgWorksheetFuncs[i][8]),
             (LPXLOPER12)TempStr12(rgWorksheetFuncs[i][9]),
             (LPXLOPER12)TempStr12(rgWorksheetFuncs[i][10]),
-            (LPXLOPER12)TempStr12(rgWorksheetFuncs[i][11])
+            (LPXLOPER12)TempStr12(rgWorksheetFuncs[i][11]),
+            (LPXLOPER12)TempStr12(rgWorksheetFuncs[i][12])
             );
     }
 
+    /* Drop asynchronous computations when a recalculation is interrupted */
+    Excel12f(xlEventRegister, 0, 2, TempStr12(L"OT_ASYNC_CANCEL"), TempInt12(xlEventCalculationCanceled));
+    /* Drop the objects of cells which were cleared or overwritten */
+    Excel12f(xlEventRegister, 0, 2, TempStr12(L"OT_OBJECT_SWEEP"), TempInt12(xlEventCalculationEnded));
+
     /* Free the XLL filename */
     Excel12f(xlFree, 0, 1, (LPXLOPER12)&xDLL);
     return 1;
@@ -232,20 +648,39 @@ int WINAPI xlAutoOpen(void)
 **                          of registering the function,
 **                          or xltypeErr containing #VALUE!
 **                          if the function could not be
-**                          registered.
+**                          registered.  It is released by
+**                          xlAutoFree12.
 ***********************************************************************************/
 LPXLOPER12 WINAPI xlAutoRegister12(LPXLOPER12 pxName)
 {
-    static XLOPER12 xDLL, xRegId;
-    int i;
-    xRegId.xltype = xltypeErr;
-    xRegId.val.err = xlerrValue;
+    XLOPER12 xDLL, xResult;
+    XCHAR szName[256];
+    int i, cch;
+    LPXLOPER12 xRegId = new_result();
+    if (!xRegId)
+    {
+        return NULL;
+    }
+    xRegId->xltype = xltypeErr | xlbitDLLFree;
+    xRegId->val.err = xlerrValue;
+
+    if (pxName->xltype != xltypeStr)
+    {
+        return xRegId;
+    }
+
+    // pxName is a length-prefixed string
+    cch = pxName->val.str[0] < 255 ? pxName->val.str[0] : 255;
+    wmemcpy_s(szName, 256, pxName->val.str + 1, cch);
+    szName[cch] = 0;
 
     for (i = 0; i < rgWorksheetFuncsRows; i++)
     {
-        if (_wcsicmp(rgWorksheetFuncs[i][0], pxName->val.str)==0)
+        if (_wcsicmp(rgWorksheetFuncs[i][0], szName)==0)
         {
-            Excel12f(xlfRegister, 0, 1 + rgWorksheetFuncsCols,
+            xResult.xltype = xltypeNil;
+            Excel12f(xlGetName, &xDLL, 0);
+            Excel12f(xlfRegister, &xResult, 1 + rgWorksheetFuncsCols,
                     (LPXLOPER12) &xDLL,
                     (LPXLOPER12) TempStr12(rgWorksheetFuncs[i][0]),
                     (LPXLOPER12) TempStr12(rgWorksheetFuncs[i][1]),
@@ -258,16 +693,23 @@ LPXLOPER12 WINAPI xlAutoRegister12(LPXLOPER12 pxName)
                     (LPXLOPER12) TempStr12(rgWorksheetFuncs[i][8]),
                     (LPXLOPER12) TempStr12(rgWorksheetFuncs[i][9]),
                     (LPXLOPER12) TempStr12(rgWorksheetFuncs[i][10]),
-                    (LPXLOPER12) TempStr12(rgWorksheetFuncs[i][11])
+                    (LPXLOPER12) TempStr12(rgWorksheetFuncs[i][11]),
+                    (LPXLOPER12) TempStr12(rgWorksheetFuncs[i][12])
                     );
-
-            // Free the oper returned by Excel.
+            if (xResult.xltype == xltypeNum)
+            {
+                xRegId->xltype = xltypeNum | xlbitDLLFree;
+                xRegId->val.num = xResult.val.num;
+            }
+
+            // Free the opers returned by Excel.
+            Excel12f(xlFree, 0, 1, (LPXLOPER12) &xResult);
             Excel12f(xlFree, 0, 1, (LPXLOPER12) &xDLL);
-            return(LPXLOPER12) &xRegId;
+            return xRegId;
         }
     }
 
-    return(LPXLOPER12) &xRegId;
+    return xRegId;
 }
 
 
@@ -311,6 +753,13 @@ int WINAPI xlAutoClose(void)
 
     for (i = 0; i < rgWorksheetFuncsRows; i++)
         Excel12f(xlfSetName, 0, 1, TempStr12(rgWorksheetFuncs[i][2]));
+
+    /* Release threads, thread local storage, stored objects and cached results */
+    releaseAsyncQueue();
+    releaseThreadPool();
+    clearObjectStore();
+    releaseHelpers();
+    trim_result_pool();
     return 1;
 }
 
@@ -378,35 +827,42 @@ int WINAPI xlAutoRemove(void)
 **
 ** Returns:
 **
-**      LPXLOPER12          The long name or #VALUE!.
+**      LPXLOPER12          The long name or #VALUE!, released
+**                          by xlAutoFree12.
 ******************************************************************************/
 LPXLOPER12 WINAPI xlAddInManagerInfo12(LPXLOPER12 xAction)
 {
-    static XLOPER12 xInfo, xIntAction;
+    // Note that the string is length-prefixed in octal.
+    static const XCHAR szLongName[] = L"\030OpenTurns Standalone DLL";
+    XLOPER12 xIntAction;
+    LPXLOPER12 xInfo = new_result();
 
 #ifdef _DEBUG
     debugPrintf("xlAutoAddInManagerInfo12\n");
 #endif
 
-    // This code coerces the passed-in value to an integer.
-    Excel12f(xlCoerce, &xIntAction, 2, xAction, TempInt12(xltypeInt));
+    if (!xInfo)
+    {
+        return NULL;
+    }
 
-    if (xIntAction.val.w == 1)
+    // This code coerces the passed-in value to an integer.
+    if (xlretSuccess == Excel12f(xlCoerce, &xIntAction, 2, xAction, TempInt12(xltypeInt))
+        && xIntAction.val.w == 1)
     {
-        // Note that the string is length-prefixed in octal.
-        xInfo.xltype = xltypeStr;
-        xInfo.val.str = L"\030OpenTurns Standalone DLL";
+        // Returned values are allocated, a static XLOPER12 would be
+        // shared by all threads
+        xInfo->xltype = xltypeStr | xlbitDLLFree;
+        xInfo->val.str = new XCHAR[szLongName[0] + 1];
+        wmemcpy_s(xInfo->val.str, szLongName[0] + 1, szLongName, szLongName[0] + 1);
     }
     else
     {
-        xInfo.xltype = xltypeErr;
-        xInfo.val.err = xlerrValue;
+        xInfo->xltype = xltypeErr | xlbitDLLFree;
+        xInfo->val.err = xlerrValue;
     }
 
-    // Word of caution: returning static XLOPERs/XLOPER12s is
-    // not thread-safe. For UDFs declared as thread-safe, use
-    // alternate memory allocation mechanisms.
-    return(LPXLOPER12) &xInfo;
+    return xInfo;
 }
 
 
@@ -421,27 +877,11 @@ LPXLOPER12 WINAPI xlAddInManagerInfo12(LPXLOPER12 xAction)
 ** dynamically allocated arrays, strings, and external references
 ** to the worksheet without memory leaks
 **
+** All such XLOPER12 are allocated by new_result or new_result_multi,
+** see xll_result_pool.h: their blocks are kept for the next results.
+**
 *************************************************************************/
 void WINAPI xlAutoFree12(LPXLOPER12 p)
 {
-    if (p->xltype == (xltypeMulti | xlbitDLLFree))
-    {
-        int size = p->val.array.rows * p->val.array.columns;
-        LPXLOPER12 parray = p->val.array.lparray;
-
-        for(; size-- > 0; parray++) // check elements for strings
-            if(parray->xltype == xltypeStr)
-                delete [] parray->val.str;
-        delete [] p->val.array.lparray;
-    }
-    else if(p->xltype  == ( xltypeStr | xlbitDLLFree))
-    {
-        delete [] p->val.str;
-    }
-    else if(p->xltype == ( xltypeRef | xlbitDLLFree))
-    {
-        delete [] p->val.mref.lpmref;
-    }
-    // Assume p was itself dynamically allocated using new.
-    delete p;
+    free_result(p);
 }
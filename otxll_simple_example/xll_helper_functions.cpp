@@ -22,16 +22,32 @@
 #include <windows.h>
 #include <xlcall.h>
 #include <framewrk.h>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <vector>
 
 #include "xll_helper_functions.h"
+#include "xll_result_pool.h"
+
+namespace {
+
+// Thread which called xlAutoOpen, see displayError
+DWORD mainThreadId = 0;
+// Fiber local storage of FP12 results, see new_fp12
+DWORD fpIndex = FLS_OUT_OF_INDEXES;
+
+} // empty namespace
 
 /****************************************************************
 ** xloper_to_multi()
 **
 ** Purpose:
 **
-**      This function takes 2 argument, coerces xloper to 2D array
+**      This function takes 2 argument, coerces xloper to 2D array.
+**      Single values, which is how Excel passes a single cell to
+**      Q arguments, are coerced to a 1x1 array.
 **
 ** Parameters:
 **
@@ -39,7 +55,8 @@
 **
 ** Returns:
 **
-**      LPXLOPER12      xloper of xltypeMulti Type.
+**      int: -1 if ret_val contains an xltypeMulti which must be
+**      released by xlFree, error code otherwise.
 *****************************************************************/
 int
 xloper_to_multi(LPXLOPER12 p_op, LPXLOPER12 ret_val)
@@ -48,9 +65,8 @@ xloper_to_multi(LPXLOPER12 p_op, LPXLOPER12 ret_val)
     switch (p_op->xltype)
     {
     case xltypeNum:
-        break;
     case xltypeStr:
-        break;
+    case xltypeBool:
     case xltypeRef:
     case xltypeSRef:
     case xltypeMulti:
@@ -60,13 +76,9 @@ xloper_to_multi(LPXLOPER12 p_op, LPXLOPER12 ret_val)
                                         p_op,
                                         TempInt12(xltypeMulti)))
         {
-            return 0;
+            return xlerrValue;
         }
         break;
-    case xltypeMissing:
-        break;
-    case xltypeNil:
-        break;
     case xltypeErr:
         error = p_op->val.err;
         break;
@@ -79,6 +91,476 @@ xloper_to_multi(LPXLOPER12 p_op, LPXLOPER12 ret_val)
 }
 
 
+/****************************************************************
+** xloper_to_multi()
+**
+** Purpose:
+**
+**      Same as above, and hash the content of the array, so that
+**      functions can tell whether their arguments changed since a
+**      previous call without keeping them, see hash_xloper.
+**
+** Parameters:
+**
+**      LPXLOPER12      3 argument : p_op, ret_val, hash
+**                      hash is updated with the array if the
+**                      coercion succeeds
+**
+** Returns:
+**
+**      int: -1 if ret_val contains an xltypeMulti which must be
+**      released by xlFree, error code otherwise.
+*****************************************************************/
+int
+xloper_to_multi(LPXLOPER12 p_op, LPXLOPER12 ret_val, ULONGLONG * hash)
+{
+    const int error = xloper_to_multi(p_op, ret_val);
+    if (error == -1)
+    {
+        *hash = hash_xloper(*ret_val, *hash);
+    }
+    return error;
+}
+
+
+namespace {
+
+const ULONGLONG fnvPrime = 1099511628211ULL;
+
+ULONGLONG hashBytes(const void * data, size_t size, ULONGLONG hash)
+{
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * fnvPrime;
+    }
+    return hash;
+}
+
+} // empty namespace
+
+
+/****************************************************************
+** hash_xloper()
+**
+** Purpose:
+**
+**      This function hashes a value, or the shape and the cells of
+**      an xltypeMulti, with 64-bit FNV-1a.  Types are hashed with
+**      values, so that 1 and "1" differ; numbers are hashed bit by
+**      bit.  References are not followed, coerce them first.
+**
+** Parameters:
+**
+**      XLOPER12        oper : the value to hash
+**      ULONGLONG       hash : XLOPER_HASH_SEED, or the hash of the
+**                      previous arguments
+**
+** Returns:
+**
+**      ULONGLONG: the hash of the arguments so far
+*****************************************************************/
+ULONGLONG
+hash_xloper(const XLOPER12 & oper, ULONGLONG hash)
+{
+    const DWORD type = oper.xltype & ~(xlbitXLFree | xlbitDLLFree);
+    hash = hashBytes(&type, sizeof(type), hash);
+    switch (type)
+    {
+    case xltypeNum:
+        hash = hashBytes(&oper.val.num, sizeof(oper.val.num), hash);
+        break;
+    case xltypeStr:
+        // Counted string, the first character is the length
+        hash = hashBytes(oper.val.str, (oper.val.str[0] + 1) * sizeof(XCHAR), hash);
+        break;
+    case xltypeBool:
+        hash = hashBytes(&oper.val.xbool, sizeof(oper.val.xbool), hash);
+        break;
+    case xltypeErr:
+        hash = hashBytes(&oper.val.err, sizeof(oper.val.err), hash);
+        break;
+    case xltypeInt:
+        hash = hashBytes(&oper.val.w, sizeof(oper.val.w), hash);
+        break;
+    case xltypeMulti:
+        {
+            const RW rows = oper.val.array.rows;
+            const COL columns = oper.val.array.columns;
+            hash = hashBytes(&rows, sizeof(rows), hash);
+            hash = hashBytes(&columns, sizeof(columns), hash);
+            const XLOPER12 * px = oper.val.array.lparray;
+            for (size_t i = (size_t) rows * columns; i > 0; --i, ++px)
+            {
+                if (px->xltype == xltypeNum)
+                {
+                    // Most cells, hashed without the switch
+                    hash = (hash ^ xltypeNum) * fnvPrime;
+                    hash = hashBytes(&px->val.num, sizeof(px->val.num), hash);
+                }
+                else
+                {
+                    hash = hash_xloper(*px, hash);
+                }
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return hash;
+}
+
+
+/****************************************************************
+** cells_to_doubles()
+**
+** Purpose:
+**
+**      This function copies the numbers of size cells, as found in
+**      an xltypeMulti, into a packed buffer of doubles.  Cells are
+**      expected to be numbers: they are copied by a loop which only
+**      checks their type, until the first cell which is not a
+**      number, from which on the policy is applied cell by cell.
+**      With CELLS_NAN, values holds size values, NaN in place of
+**      the other cells; with CELLS_SKIP, it holds the count numbers
+**      only, in order.
+**
+** Parameters:
+**
+**      6 argument : cells, size, policy, values, count, valid
+**                   values must have room for size doubles;
+**                   count receives the number of cells which are
+**                   numbers; valid, if not NULL, is a bitmap of
+**                   CELL_BITMAP_SIZE(size) DWORD in which the bit
+**                   of each cell tells whether it is a number,
+**                   see CELL_IS_VALID
+**
+** Returns:
+**
+**      int: -1 if success, error code of the first cell which is
+**      not a number with CELLS_ERROR.
+*****************************************************************/
+int
+cells_to_doubles(const XLOPER12 * cells, size_t size, XllCellPolicy policy,
+                 double * values, size_t * count, DWORD * valid)
+{
+    size_t i = 0;
+    for (; i < size && cells[i].xltype == xltypeNum; ++i)
+    {
+        values[i] = cells[i].val.num;
+    }
+    if (valid)
+    {
+        memset(valid, 0xFF, CELL_BITMAP_SIZE(size) * sizeof(DWORD));
+    }
+    *count = i;
+    if (i == size)
+    {
+        return -1;
+    }
+
+    // Some cells are not numbers, from cells[i] on
+    if (policy == CELLS_ERROR)
+    {
+        return cells[i].xltype == xltypeErr ? cells[i].val.err : xlerrValue;
+    }
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    size_t written = i;
+    for (; i < size; ++i)
+    {
+        if (cells[i].xltype == xltypeNum)
+        {
+            values[policy == CELLS_SKIP ? written : i] = cells[i].val.num;
+            ++written;
+            ++*count;
+            continue;
+        }
+        if (valid)
+        {
+            valid[i / 32] &= ~((DWORD) 1 << (i % 32));
+        }
+        if (policy == CELLS_NAN)
+        {
+            values[i] = nan;
+            ++written;
+        }
+    }
+    return -1;
+}
+
+
+namespace {
+
+// Rows of the blocks of a range of the given width, see read_range
+RW blockRows(COL columns)
+{
+    const RW rows = (RW) (RANGE_BLOCK_CELLS / (columns > 0 ? columns : 1));
+    return rows > 0 ? rows : 1;
+}
+
+// State of read_range, shared by the blocks of all areas
+struct RangeReading
+{
+    XllRangeProc proc;
+    void * context;
+    XllCellPolicy policy;
+    ULONGLONG * hash;
+    std::vector<double> buffer;
+    std::vector<DWORD> valid;
+};
+
+// Give the cells of rows [first, first + count) of an array to proc
+int readRows(const XLOPER12 & cells, RW first, RW count, RangeReading & reading)
+{
+    const COL columns = cells.val.array.columns;
+    const size_t size = (size_t) count * columns;
+    if (size == 0)
+    {
+        return -1;
+    }
+    std::vector<double> & buffer = reading.buffer;
+    buffer.resize(size);
+
+    // Rows are skipped as a whole, the cells of a row being the coordinates of a point
+    const bool skip = reading.policy == CELLS_SKIP;
+    DWORD * valid = NULL;
+    if (skip)
+    {
+        reading.valid.resize(CELL_BITMAP_SIZE(size));
+        valid = &reading.valid[0];
+    }
+    size_t numbers = 0;
+    const int error = cells_to_doubles(cells.val.array.lparray + (size_t) first * columns, size,
+                                       skip ? CELLS_NAN : reading.policy, &buffer[0], &numbers, valid);
+    if (error != -1)
+    {
+        return error;
+    }
+    if (skip && numbers < size)
+    {
+        RW kept = 0;
+        for (RW r = 0; r < count; ++r)
+        {
+            const size_t begin = (size_t) r * columns;
+            COL c = 0;
+            while (c < columns && CELL_IS_VALID(valid, begin + c))
+            {
+                ++c;
+            }
+            if (c == columns)
+            {
+                memmove(&buffer[(size_t) kept * columns], &buffer[begin], columns * sizeof(double));
+                ++kept;
+            }
+        }
+        count = kept;
+    }
+    return count > 0 ? reading.proc(reading.context, &buffer[0], count, columns) : -1;
+}
+
+// Coerce an area of a reference block by block, and give them to proc
+int readArea(const XLOPER12 & reference, const XLREF12 & area, RangeReading & reading)
+{
+    const RW rows = blockRows(area.colLast - area.colFirst + 1);
+    XLMREF12 mref;
+    XLOPER12 block;
+    if ((reference.xltype & ~(xlbitXLFree | xlbitDLLFree)) == xltypeRef)
+    {
+        mref.count = 1;
+        block.xltype = xltypeRef;
+        block.val.mref.lpmref = &mref;
+        block.val.mref.idSheet = reference.val.mref.idSheet;
+    }
+    else
+    {
+        block.xltype = xltypeSRef;
+        block.val.sref.count = 1;
+    }
+    XLREF12 & ref = block.xltype == xltypeRef ? mref.reftbl[0] : block.val.sref.ref;
+    ref = area;
+
+    for (RW first = area.rwFirst; first <= area.rwLast; first += rows)
+    {
+        XLOPER12 cells;
+        ref.rwFirst = first;
+        ref.rwLast = area.rwLast - first < rows ? area.rwLast : first + rows - 1;
+        if (xlretSuccess != Excel12f(xlCoerce, &cells, 2, &block, TempInt12(xltypeMulti)))
+        {
+            return xlerrValue;
+        }
+        if (reading.hash)
+        {
+            *reading.hash = hash_xloper(cells, *reading.hash);
+        }
+        const int error = readRows(cells, 0, cells.val.array.rows, reading);
+        Excel12f(xlFree, 0, 1, &cells);
+        if (error != -1)
+        {
+            return error;
+        }
+    }
+    return -1;
+}
+
+} // empty namespace
+
+/****************************************************************
+** get_range_shape()
+**
+** Purpose:
+**
+**      This function computes the shape of the values read_range
+**      gives for an argument, without coercing it.  The areas of a
+**      reference are stacked, they must have the same width.
+**
+** Parameters:
+**
+**      LPXLOPER12      3 argument : xl_range, rows, columns
+**
+** Returns:
+**
+**      int: -1 if success, error code otherwise.
+*****************************************************************/
+int
+get_range_shape(LPXLOPER12 xl_range, RW * rows, COL * columns)
+{
+    *rows = 1;
+    *columns = 1;
+    switch (xl_range->xltype & ~(xlbitXLFree | xlbitDLLFree))
+    {
+    case xltypeNum:
+    case xltypeStr:
+    case xltypeBool:
+        return -1;
+    case xltypeMulti:
+        *rows = xl_range->val.array.rows;
+        *columns = xl_range->val.array.columns;
+        return -1;
+    case xltypeSRef:
+        *rows = xl_range->val.sref.ref.rwLast - xl_range->val.sref.ref.rwFirst + 1;
+        *columns = xl_range->val.sref.ref.colLast - xl_range->val.sref.ref.colFirst + 1;
+        return -1;
+    case xltypeRef:
+        {
+            const XLMREF12 * mref = xl_range->val.mref.lpmref;
+            if (!mref || mref->count == 0)
+            {
+                return xlerrValue;
+            }
+            *rows = 0;
+            *columns = mref->reftbl[0].colLast - mref->reftbl[0].colFirst + 1;
+            for (WORD i = 0; i < mref->count; ++i)
+            {
+                if (mref->reftbl[i].colLast - mref->reftbl[i].colFirst + 1 != *columns)
+                {
+                    return xlerrValue;
+                }
+                *rows += mref->reftbl[i].rwLast - mref->reftbl[i].rwFirst + 1;
+            }
+        }
+        return -1;
+    case xltypeErr:
+        return xl_range->val.err;
+    default:
+        return xlerrValue;
+    }
+}
+
+/****************************************************************
+** read_range()
+**
+** Purpose:
+**
+**      This function reads the numbers of an argument block by
+**      block, so that a large range is never held at once in an
+**      xltypeMulti.  References are coerced by blocks of whole rows,
+**      of at most RANGE_BLOCK_CELLS cells, area after area for
+**      multi-area references.  Each block is given to proc as
+**      contiguous doubles, row by row.  Values are read the same
+**      way from the array Excel passed.
+**
+** Parameters:
+**
+**      LPXLOPER12      5 argument : xl_range, proc, context, policy,
+**                      hash
+**                      proc is called on each block, in order, and
+**                      stops the reading by returning an error;
+**                      policy applies to cells which are not numbers,
+**                      see cells_to_doubles, except that CELLS_SKIP
+**                      leaves out the whole rows of such cells, which
+**                      blocks then lack;
+**                      hash, if not NULL, is updated with the
+**                      coerced blocks, see hash_xloper
+**
+** Returns:
+**
+**      int: -1 if success, error code of the first cell which is
+**      not a number with CELLS_ERROR or error returned by proc
+**      otherwise.
+*****************************************************************/
+int
+read_range(LPXLOPER12 xl_range, XllRangeProc proc, void * context, XllCellPolicy policy,
+           ULONGLONG * hash)
+{
+    RangeReading reading;
+    reading.proc = proc;
+    reading.context = context;
+    reading.policy = policy;
+    reading.hash = hash;
+    const DWORD type = xl_range->xltype & ~(xlbitXLFree | xlbitDLLFree);
+
+    if (type == xltypeSRef)
+    {
+        return readArea(*xl_range, xl_range->val.sref.ref, reading);
+    }
+    if (type == xltypeRef)
+    {
+        const XLMREF12 * mref = xl_range->val.mref.lpmref;
+        if (!mref || mref->count == 0)
+        {
+            return xlerrValue;
+        }
+        for (WORD i = 0; i < mref->count; ++i)
+        {
+            const int error = readArea(*xl_range, mref->reftbl[i], reading);
+            if (error != -1)
+            {
+                return error;
+            }
+        }
+        return -1;
+    }
+
+    // Values, arrays are read where Excel passed them
+    XLOPER12 cells = *xl_range;
+    int error = -1;
+    if (type == xltypeMulti && hash)
+    {
+        *hash = hash_xloper(cells, *hash);
+    }
+    else if (type != xltypeMulti)
+    {
+        error = hash ? xloper_to_multi(xl_range, &cells, hash) : xloper_to_multi(xl_range, &cells);
+        if (error != -1)
+        {
+            return error;
+        }
+    }
+    const RW rows = blockRows(cells.val.array.columns);
+    for (RW first = 0; first < cells.val.array.rows && error == -1; first += rows)
+    {
+        const RW count = cells.val.array.rows - first < rows ? cells.val.array.rows - first : rows;
+        error = readRows(cells, first, count, reading);
+    }
+    if (type != xltypeMulti)
+    {
+        Excel12f(xlFree, 0, 1, &cells);
+    }
+    return error;
+}
+
+
 /*********************************************************************
  xloper_to_num()
 
@@ -113,9 +595,12 @@ xloper_to_num(LPXLOPER12 xl_poper, double* value)
     case xltypeNum:
         *value = xl_poper->val.num;
         break;
-    // excel reference to a cell (current  or not current sheet )
+    // excel reference to a cell (current  or not current sheet ),
+    // or a value which may be converted to a number
     case xltypeRef:
     case xltypeSRef:
+    case xltypeStr:
+    case xltypeBool:
         // Excel12f is a robust wrapper for the Excel12() function
         // It also does the following:
         // (1) Checks that none of the LPXLOPER12 arguments are 0,
@@ -129,7 +614,8 @@ xloper_to_num(LPXLOPER12 xl_poper, double* value)
                            xl_poper, TempInt12(xltypeNum));
         if(xlerror != xlretSuccess)
         {
-            error = xlerror;
+            error = xlerrValue;
+            break;
         }
         *value = xl_oper.val.num;
 
@@ -178,10 +664,14 @@ xloper_to_int(LPXLOPER12 xl_poper, int* value)
     {
     case xltypeNum:
         *value = (int)xl_poper->val.num;
+        break;
     case xltypeInt:
         *value = xl_poper->val.w;
+        break;
     case xltypeRef:
     case xltypeSRef:
+    case xltypeStr:
+    case xltypeBool:
         xlerror = Excel12f( xlCoerce,
                             &xl_oper,
                             2,
@@ -190,7 +680,8 @@ xloper_to_int(LPXLOPER12 xl_poper, int* value)
 
         if(xlerror != xlretSuccess)
         {
-            error = xlerror;
+            error = xlerrValue;
+            break;
         }
         *value = xl_oper.val.w;
 
@@ -208,6 +699,167 @@ xloper_to_int(LPXLOPER12 xl_poper, int* value)
     return error;
 }
 
+/*******************************************************************
+** xloper_to_string()
+**
+** Purpose:
+**
+**      This function takes 2 argument, coerces xloper to string
+**      type and converts it to ASCII, other characters becoming '?'.
+**      It is meant for names, like those of distributions.
+**
+** Parameters:
+**
+**      LPXLOPER12      2 argument : xl_poper, value
+**      std::string     value of xloper.
+**
+** Returns:
+**
+**      -1 if success, error else
+******************************************************************/
+int
+xloper_to_string(LPXLOPER12 xl_poper, std::string* value)
+{
+    XLOPER12 xl_oper;
+    int error = -1;
+    int xlerror;
+    const XCHAR * str = NULL;
+    bool coerced = false;
+
+    switch (xl_poper->xltype)
+    {
+    case xltypeStr:
+        str = xl_poper->val.str;
+        break;
+    case xltypeRef:
+    case xltypeSRef:
+        xlerror = Excel12f( xlCoerce,
+                            &xl_oper,
+                            2,
+                            xl_poper,
+                            TempInt12(xltypeStr));
+
+        if(xlerror != xlretSuccess)
+        {
+            error = xlerrValue;
+            break;
+        }
+        str = xl_oper.val.str;
+        coerced = true;
+        break;
+    case xltypeErr:
+        error = xl_poper->val.err;
+        break;
+    default:
+        error = xlerrValue;
+        break;
+    }
+
+    if (str)
+    {
+        // Counted string, the first character is the length
+        value->resize(str[0]);
+        for (int i = 0; i < str[0]; ++i)
+            (*value)[i] = str[i + 1] < 128 ? (char) str[i + 1] : '?';
+        if (coerced)
+        {
+            // Free the XLOPER12 returned by xlCoerce
+            Excel12f(xlFree, 0, 1, (LPXLOPER12) &xl_oper);
+        }
+    }
+
+    return error;
+}
+
+/*******************************************************************
+** xloper_to_policy()
+**
+** Purpose:
+**
+**      This function reads what a function does with the cells of
+**      its arguments which are not numbers: "error", "nan" or
+**      "skip", in any case, see XllCellPolicy.
+**
+** Parameters:
+**
+**      LPXLOPER12      2 argument : xl_poper, policy
+**                      CELLS_ERROR if xl_poper is missing or blank
+**
+** Returns:
+**
+**      -1 if success, error else
+******************************************************************/
+int
+xloper_to_policy(LPXLOPER12 xl_poper, XllCellPolicy* policy)
+{
+    *policy = CELLS_ERROR;
+    if (xl_poper->xltype == xltypeMissing || xl_poper->xltype == xltypeNil)
+    {
+        return -1;
+    }
+    std::string name;
+    const int error = xloper_to_string(xl_poper, &name);
+    if (error != -1)
+    {
+        return error;
+    }
+    for (size_t i = 0; i < name.size(); ++i)
+    {
+        if (name[i] >= 'A' && name[i] <= 'Z')
+            name[i] = name[i] - 'A' + 'a';
+    }
+    if (name == "error")
+        *policy = CELLS_ERROR;
+    else if (name == "nan")
+        *policy = CELLS_NAN;
+    else if (name == "skip")
+        *policy = CELLS_SKIP;
+    else
+        return xlerrValue;
+    return -1;
+}
+
+namespace {
+
+/*
+ * Get the first area of the caller, and its sheet if it is known.
+ * xlfCaller returns a reference, its size can be read without xlCoerce,
+ * which would need macro sheet permissions and is not allowed in
+ * thread-safe functions.
+ */
+bool getCallerRef(XLREF12 * ref, IDSHEET * sheet = NULL)
+{
+    XLOPER12 Caller;
+    bool found = false;
+
+    if(xlretSuccess != Excel12f(xlfCaller, &Caller, 0))
+    {
+        return false;
+    }
+
+    const DWORD type = Caller.xltype & ~(xlbitXLFree | xlbitDLLFree);
+    if(type == xltypeSRef)
+    {
+        *ref = Caller.val.sref.ref;
+        if (sheet)
+            *sheet = 0;
+        found = true;
+    }
+    else if(type == xltypeRef && Caller.val.mref.lpmref && Caller.val.mref.lpmref->count > 0)
+    {
+        *ref = Caller.val.mref.lpmref->reftbl[0];
+        if (sheet)
+            *sheet = Caller.val.mref.idSheet;
+        found = true;
+    }
+
+    // Free the XLOPER12 returned by xlfCaller
+    Excel12f(xlFree, 0, 1, &Caller);
+    return found;
+}
+
+} // empty namespace
+
 /*********************************************************************
 **  getNumberOfRows()
 **
@@ -221,30 +873,13 @@ xloper_to_int(LPXLOPER12 xl_poper, int* value)
 int
 getNumberOfRows()
 {
-    XLOPER12 Caller;
-    XLOPER12 ret_val;
+    XLREF12 ref;
 
-    if(xlretSuccess != Excel12f(xlfCaller, &Caller, 0))
+    if(!getCallerRef(&ref))
     {
         return 0;
     }
-
-    if(xlretSuccess != Excel12f( xlCoerce,
-            &ret_val,
-            2,
-            &Caller,
-            TempInt12(xltypeMulti)))
-    {
-        return 0;
-    }
-
-    int result = ret_val.val.array.rows;
-
-    // Free the XLOPER12 returned by xlCoerce && xlfCaller
-    Excel12f(xlFree, 0, 1, &Caller);
-    Excel12f(xlFree, 0, 1, &ret_val);
-
-    return result;
+    return ref.rwLast - ref.rwFirst + 1;
 }
 
 
@@ -261,33 +896,68 @@ getNumberOfRows()
 int
 getNumberOfColumns()
 {
-    XLOPER12 Caller;
-    XLOPER12 ret_val;
+    XLREF12 ref;
 
-    if(xlretSuccess != Excel12f(xlfCaller, &Caller, 0))
+    if(!getCallerRef(&ref))
     {
         return 0;
     }
+    return ref.colLast - ref.colFirst + 1;
+}
 
-    if(xlretSuccess != Excel12f( xlCoerce,
-            &ret_val,
-            2,
-            &Caller,
-            TempInt12(xltypeMulti)))
+
+/*********************************************************************
+**  getCallerCell()
+**
+**  Purpose :
+**        identify the cell which calls the function, the first one
+**        of the caller of an array formula.
+**
+**  Parameters:
+**
+**        sheet  : IDSHEET, set to the sheet of the caller
+**        row    : RW, set to its first row
+**        column : COL, set to its first column
+**
+**  Returns :
+**      false if the function is not called from a cell, e.g. from VB
+**********************************************************************/
+bool
+getCallerCell(IDSHEET * sheet, RW * row, COL * column)
+{
+    XLREF12 ref;
+
+    if(!getCallerRef(&ref, sheet))
     {
-        return 0;
+        return false;
     }
+    *row = ref.rwFirst;
+    *column = ref.colFirst;
+    return true;
+}
 
-    int result = ret_val.val.array.columns;
-
-    // Free the XLOPER12 returned by xlCoerce && xlfCaller
-    Excel12f(xlFree, 0, 1, &Caller);
-    Excel12f(xlFree, 0, 1, &ret_val);
 
-    return result;
+/*********************************************************************
+**  displayError()
+**
+**  Purpose :
+**      display a dialog message to report some error message,
+**      unless called from Function Wizard.  Nothing is displayed
+**      when called from a recalculation thread other than the
+**      main thread, the function only returns an error value.
+**
+**  Parameters:
+**
+**        msg : std::string
+**              message
+**********************************************************************/
+void
+displayError(const std::string & msg)
+{
+    if (GetCurrentThreadId() == mainThreadId && !isCalledByFuncWiz())
+        MessageBox(NULL, msg.c_str(), NULL, MB_ICONERROR);
 }
 
-
 /*********************************************************************
 **  dialogError()
 **
@@ -306,17 +976,126 @@ getNumberOfColumns()
 LPXLOPER12
 dialogError(const std::string & msg, int error_code)
 {
-    if (!isCalledByFuncWiz())
-        MessageBox(NULL, msg.c_str(), NULL, MB_ICONERROR);
+    displayError(msg);
 
-    LPXLOPER12 xResult = new XLOPER12();
-    xResult->xltype = xltypeErr | xlbitDLLFree;
-    xResult->val.err = error_code;
+    LPXLOPER12 xResult = new_result();
+    if (xResult)
+    {
+        xResult->xltype = xltypeErr | xlbitDLLFree;
+        xResult->val.err = error_code;
+    }
     return xResult;
 }
 
 namespace {
 
+// Buffer of FP12 results of a thread, see new_fp12
+struct FP12Buffer
+{
+    FP12 * fp;
+    size_t capacity;
+};
+
+// Called by the system when a thread exits
+void WINAPI freeFP12Buffer(void * data)
+{
+    FP12Buffer * buffer = (FP12Buffer *) data;
+    if (buffer)
+    {
+        free(buffer->fp);
+        delete buffer;
+    }
+}
+
+} // empty namespace
+
+/*********************************************************************
+**  new_fp12()
+**
+**  Purpose :
+**      get an FP12 array to return from functions registered with
+**      the "K%" type.  Excel does not call xlAutoFree12 for them, it
+**      copies the values when the function returns; each thread thus
+**      reuses the same buffer for all its calls, which only grows.
+**
+**  Parameters:
+**
+**        rows    : number of rows
+**        columns : number of columns
+**
+**  Returns :
+**        FP12 * with rows and columns set, values are left
+**        uninitialized; NULL if the size is not positive or if
+**        memory cannot be allocated.
+**        It is valid until the next call of new_fp12 by this thread.
+**********************************************************************/
+FP12 *
+new_fp12(int rows, int columns)
+{
+    if (rows <= 0 || columns <= 0)
+        return NULL;
+    if (fpIndex == FLS_OUT_OF_INDEXES)
+        return NULL;
+    FP12Buffer * buffer = (FP12Buffer *) FlsGetValue(fpIndex);
+    if (!buffer)
+    {
+        buffer = new FP12Buffer();
+        buffer->fp = NULL;
+        buffer->capacity = 0;
+        FlsSetValue(fpIndex, buffer);
+    }
+    // FP12 already contains the first value
+    const size_t size = sizeof(FP12) + sizeof(double) * ((size_t) rows * columns - 1);
+    if (size > buffer->capacity)
+    {
+        free(buffer->fp);
+        buffer->fp = (FP12 *) malloc(size);
+        buffer->capacity = buffer->fp ? size : 0;
+        if (!buffer->fp)
+            return NULL;
+    }
+    buffer->fp->rows = rows;
+    buffer->fp->columns = columns;
+    return buffer->fp;
+}
+
+/*********************************************************************
+**  initHelpers()
+**
+**  Purpose :
+**      record the main thread, on which error messages are displayed,
+**      and allocate the storage of FP12 results.  Called by xlAutoOpen.
+**********************************************************************/
+void
+initHelpers()
+{
+    mainThreadId = GetCurrentThreadId();
+    if (fpIndex == FLS_OUT_OF_INDEXES)
+        fpIndex = FlsAlloc(freeFP12Buffer);
+}
+
+/*********************************************************************
+**  releaseHelpers()
+**
+**  Purpose :
+**      release the storage of FP12 results, called by xlAutoClose.
+**      Buffers of other threads are released when they exit, or by
+**      FlsFree.
+**********************************************************************/
+void
+releaseHelpers()
+{
+    if (fpIndex == FLS_OUT_OF_INDEXES)
+        return;
+    freeFP12Buffer(FlsGetValue(fpIndex));
+    FlsSetValue(fpIndex, NULL);
+    FlsFree(fpIndex);
+    fpIndex = FLS_OUT_OF_INDEXES;
+}
+
+#ifdef _WIN32
+namespace {
+
 // Needed by isCalledByFuncWiz.
 typedef struct _EnumStruct {
     bool bFuncWiz;
@@ -357,6 +1136,7 @@ bool CALLBACK EnumProc(HWND hwnd, LPEnumStruct pEnum)
 }
 
 } // empty namespace
+#endif // _WIN32
 
 /*********************************************************************
 **  isCalledByFuncWiz()
@@ -368,14 +1148,20 @@ bool CALLBACK EnumProc(HWND hwnd, LPEnumStruct pEnum)
 **
 **  Returns :
 **      true if called from function Wizard, false otherwise.
+**      Always false outside of Windows, there is no Function Wizard
+**      in the headless host.
 **********************************************************************/
 bool
 isCalledByFuncWiz()
 {
+#ifdef _WIN32
     EnumStruct enm;
 
     enm.bFuncWiz = false;
     EnumThreadWindows(GetCurrentThreadId(), (WNDENUMPROC) EnumProc, (LPARAM) ((LPEnumStruct)  &enm));
     return enm.bFuncWiz;
+#else
+    return false;
+#endif
 }
 
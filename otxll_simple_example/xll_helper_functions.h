@@ -9,21 +9,67 @@
 #include <framewrk.h>
 #include <string>
 
+#define XLOPER_HASH_SEED 14695981039346656037ULL
+#define RANGE_BLOCK_CELLS 65536
+
+/* What the coercion of cells does with blanks, strings, booleans and errors */
+enum XllCellPolicy
+{
+    CELLS_ERROR = 0,    /* fail with the error of the cell, #VALUE! if it is not an error */
+    CELLS_NAN,          /* give NaN in their place */
+    CELLS_SKIP          /* leave them out */
+};
+/* Whether cell i is a number in a bitmap of cells_to_doubles */
+#define CELL_IS_VALID(valid, i) ((((valid)[(i) / 32]) >> ((i) % 32)) & 1)
+/* Size in DWORD of the bitmap of size cells */
+#define CELL_BITMAP_SIZE(size) (((size) + 31) / 32)
+
 /* Coerce an XLOPER12 to a */
 int xloper_to_multi(LPXLOPER12 p_op, LPXLOPER12 ret_val);
+/* Same, and hash the content of the array into hash */
+int xloper_to_multi(LPXLOPER12 p_op, LPXLOPER12 ret_val, ULONGLONG * hash);
+/* Hash a value or an xltypeMulti, starting from XLOPER_HASH_SEED */
+ULONGLONG hash_xloper(const XLOPER12 & oper, ULONGLONG hash);
+/* Copy the numbers of size cells into values, count of them, and mark them in valid if not NULL */
+int cells_to_doubles(const XLOPER12 * cells, size_t size, XllCellPolicy policy,
+                     double * values, size_t * count, DWORD * valid = NULL);
+
+/* Receive a block of a range, rows * columns values row by row; returns -1 or an error which stops the reading */
+typedef int (*XllRangeProc)(void * context, const double * values, RW rows, COL columns);
+/* Shape of the values read_range gives, areas of a reference being stacked */
+int get_range_shape(LPXLOPER12 xl_range, RW * rows, COL * columns);
+/* Give the numbers of a value or reference to proc by blocks of at most RANGE_BLOCK_CELLS cells */
+int read_range(LPXLOPER12 xl_range, XllRangeProc proc, void * context,
+               XllCellPolicy policy = CELLS_ERROR, ULONGLONG * hash = NULL);
 /* Convert an XLOPER12 to a double  */
 int xloper_to_num(LPXLOPER12 xl_poper, double* value);
 /* Convert an XLOPER12 to an int  */
 int xloper_to_int(LPXLOPER12 xl_poper, int* value);
+/* Convert an XLOPER12 to an ASCII string */
+int xloper_to_string(LPXLOPER12 xl_poper, std::string* value);
+/* Convert an XLOPER12 to a cell policy, CELLS_ERROR if it is missing */
+int xloper_to_policy(LPXLOPER12 xl_poper, XllCellPolicy* policy);
 
 /* Get the number of rows of active selection */
 int getNumberOfRows();
 /* Get the number of columns of active selection */
 int getNumberOfColumns();
+/* Get the sheet and first cell of the caller, false if it is not a cell */
+bool getCallerCell(IDSHEET * sheet, RW * row, COL * column);
 
 /* Display an error message */
+void displayError(const std::string & msg);
+/* Display an error message and return an error value */
 LPXLOPER12 dialogError(const std::string & msg, int error_code);
 
+/* Get a buffer for an FP12 result, valid until next call of this thread */
+FP12 * new_fp12(int rows, int columns);
+
+/* Record the main thread and allocate thread local storage, see xlAutoOpen */
+void initHelpers();
+/* Release thread local storage, see xlAutoClose */
+void releaseHelpers();
+
 /* Check whether function is called from Function Wizard */
 bool isCalledByFuncWiz();
 
@@ -0,0 +1,128 @@
+#ifndef __XLL_LRU_CACHE_H
+#define __XLL_LRU_CACHE_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <list>
+#include <map>
+#include <utility>
+
+/*
+ * Bounded cache of values, the least recently used one is evicted when
+ * the cache is full.  All methods may be called concurrently by the
+ * recalculation threads of Excel.
+ *
+ * Key needs operator<, Key and Value are copied in and out of the cache
+ * under its lock, so Value should be cheap to copy (a handle to shared
+ * data, like OpenTURNS interface classes).
+ */
+template <class Key, class Value>
+class XllLruCache
+{
+public:
+    explicit XllLruCache(size_t capacity)
+        : capacity_(capacity > 0 ? capacity : 1)
+        , hits_(0)
+        , misses_(0)
+    {
+        InitializeCriticalSection(&lock_);
+    }
+
+    ~XllLruCache()
+    {
+        DeleteCriticalSection(&lock_);
+    }
+
+    // Copy the value of key into value and return true if it is cached
+    bool get(const Key & key, Value & value)
+    {
+        EnterCriticalSection(&lock_);
+        typename Index::iterator it = index_.find(key);
+        const bool found = it != index_.end();
+        if (found)
+        {
+            // Move the entry to the front of the list
+            entries_.splice(entries_.begin(), entries_, it->second);
+            value = it->second->second;
+            ++hits_;
+        }
+        else
+        {
+            ++misses_;
+        }
+        LeaveCriticalSection(&lock_);
+        return found;
+    }
+
+    // Insert or replace the value of key, evicting the least recently used entry if needed
+    void put(const Key & key, const Value & value)
+    {
+        EnterCriticalSection(&lock_);
+        typename Index::iterator it = index_.find(key);
+        if (it != index_.end())
+        {
+            it->second->second = value;
+            entries_.splice(entries_.begin(), entries_, it->second);
+        }
+        else
+        {
+            if (index_.size() >= capacity_)
+            {
+                index_.erase(entries_.back().first);
+                entries_.pop_back();
+            }
+            entries_.push_front(Entry(key, value));
+            index_.insert(std::make_pair(key, entries_.begin()));
+        }
+        LeaveCriticalSection(&lock_);
+    }
+
+    // Remove all entries and return how many there were, counters are reset
+    size_t clear()
+    {
+        EnterCriticalSection(&lock_);
+        const size_t size = index_.size();
+        index_.clear();
+        entries_.clear();
+        hits_ = 0;
+        misses_ = 0;
+        LeaveCriticalSection(&lock_);
+        return size;
+    }
+
+    // Counters since creation or last clear, and current number of entries
+    void getStats(LONGLONG & hits, LONGLONG & misses, size_t & size)
+    {
+        EnterCriticalSection(&lock_);
+        hits = hits_;
+        misses = misses_;
+        size = index_.size();
+        LeaveCriticalSection(&lock_);
+    }
+
+    size_t getCapacity() const
+    {
+        return capacity_;
+    }
+
+private:
+    typedef std::pair<Key, Value> Entry;
+    typedef std::list<Entry> Entries;
+    typedef std::map<Key, typename Entries::iterator> Index;
+
+    // Not copyable
+    XllLruCache(const XllLruCache &);
+    XllLruCache & operator=(const XllLruCache &);
+
+    CRITICAL_SECTION lock_;
+    const size_t capacity_;
+    // Most recently used entries first
+    Entries entries_;
+    Index index_;
+    LONGLONG hits_;
+    LONGLONG misses_;
+};
+
+#endif // __XLL_LRU_CACHE_H
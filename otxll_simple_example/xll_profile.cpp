@@ -0,0 +1,85 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "xll_profile.h"
+
+#ifdef OTXLL_PROFILE
+
+namespace {
+
+// Accumulated ticks of QueryPerformanceCounter, per stage
+volatile LONGLONG stageTicks[XLL_STAGE_COUNT];
+
+} // empty namespace
+
+XllStopwatch::XllStopwatch()
+{
+    QueryPerformanceCounter(&last_);
+}
+
+void
+XllStopwatch::lap(XllProfileStage stage)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    InterlockedExchangeAdd64(&stageTicks[stage], now.QuadPart - last_.QuadPart);
+    last_ = now;
+}
+
+/*********************************************************************
+**  XllProfileRead()
+**
+**  Purpose :
+**      copy the time spent in each stage since last reset.
+**
+**  Parameters:
+**
+**        seconds : array of at least count values
+**        count   : size of seconds
+**
+**  Returns :
+**        the number of stages, XLL_STAGE_COUNT
+**********************************************************************/
+int WINAPI
+XllProfileRead(double * seconds, int count)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    for (int i = 0; i < count && i < XLL_STAGE_COUNT; ++i)
+    {
+        seconds[i] = (double) stageTicks[i] / (double) frequency.QuadPart;
+    }
+    return XLL_STAGE_COUNT;
+}
+
+/*********************************************************************
+**  XllProfileReset()
+**
+**  Purpose :
+**      set all stage timings to zero.
+**********************************************************************/
+void WINAPI
+XllProfileReset(void)
+{
+    for (int i = 0; i < XLL_STAGE_COUNT; ++i)
+    {
+        InterlockedExchangeAdd64(&stageTicks[i], -stageTicks[i]);
+    }
+}
+
+#endif // OTXLL_PROFILE
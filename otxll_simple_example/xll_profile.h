@@ -0,0 +1,60 @@
+#ifndef __XLL_PROFILE_H
+#define __XLL_PROFILE_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+/*
+ * Per-stage timing of worksheet functions, used by the benchmark of the
+ * headless host (otxll_host/xll_bench.cpp).  Everything compiles to nothing
+ * unless OTXLL_PROFILE is defined.
+ *
+ * A function declares a stopwatch with XLL_PROFILE_START(), then each
+ * XLL_PROFILE_LAP(stage) charges the time elapsed since the previous lap
+ * to the given stage.  Several laps may be charged to the same stage.
+ */
+enum XllProfileStage
+{
+    XLL_STAGE_COERCE = 0,  // argument coercion (xloper_to_num, xloper_to_multi)
+    XLL_STAGE_COPY,        // copies between Excel arrays and intermediate containers
+    XLL_STAGE_SAMPLE,      // building OT::NumericalSample
+    XLL_STAGE_COMPUTE,     // OpenTURNS computations
+    XLL_STAGE_RESULT,      // building the returned XLOPER12
+    XLL_STAGE_COUNT
+};
+
+#ifdef OTXLL_PROFILE
+
+class XllStopwatch
+{
+public:
+    XllStopwatch();
+    void lap(XllProfileStage stage);
+
+private:
+    LARGE_INTEGER last_;
+};
+
+# define XLL_PROFILE_START() XllStopwatch xllStopwatch
+# define XLL_PROFILE_LAP(stage) xllStopwatch.lap(stage)
+
+/*
+ * Accessors for the host, they are not exported to Excel.
+ * XllProfileRead fills at most count seconds, one per stage,
+ * and returns the number of stages.
+ */
+extern "C" {
+int WINAPI XllProfileRead(double * seconds, int count);
+void WINAPI XllProfileReset(void);
+}
+
+#else
+
+# define XLL_PROFILE_START()
+# define XLL_PROFILE_LAP(stage)
+
+#endif // OTXLL_PROFILE
+
+#endif // __XLL_PROFILE_H
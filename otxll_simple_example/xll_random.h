@@ -0,0 +1,72 @@
+#ifndef __XLL_RANDOM_H
+#define __XLL_RANDOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Reproducible random numbers for samples drawn by several threads.
+ *
+ * OT::RandomGenerator is a single Mersenne Twister shared by the whole
+ * process, its values depend on the order of the calls and it cannot be
+ * used by several threads at once.  Samples are instead divided into
+ * blocks of RANDOM_BLOCK values, and block b is drawn from its own
+ * substream: a xoshiro256** generator whose state is derived from the seed
+ * and b by SplitMix64, as recommended by the authors of xoshiro.  A value
+ * thus only depends on the seed and on its index in the sample, not on the
+ * thread which draws it nor on the number of threads.
+ */
+
+#define RANDOM_BLOCK 4096
+
+class XllRandomStream
+{
+public:
+    /* Substream of the given block of a sample */
+    XllRandomStream(uint64_t seed, uint64_t block)
+    {
+        uint64_t x = seed;
+        x = splitMix64(x) ^ (block * 0xD1B54A32D192ED03ULL);
+        for (int i = 0; i < 4; ++i)
+        {
+            s_[i] = splitMix64(x);
+        }
+    }
+
+    uint64_t next()
+    {
+        const uint64_t result = rotl(s_[1] * 5, 7) * 9;
+        const uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    /* Uniform in (0, 1), 0 and 1 excluded so that quantiles are finite */
+    double uniform()
+    {
+        return ((next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    static uint64_t splitMix64(uint64_t & x)
+    {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t s_[4];
+};
+
+#endif // __XLL_RANDOM_H
@@ -0,0 +1,288 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cstdlib>
+
+#include "xll_result_pool.h"
+
+namespace {
+
+// Class 0 holds single XLOPER12, class k > 0 arrays of up to 2^(k-1) cells
+const int CLASS_COUNT = 18;
+// Blocks too large for any class are given back to the heap at once
+const int LARGE_CLASS = -1;
+// Free blocks kept per class, in bytes; at least one block is kept
+const size_t CLASS_BUDGET = 4 * 1024 * 1024;
+
+// Allocated block, followed by the XLOPER12 returned to Excel and its array
+struct ResultBlock
+{
+    ResultBlock * next;     // next free block of the same class
+    int sizeClass;          // class of the block, or LARGE_CLASS
+    bool numeric;           // cells of the array hold no strings
+};
+
+// XLOPER12 which follow a block are aligned like a double
+const size_t BLOCK_PREFIX = (sizeof(ResultBlock) + 15) & ~(size_t) 15;
+
+struct FreeList
+{
+    CRITICAL_SECTION lock;
+    ResultBlock * first;
+    size_t count;
+    size_t maxCount;
+};
+
+size_t cellsOfClass(int sizeClass)
+{
+    return sizeClass == 0 ? 0 : (size_t) 1 << (sizeClass - 1);
+}
+
+size_t blockSize(size_t cells)
+{
+    return BLOCK_PREFIX + sizeof(XLOPER12) * (1 + cells);
+}
+
+int classOfCells(size_t cells)
+{
+    if (cells == 0)
+        return 0;
+    int sizeClass = 1;
+    for (size_t size = 1; size < cells; size <<= 1)
+        ++sizeClass;
+    return sizeClass < CLASS_COUNT ? sizeClass : LARGE_CLASS;
+}
+
+LPXLOPER12 operOfBlock(ResultBlock * block)
+{
+    return (LPXLOPER12) ((char *) block + BLOCK_PREFIX);
+}
+
+ResultBlock * blockOfOper(LPXLOPER12 p)
+{
+    return (ResultBlock *) ((char *) p - BLOCK_PREFIX);
+}
+
+// Free lists of all classes, they live as long as the DLL
+class ResultPool
+{
+public:
+    ResultPool()
+    {
+        for (int k = 0; k < CLASS_COUNT; ++k)
+        {
+            InitializeCriticalSection(&lists_[k].lock);
+            lists_[k].first = NULL;
+            lists_[k].count = 0;
+            lists_[k].maxCount = CLASS_BUDGET / blockSize(cellsOfClass(k));
+            if (lists_[k].maxCount == 0)
+                lists_[k].maxCount = 1;
+        }
+    }
+
+    ~ResultPool()
+    {
+        trim();
+        for (int k = 0; k < CLASS_COUNT; ++k)
+        {
+            DeleteCriticalSection(&lists_[k].lock);
+        }
+    }
+
+    ResultBlock * allocate(size_t cells, bool numeric)
+    {
+        const int sizeClass = classOfCells(cells);
+        ResultBlock * block = NULL;
+
+        if (sizeClass != LARGE_CLASS)
+        {
+            FreeList & list = lists_[sizeClass];
+            EnterCriticalSection(&list.lock);
+            block = list.first;
+            if (block)
+            {
+                list.first = block->next;
+                --list.count;
+            }
+            LeaveCriticalSection(&list.lock);
+        }
+        if (!block)
+        {
+            block = (ResultBlock *) malloc(blockSize(sizeClass == LARGE_CLASS ? cells : cellsOfClass(sizeClass)));
+            if (!block)
+                return NULL;
+            block->sizeClass = sizeClass;
+        }
+        block->next = NULL;
+        block->numeric = numeric;
+        return block;
+    }
+
+    void release(ResultBlock * block)
+    {
+        if (block->sizeClass != LARGE_CLASS)
+        {
+            FreeList & list = lists_[block->sizeClass];
+            EnterCriticalSection(&list.lock);
+            const bool keep = list.count < list.maxCount;
+            if (keep)
+            {
+                block->next = list.first;
+                list.first = block;
+                ++list.count;
+            }
+            LeaveCriticalSection(&list.lock);
+            if (keep)
+                return;
+        }
+        free(block);
+    }
+
+    void trim()
+    {
+        for (int k = 0; k < CLASS_COUNT; ++k)
+        {
+            FreeList & list = lists_[k];
+            EnterCriticalSection(&list.lock);
+            ResultBlock * block = list.first;
+            list.first = NULL;
+            list.count = 0;
+            LeaveCriticalSection(&list.lock);
+            while (block)
+            {
+                ResultBlock * next = block->next;
+                free(block);
+                block = next;
+            }
+        }
+    }
+
+private:
+    FreeList lists_[CLASS_COUNT];
+};
+
+ResultPool resultPool;
+
+} // empty namespace
+
+/*********************************************************************
+**  new_result()
+**
+**  Purpose :
+**      allocate a single XLOPER12 returned to Excel.
+**
+**  Returns :
+**        LPXLOPER12 whose xltype is set by the caller, with
+**        xlbitDLLFree so that Excel calls xlAutoFree12;
+**        NULL if memory cannot be allocated.
+**********************************************************************/
+LPXLOPER12
+new_result()
+{
+    ResultBlock * block = resultPool.allocate(0, true);
+    return block ? operOfBlock(block) : NULL;
+}
+
+/*********************************************************************
+**  new_result_multi()
+**
+**  Purpose :
+**      allocate an XLOPER12 of xltypeMulti type returned to Excel,
+**      together with its array.
+**
+**  Parameters:
+**
+**        rows    : number of rows
+**        columns : number of columns
+**        numeric : true if no cell will hold a string, xlAutoFree12
+**                  then does not scan the array
+**
+**  Returns :
+**        LPXLOPER12 of type xltypeMulti | xlbitDLLFree, values are
+**        left uninitialized; NULL if memory cannot be allocated.
+**********************************************************************/
+LPXLOPER12
+new_result_multi(RW rows, COL columns, bool numeric)
+{
+    const size_t cells = (size_t) rows * columns;
+    ResultBlock * block = resultPool.allocate(cells, numeric);
+    if (!block)
+    {
+        return NULL;
+    }
+
+    LPXLOPER12 xResult = operOfBlock(block);
+    xResult->xltype = xltypeMulti | xlbitDLLFree;
+    xResult->val.array.rows = rows;
+    xResult->val.array.columns = columns;
+    // The array follows the header in the same block
+    xResult->val.array.lparray = xResult + 1;
+    return xResult;
+}
+
+/*********************************************************************
+**  free_result()
+**
+**  Purpose :
+**      release an XLOPER12 allocated by new_result or new_result_multi,
+**      with the strings or references it owns.
+**
+**  Parameters:
+**
+**        p : LPXLOPER12 passed to xlAutoFree12
+**********************************************************************/
+void
+free_result(LPXLOPER12 p)
+{
+    ResultBlock * block = blockOfOper(p);
+
+    if (p->xltype == (xltypeMulti | xlbitDLLFree))
+    {
+        if (!block->numeric)
+        {
+            int size = p->val.array.rows * p->val.array.columns;
+            LPXLOPER12 parray = p->val.array.lparray;
+
+            for(; size-- > 0; parray++) // check elements for strings
+                if(parray->xltype == xltypeStr)
+                    delete [] parray->val.str;
+        }
+    }
+    else if(p->xltype  == ( xltypeStr | xlbitDLLFree))
+    {
+        delete [] p->val.str;
+    }
+    else if(p->xltype == ( xltypeRef | xlbitDLLFree))
+    {
+        delete [] p->val.mref.lpmref;
+    }
+    resultPool.release(block);
+}
+
+/*********************************************************************
+**  trim_result_pool()
+**
+**  Purpose :
+**      give the free blocks back to the heap.  Blocks still used by
+**      Excel are released normally by xlAutoFree12 later on.
+**********************************************************************/
+void
+trim_result_pool()
+{
+    resultPool.trim();
+}
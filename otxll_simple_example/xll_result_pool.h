@@ -0,0 +1,38 @@
+#ifndef __XLL_RESULT_POOL_H
+#define __XLL_RESULT_POOL_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <xlcall.h>
+
+/*
+ * Allocation of the XLOPER12 returned to Excel with xlbitDLLFree, which
+ * are released by xlAutoFree12.
+ *
+ * The header of an xltypeMulti and its array are allocated in a single
+ * block.  Released blocks are kept in free lists, one per size class (the
+ * number of cells rounded up to a power of two), and are reused by later
+ * calls: recalculating many array formulas of similar sizes then no longer
+ * goes through the heap.  Blocks of more than RESULT_POOL_MAX_CELLS cells
+ * are not kept.
+ *
+ * Cells of an array may hold strings allocated with new XCHAR[], they are
+ * deleted by free_result unless the array was allocated with numeric set,
+ * in which case the cells are not even looked at.
+ */
+
+#define RESULT_POOL_MAX_CELLS 65536
+
+/* Allocate a single XLOPER12; the caller sets xltype, with xlbitDLLFree */
+LPXLOPER12 new_result();
+/* Allocate an xltypeMulti | xlbitDLLFree with its array, values are left
+   uninitialized; numeric is true if no cell will be a string */
+LPXLOPER12 new_result_multi(RW rows, COL columns, bool numeric);
+/* Release an XLOPER12 allocated by new_result or new_result_multi, see xlAutoFree12 */
+void free_result(LPXLOPER12 p);
+/* Give the blocks kept in the free lists back to the heap, see xlAutoClose */
+void trim_result_pool();
+
+#endif // __XLL_RESULT_POOL_H
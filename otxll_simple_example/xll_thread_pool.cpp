@@ -0,0 +1,379 @@
+//                                               -*- C++ -*-
+/**
+ *  Copyright 2005-2015 Airbus-IMACS
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cstdlib>
+#include <list>
+#include <vector>
+
+#include "xll_thread_pool.h"
+
+namespace {
+
+// Threads working on a job, the calling thread included
+const int MAX_PARTS = 64;
+
+// A call of parallel_for, which lives on the stack of the calling thread
+struct ParallelJob
+{
+    XllParallelProc proc;
+    void * context;
+    size_t n;
+    // Indices per chunk
+    size_t chunk;
+    int parts;
+    // Chunks left in each part: index of the first one in the low 32 bits,
+    // index after the last one in the high 32 bits
+    volatile LONGLONG ranges[MAX_PARTS];
+    // Number of threads which joined the job, gives them their part
+    volatile LONG joined;
+    // Threads still working on the job, protected by the lock of the pool
+    int active;
+};
+
+LONGLONG packRange(LONG front, LONG back)
+{
+    return ((LONGLONG) back << 32) | (DWORD) front;
+}
+
+// Take the first chunk of a part, for the thread which owns it
+bool takeFront(volatile LONGLONG & range, LONG & chunk)
+{
+    // Atomic read of the part, 0 is an empty part
+    LONGLONG old = InterlockedCompareExchange64(&range, 0, 0);
+    for (;;)
+    {
+        const LONG front = (LONG) (old & 0xffffffff);
+        const LONG back = (LONG) (old >> 32);
+        if (front >= back)
+            return false;
+        const LONGLONG seen = InterlockedCompareExchange64(&range, packRange(front + 1, back), old);
+        if (seen == old)
+        {
+            chunk = front;
+            return true;
+        }
+        old = seen;
+    }
+}
+
+// Take the last chunk of a part, for other threads
+bool takeBack(volatile LONGLONG & range, LONG & chunk)
+{
+    // Atomic read of the part, 0 is an empty part
+    LONGLONG old = InterlockedCompareExchange64(&range, 0, 0);
+    for (;;)
+    {
+        const LONG front = (LONG) (old & 0xffffffff);
+        const LONG back = (LONG) (old >> 32);
+        if (front >= back)
+            return false;
+        const LONGLONG seen = InterlockedCompareExchange64(&range, packRange(front, back - 1), old);
+        if (seen == old)
+        {
+            chunk = back - 1;
+            return true;
+        }
+        old = seen;
+    }
+}
+
+void processChunk(ParallelJob & job, LONG chunk)
+{
+    const size_t begin = (size_t) chunk * job.chunk;
+    const size_t end = begin + job.chunk < job.n ? begin + job.chunk : job.n;
+    job.proc(job.context, begin, end);
+}
+
+// Process chunks of the job until none is left
+void runJob(ParallelJob & job)
+{
+    const int own = (InterlockedIncrement(&job.joined) - 1) % job.parts;
+    LONG chunk;
+
+    while (takeFront(job.ranges[own], chunk))
+    {
+        processChunk(job, chunk);
+    }
+    for (int i = 1; i < job.parts; ++i)
+    {
+        volatile LONGLONG & victim = job.ranges[(own + i) % job.parts];
+        while (takeBack(victim, chunk))
+        {
+            processChunk(job, chunk);
+        }
+    }
+}
+
+// Value of an environment variable which is a non-negative integer, -1 otherwise
+int getEnvironmentInteger(LPCSTR name)
+{
+    char buffer[32];
+    const DWORD length = GetEnvironmentVariableA(name, buffer, sizeof(buffer));
+    if (length == 0 || length >= sizeof(buffer))
+        return -1;
+    char * end;
+    const long value = strtol(buffer, &end, 10);
+    return *end == 0 && value >= 0 && value <= 0x7fffffff ? (int) value : -1;
+}
+
+class ThreadPool
+{
+public:
+    ThreadPool()
+        : stopping_(false)
+        , threshold_(PARALLEL_THRESHOLD)
+    {
+        InitializeCriticalSection(&lock_);
+        InitializeConditionVariable(&work_);
+        InitializeConditionVariable(&done_);
+    }
+
+    ~ThreadPool()
+    {
+        stop();
+        DeleteCriticalSection(&lock_);
+    }
+
+    void start(int threads, size_t threshold)
+    {
+        threshold_ = threshold;
+        for (int i = 0; i < threads; ++i)
+        {
+            HANDLE thread = CreateThread(NULL, 0, &ThreadPool::threadMain, this, 0, NULL);
+            if (!thread)
+                break;
+            threads_.push_back(thread);
+        }
+    }
+
+    void stop()
+    {
+        EnterCriticalSection(&lock_);
+        stopping_ = true;
+        WakeAllConditionVariable(&work_);
+        LeaveCriticalSection(&lock_);
+        for (size_t i = 0; i < threads_.size(); ++i)
+        {
+            WaitForSingleObject(threads_[i], INFINITE);
+            CloseHandle(threads_[i]);
+        }
+        threads_.clear();
+        stopping_ = false;
+    }
+
+    int size() const
+    {
+        return (int) threads_.size();
+    }
+
+    size_t threshold() const
+    {
+        return threshold_;
+    }
+
+    void run(size_t n, size_t chunk, size_t threshold, XllParallelProc proc, void * context)
+    {
+        if (n < threshold || threads_.empty())
+        {
+            proc(context, 0, n);
+            return;
+        }
+
+        ParallelJob job;
+        const size_t chunks = (n + chunk - 1) / chunk;
+        size_t parts = threads_.size() + 1;
+        parts = parts < chunks ? parts : chunks;
+        parts = parts < (size_t) MAX_PARTS ? parts : MAX_PARTS;
+        job.proc = proc;
+        job.context = context;
+        job.n = n;
+        job.chunk = chunk;
+        job.parts = (int) parts;
+        for (size_t i = 0; i < parts; ++i)
+        {
+            job.ranges[i] = packRange((LONG) (i * chunks / parts), (LONG) ((i + 1) * chunks / parts));
+        }
+        job.joined = 0;
+        job.active = 1;
+
+        EnterCriticalSection(&lock_);
+        jobs_.push_back(&job);
+        WakeAllConditionVariable(&work_);
+        LeaveCriticalSection(&lock_);
+
+        runJob(job);
+
+        // Wait for the chunks which other threads are still processing
+        EnterCriticalSection(&lock_);
+        leave(job);
+        while (job.active > 0)
+        {
+            SleepConditionVariableCS(&done_, &lock_, INFINITE);
+        }
+        LeaveCriticalSection(&lock_);
+    }
+
+private:
+    // Called with the lock held by a thread which found no chunk left
+    void leave(ParallelJob & job)
+    {
+        jobs_.remove(&job);
+        if (--job.active == 0)
+        {
+            WakeAllConditionVariable(&done_);
+        }
+    }
+
+    static DWORD WINAPI threadMain(void * data)
+    {
+        ThreadPool * pool = (ThreadPool *) data;
+
+        EnterCriticalSection(&pool->lock_);
+        for (;;)
+        {
+            while (!pool->stopping_ && pool->jobs_.empty())
+            {
+                SleepConditionVariableCS(&pool->work_, &pool->lock_, INFINITE);
+            }
+            if (pool->stopping_)
+                break;
+            ParallelJob * job = pool->jobs_.front();
+            ++job->active;
+            LeaveCriticalSection(&pool->lock_);
+
+            runJob(*job);
+
+            EnterCriticalSection(&pool->lock_);
+            pool->leave(*job);
+        }
+        LeaveCriticalSection(&pool->lock_);
+        return 0;
+    }
+
+    // Not copyable
+    ThreadPool(const ThreadPool &);
+    ThreadPool & operator=(const ThreadPool &);
+
+    CRITICAL_SECTION lock_;
+    // Signaled when a job is added, or when threads must stop
+    CONDITION_VARIABLE work_;
+    // Signaled when the last thread leaves a job
+    CONDITION_VARIABLE done_;
+    // Jobs which may have chunks left
+    std::list<ParallelJob *> jobs_;
+    std::vector<HANDLE> threads_;
+    bool stopping_;
+    size_t threshold_;
+};
+
+ThreadPool threadPool;
+
+} // empty namespace
+
+/*********************************************************************
+**  parallel_for()
+**
+**  Purpose :
+**      call proc on chunks which cover [0, n), with the threads of
+**      the pool if n is at least the threshold.  Returns when all
+**      chunks are processed.
+**
+**  Parameters:
+**
+**        n       : number of indices
+**        proc    : XllParallelProc, which must not throw
+**        context : passed to proc
+**********************************************************************/
+void
+parallel_for(size_t n, XllParallelProc proc, void * context)
+{
+    if (n > 0)
+    {
+        threadPool.run(n, PARALLEL_CHUNK, threadPool.threshold(), proc, context);
+    }
+}
+
+/*********************************************************************
+**  parallel_tasks()
+**
+**  Purpose :
+**      call proc on each index of [0, n) on its own, with the threads
+**      of the pool if there are several indices, for a few tasks
+**      which each take long, whatever the threshold.  Returns when
+**      all tasks are done.
+**
+**  Parameters:
+**
+**        n       : number of tasks
+**        proc    : XllParallelProc, called with end = begin + 1,
+**                  which must not throw
+**        context : passed to proc
+**********************************************************************/
+void
+parallel_tasks(size_t n, XllParallelProc proc, void * context)
+{
+    if (n > 0)
+    {
+        threadPool.run(n, 1, 2, proc, context);
+    }
+}
+
+/*********************************************************************
+**  initThreadPool()
+**
+**  Purpose :
+**      start the threads of the pool, see OTXLL_THREADS and
+**      OTXLL_PARALLEL_THRESHOLD in xll_thread_pool.h.
+**********************************************************************/
+void
+initThreadPool()
+{
+    int threads = getEnvironmentInteger("OTXLL_THREADS");
+    if (threads < 0)
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        threads = (int) info.dwNumberOfProcessors - 1;
+    }
+    if (threads > MAX_PARTS - 1)
+    {
+        threads = MAX_PARTS - 1;
+    }
+    const int threshold = getEnvironmentInteger("OTXLL_PARALLEL_THRESHOLD");
+
+    threadPool.stop();
+    threadPool.start(threads, threshold >= 0 ? (size_t) threshold : PARALLEL_THRESHOLD);
+}
+
+/*********************************************************************
+**  releaseThreadPool()
+**
+**  Purpose :
+**      stop the threads of the pool, parallel_for then runs serially.
+**********************************************************************/
+void
+releaseThreadPool()
+{
+    threadPool.stop();
+}
+
+int
+getThreadPoolSize()
+{
+    return threadPool.size();
+}
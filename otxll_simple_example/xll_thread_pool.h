@@ -0,0 +1,55 @@
+#ifndef __XLL_THREAD_POOL_H
+#define __XLL_THREAD_POOL_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <stddef.h>
+
+/*
+ * Threads of the add-in, used to split the evaluation of large ranges.
+ *
+ * parallel_for(n, proc, context) calls proc on chunks of PARALLEL_CHUNK
+ * indices which cover [0, n) exactly once.  The chunks are divided into one
+ * contiguous part per thread; a thread takes chunks from the front of its
+ * own part and, once it is done, steals chunks from the back of the other
+ * parts.  The calling thread takes part in the work, so that calls made
+ * concurrently by the recalculation threads of Excel all progress even
+ * when all threads of the pool are busy.
+ *
+ * Each index is processed by a single call of proc, results are thus the
+ * same as with a serial loop as long as proc computes each index on its
+ * own, like the kernels of ot_normal_kernel.h.
+ *
+ * parallel_tasks(n, proc, context) does the same with chunks of a single
+ * index, and whatever the threshold, for a few independent tasks which
+ * each take long, like the fits of OT_FIT_BEST.
+ *
+ * The pool is started by xlAutoOpen and stopped by xlAutoClose.  Its size
+ * and the number of indices below which parallel_for does not use it are
+ * read from the OTXLL_THREADS and OTXLL_PARALLEL_THRESHOLD environment
+ * variables; by default, there is one thread less than processors (the
+ * calling thread is the last one) and the threshold is 65536 indices.
+ * OTXLL_THREADS=0 disables the pool.
+ */
+
+#define PARALLEL_CHUNK 4096
+#define PARALLEL_THRESHOLD 65536
+
+/* Process indices [begin, end) */
+typedef void (*XllParallelProc)(void * context, size_t begin, size_t end);
+
+/* Call proc over [0, n), in parallel if n is above the threshold */
+void parallel_for(size_t n, XllParallelProc proc, void * context);
+/* Call proc on each index of [0, n) as a task of its own, in parallel if n > 1 */
+void parallel_tasks(size_t n, XllParallelProc proc, void * context);
+
+/* Start the threads, see xlAutoOpen */
+void initThreadPool();
+/* Stop the threads, see xlAutoClose */
+void releaseThreadPool();
+/* Number of threads of the pool, 0 if it is not started */
+int getThreadPoolSize();
+
+#endif // __XLL_THREAD_POOL_H